@@ -10,6 +10,15 @@ extern String coreiot_client_id;
 extern String coreiot_username;
 extern String coreiot_password;
 
+// ✅ Giao thức MQTT: 4 = 3.1.1 (mặc định), 5 = MQTT 5 (topic alias, message expiry)
+extern int      coreiot_mqtt_version;
+extern uint32_t coreiot_message_expiry;   // giây, 0 = không hết hạn (chỉ MQTT 5)
+// ✅ Persistent session (cleanSession = false): broker giữ subscription và lệnh
+// QoS 1 trong lúc mất kết nối, Client ID phải cố định
+extern bool     coreiot_persistent_session;
+// ✅ MQTT qua TLS (mặc định bật khi port = 8883), session TLS được cache để nối lại nhanh
+extern bool     coreiot_tls;
+
 bool loadCoreIOTConfig();
 bool saveCoreIOTConfig();
 
@@ -3,17 +3,34 @@
 
 #include <Arduino.h>
 #include <PubSubClient.h>
+#include <ArduinoJson.h>
 
-// ✅ Các hàm cơ bản
+// ✅ Các hàm cơ bản (coreiot_init/coreiot_loop chỉ chạy trong task MQTT)
+void coreiot_init();
 void coreiot_loop();
-bool mqttReconnect();
-void publishData(String json);
+void publishData(const String &json);
+
+// ✅ Gọi được từ mọi task: chỉ xếp message vào mqtt_queue, task MQTT sẽ gửi.
+// key != 0: message cùng key có thể được gộp (chỉ gửi bản mới nhất) khi policy = coalesce
+bool publishJson(const JsonDocument &doc, uint8_t key = 0);
+bool publishPayload(const uint8_t *payload, size_t length);
+
+// Payload tối đa một lần publish lên topic telemetry (theo buffer PubSubClient)
+size_t publishMaxPayload();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
 
 // ✅ Hàm kiểm tra trạng thái
 bool isMQTTConnected();
 
-// ✅ THÊM: Hàm reconnect cho main loop (wrapper)
+// ✅ Yêu cầu reconnect từ main loop: chỉ đặt cờ, task MQTT tự kết nối
 void CORE_IOT_reconnect();
 
+// Trạng thái máy kết nối: backoff/resolve/tcp/connack/subscribe/connected
+const char *coreiot_state_str();
+uint32_t coreiot_connect_attempts();
+
+// Persistent session: broker có giữ session cũ không, số lệnh gửi lại bị bỏ qua
+bool coreiot_session_present();
+uint32_t coreiot_duplicate_commands();
+
 #endif
\ No newline at end of file
@@ -5,9 +5,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "sensor_snapshot.h"
 
-extern float glob_temperature;
-extern float glob_humidity;
 extern bool ap_started;
 
 extern String WIFI_SSID;
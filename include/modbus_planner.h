@@ -0,0 +1,48 @@
+#ifndef __MODBUS_PLANNER_H__
+#define __MODBUS_PLANNER_H__
+
+#include <Arduino.h>
+#include "modbus_rtu.h"
+
+#define MODBUS_PLAN_MAX_POINTS  16
+#define MODBUS_PLAN_MAX_BLOCKS  8
+#define MODBUS_PLAN_DEFAULT_GAP 8       // số register thừa tối đa được đọc kèm để gộp 2 vùng
+
+// Một điểm dữ liệu logic = 1 register trên 1 slave
+struct ModbusPoint {
+    uint8_t  slave;
+    uint8_t  function;      // MODBUS_FC_READ_HOLDING / MODBUS_FC_READ_INPUT
+    uint16_t address;
+
+    // Kết quả sau mỗi lần đọc
+    uint16_t raw;
+    bool     ok;
+};
+
+// Một request FC03/FC04 thực sự được gửi lên bus
+struct ModbusReadBlock {
+    uint8_t  slave;
+    uint8_t  function;
+    uint16_t address;
+    uint16_t count;
+};
+
+struct ModbusReadPlan {
+    ModbusPoint    *points;
+    uint8_t         pointCount;
+    uint8_t         blockOf[MODBUS_PLAN_MAX_POINTS];   // block chứa từng point
+    ModbusReadBlock blocks[MODBUS_PLAN_MAX_BLOCKS];
+    uint8_t         blockCount;
+};
+
+// Gộp các point cùng slave/function có khoảng cách <= maxGap register,
+// mỗi block không vượt quá maxRegisters (<= MODBUS_MAX_REGISTERS).
+// Trả về false nếu không đủ chỗ cho số block/point.
+bool modbus_plan_build(ModbusReadPlan &plan, ModbusPoint *points, uint8_t count,
+                       uint16_t maxGap = MODBUS_PLAN_DEFAULT_GAP,
+                       uint16_t maxRegisters = MODBUS_MAX_REGISTERS);
+
+// Đọc tất cả block rồi phân phối giá trị về points. Trả về số point đọc được.
+uint8_t modbus_plan_execute(ModbusReadPlan &plan);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __MODBUS_RTU_H__
+#define __MODBUS_RTU_H__
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include "global.h"
+
+#define MODBUS_MAX_ADU          256     // slave + PDU + CRC
+#define MODBUS_MAX_PDU          253
+#define MODBUS_MAX_REGISTERS    125     // giới hạn FC03/FC04 mỗi request
+#define MODBUS_MAX_COILS        1968    // giới hạn FC15 mỗi request
+#define MODBUS_QUEUE_LENGTH     8
+#define MODBUS_DEFAULT_TIMEOUT  200     // ms chờ byte đầu tiên của response
+#define MODBUS_DEFAULT_RETRIES  2
+
+// Function code
+#define MODBUS_FC_READ_COILS            0x01
+#define MODBUS_FC_READ_DISCRETE_INPUTS  0x02
+#define MODBUS_FC_READ_HOLDING          0x03
+#define MODBUS_FC_READ_INPUT            0x04
+#define MODBUS_FC_WRITE_COIL            0x05
+#define MODBUS_FC_WRITE_REGISTER        0x06
+#define MODBUS_FC_WRITE_COILS           0x0F
+#define MODBUS_FC_WRITE_REGISTERS       0x10
+
+enum ModbusResult {
+    MODBUS_OK = 0,
+    MODBUS_ERR_TIMEOUT,      // slave không trả lời
+    MODBUS_ERR_CRC,          // sai CRC
+    MODBUS_ERR_FRAME,        // sai slave/function/độ dài
+    MODBUS_ERR_EXCEPTION,    // slave trả exception, xem ModbusRequest::exception
+    MODBUS_ERR_QUEUE,        // master chưa init hoặc hàng đợi đầy
+};
+
+// Một transaction trên bus. Caller giữ struct này tới khi modbus_transact() trả về.
+struct ModbusRequest {
+    uint8_t  slave;
+    uint8_t  function;
+    uint16_t address;
+    uint16_t count;                 // số register/coil (FC05/FC06: giá trị ghi)
+    const uint8_t *data;            // dữ liệu cho FC15/FC16 (đã đóng gói theo spec)
+    uint8_t  dataLength;
+    uint16_t timeoutMs;
+    uint8_t  retries;
+
+    // Kết quả
+    uint8_t  result;                // ModbusResult
+    uint8_t  exception;             // exception code khi result == MODBUS_ERR_EXCEPTION
+    uint8_t  attempts;
+    uint8_t  response[MODBUS_MAX_ADU];
+    uint16_t responseLength;
+
+    // Nội bộ: bus task báo hoàn tất qua semaphore riêng của request, không qua
+    // task notification của caller (slot đó còn được task khác dùng)
+    StaticSemaphore_t doneBuffer;
+    SemaphoreHandle_t done;
+};
+
+void modbus_init(HardwareSerial &serial, uint32_t baud);
+
+// CRC16 Modbus (đa thức 0xA001), dùng bảng tính lúc init
+uint16_t modbus_crc16(const uint8_t *data, size_t length);
+
+// Thời gian im lặng t3.5 giữa 2 frame (micro giây)
+uint32_t modbus_t35_us();
+
+// Gửi request vào hàng đợi và chờ bus task xử lý xong (block caller, không block bus)
+uint8_t modbus_transact(ModbusRequest &req);
+
+// Các helper cho function code thường dùng
+void    modbus_prepare(ModbusRequest &req, uint8_t slave, uint8_t function, uint16_t address, uint16_t count);
+uint8_t modbus_read_registers(uint8_t slave, uint8_t function, uint16_t address, uint16_t count, uint16_t *out);
+uint8_t modbus_write_coil(uint8_t slave, uint16_t address, bool on);
+uint8_t modbus_write_coils(uint8_t slave, uint16_t address, uint16_t count, const uint8_t *bits);
+uint8_t modbus_write_register(uint8_t slave, uint16_t address, uint16_t value);
+
+const char *modbus_result_str(uint8_t result);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __MODBUS_SCHEDULER_H__
+#define __MODBUS_SCHEDULER_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "modbus_planner.h"
+
+#define MODBUS_MAX_JOBS     8
+#define MODBUS_MAX_DEVICES  8
+
+// Job đọc định kỳ, chạy trong bus task của modbus_rtu.
+// Lệnh ghi gửi qua modbus_transact() (relay...) luôn được ưu tiên hơn các job.
+struct ModbusPollJob {
+    const char     *name;
+    ModbusReadPlan *plan;
+    uint32_t        periodMs;
+    uint8_t         priority;       // lớn hơn = ưu tiên hơn
+    uint32_t        deadlineMs;     // trễ tối đa cho phép so với lịch
+    TaskHandle_t    consumer;       // được notify sau mỗi lần đọc xong (có thể NULL)
+
+    // Runtime
+    uint32_t nextDue;
+    uint32_t runs;
+    uint32_t misses;
+    uint32_t maxLateMs;
+};
+
+struct ModbusDeviceStats {
+    uint8_t  slave;
+    uint32_t transactions;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t exceptions;
+    uint64_t latencySumUs;
+    uint32_t latencyMaxUs;
+};
+
+// Đăng ký job; struct phải tồn tại suốt chương trình
+bool modbus_scheduler_add(ModbusPollJob &job);
+
+// Dùng bởi bus task: số ms tới job kế tiếp, và chạy 1 job tới hạn
+uint32_t modbus_scheduler_idle_ms();
+void modbus_scheduler_run_due();
+
+// Ghi nhận 1 transaction (gọi từ bus task)
+void modbus_stats_record(uint8_t slave, uint8_t result, uint32_t durationUs);
+
+// Bus utilization, thống kê từng job và từng slave
+void modbus_scheduler_save_stats(JsonObject obj);
+
+#endif
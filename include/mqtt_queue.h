@@ -0,0 +1,72 @@
+#ifndef __MQTT_QUEUE_H__
+#define __MQTT_QUEUE_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+
+// Hàng đợi publish giữa các task sản xuất (sensor, batch) và task MQTT.
+// Chỉ task MQTT được chạm vào PubSubClient; producer chỉ đẩy message
+// đã serialize sẵn vào đây, không bao giờ block.
+#define MQTT_QUEUE_DEPTH     8       // số message, phải là lũy thừa của 2
+#define MQTT_QUEUE_MSG_SIZE  512     // payload tối đa mỗi message (= slot in-flight QoS 1)
+#define MQTT_QUEUE_KEYS      16      // key coalesce 1..15, 0 = không coalesce
+
+enum MqttQueuePolicy {
+    MQTT_QUEUE_DROP_OLDEST,    // đầy: bỏ message cũ nhất để nhận message mới
+    MQTT_QUEUE_DROP_NEWEST,    // đầy: từ chối message mới
+    MQTT_QUEUE_COALESCE,       // message cùng key chỉ gửi bản mới nhất; đầy thì bỏ cũ nhất
+};
+
+struct MqttQueueCell {
+    std::atomic<uint32_t> sequence;
+    uint32_t ticket;           // vị trí enqueue, dùng để nhận ra bản mới nhất của key
+    uint32_t enqueuedMs;
+    uint16_t length;           // 0 = message bị hủy, bỏ qua khi lấy ra
+    uint8_t  key;
+    uint8_t  format;           // PayloadFormat, quyết định topic khi gửi
+    uint8_t  payload[MQTT_QUEUE_MSG_SIZE];
+};
+
+struct MqttQueueStats {
+    uint32_t enqueued;
+    uint32_t delivered;        // đã lấy ra cho task MQTT
+    uint32_t droppedOldest;
+    uint32_t droppedNewest;
+    uint32_t coalesced;        // bị thay bằng message mới hơn cùng key
+    uint16_t depth;
+    uint16_t highWater;
+    uint32_t latencyMaxMs;     // thời gian từ enqueue tới khi task MQTT lấy ra
+    uint32_t latencyAvgMs;
+};
+
+extern MqttQueuePolicy mqtt_queue_policy;
+
+void mqtt_queue_init();
+
+// Task sẽ được xTaskNotifyGive mỗi khi có message mới (task MQTT)
+void mqtt_queue_set_consumer(TaskHandle_t task);
+
+// ---- Producer (nhiều task) ----
+// Giữ 1 ô để serialize trực tiếp vào, NULL nếu đầy theo policy.
+// Sau khi ghi payload phải gọi mqtt_queue_commit (length = 0 để hủy).
+MqttQueueCell *mqtt_queue_reserve(uint8_t key);
+void mqtt_queue_commit(MqttQueueCell *cell, size_t length);
+
+// Copy payload vào hàng đợi; false nếu bị từ chối hoặc quá lớn
+bool mqtt_queue_push(const uint8_t *payload, size_t length, uint8_t key);
+
+// ---- Consumer (chỉ task MQTT) ----
+// Lấy message cũ nhất còn hiệu lực, NULL nếu rỗng.
+// Ô vẫn thuộc về consumer cho tới khi mqtt_queue_release.
+MqttQueueCell *mqtt_queue_claim();
+void mqtt_queue_release(MqttQueueCell *cell);
+
+MqttQueueStats mqtt_queue_stats();
+void mqtt_queue_save_stats(JsonObject obj);
+
+// Đọc/ghi cấu hình dạng {"policy":"drop_oldest"|"drop_newest"|"coalesce"}
+void mqtt_queue_load(JsonObjectConst obj);
+void mqtt_queue_save(JsonObject obj);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __MQTT_ROUTER_H__
+#define __MQTT_ROUTER_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Router lệnh MQTT chiều về: khớp topic (hỗ trợ + và #) trên trie đã biên dịch,
+// decode payload (JSON/MessagePack/CBOR theo payload_codec) ngay trong buffer
+// của PubSubClient rồi gọi handler.
+#define MQTT_ROUTER_MAX_ROUTES   64
+#define MQTT_ROUTER_MAX_NODES    128
+#define MQTT_ROUTER_MAX_MATCHES  4       // số handler tối đa cho 1 message
+#define MQTT_ROUTER_DOC_SIZE     512
+
+// payload đã decode; với JSON/MessagePack chuỗi bên trong trỏ thẳng vào
+// buffer MQTT, chỉ hợp lệ trong lúc handler chạy
+typedef void (*MqttRouteHandler)(const char *topic, JsonVariantConst payload);
+
+// Đăng ký route trước khi compile. pattern phải sống suốt chương trình
+// (chuỗi hằng), vd "+/commands/led" hoặc "+/commands/#"
+bool mqtt_router_add(const char *pattern, MqttRouteHandler handler);
+
+// Đóng băng bảng route thành trie phẳng, con được sắp xếp để tìm nhị phân
+bool mqtt_router_compile();
+
+// Trả về số route khớp, ghi id route (thứ tự đăng ký) vào routes[]
+uint8_t mqtt_router_match(const char *topic, int8_t routes[], uint8_t maxRoutes);
+
+// Gọi từ callback PubSubClient; payload bị sửa tại chỗ khi parse
+uint8_t mqtt_router_dispatch(const char *topic, uint8_t *payload, size_t length);
+
+#endif
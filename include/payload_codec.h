@@ -0,0 +1,58 @@
+#ifndef __PAYLOAD_CODEC_H__
+#define __PAYLOAD_CODEC_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Định dạng payload trên đường MQTT (telemetry gửi đi và lệnh nhận về)
+enum PayloadFormat {
+    PAYLOAD_JSON,
+    PAYLOAD_MSGPACK,
+    PAYLOAD_CBOR,
+    PAYLOAD_FORMAT_COUNT
+};
+
+#define PAYLOAD_CODEC_DICT_SIZE   8      // số cặp key dài -> key ngắn
+#define PAYLOAD_CODEC_LONG_KEY    16
+#define PAYLOAD_CODEC_SHORT_KEY   8
+#define PAYLOAD_CODEC_MAX_DEPTH   8      // độ sâu lồng tối đa khi decode CBOR
+
+struct PayloadCodecConfig {
+    PayloadFormat format;
+    int8_t        precision;   // số chữ số thập phân giữ lại, < 0 = giữ nguyên float
+    bool          shortKeys;   // dùng từ điển key ngắn ("temperature" -> "t")
+};
+
+// Cấu hình đã lưu; chỉ có hiệu lực từ lần kết nối MQTT kế tiếp
+extern PayloadCodecConfig payload_codec_config;
+
+// Chốt cấu hình cho kết nối hiện tại (gọi khi bắt đầu kết nối MQTT)
+void payload_codec_activate();
+PayloadFormat payload_codec_format();
+
+// Hậu tố topic theo định dạng: "", "/msgpack", "/cbor"
+const char *payload_codec_suffix(uint8_t format);
+const char *payload_codec_name(uint8_t format);
+
+// Dùng khi dựng document telemetry: key ngắn (nếu bật) và giá trị đã làm tròn.
+// Key trả về giữ nguyên tới payload_codec_keys_end(): bọc cả đoạn dựng document
+// tới khi serialize xong, payload_codec_load() chờ đoạn đó kết thúc.
+// "ts" và "values" (khung batch ThingsBoard) không bao giờ bị đổi.
+void payload_codec_keys_begin();
+void payload_codec_keys_end();
+const char *payload_codec_key(const char *key);
+double payload_codec_value(float value);
+
+// Encode theo định dạng đang dùng; serialize trả về 0 nếu không đủ chỗ
+size_t payload_codec_measure(JsonVariantConst source);
+size_t payload_codec_serialize(JsonVariantConst source, uint8_t *output, size_t size);
+
+// Decode lệnh: JSON nếu bắt đầu bằng '{' / '[', còn lại theo định dạng đang dùng.
+// JSON và MessagePack parse tại chỗ (input bị sửa), CBOR chép chuỗi vào doc.
+DeserializationError payload_codec_deserialize(JsonDocument &doc, uint8_t *input, size_t length);
+
+// Đọc/ghi cấu hình dạng {"format":"cbor","precision":2,"short_keys":true,"dict":{...}}
+void payload_codec_load(JsonObjectConst obj);
+void payload_codec_save(JsonObject obj);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __RELAY_OUTPUT_H__
+#define __RELAY_OUTPUT_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "modbus_rtu.h"
+
+#define RELAY_SLAVE  0x01
+#define RELAY_COUNT  4
+
+void relay_output_init();
+
+// Đặt trạng thái các relay có bit trong mask theo states (bit i = relay i).
+// Chỉ gửi các relay thực sự thay đổi: 1 relay → FC05, nhiều relay → 1 frame FC15.
+// Trả về ModbusResult (MODBUS_OK nếu không cần gửi gì).
+uint8_t relay_output_apply(uint8_t mask, uint8_t states);
+uint8_t relay_output_set(uint8_t index, bool on);
+
+// Ảnh coil đã xác nhận bởi slave
+uint8_t relay_output_state();
+
+// Lệnh dạng {"relay":1,"status":"ON"} hoặc {"relays":[true,false,...]}
+// Dùng chung cho WebSocket page=device và MQTT commands. Trả về false nếu
+// JSON không phải lệnh relay.
+bool relay_output_handle_json(JsonVariantConst cmd);
+
+#endif
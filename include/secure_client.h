@@ -0,0 +1,88 @@
+#ifndef __SECURE_CLIENT_H__
+#define __SECURE_CLIENT_H__
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+
+// Client TLS (mbedtls) có cache session: lần nối lại gửi kèm session ticket /
+// session ID cũ, server chấp nhận thì bỏ qua trao đổi chứng chỉ + khóa
+// (nhanh hơn vài trăm ms trên ESP32, ít round trip hơn).
+#define TLS_SESSION_CACHE_SIZE   2        // số cặp host:port nhớ session
+#define TLS_SESSION_MAX_SIZE     2048     // session đã serialize (kèm chứng chỉ server)
+#define TLS_SESSION_HOST_LEN     64
+#define TLS_SESSION_FILE         "/tls_sessions.bin"
+#define TLS_HANDSHAKE_TIMEOUT    8000     // ms
+
+struct TlsSessionStats {
+    uint32_t handshakes;       // handshake thành công
+    uint32_t offered;          // lần gửi kèm session cũ
+    uint32_t resumed;          // server chấp nhận session cũ
+    uint32_t failed;           // handshake lỗi / timeout
+    uint32_t lastMs;
+    uint32_t fullAvgMs;
+    uint32_t resumedAvgMs;
+};
+
+// Lưu session xuống LittleFS để nối lại nhanh cả sau khi khởi động lại
+extern bool tls_session_persist;
+
+void tls_session_cache_load();
+// Xóa bản lưu trên flash (cache RAM vẫn dùng tiếp)
+void tls_session_remove_file();
+TlsSessionStats tls_session_stats();
+void tls_session_save_stats(JsonObject obj);
+
+class SecureClient : public Client {
+public:
+    SecureClient();
+    ~SecureClient();
+
+    // CA dạng PEM (phải sống suốt chương trình); bắt buộc, không có thì connect() thất bại
+    void setCACert(const char *pem);
+    // Tên server cho SNI, kiểm tra chứng chỉ và khóa cache khi connect bằng IP
+    void setHostname(const char *host);
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+    // true nếu kết nối hiện tại được nối lại từ session cũ
+    bool resumed() { return _resumed; }
+    int lastError() { return _lastError; }
+
+private:
+    WiFiClient _tcp;
+    mbedtls_ssl_context _ssl;
+    mbedtls_ssl_config _conf;
+    mbedtls_x509_crt _ca;
+    const char *_caPem;
+    String _host;
+    uint16_t _port;
+    bool _ready;       // _ssl/_conf đã init
+    bool _open;        // handshake xong, đang dùng được
+    bool _resumed;
+    int _lastError;
+    int _peeked;
+
+    bool handshake(uint32_t timeoutMs);
+    void release();
+    static int bioSend(void *ctx, const unsigned char *buf, size_t len);
+    static int bioRecv(void *ctx, unsigned char *buf, size_t len);
+};
+
+#endif
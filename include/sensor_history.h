@@ -0,0 +1,41 @@
+#ifndef __SENSOR_HISTORY_H__
+#define __SENSOR_HISTORY_H__
+
+#include <Arduino.h>
+
+// Kích thước từng tầng lịch sử (cấp phát tĩnh, không malloc)
+#define HISTORY_RAW_SIZE      600   // mẫu thô, ~10 phút ở nhịp 1 s
+#define HISTORY_MINUTE_SIZE   1440  // min/avg/max mỗi phút, 24 h
+#define HISTORY_HOUR_SIZE     720   // min/avg/max mỗi giờ, 30 ngày
+
+// Độ phân giải (giây) dùng cho tham số res=
+#define HISTORY_RES_RAW       1
+#define HISTORY_RES_MINUTE    60
+#define HISTORY_RES_HOUR      3600
+
+// Giá trị được lưu dạng số nguyên x100 (0.01 °C / 0.01 %)
+#define HISTORY_SCALE         100
+
+void sensor_history_init();
+
+// Thêm một mẫu; t = số giây kể từ khi boot. Không cấp phát bộ nhớ.
+void sensor_history_add(uint32_t t, float temperature, float humidity);
+
+// Ghi JSON các mẫu trong [from, to] ở độ phân giải res (1, 60, 3600) ra out.
+// res = 0 → tự chọn tầng mịn nhất còn giữ được 'from'.
+void sensor_history_query(Print &out, uint32_t from, uint32_t to, uint32_t res);
+
+// Query trả theo từng phần (HTTP chunked): cursor giữ vị trí đang đọc nên mỗi
+// lần chỉ cần buffer do caller cấp, bộ nhớ cố định bất kể số điểm trả về.
+// Cursor lấy từ pool tĩnh HISTORY_CURSOR_POOL phần tử: open trả về NULL nếu chưa
+// init hoặc cả pool đang bận; read trả về 0 khi đã hết.
+#define HISTORY_CURSOR_POOL   2
+struct SensorHistoryCursor;
+SensorHistoryCursor *sensor_history_cursor_open(uint32_t from, uint32_t to, uint32_t res);
+size_t sensor_history_cursor_read(SensorHistoryCursor *cursor, uint8_t *buf, size_t len);
+void sensor_history_cursor_close(SensorHistoryCursor *cursor);
+
+// Đổi chuỗi "raw"/"1s"/"1m"/"1h"/số giây sang res
+uint32_t sensor_history_parse_res(const String &res);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __SENSOR_SNAPSHOT_H__
+#define __SENSOR_SNAPSHOT_H__
+
+#include <Arduino.h>
+
+// Cờ hợp lệ của từng giá trị trong snapshot
+#define SENSOR_TEMP_VALID  0x01
+#define SENSOR_HUMI_VALID  0x02
+#define SENSOR_ALL_VALID   (SENSOR_TEMP_VALID | SENSOR_HUMI_VALID)
+
+// Một mẫu DHT20 hoàn chỉnh: nhiệt độ và độ ẩm luôn đi cùng nhau.
+struct SensorSnapshot {
+    float    temperature;
+    float    humidity;
+    uint32_t timestamp;   // millis() lúc lấy mẫu
+    uint32_t seq;         // số thứ tự mẫu, 0 = chưa có mẫu nào
+    uint8_t  flags;       // SENSOR_*_VALID
+
+    bool valid() const { return (flags & SENSOR_ALL_VALID) == SENSOR_ALL_VALID; }
+};
+
+// Seqlock 1 writer / nhiều reader, không khóa, dùng được giữa 2 core.
+// Chỉ task temp_humi_monitor được gọi hàm publish.
+void sensor_snapshot_publish(float temperature, float humidity, uint8_t flags);
+
+// Đọc mẫu mới nhất (không bao giờ bị "xé": nhiệt độ mới + độ ẩm cũ)
+SensorSnapshot sensor_snapshot_read();
+
+// Đọc mẫu mới nhất, trả về true nếu nó mới hơn lastSeq (và cập nhật lastSeq)
+bool sensor_snapshot_read_new(SensorSnapshot &out, uint32_t &lastSeq);
+
+#endif
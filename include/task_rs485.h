@@ -4,4 +4,8 @@
 #include <HardwareSerial.h>
 #include <Arduino.h>
 
-#endif
\ No newline at end of file
+extern HardwareSerial RS485Serial;
+
+void tasksensor_init();
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __TELEMETRY_BATCH_H__
+#define __TELEMETRY_BATCH_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Số key tối đa trong một mẫu và số mẫu tối đa giữ trong RAM
+#define TELEMETRY_MAX_KEYS       4
+#define TELEMETRY_BATCH_CAPACITY 32
+
+// Giá trị mặc định khi coreiot.json chưa có mục "batch"
+#define TELEMETRY_BATCH_SAMPLES  6
+#define TELEMETRY_BATCH_AGE_MS   30000
+#define TELEMETRY_BATCH_BYTES    1024
+
+struct TelemetryBatchConfig {
+    uint8_t  maxSamples;   // flush khi đủ số mẫu
+    uint32_t maxAgeMs;     // flush khi mẫu cũ nhất quá tuổi này
+    uint16_t maxBytes;     // payload tối đa mỗi lần publish
+};
+
+struct TelemetryBatchStats {
+    uint32_t samples;      // số mẫu đã nhận
+    uint32_t flushes;      // số lần publish
+    uint32_t dropped;      // mẫu bị bỏ (đầy buffer / quá lớn)
+};
+
+extern TelemetryBatchConfig telemetry_batch_config;
+
+void telemetry_batch_init();
+
+// Thêm một mẫu (keys phải là chuỗi hằng, vd "temperature")
+bool telemetry_batch_add(const char *const keys[], const float values[], uint8_t count);
+
+// Gọi định kỳ từ task MQTT: flush theo tuổi mẫu
+void telemetry_batch_poll();
+
+// Publish ngay toàn bộ mẫu đang chờ
+void telemetry_batch_flush();
+
+TelemetryBatchStats telemetry_batch_stats();
+
+// Đọc/ghi cấu hình dạng {"samples":..,"age_ms":..,"bytes":..}
+void telemetry_batch_load(JsonObjectConst obj);
+void telemetry_batch_save(JsonObject obj);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __TELEMETRY_FILTER_H__
+#define __TELEMETRY_FILTER_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Các kênh telemetry đi qua bộ lọc deadband
+enum TelemetryChannel {
+    TELEMETRY_CH_TEMPERATURE = 0,
+    TELEMETRY_CH_HUMIDITY,
+    TELEMETRY_CH_SOUND,
+    TELEMETRY_CH_PRESSURE,
+    TELEMETRY_CH_COUNT
+};
+
+struct TelemetryFilterConfig {
+    float    absDelta;       // thay đổi tuyệt đối tối thiểu để gửi (0 = tắt)
+    float    pctDelta;       // thay đổi % so với giá trị đã gửi (0 = tắt)
+    uint32_t minIntervalMs;  // khoảng cách tối thiểu giữa 2 lần gửi
+    uint32_t maxSilenceMs;   // heartbeat: quá lâu chưa gửi thì gửi lại (0 = tắt)
+};
+
+struct TelemetryFilterStats {
+    uint32_t sent;
+    uint32_t suppressed;
+};
+
+extern TelemetryFilterConfig telemetry_filter_config[TELEMETRY_CH_COUNT];
+
+const char *telemetry_channel_key(uint8_t channel);
+
+// true nếu giá trị cần được gửi (đồng thời ghi nhận làm mốc so sánh mới)
+bool telemetry_filter_accept(uint8_t channel, float value);
+
+// Lọc một nhóm kênh và đẩy các giá trị còn lại vào batch telemetry
+uint8_t telemetry_report(const uint8_t channels[], const float values[], uint8_t count);
+
+TelemetryFilterStats telemetry_filter_stats(uint8_t channel);
+
+// Đọc/ghi cấu hình {"temperature":{"abs":..,"pct":..,"min_ms":..,"max_ms":..},...}
+void telemetry_filter_load(JsonObjectConst obj);
+void telemetry_filter_save(JsonObject obj);
+void telemetry_filter_save_stats(JsonObject obj);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __TELEMETRY_SPOOL_H__
+#define __TELEMETRY_SPOOL_H__
+
+#include <Arduino.h>
+
+// Spool telemetry trên LittleFS khi MQTT mất kết nối
+#define SPOOL_DIR               "/spool"
+#define SPOOL_SEGMENT_SIZE      8192    // byte mỗi file segment
+#define SPOOL_MAX_BYTES         65536   // tổng dung lượng tối đa, vượt thì xóa segment cũ nhất
+#define SPOOL_MAX_RECORD        1024    // bản ghi lớn nhất (= buffer MQTT)
+#define SPOOL_REPLAY_BATCH      5       // số bản ghi gửi lại mỗi lượt
+#define SPOOL_REPLAY_INTERVAL   1000    // ms giữa 2 lượt gửi lại
+
+struct TelemetrySpoolStats {
+    uint32_t spooled;     // bản ghi đã ghi xuống flash
+    uint32_t replayed;    // bản ghi đã gửi lại thành công
+    uint32_t dropped;     // bản ghi bị bỏ (quá lớn / bị xóa do đầy)
+    uint32_t pendingBytes;
+    uint16_t segments;
+};
+
+// Hàm publish dùng khi replay, trả về false để dừng lượt replay.
+// tag: giá trị 0..3 lưu kèm bản ghi (vd định dạng payload)
+typedef bool (*SpoolPublishFn)(const uint8_t *payload, size_t length, uint8_t tag);
+
+void telemetry_spool_init();
+bool telemetry_spool_append(const uint8_t *payload, size_t length, uint8_t tag = 0);
+
+// Gửi lại tối đa SPOOL_REPLAY_BATCH bản ghi, tự giãn nhịp theo SPOOL_REPLAY_INTERVAL
+void telemetry_spool_replay(SpoolPublishFn publish);
+
+bool telemetry_spool_empty();
+TelemetrySpoolStats telemetry_spool_stats();
+
+#endif
@@ -6,6 +6,9 @@
 #include "global.h"
 
 void temp_humi_monitor(void *pvParameters);
+// Xử lý 1 lần đọc DHT20 (status = DHT20_OK nếu đọc được) và đẩy vào telemetry.
+// lastSeq: số thứ tự snapshot đã gửi lần trước, do task giữ
+void temp_humi_report(int status, float temperature, float humidity, uint32_t &lastSeq);
 
 
 #endif
\ No newline at end of file
@@ -26,6 +26,10 @@ DHT20::DHT20(TwoWire *wire)
   _status      = DHT20_OK;
   _lastRequest = 0;
   _lastRead    = 0;
+  _pending     = false;
+  _ready       = false;
+  _timedOut    = false;
+  _polls       = 0;
 }
 
 
@@ -111,6 +115,80 @@ int DHT20::read()
 }
 
 
+////////////////////////////////////////////////
+//
+//  NON-BLOCKING READ
+//
+int DHT20::startRead()
+{
+  if (_pending) return DHT20_READ_PENDING;
+  //  do not read to fast == more than once per second.
+  if (millis() - _lastRead < 1000)
+  {
+    return DHT20_ERROR_LASTREAD;
+  }
+
+  int status = requestData();
+  if (status != 0) return DHT20_ERROR_WIRE - status;
+
+  _pending  = true;
+  _ready    = false;
+  _timedOut = false;
+  _polls    = 0;
+  return DHT20_OK;
+}
+
+
+bool DHT20::readReady()
+{
+  if (!_pending) return false;
+  if (_ready)    return true;
+
+  uint32_t elapsed = millis() - _lastRequest;
+  //  no point in asking the sensor before the conversion can be done.
+  if (elapsed < DHT20_CONVERSION_TIME) return false;
+
+  _polls++;
+  if (!isMeasuring())
+  {
+    _ready = true;
+  }
+  else if (elapsed >= DHT20_CONVERSION_TIMEOUT)
+  {
+    _ready    = true;
+    _timedOut = true;
+  }
+  return _ready;
+}
+
+
+int DHT20::fetchRead()
+{
+  if (!_pending) return DHT20_ERROR_LASTREAD;
+  if (!readReady()) return DHT20_READ_PENDING;
+
+  _pending = false;
+  _ready   = false;
+  if (_timedOut) return DHT20_ERROR_READ_TIMEOUT;
+
+  int status = readData();
+  if (status < 0) return status;
+  return convert();
+}
+
+
+bool DHT20::readPending()
+{
+  return _pending;
+}
+
+
+uint16_t DHT20::pollCount()
+{
+  return _polls;
+}
+
+
 int DHT20::requestData()
 {
   //  reset sensor if needed.
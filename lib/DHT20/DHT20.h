@@ -29,6 +29,18 @@
 #define DHT20_ERROR_BYTES_ALL_ZERO          -13
 #define DHT20_ERROR_READ_TIMEOUT            -14
 #define DHT20_ERROR_LASTREAD                -15
+#define DHT20_READ_PENDING                  -16
+//  startRead() could not trigger a conversion, the I2C status of
+//  endTransmission() is subtracted so every cause has its own code:
+//  -21 data too long, -22 NACK on address (sensor missing),
+//  -23 NACK on data, -24 other error, -25 bus timeout.
+#define DHT20_ERROR_WIRE                    -20
+
+//  typical conversion time, see datasheet 7.4 point 3.
+//  readReady() does not touch the bus before this has passed.
+#define DHT20_CONVERSION_TIME                80     //  milliseconds
+//  readReady() gives up (and fetchRead() reports a timeout) after this.
+#define DHT20_CONVERSION_TIMEOUT             1000   //  milliseconds
 
 
 class DHT20
@@ -56,6 +68,19 @@ public:
   int      convert();
 
 
+  //  NON-BLOCKING CALL
+  //  poll driven state machine around requestData() / readData() / convert()
+  //  startRead()  triggers a conversion.
+  //  readReady()  true once the conversion is done (or timed out), cheap to poll.
+  //  fetchRead()  reads + converts, DHT20_READ_PENDING if called too early.
+  int      startRead();
+  bool     readReady();
+  int      fetchRead();
+  bool     readPending();
+  //  number of status polls used by the last async read.
+  uint16_t pollCount();
+
+
   //  SYNCHRONOUS CALL
   //  blocking read call to read + convert data
   int      read();
@@ -107,6 +132,10 @@ private:
   uint32_t _lastRequest;
   uint32_t _lastRead;
   uint8_t  _bits[7];
+  bool     _pending;
+  bool     _ready;
+  bool     _timedOut;
+  uint16_t _polls;
 
   uint8_t  _crc8(uint8_t *ptr, uint8_t len);
 
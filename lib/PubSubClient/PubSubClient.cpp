@@ -160,6 +160,8 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGN
 
 PubSubClient::~PubSubClient() {
   free(this->buffer);
+  free(this->inflightStore);
+  free(this->coalesceBuffer);
 }
 
 boolean PubSubClient::connect(const char *id) {
@@ -194,94 +196,207 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
         }
 
         if (result == 1) {
-            nextMsgId = 1;
-            // Leave room in the buffer for header and variable length field
-            uint16_t length = MQTT_MAX_HEADER_SIZE;
-            unsigned int j;
+            if (!sendConnect(id,user,pass,willTopic,willQos,willRetain,willMessage,cleanSession)) {
+                return false;
+            }
+
+            while (!_client->available()) {
+                unsigned long t = millis();
+                if (t-lastInActivity >= ((int32_t) this->socketTimeout*1000UL)) {
+                    _state = MQTT_CONNECTION_TIMEOUT;
+                    stopClient();
+                    return false;
+                }
+            }
+            return readConnack();
+        } else {
+            _state = MQTT_CONNECT_FAILED;
+        }
+        return false;
+    }
+    return true;
+}
+
+boolean PubSubClient::beginConnect(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession) {
+    if (connected()) {
+        return true;
+    }
+    if (!_client->connected()) {
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    return sendConnect(id,user,pass,willTopic,willQos,willRetain,willMessage,cleanSession);
+}
+
+int PubSubClient::pollConnect() {
+    if (_state == MQTT_CONNECTED) {
+        return 1;
+    }
+    if (_state != MQTT_CONNECTING) {
+        return -1;
+    }
+    if (!_client->connected()) {
+        _state = MQTT_CONNECTION_LOST;
+        return -1;
+    }
+    if (_client->available()) {
+        return readConnack() ? 1 : -1;
+    }
+    if (millis() - lastInActivity >= ((int32_t) this->socketTimeout*1000UL)) {
+        _state = MQTT_CONNECTION_TIMEOUT;
+        stopClient();
+        return -1;
+    }
+    return 0;
+}
+
+// Builds and sends CONNECT on an already open network connection
+boolean PubSubClient::sendConnect(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession) {
+    nextMsgId = 1;
+    // Nothing held for the previous connection may go out ahead of CONNECT;
+    // unacknowledged QoS 1 messages are resent from the in-flight window instead
+    this->coalesceLength = 0;
+    // Leave room in the buffer for header and variable length field
+    uint16_t length = MQTT_MAX_HEADER_SIZE;
+    unsigned int j;
 
 #if MQTT_VERSION == MQTT_VERSION_3_1
-            uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION};
+    uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION};
 #define MQTT_HEADER_VERSION_LENGTH 9
 #elif MQTT_VERSION == MQTT_VERSION_3_1_1
-            uint8_t d[7] = {0x00,0x04,'M','Q','T','T',MQTT_VERSION};
+    uint8_t d[7] = {0x00,0x04,'M','Q','T','T',MQTT_VERSION};
 #define MQTT_HEADER_VERSION_LENGTH 7
 #endif
-            for (j = 0;j<MQTT_HEADER_VERSION_LENGTH;j++) {
-                this->buffer[length++] = d[j];
-            }
+    if (this->protocolVersion == MQTT_VERSION_5) {
+        uint8_t d5[7] = {0x00,0x04,'M','Q','T','T',MQTT_VERSION_5};
+        for (j = 0;j<7;j++) {
+            this->buffer[length++] = d5[j];
+        }
+    } else {
+        for (j = 0;j<MQTT_HEADER_VERSION_LENGTH;j++) {
+            this->buffer[length++] = d[j];
+        }
+    }
 
-            uint8_t v;
-            if (willTopic) {
-                v = 0x04|(willQos<<3)|(willRetain<<5);
-            } else {
-                v = 0x00;
-            }
-            if (cleanSession) {
-                v = v|0x02;
-            }
+    uint8_t v;
+    if (willTopic) {
+        v = 0x04|(willQos<<3)|(willRetain<<5);
+    } else {
+        v = 0x00;
+    }
+    if (cleanSession) {
+        v = v|0x02;
+    }
 
-            if(user != NULL) {
-                v = v|0x80;
+    if(user != NULL) {
+        v = v|0x80;
 
-                if(pass != NULL) {
-                    v = v|(0x80>>1);
-                }
-            }
-            this->buffer[length++] = v;
-
-            this->buffer[length++] = ((this->keepAlive) >> 8);
-            this->buffer[length++] = ((this->keepAlive) & 0xFF);
-
-            CHECK_STRING_LENGTH(length,id)
-            length = writeString(id,this->buffer,length);
-            if (willTopic) {
-                CHECK_STRING_LENGTH(length,willTopic)
-                length = writeString(willTopic,this->buffer,length);
-                CHECK_STRING_LENGTH(length,willMessage)
-                length = writeString(willMessage,this->buffer,length);
-            }
+        if(pass != NULL) {
+            v = v|(0x80>>1);
+        }
+    }
+    this->buffer[length++] = v;
+
+    this->buffer[length++] = ((this->keepAlive) >> 8);
+    this->buffer[length++] = ((this->keepAlive) & 0xFF);
+
+    if (this->protocolVersion == MQTT_VERSION_5) {
+        // Properties: Maximum Packet Size = our buffer. Topic Alias
+        // Maximum is left at 0, so the server never aliases inbound topics.
+        boolean expiry = !cleanSession && this->sessionExpiry > 0;
+        this->buffer[length++] = expiry ? 10 : 5;
+        this->buffer[length++] = 0x27;
+        this->buffer[length++] = 0;
+        this->buffer[length++] = 0;
+        this->buffer[length++] = (this->bufferSize >> 8);
+        this->buffer[length++] = (this->bufferSize & 0xFF);
+        if (expiry) {
+            this->buffer[length++] = 0x11;
+            this->buffer[length++] = (this->sessionExpiry >> 24);
+            this->buffer[length++] = (this->sessionExpiry >> 16) & 0xFF;
+            this->buffer[length++] = (this->sessionExpiry >> 8) & 0xFF;
+            this->buffer[length++] = (this->sessionExpiry & 0xFF);
+        }
+    }
 
-            if(user != NULL) {
-                CHECK_STRING_LENGTH(length,user)
-                length = writeString(user,this->buffer,length);
-                if(pass != NULL) {
-                    CHECK_STRING_LENGTH(length,pass)
-                    length = writeString(pass,this->buffer,length);
-                }
-            }
+    CHECK_STRING_LENGTH(length,id)
+    length = writeString(id,this->buffer,length);
+    if (willTopic) {
+        if (this->protocolVersion == MQTT_VERSION_5) {
+            this->buffer[length++] = 0; // no will properties
+        }
+        CHECK_STRING_LENGTH(length,willTopic)
+        length = writeString(willTopic,this->buffer,length);
+        CHECK_STRING_LENGTH(length,willMessage)
+        length = writeString(willMessage,this->buffer,length);
+    }
 
-            write(MQTTCONNECT,this->buffer,length-MQTT_MAX_HEADER_SIZE);
+    if(user != NULL) {
+        CHECK_STRING_LENGTH(length,user)
+        length = writeString(user,this->buffer,length);
+        if(pass != NULL) {
+            CHECK_STRING_LENGTH(length,pass)
+            length = writeString(pass,this->buffer,length);
+        }
+    }
 
-            lastInActivity = lastOutActivity = millis();
+    if (!write(MQTTCONNECT,this->buffer,length-MQTT_MAX_HEADER_SIZE)) {
+        stopClient();
+        return false;
+    }
+    lastInActivity = lastOutActivity = millis();
+    _state = MQTT_CONNECTING;
+    return true;
+}
 
-            while (!_client->available()) {
-                unsigned long t = millis();
-                if (t-lastInActivity >= ((int32_t) this->socketTimeout*1000UL)) {
-                    _state = MQTT_CONNECTION_TIMEOUT;
-                    _client->stop();
-                    return false;
-                }
+boolean PubSubClient::readConnack() {
+    uint8_t llen;
+    uint32_t len = readPacket(&llen);
+
+    // 3.1.1: 20 02 flags rc. MQTT 5: 20 len flags rc props...
+    boolean isConnack = (len >= 4) && ((buffer[0]&0xF0) == MQTTCONNACK);
+    if (isConnack && (this->protocolVersion == MQTT_VERSION_5 || len == 4)) {
+        uint8_t rc = buffer[llen+2];
+        this->reasonCode = rc;
+        if (rc == 0) {
+            this->_sessionPresent = (buffer[llen+1] & 0x01) != 0;
+            // Only ids seen on the connection that just ended can come back as
+            // redeliveries; older ones may already have been reused by the server.
+            // A new session redelivers nothing at all.
+            if (this->_sessionPresent) {
+                memcpy(this->resumeIds, this->recentIds, sizeof(this->resumeIds));
+            } else {
+                memset(this->resumeIds, 0, sizeof(this->resumeIds));
             }
-            uint8_t llen;
-            uint32_t len = readPacket(&llen);
-
-            if (len == 4) {
-                if (buffer[3] == 0) {
-                    lastInActivity = millis();
-                    pingOutstanding = false;
-                    _state = MQTT_CONNECTED;
-                    return true;
-                } else {
-                    _state = buffer[3];
+            memset(this->recentIds, 0, sizeof(this->recentIds));
+            this->recentNext = 0;
+            this->serverReceiveMaximum = 0xFFFF;
+            this->serverTopicAliasMaximum = 0;
+            if (this->protocolVersion == MQTT_VERSION_5) {
+                parseConnackProperties(buffer+llen+3, len-(llen+3));
+            }
+            // Aliases from the previous connection are no longer valid, and the
+            // protocol version may have changed since the packets were encoded
+            for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+                if (this->inflight[i].msgId != 0 && !expandInflightTopic(&this->inflight[i])) {
+                    this->inflight[i].msgId = 0;
                 }
             }
-            _client->stop();
+            resetTopicAliases();
+
+            lastInActivity = millis();
+            pingOutstanding = false;
+            _state = MQTT_CONNECTED;
+            // Resend anything still unacknowledged from the previous connection
+            retransmitInflight(lastInActivity, true);
+            return true;
         } else {
-            _state = MQTT_CONNECT_FAILED;
+            // 3.1.1 return codes 1-5, or an MQTT 5 reason code (>= 0x80)
+            _state = rc;
         }
-        return false;
     }
-    return true;
+    stopClient();
+    return false;
 }
 
 // reads a byte into result
@@ -309,6 +424,35 @@ boolean PubSubClient::readByte(uint8_t * result, uint16_t * index){
   return false;
 }
 
+// reads exactly n bytes into buf using bulk reads; the socket timeout restarts
+// whenever data arrives. Any pass that makes no progress (nothing available, or
+// available() > 0 but read() returns <= 0, e.g. a TLS record still being
+// decrypted or a socket error) counts against the timeout.
+boolean PubSubClient::readBytes(uint8_t * buf, uint32_t n) {
+   uint32_t got = 0;
+   uint32_t previousMillis = millis();
+   while (got < n) {
+     int avail = _client->available();
+     if (avail > 0) {
+       uint32_t want = n - got;
+       if ((uint32_t)avail < want) {
+         want = avail;
+       }
+       int rc = _client->read(buf + got, want);
+       if (rc > 0) {
+         got += rc;
+         previousMillis = millis();
+         continue;
+       }
+     }
+     yield();
+     if (millis() - previousMillis >= ((int32_t) this->socketTimeout * 1000)) {
+       return false;
+     }
+   }
+   return true;
+}
+
 uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
     uint16_t len = 0;
     if(!readByte(this->buffer, &len)) return 0;
@@ -323,7 +467,7 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
         if (len == 5) {
             // Invalid remaining length encoding - kill the connection
             _state = MQTT_DISCONNECTED;
-            _client->stop();
+            stopClient();
             return 0;
         }
         if(!readByte(&digit)) return 0;
@@ -333,7 +477,8 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
     } while ((digit & 128) != 0);
     *lengthLength = len-1;
 
-    if (isPublish) {
+    if (this->stream && isPublish) {
+        // Stream mode: payload bytes are forwarded one by one as they arrive
         // Read in topic length to calculate bytes to skip over for Stream writing
         if(!readByte(this->buffer, &len)) return 0;
         if(!readByte(this->buffer, &len)) return 0;
@@ -343,25 +488,38 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
             // skip message id
             skip += 2;
         }
-    }
-    uint32_t idx = len;
+        uint32_t idx = len;
 
-    for (uint32_t i = start;i<length;i++) {
-        if(!readByte(&digit)) return 0;
-        if (this->stream) {
-            if (isPublish && idx-*lengthLength-2>skip) {
+        for (uint32_t i = start;i<length;i++) {
+            if(!readByte(&digit)) return 0;
+            if (idx-*lengthLength-2>skip) {
                 this->stream->write(digit);
             }
-        }
 
-        if (len < this->bufferSize) {
-            this->buffer[len] = digit;
-            len++;
+            if (len < this->bufferSize) {
+                this->buffer[len] = digit;
+                len++;
+            }
+            idx++;
         }
-        idx++;
+        return len;
     }
 
-    if (!this->stream && idx > this->bufferSize) {
+    // Fetch the remaining length in bulk straight into the buffer
+    uint32_t room = this->bufferSize - len;
+    uint32_t n = length < room ? length : room;
+    if (!readBytes(this->buffer + len, n)) return 0;
+    len += n;
+
+    if (length > room) {
+        // Too big for the buffer: drain the rest and ignore the packet
+        uint8_t scratch[32];
+        uint32_t remaining = length - n;
+        while (remaining > 0) {
+            uint32_t chunk = remaining < sizeof(scratch) ? remaining : sizeof(scratch);
+            if (!readBytes(scratch, chunk)) return 0;
+            remaining -= chunk;
+        }
         len = 0; // This will cause the packet to be ignored.
     }
     return len;
@@ -373,18 +531,24 @@ boolean PubSubClient::loop() {
         if ((t - lastInActivity > this->keepAlive*1000UL) || (t - lastOutActivity > this->keepAlive*1000UL)) {
             if (pingOutstanding) {
                 this->_state = MQTT_CONNECTION_TIMEOUT;
-                _client->stop();
+                stopClient();
                 return false;
             } else {
                 this->buffer[0] = MQTTPINGREQ;
                 this->buffer[1] = 0;
-                _client->write(this->buffer,2);
+                sendPacket(this->buffer,2,false);
                 lastOutActivity = t;
                 lastInActivity = t;
                 pingOutstanding = true;
             }
         }
-        if (_client->available()) {
+        retransmitInflight(t, false);
+        if (this->coalesceLength > 0 && t - this->coalesceStart >= this->coalesceWindow) {
+            flushWrites();
+        }
+        // readPacket() would overwrite a QoS 0 beginPublish() being assembled in
+        // the buffer; incoming packets wait on the socket until endPublish()
+        if (!this->bufferStaged && _client->available()) {
             uint8_t llen;
             uint16_t len = readPacket(&llen);
             uint16_t msgId = 0;
@@ -399,27 +563,55 @@ boolean PubSubClient::loop() {
                         this->buffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
                         char *topic = (char*) this->buffer+llen+2;
                         // msgId only present for QOS>0
+                        // MQTT 5: skip the PUBLISH properties in front of the payload
+                        uint16_t props = 0;
+                        if (this->protocolVersion == MQTT_VERSION_5) {
+                            uint16_t at = llen+3+tl+(((this->buffer[0]&0x06) == MQTTQOS1) ? 2 : 0);
+                            uint32_t plen = 0;
+                            uint8_t shift = 0;
+                            do {
+                                plen |= (uint32_t)(this->buffer[at+props] & 127) << shift;
+                                shift += 7;
+                            } while ((this->buffer[at+props++] & 128) && props < 4);
+                            props += plen;
+                            if (at + props > len) {
+                                return true; // malformed, ignore
+                            }
+                        }
                         if ((this->buffer[0]&0x06) == MQTTQOS1) {
                             msgId = (this->buffer[llen+3+tl]<<8)+this->buffer[llen+3+tl+1];
-                            payload = this->buffer+llen+3+tl+2;
-                            callback(topic,payload,len-llen-3-tl-2);
+                            payload = this->buffer+llen+3+tl+2+props;
+                            // A redelivery of a message already handed to the
+                            // callback only needs acknowledging again
+                            if (rememberPacketId(msgId, (this->buffer[0]&MQTTDUP) != 0)) {
+                                callback(topic,payload,len-llen-3-tl-2-props);
+                            }
 
                             this->buffer[0] = MQTTPUBACK;
                             this->buffer[1] = 2;
                             this->buffer[2] = (msgId >> 8);
                             this->buffer[3] = (msgId & 0xFF);
-                            _client->write(this->buffer,4);
-                            lastOutActivity = t;
+                            sendPacket(this->buffer,4,false);
 
                         } else {
-                            payload = this->buffer+llen+3+tl;
-                            callback(topic,payload,len-llen-3-tl);
+                            payload = this->buffer+llen+3+tl+props;
+                            callback(topic,payload,len-llen-3-tl-props);
                         }
                     }
+                } else if (type == MQTTPUBACK) {
+                    // MQTT 5 may append a reason code; the message is done either way
+                    this->reasonCode = (len > (uint16_t)(llen+3)) ? this->buffer[llen+3] : 0;
+                    releaseInflight((this->buffer[llen+1]<<8)+this->buffer[llen+2]);
+                } else if (type == MQTTDISCONNECT) {
+                    // MQTT 5 server-initiated disconnect
+                    this->reasonCode = (len > (uint16_t)(llen+1)) ? this->buffer[llen+1] : 0;
+                    _state = MQTT_DISCONNECTED;
+                    stopClient();
+                    return false;
                 } else if (type == MQTTPINGREQ) {
                     this->buffer[0] = MQTTPINGRESP;
                     this->buffer[1] = 0;
-                    _client->write(this->buffer,2);
+                    sendPacket(this->buffer,2,false);
                 } else if (type == MQTTPINGRESP) {
                     pingOutstanding = false;
                 }
@@ -447,13 +639,16 @@ boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigne
 
 boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
     if (connected()) {
-        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2+strnlen(topic, this->bufferSize) + plength) {
+        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2+strnlen(topic, this->bufferSize) + maxPublishProperties() + plength) {
             // Too long
             return false;
         }
+        PublishTopic t;
+        resolveTopic(topic, &t);
+
         // Leave room in the buffer for header and variable length field
         uint16_t length = MQTT_MAX_HEADER_SIZE;
-        length = writeString(topic,this->buffer,length);
+        length = writePublishVariableHeader(this->buffer,length,t,0);
 
         // Add payload
         uint16_t i;
@@ -466,11 +661,38 @@ boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigne
         if (retained) {
             header |= 1;
         }
-        return write(header,this->buffer,length-MQTT_MAX_HEADER_SIZE);
+        if (write(header,this->buffer,length-MQTT_MAX_HEADER_SIZE)) {
+            commitTopicAlias(t.alias);
+            return true;
+        }
     }
     return false;
 }
 
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained, uint8_t qos) {
+    if (qos == 0) {
+        return publish(topic, payload, plength, retained);
+    }
+    if (qos > 1 || !connected()) {
+        return false;
+    }
+    // Size with the full topic so the packet still fits if it must be expanded on reconnect
+    uint16_t tlen = strnlen(topic, this->bufferSize);
+    int8_t slot = allocInflight(MQTT_MAX_HEADER_SIZE + 2 + tlen + 2 + maxPublishProperties() + plength);
+    if (slot < 0) {
+        return false;
+    }
+    PublishTopic t;
+    resolveTopic(topic, &t);
+    InflightPacket* p = &this->inflight[slot];
+    size_t pos = buildPublishHeader(p->data, t, plength, retained, p->msgId);
+    memcpy(p->data + pos, payload, plength);
+    p->length = pos + plength;
+    // Even a short write stays in flight and is retransmitted with the topic
+    commitTopicAlias(t.alias);
+    return sendInflight(slot);
+}
+
 boolean PubSubClient::publish_P(const char* topic, const char* payload, boolean retained) {
     return publish_P(topic, (const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0, retained);
 }
@@ -479,25 +701,27 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
     uint8_t llen = 0;
     uint8_t digit;
     unsigned int rc = 0;
-    uint16_t tlen;
     unsigned int pos = 0;
     unsigned int i;
     uint8_t header;
     unsigned int len;
     int expectedLength;
+    uint16_t vlen;
+    PublishTopic t;
 
     if (!connected()) {
         return false;
     }
 
-    tlen = strnlen(topic, this->bufferSize);
+    resolveTopic(topic, &t);
+    vlen = publishVariableLength(t, false);
 
     header = MQTTPUBLISH;
     if (retained) {
         header |= 1;
     }
     this->buffer[pos++] = header;
-    len = plength + 2 + tlen;
+    len = plength + vlen;
     do {
         digit = len  & 127; //digit = len %128
         len >>= 7; //len = len / 128
@@ -508,8 +732,9 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
         llen++;
     } while(len>0);
 
-    pos = writeString(topic,this->buffer,pos);
+    pos = writePublishVariableHeader(this->buffer,pos,t,0);
 
+    flushWrites();
     rc += _client->write(this->buffer,pos);
 
     for (i=0;i<plength;i++) {
@@ -518,40 +743,491 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
 
     lastOutActivity = millis();
 
-    expectedLength = 1 + llen + 2 + tlen + plength;
+    expectedLength = 1 + llen + vlen + plength;
 
-    return (rc == expectedLength);
+    if (rc == expectedLength) {
+        commitTopicAlias(t.alias);
+        return true;
+    }
+    return false;
+}
+
+boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained, uint8_t qos) {
+    if (qos == 0) {
+        return beginPublish(topic, plength, retained);
+    }
+    if (qos > 1 || !connected()) {
+        return false;
+    }
+    uint16_t tlen = strnlen(topic, this->bufferSize);
+    int8_t slot = allocInflight(MQTT_MAX_HEADER_SIZE + 2 + tlen + 2 + maxPublishProperties() + plength);
+    if (slot < 0) {
+        return false;
+    }
+    PublishTopic t;
+    resolveTopic(topic, &t);
+    InflightPacket* p = &this->inflight[slot];
+    p->length = buildPublishHeader(p->data, t, plength, retained, p->msgId);
+    // The payload is appended by write(); endPublish() checks it is complete
+    this->stagedLength = p->length + plength;
+    this->stagedSlot = slot;
+    this->stagedAlias = t.alias;
+    return true;
 }
 
 boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained) {
     if (connected()) {
+        PublishTopic t;
+        resolveTopic(topic, &t);
         // Send the header and variable length field
         uint16_t length = MQTT_MAX_HEADER_SIZE;
-        length = writeString(topic,this->buffer,length);
+        if (length + publishVariableLength(t, false) > this->bufferSize) {
+            return false;
+        }
+        length = writePublishVariableHeader(this->buffer,length,t,0);
         uint8_t header = MQTTPUBLISH;
         if (retained) {
             header |= 1;
         }
+        if (length + plength <= this->bufferSize) {
+            // Assemble the whole packet in the buffer; endPublish() sends it in one write
+            this->bufferStaged = true;
+            this->stagedHeader = header;
+            this->stagedPos = length;
+            this->stagedLength = length + plength;
+            this->stagedAlias = t.alias;
+            return true;
+        }
+        // Too big for the buffer: stream the header now and the payload via write()
         size_t hlen = buildHeader(header, this->buffer, plength+length-MQTT_MAX_HEADER_SIZE);
-        uint16_t rc = _client->write(this->buffer+(MQTT_MAX_HEADER_SIZE-hlen),length-(MQTT_MAX_HEADER_SIZE-hlen));
-        lastOutActivity = millis();
-        return (rc == (length-(MQTT_MAX_HEADER_SIZE-hlen)));
+        uint16_t rc = sendPacket(this->buffer+(MQTT_MAX_HEADER_SIZE-hlen),length-(MQTT_MAX_HEADER_SIZE-hlen),false);
+        if (rc == (length-(MQTT_MAX_HEADER_SIZE-hlen))) {
+            commitTopicAlias(t.alias);
+            return true;
+        }
     }
     return false;
 }
 
 int PubSubClient::endPublish() {
- return 1;
+    if (this->bufferStaged) {
+        this->bufferStaged = false;
+        if (this->stagedPos != this->stagedLength) {
+            return 0;
+        }
+        if (!write(this->stagedHeader, this->buffer, this->stagedLength - MQTT_MAX_HEADER_SIZE)) {
+            return 0;
+        }
+        commitTopicAlias(this->stagedAlias);
+        return 1;
+    }
+    if (this->stagedSlot < 0) {
+        return 1;
+    }
+    uint8_t slot = this->stagedSlot;
+    InflightPacket* p = &this->inflight[slot];
+    this->stagedSlot = -1;
+    if (p->length != this->stagedLength) {
+        p->msgId = 0;
+        return 0;
+    }
+    commitTopicAlias(this->stagedAlias);
+    return sendInflight(slot);
 }
 
 size_t PubSubClient::write(uint8_t data) {
-    lastOutActivity = millis();
-    return _client->write(data);
+    return write(&data, 1);
 }
 
 size_t PubSubClient::write(const uint8_t *buffer, size_t size) {
+    if (this->bufferStaged) {
+        if (this->stagedPos + size > this->stagedLength) {
+            size = this->stagedLength - this->stagedPos;
+        }
+        memcpy(this->buffer + this->stagedPos, buffer, size);
+        this->stagedPos += size;
+        return size;
+    }
+    if (this->stagedSlot >= 0) {
+        InflightPacket* p = &this->inflight[this->stagedSlot];
+        if (p->length + size > this->stagedLength) {
+            size = this->stagedLength - p->length;
+        }
+        memcpy(p->data + p->length, buffer, size);
+        p->length += size;
+        return size;
+    }
+    return sendPacket(buffer,size,false);
+}
+
+size_t PubSubClient::buildPublishHeader(uint8_t* buf, const PublishTopic& t, unsigned int plength, boolean retained, uint16_t msgId) {
+    uint8_t header = MQTTPUBLISH | MQTTQOS1;
+    if (retained) {
+        header |= 1;
+    }
+    uint32_t len = publishVariableLength(t, true) + plength;
+    size_t pos = 0;
+    buf[pos++] = header;
+    do {
+        uint8_t digit = len & 127;
+        len >>= 7;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        buf[pos++] = digit;
+    } while (len > 0);
+    return writePublishVariableHeader(buf, pos, t, msgId);
+}
+
+// ---- MQTT 5 topic aliases ----------------------------------------------------
+
+void PubSubClient::resolveTopic(const char* topic, PublishTopic* t) {
+    t->topic = topic;
+    t->alias = 0;
+    t->aliasOnly = false;
+    if (this->protocolVersion != MQTT_VERSION_5) {
+        return;
+    }
+    size_t tlen = strnlen(topic, MQTT_TOPIC_ALIAS_LENGTH);
+    if (tlen == 0 || tlen >= MQTT_TOPIC_ALIAS_LENGTH) {
+        return;
+    }
+    uint16_t max = this->serverTopicAliasMaximum < MQTT_MAX_TOPIC_ALIASES ? this->serverTopicAliasMaximum : MQTT_MAX_TOPIC_ALIASES;
+    for (uint16_t i = 0; i < max; i++) {
+        TopicAlias* a = &this->topicAliases[i];
+        if (a->topic[0] == 0) {
+            // Free entry: claim it; the topic is sent in full together with the alias
+            memcpy(a->topic, topic, tlen + 1);
+            a->established = false;
+            t->alias = i + 1;
+            return;
+        }
+        if (strcmp(a->topic, topic) == 0) {
+            t->alias = i + 1;
+            t->aliasOnly = a->established;
+            return;
+        }
+    }
+}
+
+void PubSubClient::commitTopicAlias(uint16_t alias) {
+    if (alias > 0 && alias <= MQTT_MAX_TOPIC_ALIASES) {
+        this->topicAliases[alias-1].established = true;
+    }
+}
+
+void PubSubClient::resetTopicAliases() {
+    for (uint8_t i = 0; i < MQTT_MAX_TOPIC_ALIASES; i++) {
+        this->topicAliases[i].topic[0] = 0;
+        this->topicAliases[i].established = false;
+    }
+}
+
+uint16_t PubSubClient::publishVariableLength(const PublishTopic& t, boolean hasMsgId) {
+    uint16_t len = 2 + (t.aliasOnly ? 0 : strnlen(t.topic, this->bufferSize));
+    if (hasMsgId) {
+        len += 2;
+    }
+    if (this->protocolVersion == MQTT_VERSION_5) {
+        len += 1 + (this->messageExpiry ? 5 : 0) + (t.alias ? 3 : 0);
+    }
+    return len;
+}
+
+uint16_t PubSubClient::writePublishVariableHeader(uint8_t* buf, uint16_t pos, const PublishTopic& t, uint16_t msgId) {
+    pos = writeString(t.aliasOnly ? "" : t.topic, buf, pos);
+    if (msgId != 0) {
+        buf[pos++] = (msgId >> 8);
+        buf[pos++] = (msgId & 0xFF);
+    }
+    if (this->protocolVersion == MQTT_VERSION_5) {
+        buf[pos++] = (this->messageExpiry ? 5 : 0) + (t.alias ? 3 : 0);
+        if (this->messageExpiry) {
+            buf[pos++] = 0x02;
+            buf[pos++] = (this->messageExpiry >> 24);
+            buf[pos++] = (this->messageExpiry >> 16) & 0xFF;
+            buf[pos++] = (this->messageExpiry >> 8) & 0xFF;
+            buf[pos++] = (this->messageExpiry & 0xFF);
+        }
+        if (t.alias) {
+            buf[pos++] = 0x23;
+            buf[pos++] = (t.alias >> 8);
+            buf[pos++] = (t.alias & 0xFF);
+        }
+    }
+    return pos;
+}
+
+// Room reserved for PUBLISH properties when sizing a packet: MQTT 3.1.1 has none
+uint8_t PubSubClient::maxPublishProperties() {
+    return this->protocolVersion == MQTT_VERSION_5 ? MQTT_MAX_PUBLISH_PROPERTIES : 0;
+}
+
+// An in-flight packet that used an alias-only topic cannot be resent on a new
+// connection. Rebuild it with the full topic name and without the alias. A
+// packet encoded for the other protocol version is rebuilt the same way, adding
+// or removing the MQTT 5 properties block (message expiry is kept for MQTT 5).
+// Returns false if the packet cannot be rebuilt and must be dropped.
+boolean PubSubClient::expandInflightTopic(InflightPacket* p) {
+    uint8_t* d = p->data;
+    uint16_t pos = 1;
+    while (d[pos++] & 0x80);
+    uint16_t tl = (d[pos]<<8) + d[pos+1];
+    if (tl != 0 && p->version == this->protocolVersion) {
+        return true;
+    }
+    const uint8_t* topic = d + pos + 2;
+    uint16_t idPos = pos + 2 + tl;
+    uint16_t payloadPos = idPos + 2;
+    uint16_t alias = 0;
+    const uint8_t* expiry = NULL;
+    if (p->version == MQTT_VERSION_5) {
+        uint16_t i = payloadPos + 1;
+        payloadPos = i + d[payloadPos];   // we never write more than MQTT_MAX_PUBLISH_PROPERTIES
+        while (i < payloadPos) {
+            if (d[i] == 0x23) {
+                alias = (d[i+1]<<8) + d[i+2];
+                i += 3;
+            } else {
+                expiry = d + i + 1;
+                i += 5;
+            }
+        }
+    }
+    if (tl == 0) {
+        if (alias == 0 || alias > MQTT_MAX_TOPIC_ALIASES) {
+            return false;
+        }
+        topic = (const uint8_t*)this->topicAliases[alias-1].topic;
+        tl = strnlen((const char*)topic, MQTT_TOPIC_ALIAS_LENGTH);
+    }
+    uint16_t plength = p->length - payloadPos;
+    uint8_t props = 0;
+    if (this->protocolVersion == MQTT_VERSION_5) {
+        props = 1 + (expiry ? 5 : 0);
+    }
+    if (MQTT_MAX_HEADER_SIZE + 2 + tl + 2 + props > this->bufferSize) {
+        return false;
+    }
+
+    // Payload stays in the slot; build the new header in the client buffer
+    uint8_t* tmp = this->buffer;
+    size_t h = MQTT_MAX_HEADER_SIZE;
+    tmp[h++] = tl >> 8;
+    tmp[h++] = tl & 0xFF;
+    memcpy(tmp + h, topic, tl);
+    h += tl;
+    tmp[h++] = d[idPos];
+    tmp[h++] = d[idPos+1];
+    if (props) {
+        tmp[h++] = props - 1;
+        if (expiry) {
+            tmp[h++] = 0x02;
+            memcpy(tmp + h, expiry, 4);
+            h += 4;
+        }
+    }
+    size_t start = MQTT_MAX_HEADER_SIZE - buildHeader(d[0], tmp, h - MQTT_MAX_HEADER_SIZE + plength);
+    size_t hlen = h - start;
+    if (hlen + plength > MQTT_INFLIGHT_PACKET_SIZE) {
+        return false;
+    }
+    memmove(d + hlen, d + payloadPos, plength);
+    memcpy(d, tmp + start, hlen);
+    p->length = hlen + plength;
+    p->version = this->protocolVersion;
+    return true;
+}
+
+void PubSubClient::parseConnackProperties(const uint8_t* p, uint32_t length) {
+    uint32_t plen = 0;
+    uint8_t shift = 0;
+    uint32_t i = 0;
+    do {
+        if (i >= length) {
+            return;
+        }
+        plen |= (uint32_t)(p[i] & 127) << shift;
+        shift += 7;
+    } while (p[i++] & 128);
+    uint32_t end = i + plen;
+    if (end > length) {
+        end = length;
+    }
+    while (i < end) {
+        uint8_t id = p[i];
+        if (id == 0x21) {
+            this->serverReceiveMaximum = (p[i+1]<<8) + p[i+2];
+        } else if (id == 0x22) {
+            this->serverTopicAliasMaximum = (p[i+1]<<8) + p[i+2];
+        }
+        int32_t n = skipProperty(p + i, end - i);
+        if (n <= 0) {
+            return;
+        }
+        i += n;
+    }
+}
+
+// Returns the size of the property at p (identifier included), or -1 if unknown
+int32_t PubSubClient::skipProperty(const uint8_t* p, uint32_t length) {
+    uint32_t n;
+    switch (p[0]) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            n = 2;
+            break;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            n = 3;
+            break;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            n = 5;
+            break;
+        case 0x0B:
+            n = 2;
+            while (n <= length && n < 6 && (p[n-1] & 0x80)) {
+                n++;
+            }
+            break;
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            if (length < 3) {
+                return -1;
+            }
+            n = 3 + (p[1]<<8) + p[2];
+            break;
+        case 0x26: {
+            if (length < 3) {
+                return -1;
+            }
+            uint32_t k = 3 + (p[1]<<8) + p[2];
+            if (length < k + 2) {
+                return -1;
+            }
+            n = k + 2 + (p[k]<<8) + p[k+1];
+            break;
+        }
+        default:
+            return -1;
+    }
+    return n <= length ? (int32_t)n : -1;
+}
+
+// Single exit point for outbound bytes. PUBLISH packets may be held in the
+// coalescing buffer; anything else flushes it first so ordering is kept.
+size_t PubSubClient::sendPacket(const uint8_t* data, size_t length, boolean coalesce) {
     lastOutActivity = millis();
-    return _client->write(buffer,size);
+    if (coalesce && this->coalesceWindow > 0 && length <= MQTT_COALESCE_SIZE) {
+        if (this->coalesceBuffer == NULL) {
+            this->coalesceBuffer = (uint8_t*)malloc(MQTT_COALESCE_SIZE);
+        }
+        if (this->coalesceBuffer != NULL) {
+            if (this->coalesceLength + length > MQTT_COALESCE_SIZE) {
+                flushWrites();
+            }
+            if (this->coalesceLength == 0) {
+                this->coalesceStart = lastOutActivity;
+            }
+            memcpy(this->coalesceBuffer + this->coalesceLength, data, length);
+            this->coalesceLength += length;
+            return length;
+        }
+    }
+    flushWrites();
+    return _client->write(data, length);
+}
+
+// Closes the network connection and discards coalesced bytes that were meant
+// for it, so they are never written to the next connection
+void PubSubClient::stopClient() {
+    this->coalesceLength = 0;
+    this->coalesceStart = 0;
+    _client->stop();
+}
+
+boolean PubSubClient::flushWrites() {
+    if (this->coalesceLength == 0) {
+        return true;
+    }
+    uint16_t length = this->coalesceLength;
+    this->coalesceLength = 0;
+    return _client->write(this->coalesceBuffer, length) == length;
+}
+
+uint16_t PubSubClient::nextPacketId() {
+    boolean inUse;
+    do {
+        nextMsgId++;
+        if (nextMsgId == 0) {
+            nextMsgId = 1;
+        }
+        inUse = false;
+        for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+            if (this->inflight[i].msgId == nextMsgId) {
+                inUse = true;
+            }
+        }
+    } while (inUse);
+    return nextMsgId;
+}
+
+int8_t PubSubClient::allocInflight(uint16_t length) {
+    if (length > MQTT_INFLIGHT_PACKET_SIZE || this->stagedSlot >= 0) {
+        return -1;
+    }
+    uint16_t window = this->inflightWindow;
+    if (this->serverReceiveMaximum < window) {
+        window = this->serverReceiveMaximum;
+    }
+    if (getInflightCount() >= window) {
+        return -1;
+    }
+    if (this->inflightStore == NULL) {
+        this->inflightStore = (uint8_t*)malloc(MQTT_MAX_INFLIGHT * MQTT_INFLIGHT_PACKET_SIZE);
+        if (this->inflightStore == NULL) {
+            return -1;
+        }
+    }
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (this->inflight[i].msgId == 0) {
+            this->inflight[i].msgId = nextPacketId();
+            this->inflight[i].length = 0;
+            this->inflight[i].sentAt = 0;
+            this->inflight[i].data = this->inflightStore + i * MQTT_INFLIGHT_PACKET_SIZE;
+            this->inflight[i].version = this->protocolVersion;
+            return i;
+        }
+    }
+    return -1;
+}
+
+boolean PubSubClient::sendInflight(uint8_t slot) {
+    InflightPacket* p = &this->inflight[slot];
+    uint16_t rc = sendPacket(p->data, p->length, true);
+    p->sentAt = millis();
+    // A short write is retried by retransmitInflight() on timeout
+    return rc == p->length;
+}
+
+void PubSubClient::releaseInflight(uint16_t msgId) {
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (this->inflight[i].msgId == msgId && (int8_t)i != this->stagedSlot) {
+            this->inflight[i].msgId = 0;
+            return;
+        }
+    }
+}
+
+void PubSubClient::retransmitInflight(unsigned long now, boolean all) {
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        InflightPacket* p = &this->inflight[i];
+        if (p->msgId == 0 || (int8_t)i == this->stagedSlot) {
+            continue;
+        }
+        if (all || now - p->sentAt >= this->retryTimeout) {
+            p->data[0] |= MQTTDUP;
+            sendInflight(i);
+            this->retransmits++;
+        }
+    }
 }
 
 size_t PubSubClient::buildHeader(uint8_t header, uint8_t* buf, uint16_t length) {
@@ -583,6 +1259,7 @@ boolean PubSubClient::write(uint8_t header, uint8_t* buf, uint16_t length) {
     uint8_t hlen = buildHeader(header, buf, length);
 
 #ifdef MQTT_MAX_TRANSFER_SIZE
+    flushWrites();
     uint8_t* writeBuf = buf+(MQTT_MAX_HEADER_SIZE-hlen);
     uint16_t bytesRemaining = length+hlen;  //Match the length type
     uint8_t bytesToWrite;
@@ -596,8 +1273,7 @@ boolean PubSubClient::write(uint8_t header, uint8_t* buf, uint16_t length) {
     }
     return result;
 #else
-    rc = _client->write(buf+(MQTT_MAX_HEADER_SIZE-hlen),length+hlen);
-    lastOutActivity = millis();
+    rc = sendPacket(buf+(MQTT_MAX_HEADER_SIZE-hlen),length+hlen,(header&0xF0) == MQTTPUBLISH);
     return (rc == hlen+length);
 #endif
 }
@@ -621,12 +1297,12 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
     if (connected()) {
         // Leave room in the buffer for header and variable length field
         uint16_t length = MQTT_MAX_HEADER_SIZE;
-        nextMsgId++;
-        if (nextMsgId == 0) {
-            nextMsgId = 1;
-        }
+        nextPacketId();
         this->buffer[length++] = (nextMsgId >> 8);
         this->buffer[length++] = (nextMsgId & 0xFF);
+        if (this->protocolVersion == MQTT_VERSION_5) {
+            this->buffer[length++] = 0; // no properties
+        }
         length = writeString((char*)topic, this->buffer,length);
         this->buffer[length++] = qos;
         return write(MQTTSUBSCRIBE|MQTTQOS1,this->buffer,length-MQTT_MAX_HEADER_SIZE);
@@ -645,12 +1321,12 @@ boolean PubSubClient::unsubscribe(const char* topic) {
     }
     if (connected()) {
         uint16_t length = MQTT_MAX_HEADER_SIZE;
-        nextMsgId++;
-        if (nextMsgId == 0) {
-            nextMsgId = 1;
-        }
+        nextPacketId();
         this->buffer[length++] = (nextMsgId >> 8);
         this->buffer[length++] = (nextMsgId & 0xFF);
+        if (this->protocolVersion == MQTT_VERSION_5) {
+            this->buffer[length++] = 0; // no properties
+        }
         length = writeString(topic, this->buffer,length);
         return write(MQTTUNSUBSCRIBE|MQTTQOS1,this->buffer,length-MQTT_MAX_HEADER_SIZE);
     }
@@ -660,10 +1336,10 @@ boolean PubSubClient::unsubscribe(const char* topic) {
 void PubSubClient::disconnect() {
     this->buffer[0] = MQTTDISCONNECT;
     this->buffer[1] = 0;
-    _client->write(this->buffer,2);
+    sendPacket(this->buffer,2,false);
     _state = MQTT_DISCONNECTED;
     _client->flush();
-    _client->stop();
+    stopClient();
     lastInActivity = lastOutActivity = millis();
 }
 
@@ -691,7 +1367,7 @@ boolean PubSubClient::connected() {
             if (this->_state == MQTT_CONNECTED) {
                 this->_state = MQTT_CONNECTION_LOST;
                 _client->flush();
-                _client->stop();
+                stopClient();
             }
         } else {
             return this->_state == MQTT_CONNECTED;
@@ -756,6 +1432,107 @@ boolean PubSubClient::setBufferSize(uint16_t size) {
     return (this->buffer != NULL);
 }
 
+PubSubClient& PubSubClient::setCoalesceWindow(uint16_t windowMs) {
+    if (windowMs == 0) {
+        flushWrites();
+    }
+    this->coalesceWindow = windowMs;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setProtocolVersion(uint8_t version) {
+    this->protocolVersion = (version == MQTT_VERSION_5) ? MQTT_VERSION_5 : MQTT_VERSION;
+    return *this;
+}
+
+uint8_t PubSubClient::getProtocolVersion() {
+    return this->protocolVersion;
+}
+
+PubSubClient& PubSubClient::setMessageExpiry(uint32_t seconds) {
+    this->messageExpiry = seconds;
+    return *this;
+}
+
+uint8_t PubSubClient::getReasonCode() {
+    return this->reasonCode;
+}
+
+PubSubClient& PubSubClient::setSessionExpiry(uint32_t seconds) {
+    this->sessionExpiry = seconds;
+    return *this;
+}
+
+boolean PubSubClient::sessionPresent() {
+    return this->_sessionPresent;
+}
+
+uint32_t PubSubClient::getDuplicateCount() {
+    return this->duplicates;
+}
+
+// Returns false if msgId is a redelivery (DUP set) of a packet already seen.
+// Ids are only reused by the server after our PUBACK, so a packet without DUP
+// is always new and simply replaces any older entry. After a session resume the
+// server resends unacknowledged packets before anything new, so the ids of the
+// previous connection are checked once and forgotten at the first new packet.
+boolean PubSubClient::rememberPacketId(uint16_t msgId, boolean dup) {
+    boolean seen = false;
+    if (dup) {
+        for (uint8_t i = 0; i < MQTT_DEDUP_CACHE; i++) {
+            if (this->resumeIds[i] == msgId) {
+                // Matches one redelivery only; the id is free again after our PUBACK
+                this->resumeIds[i] = 0;
+                seen = true;
+                break;
+            }
+        }
+    } else {
+        memset(this->resumeIds, 0, sizeof(this->resumeIds));
+    }
+    for (uint8_t i = 0; i < MQTT_DEDUP_CACHE; i++) {
+        if (this->recentIds[i] == msgId) {
+            if (dup) {
+                this->duplicates++;
+                return false;
+            }
+            return true;
+        }
+    }
+    // Remember it for this connection too: our new PUBACK may be lost as well
+    this->recentIds[this->recentNext] = msgId;
+    this->recentNext = (this->recentNext + 1) % MQTT_DEDUP_CACHE;
+    if (seen) {
+        this->duplicates++;
+        return false;
+    }
+    return true;
+}
+
+PubSubClient& PubSubClient::setInflightWindow(uint8_t window) {
+    this->inflightWindow = window > MQTT_MAX_INFLIGHT ? MQTT_MAX_INFLIGHT : window;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setRetryTimeout(uint16_t timeoutMs) {
+    this->retryTimeout = timeoutMs;
+    return *this;
+}
+
+uint8_t PubSubClient::getInflightCount() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (this->inflight[i].msgId != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint32_t PubSubClient::getRetransmitCount() {
+    return this->retransmits;
+}
+
 uint16_t PubSubClient::getBufferSize() {
     return this->bufferSize;
 }
@@ -14,6 +14,7 @@
 
 #define MQTT_VERSION_3_1      3
 #define MQTT_VERSION_3_1_1    4
+#define MQTT_VERSION_5        5
 
 // MQTT_VERSION : Pick the version
 //#define MQTT_VERSION MQTT_VERSION_3_1
@@ -36,12 +37,60 @@
 #define MQTT_SOCKET_TIMEOUT 15
 #endif
 
+// MQTT_MAX_INFLIGHT : Maximum number of outbound QoS 1 PUBLISH packets awaiting
+//  PUBACK. Override the active window with setInflightWindow().
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 4
+#endif
+
+// MQTT_INFLIGHT_PACKET_SIZE : Bytes kept per in-flight QoS 1 packet so it can be
+//  retransmitted. Storage (MQTT_MAX_INFLIGHT * this) is allocated on first use.
+#ifndef MQTT_INFLIGHT_PACKET_SIZE
+#define MQTT_INFLIGHT_PACKET_SIZE 512
+#endif
+
+// MQTT_RETRY_TIMEOUT : milliseconds to wait for PUBACK before resending a QoS 1
+//  PUBLISH with the DUP flag. Override with setRetryTimeout()
+#ifndef MQTT_RETRY_TIMEOUT
+#define MQTT_RETRY_TIMEOUT 5000
+#endif
+
+// MQTT_COALESCE_SIZE : Size of the buffer used to pack several small PUBLISH
+//  packets into one network write when setCoalesceWindow() is enabled.
+#ifndef MQTT_COALESCE_SIZE
+#define MQTT_COALESCE_SIZE 1460
+#endif
+
+// MQTT_MAX_TOPIC_ALIASES : Outbound topic aliases remembered per connection in
+//  MQTT 5 mode (also limited by the server's Topic Alias Maximum).
+#ifndef MQTT_MAX_TOPIC_ALIASES
+#define MQTT_MAX_TOPIC_ALIASES 4
+#endif
+
+// MQTT_TOPIC_ALIAS_LENGTH : Longest topic that can be given an alias
+#ifndef MQTT_TOPIC_ALIAS_LENGTH
+#define MQTT_TOPIC_ALIAS_LENGTH 64
+#endif
+
+// MQTT_DEDUP_CACHE : Packet ids of recent inbound QoS 1 PUBLISH packets kept to
+//  drop redeliveries (DUP flag set) that were already passed to the callback.
+//  Ids from the previous connection only count for the redeliveries that open
+//  a resumed session.
+#ifndef MQTT_DEDUP_CACHE
+#define MQTT_DEDUP_CACHE 8
+#endif
+
+// MQTT_MAX_PUBLISH_PROPERTIES : Upper bound of the MQTT 5 PUBLISH properties we
+//  send (length byte + Message Expiry Interval + Topic Alias)
+#define MQTT_MAX_PUBLISH_PROPERTIES 9
+
 // MQTT_MAX_TRANSFER_SIZE : limit how much data is passed to the network client
 //  in each write call. Needed for the Arduino Wifi Shield. Leave undefined to
 //  pass the entire MQTT packet in each write call.
 //#define MQTT_MAX_TRANSFER_SIZE 80
 
 // Possible values for client.state()
+#define MQTT_CONNECTING             -5
 #define MQTT_CONNECTION_TIMEOUT     -4
 #define MQTT_CONNECTION_LOST        -3
 #define MQTT_CONNECT_FAILED         -2
@@ -72,6 +121,7 @@
 #define MQTTQOS0        (0 << 1)
 #define MQTTQOS1        (1 << 1)
 #define MQTTQOS2        (2 << 1)
+#define MQTTDUP         (1 << 3)
 
 // Maximum size of fixed header and variable length size header
 #define MQTT_MAX_HEADER_SIZE 5
@@ -83,7 +133,7 @@
 #define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
 #endif
 
-#define CHECK_STRING_LENGTH(l,s) if (l+2+strnlen(s, this->bufferSize) > this->bufferSize) {_client->stop();return false;}
+#define CHECK_STRING_LENGTH(l,s) if (l+2+strnlen(s, this->bufferSize) > this->bufferSize) {stopClient();return false;}
 
 class PubSubClient : public Print {
 private:
@@ -100,6 +150,7 @@ private:
    uint32_t readPacket(uint8_t*);
    boolean readByte(uint8_t * result);
    boolean readByte(uint8_t * result, uint16_t * index);
+   boolean readBytes(uint8_t * buf, uint32_t n);
    boolean write(uint8_t header, uint8_t* buf, uint16_t length);
    uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
    // Build up the header ready to send
@@ -107,11 +158,83 @@ private:
    // Note: the header is built at the end of the first MQTT_MAX_HEADER_SIZE bytes, so will start
    //       (MQTT_MAX_HEADER_SIZE - <returned size>) bytes into the buffer
    size_t buildHeader(uint8_t header, uint8_t* buf, uint16_t length);
+   boolean sendConnect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession);
+   boolean readConnack();
    IPAddress ip;
    const char* domain;
    uint16_t port;
    Stream* stream;
    int _state;
+
+   // Outbound QoS 1 PUBLISH packets awaiting PUBACK
+   struct InflightPacket {
+      uint16_t msgId;          // 0 = free slot
+      uint16_t length;
+      unsigned long sentAt;
+      uint8_t* data;
+      uint8_t version;         // protocol version the packet was encoded for
+   };
+   InflightPacket inflight[MQTT_MAX_INFLIGHT] = {};
+   uint8_t* inflightStore = NULL;
+   uint8_t inflightWindow = MQTT_MAX_INFLIGHT;
+   uint16_t retryTimeout = MQTT_RETRY_TIMEOUT;
+   int8_t stagedSlot = -1;     // slot being filled by beginPublish(..., 1)
+   uint16_t stagedLength = 0;  // full packet length expected for stagedSlot / bufferStaged
+   boolean bufferStaged = false; // QoS 0 beginPublish() being assembled in buffer
+   uint8_t stagedHeader = 0;
+   uint16_t stagedPos = 0;
+
+   // Optional write coalescing of outbound PUBLISH packets
+   uint8_t* coalesceBuffer = NULL;
+   uint16_t coalesceLength = 0;
+   uint16_t coalesceWindow = 0;
+   unsigned long coalesceStart = 0;
+   size_t sendPacket(const uint8_t* data, size_t length, boolean coalesce);
+   void stopClient();
+   uint32_t retransmits = 0;
+   uint16_t nextPacketId();
+   int8_t allocInflight(uint16_t length);
+   boolean sendInflight(uint8_t slot);
+   void releaseInflight(uint16_t msgId);
+   void retransmitInflight(unsigned long now, boolean all);
+
+   // MQTT 5 state (protocolVersion is chosen at runtime, see setProtocolVersion())
+   struct TopicAlias {
+      char topic[MQTT_TOPIC_ALIAS_LENGTH];
+      boolean established;     // server has seen topic + alias on this connection
+   };
+   struct PublishTopic {
+      const char* topic;
+      uint16_t alias;          // 0 = no alias
+      boolean aliasOnly;       // send an empty topic name
+   };
+   uint8_t protocolVersion = MQTT_VERSION;
+   uint32_t messageExpiry = 0;
+   uint8_t reasonCode = 0;
+   uint16_t serverReceiveMaximum = 0xFFFF;
+   uint16_t serverTopicAliasMaximum = 0;
+   TopicAlias topicAliases[MQTT_MAX_TOPIC_ALIASES] = {};
+   void resolveTopic(const char* topic, PublishTopic* t);
+   void commitTopicAlias(uint16_t alias);
+   void resetTopicAliases();
+   boolean expandInflightTopic(InflightPacket* p);
+   uint8_t maxPublishProperties();
+   uint16_t publishVariableLength(const PublishTopic& t, boolean hasMsgId);
+   uint16_t writePublishVariableHeader(uint8_t* buf, uint16_t pos, const PublishTopic& t, uint16_t msgId);
+   void parseConnackProperties(const uint8_t* p, uint32_t length);
+   int32_t skipProperty(const uint8_t* p, uint32_t length);
+   uint16_t stagedAlias = 0;
+
+   // Persistent sessions
+   boolean _sessionPresent = false;
+   uint32_t sessionExpiry = 0;
+   uint16_t recentIds[MQTT_DEDUP_CACHE] = {};    // this connection
+   uint8_t recentNext = 0;
+   uint16_t resumeIds[MQTT_DEDUP_CACHE] = {};    // previous connection, until resume ends
+   uint32_t duplicates = 0;
+   boolean rememberPacketId(uint16_t msgId, boolean dup);
+
+   size_t buildPublishHeader(uint8_t* buf, const PublishTopic& t, unsigned int plength, boolean retained, uint16_t msgId);
 public:
    PubSubClient();
    PubSubClient(Client& client);
@@ -139,6 +262,31 @@ public:
    PubSubClient& setKeepAlive(uint16_t keepAlive);
    PubSubClient& setSocketTimeout(uint16_t timeout);
 
+   // Hold outbound PUBLISH packets for up to windowMs and send them in one
+   // write (0 disables). Other control packets flush the pending data first.
+   PubSubClient& setCoalesceWindow(uint16_t windowMs);
+   // MQTT_VERSION_3_1_1 (default) or MQTT_VERSION_5; applies from the next connect()
+   PubSubClient& setProtocolVersion(uint8_t version);
+   uint8_t getProtocolVersion();
+   // MQTT 5: Message Expiry Interval attached to every PUBLISH (0 = never expires)
+   PubSubClient& setMessageExpiry(uint32_t seconds);
+   // MQTT 5: last reason code received in CONNACK, PUBACK or DISCONNECT
+   uint8_t getReasonCode();
+   // MQTT 5: Session Expiry Interval sent in CONNECT when cleanSession is false
+   // (0 = the server drops the session as soon as the connection closes)
+   PubSubClient& setSessionExpiry(uint32_t seconds);
+   // Session Present flag of the last accepted CONNACK: the server kept our
+   // subscriptions and will redeliver unacknowledged QoS 1 messages
+   boolean sessionPresent();
+   // Inbound QoS 1 redeliveries acknowledged without calling the callback again
+   uint32_t getDuplicateCount();
+   // Send any coalesced packets now
+   boolean flushWrites();
+   PubSubClient& setInflightWindow(uint8_t window);
+   PubSubClient& setRetryTimeout(uint16_t timeoutMs);
+   uint8_t getInflightCount();
+   uint32_t getRetransmitCount();
+
    boolean setBufferSize(uint16_t size);
    uint16_t getBufferSize();
 
@@ -147,11 +295,20 @@ public:
    boolean connect(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
    boolean connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
    boolean connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession);
+   // Non-blocking connect for callers that open the network connection
+   // themselves: beginConnect() sends CONNECT and returns at once; pollConnect()
+   // returns 1 once CONNACK accepted, 0 while waiting, -1 on failure (see state()).
+   boolean beginConnect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession);
+   int pollConnect();
    void disconnect();
    boolean publish(const char* topic, const char* payload);
    boolean publish(const char* topic, const char* payload, boolean retained);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // QoS 1: the packet is kept until PUBACK and resent with DUP after the retry
+   // timeout. Returns false if the in-flight window is full or the packet does
+   // not fit in MQTT_INFLIGHT_PACKET_SIZE.
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, uint8_t qos);
    boolean publish_P(const char* topic, const char* payload, boolean retained);
    boolean publish_P(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
    // Start to publish a message.
@@ -159,10 +316,15 @@ public:
    //   beginPublish(...)
    //   one or more calls to write(...)
    //   endPublish()
-   // Allows for arbitrarily large payloads to be sent without them having to be copied into
-   // a new buffer and held in memory at one time
+   // Allows for arbitrarily large payloads to be sent without them having to be held in
+   // memory at one time. A QoS 0 packet that fits in the buffer is assembled there and
+   // sent by endPublish() in one write; a larger one sends its header now and each
+   // write(...) goes straight to the network. While a packet is being assembled in the
+   // buffer, loop() leaves incoming packets unread until endPublish()
    // Returns 1 if the message was started successfully, 0 if there was an error
    boolean beginPublish(const char* topic, unsigned int plength, boolean retained);
+   // As above with QoS 1: the payload is staged in an in-flight slot and sent by endPublish()
+   boolean beginPublish(const char* topic, unsigned int plength, boolean retained, uint8_t qos);
    // Finish off this publish message (started with beginPublish)
    // Returns 1 if the packet was sent successfully, 0 if there was an error
    int endPublish();
@@ -0,0 +1,137 @@
+// Header include.
+#include "Callback_Index.h"
+
+// Library includes.
+#include <new>
+#include <string.h>
+
+// Initial table size, enough for a handful of callbacks without growing
+constexpr size_t INITIAL_INDEX_CAPACITY = 16U;
+// FNV-1a 32-bit parameters, see http://www.isthe.com/chongo/tech/comp/fnv/
+constexpr uint32_t FNV_OFFSET_BASIS = 2166136261U;
+constexpr uint32_t FNV_PRIME = 16777619U;
+
+constexpr size_t Callback_Index::NOT_FOUND;
+
+Callback_Index::Callback_Index() :
+    m_slots(nullptr),
+    m_capacity(0U),
+    m_size(0U),
+    m_complete(true)
+{
+    // Nothing to do
+}
+
+Callback_Index::~Callback_Index() {
+    delete[] m_slots;
+    m_slots = nullptr;
+}
+
+void Callback_Index::clear() {
+    for (size_t i = 0; i < m_capacity; i++) {
+        m_slots[i].key = nullptr;
+    }
+    m_size = 0U;
+    m_complete = true;
+}
+
+size_t Callback_Index::size() const {
+    return m_size;
+}
+
+bool Callback_Index::complete() const {
+    return m_complete;
+}
+
+bool Callback_Index::insert(const char *key, const size_t& length, const size_t& callback) {
+    // Keys and callback indices have to fit into the packed slot, otherwise the caller has to fall back to the linear search
+    if (key == nullptr || length > UINT16_MAX || callback > UINT16_MAX) {
+        m_complete = false;
+        return false;
+    }
+
+    // Keep the load factor below 3/4, so that probe sequences stay short and there is always an empty slot to terminate a search
+    if ((m_size + 1U) * 4U > m_capacity * 3U) {
+        const size_t capacity = (m_capacity == 0U) ? INITIAL_INDEX_CAPACITY : m_capacity * 2U;
+        if (!grow(capacity)) {
+            m_complete = false;
+            return false;
+        }
+    }
+
+    Slot slot;
+    slot.key = key;
+    slot.hash = hash(key, length);
+    slot.length = length;
+    slot.callback = callback;
+    place(slot);
+    m_size++;
+    return true;
+}
+
+size_t Callback_Index::find(const char *key, const size_t& length, size_t& cursor) const {
+    if (m_size == 0U || key == nullptr) {
+        return NOT_FOUND;
+    }
+
+    const size_t mask = m_capacity - 1U;
+    const uint32_t key_hash = hash(key, length);
+
+    // Cursor counts the already probed slots, so that repeated calls continue after the last match
+    for (; cursor < m_capacity; cursor++) {
+        const Slot& slot = m_slots[(key_hash + cursor) & mask];
+        if (slot.key == nullptr) {
+            // Reached the end of the probe sequence, ensure further calls do not restart the search
+            cursor = m_capacity;
+            break;
+        }
+        if (slot.hash == key_hash && slot.length == length && strncmp(slot.key, key, length) == 0) {
+            cursor++;
+            return slot.callback;
+        }
+    }
+    return NOT_FOUND;
+}
+
+uint32_t Callback_Index::hash(const char *key, const size_t& length) {
+    uint32_t result = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < length; i++) {
+        result = (result ^ static_cast<uint8_t>(key[i])) * FNV_PRIME;
+    }
+    return result;
+}
+
+bool Callback_Index::grow(const size_t& capacity) {
+    Slot *previous = m_slots;
+    const size_t previousCapacity = m_capacity;
+
+    // Plain new would throw or abort instead of returning nullptr, the caller falls back to the linear search instead
+    m_slots = new (std::nothrow) Slot[capacity];
+    if (m_slots == nullptr) {
+        m_slots = previous;
+        return false;
+    }
+    m_capacity = capacity;
+    for (size_t i = 0; i < m_capacity; i++) {
+        m_slots[i].key = nullptr;
+    }
+
+    // Slots are visited in table order, which does not keep the insertion order of equal keys,
+    // callers that need the first subscribed callback therefore have to compare the returned indices
+    for (size_t i = 0; i < previousCapacity; i++) {
+        if (previous[i].key != nullptr) {
+            place(previous[i]);
+        }
+    }
+    delete[] previous;
+    return true;
+}
+
+void Callback_Index::place(const Slot& slot) {
+    const size_t mask = m_capacity - 1U;
+    size_t position = slot.hash & mask;
+    while (m_slots[position].key != nullptr) {
+        position = (position + 1U) & mask;
+    }
+    m_slots[position] = slot;
+}
@@ -0,0 +1,86 @@
+#ifndef Callback_Index_h
+#define Callback_Index_h
+
+// Library includes.
+#include <stddef.h>
+#include <stdint.h>
+
+
+/// @brief Open addressing hash map from a string key (server-side RPC method name or shared attribute key),
+/// to the index of the callback that subscribed it in the vector of the ThingsBoardSized instance.
+/// Allows to dispatch received messages with one FNV-1a hash and on average a single probe per key,
+/// instead of comparing the received key with every subscribed callback.
+/// Keys are not copied, only the pointer and length are kept, therefore they have to outlive the index, which is already required for the callbacks themselves.
+/// The same key can be inserted for multiple callbacks, find() then returns all of them one after another.
+/// There is no erase, because the callbacks can only be unsubscribed all at once, in that case clear() is called and the index is rebuilt on the next subscribe.
+/// If the table could not be allocated the index is marked as incomplete and the caller is expected to fall back to the linear search, until clear() is called
+class Callback_Index {
+  public:
+    /// @brief Returned by find() if there are no more callbacks subscribed to the given key
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    /// @brief Constructor
+    Callback_Index();
+
+    /// @brief Destructor
+    ~Callback_Index();
+
+    Callback_Index(const Callback_Index&) = delete;
+    Callback_Index& operator=(const Callback_Index&) = delete;
+
+    /// @brief Removes all keys, keeps the already allocated table so resubscribing does not allocate again
+    void clear();
+
+    /// @brief Gets the amount of keys currently inserted into the index
+    /// @return Amount of key and callback index pairs
+    size_t size() const;
+
+    /// @brief Whether every insert since the last call to clear() was successful,
+    /// if not the index can not be used to dispatch, because it might be missing some callbacks
+    /// @return Whether the index contains every inserted key
+    bool complete() const;
+
+    /// @brief Inserts the given key for the given callback index, grows the table if the load factor would exceed 3/4
+    /// @param key Pointer to the key, does not have to be null-terminated and is not copied
+    /// @param length Length of the given key
+    /// @param callback Index of the callback in the callback vector
+    /// @return Whether the key was inserted successfully
+    bool insert(const char *key, const size_t& length, const size_t& callback);
+
+    /// @brief Finds the next callback subscribed to the given key, should be called repeatedly with the same cursor until NOT_FOUND is returned
+    /// @param key Pointer to the key, does not have to be null-terminated
+    /// @param length Length of the given key
+    /// @param cursor Position to continue the search from, has to be 0 on the first call and is advanced by each call
+    /// @return Index of the callback in the callback vector or NOT_FOUND if there are no further matches
+    size_t find(const char *key, const size_t& length, size_t& cursor) const;
+
+    /// @brief Calculates the 32-bit FNV-1a hash of the given key
+    /// @param key Pointer to the key, does not have to be null-terminated
+    /// @param length Length of the given key
+    /// @return Hash of the given key
+    static uint32_t hash(const char *key, const size_t& length);
+
+  private:
+    struct Slot {
+      const char *key;      // Pointer to the subscribed key, nullptr marks an empty slot
+      uint32_t   hash;      // Cached hash, allows to skip the string compare for nearly every colliding slot
+      uint16_t   length;    // Length of the subscribed key
+      uint16_t   callback;  // Index of the callback in the callback vector
+    };
+
+    /// @brief Rehashes all keys into a new table with the given capacity
+    /// @param capacity Amount of slots in the new table, has to be a power of two
+    /// @return Whether allocating the new table was successful
+    bool grow(const size_t& capacity);
+
+    /// @brief Places the given slot into the first empty slot of its probe sequence, expects the table to contain atleast one empty slot
+    /// @param slot Slot that should be placed into the current table
+    void place(const Slot& slot);
+
+    Slot   *m_slots;     // Table of slots, size is always a power of two so the probe can use a mask instead of a modulo
+    size_t m_capacity;   // Amount of slots in the table
+    size_t m_size;       // Amount of used slots
+    bool   m_complete;   // Whether all inserts since the last clear() were successful
+};
+
+#endif // Callback_Index_h
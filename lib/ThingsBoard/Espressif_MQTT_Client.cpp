@@ -1,6 +1,9 @@
 // Header include.
 #include "Espressif_MQTT_Client.h"
 
+// Library includes.
+#include <string.h>
+
 #if THINGSBOARD_USE_ESP_MQTT
 
 // The error integer -1 means a general failure while handling the mqtt client,
@@ -8,6 +11,8 @@
 // Therefore we have to check if the value is smaller or equal to the MQTT_FAILURE_MESSAGE_ID,
 // to ensure other errors are indentified as well
 constexpr int MQTT_FAILURE_MESSAGE_ID = -1;
+// Longest topic of a received message that is passed to the callback, longer topics are discarded
+constexpr size_t MAX_RECEIVED_TOPIC_LENGTH = 128U;
 
 Espressif_MQTT_Client *Espressif_MQTT_Client::m_instance = nullptr;
 
@@ -278,7 +283,14 @@ void Espressif_MQTT_Client::mqtt_event_handler(void *handler_args, esp_event_bas
             }
 
             if (m_received_data_callback != nullptr) {
-                m_received_data_callback(event->topic, reinterpret_cast<uint8_t*>(event->data), event->data_len);
+                // The topic points directly into the receive buffer and is not null-terminated,
+                // therefore it has to be copied before it can be passed to the callback as a string
+                if (event->topic_len < 0 || static_cast<size_t>(event->topic_len) >= MAX_RECEIVED_TOPIC_LENGTH) {
+                    break;
+                }
+                char topic[MAX_RECEIVED_TOPIC_LENGTH] = {};
+                memcpy(topic, event->topic, event->topic_len);
+                m_received_data_callback(topic, reinterpret_cast<uint8_t*>(event->data), event->data_len);
             }
             break;
         case esp_mqtt_event_id_t::MQTT_EVENT_ERROR:
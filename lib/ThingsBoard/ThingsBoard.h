@@ -4,6 +4,7 @@
 // Local includes.
 #include "Constants.h"
 #include "Vector.h"
+#include "Callback_Index.h"
 #include "Helper.h"
 #include "ThingsBoardDefaultLogger.h"
 #include "Shared_Attribute_Callback.h"
@@ -339,6 +340,9 @@ class ThingsBoardSized {
       , m_rpc_request_callbacks()
       , m_shared_attribute_update_callbacks()
       , m_attribute_request_callbacks()
+      , m_rpc_index()
+      , m_shared_attribute_index()
+      , m_shared_attribute_matches()
       , m_provision_callback()
       , m_request_id(0U)
 #if THINGSBOARD_ENABLE_OTA
@@ -777,7 +781,9 @@ class ThingsBoardSized {
       }
 
       // Push back complete vector into our local m_rpc_callbacks vector.
+      const size_t first = m_rpc_callbacks.size();
       m_rpc_callbacks.insert(m_rpc_callbacks.end(), first_itr, last_itr);
+      index_rpc_callbacks(first);
       return true;
     }
 
@@ -802,9 +808,11 @@ class ThingsBoardSized {
         return false;
       }
 
+      const size_t first = m_rpc_callbacks.size();
       for (size_t i = 0; i < callbacksSize; i++) {
         m_rpc_callbacks.push_back(callbacks[i]);
       }
+      index_rpc_callbacks(first);
       return true;
     }
 
@@ -829,6 +837,7 @@ class ThingsBoardSized {
 
       // Push back given callback into our local vector
       m_rpc_callbacks.push_back(callback);
+      index_rpc_callbacks(m_rpc_callbacks.size() - 1U);
       return true;
     }
 
@@ -839,6 +848,7 @@ class ThingsBoardSized {
     inline bool RPC_Unsubscribe() {
       // Empty all callbacks
       m_rpc_callbacks.clear();
+      m_rpc_index.clear();
       return m_client.unsubscribe(RPC_SUBSCRIBE_TOPIC);
     }
 
@@ -1022,7 +1032,9 @@ class ThingsBoardSized {
       }
 
       // Push back complete vector into our local m_shared_attribute_update_callbacks vector.
+      const size_t first = m_shared_attribute_update_callbacks.size();
       m_shared_attribute_update_callbacks.insert(m_shared_attribute_update_callbacks.end(), first_itr, last_itr);
+      index_shared_attribute_callbacks(first);
       return true;
     }
 
@@ -1047,9 +1059,11 @@ class ThingsBoardSized {
         return false;
       }
 
+      const size_t first = m_shared_attribute_update_callbacks.size();
       for (size_t i = 0; i < callbacksSize; i++) {
         m_shared_attribute_update_callbacks.push_back(callbacks[i]);
       }
+      index_shared_attribute_callbacks(first);
       return true;
     }
 
@@ -1074,6 +1088,7 @@ class ThingsBoardSized {
 
       // Push back given callback into our local vector
       m_shared_attribute_update_callbacks.push_back(callback);
+      index_shared_attribute_callbacks(m_shared_attribute_update_callbacks.size() - 1U);
       return true;
     }
 
@@ -1084,6 +1099,8 @@ class ThingsBoardSized {
     inline bool Shared_Attributes_Unsubscribe() {
       // Empty all callbacks
       m_shared_attribute_update_callbacks.clear();
+      m_shared_attribute_index.clear();
+      m_shared_attribute_matches.clear();
       return m_client.unsubscribe(ATTRIBUTE_TOPIC);
     }
   
@@ -1453,6 +1470,7 @@ class ThingsBoardSized {
       m_rpc_callbacks.reserve(reservedSize);
       m_rpc_request_callbacks.reserve(reservedSize);
       m_shared_attribute_update_callbacks.reserve(reservedSize);
+      m_shared_attribute_matches.reserve(reservedSize);
       m_attribute_request_callbacks.reserve(reservedSize);
     }
 #endif // !THINGSBOARD_ENABLE_DYNAMIC
@@ -1594,19 +1612,36 @@ class ThingsBoardSized {
       }
     }
 
-    /// @brief Process callback that will be called upon server-side RPC request arrival
-    /// and is responsible for handling the payload and calling the appropriate previously subscribed callbacks
-    /// @param topic Previously subscribed topic, we got the response over
-    /// @param data Payload sent by the server over our given topic, that contains our key value pairs
-    inline void process_rpc_message(char *topic, const JsonObjectConst& data) {
-      const char *methodName = data[RPC_METHOD_KEY].as<const char *>();
-
-      if (methodName == nullptr) {
-        Logger::log(RPC_METHOD_NULL);
-        return;
+    /// @brief Adds the method names of the server-side RPC callbacks starting at the given index into the hashed index,
+    /// has to be called after every subscribe, callbacks without a method name are skipped and only found by the linear search
+    /// @param first Index of the first callback in m_rpc_callbacks that has not been indexed yet
+    inline void index_rpc_callbacks(const size_t& first) {
+      for (size_t i = first; i < m_rpc_callbacks.size(); i++) {
+        const char *subscribedMethodName = m_rpc_callbacks[i].Get_Name();
+        if (subscribedMethodName == nullptr) {
+          continue;
+        }
+        m_rpc_index.insert(subscribedMethodName, strlen(subscribedMethodName), i);
+      }
+    }
+
+    /// @brief Finds the server-side RPC callback subscribed to the given method name.
+    /// An exactly matching method name is looked up in the hashed index and if multiple callbacks subscribed the same name the first subscribed one is returned,
+    /// only if there is none or the index could not be built completly, the callbacks are compared one by one with the received method name as a prefix, like before the index existed
+    /// @param methodName Method name received from the server
+    /// @return Pointer to the callback in m_rpc_callbacks or nullptr if no callback is subscribed to the given method name
+    inline const RPC_Callback* find_rpc_callback(const char *methodName) {
+      if (m_rpc_index.complete()) {
+        const size_t length = strlen(methodName);
+        size_t cursor = 0U;
+        size_t first = Callback_Index::NOT_FOUND;
+        for (size_t i = m_rpc_index.find(methodName, length, cursor); i != Callback_Index::NOT_FOUND; i = m_rpc_index.find(methodName, length, cursor)) {
+          first = (i < first) ? i : first;
+        }
+        if (first != Callback_Index::NOT_FOUND) {
+          return &m_rpc_callbacks[first];
+        }
       }
- 
-      RPC_Response response;
 
       for (const RPC_Callback& rpc : m_rpc_callbacks) {
         const char *subscribedMethodName = rpc.Get_Name();
@@ -1619,7 +1654,27 @@ class ThingsBoardSized {
         else if (strncmp(subscribedMethodName, methodName, strlen(subscribedMethodName)) != 0) {
           continue;
         }
+        return &rpc;
+      }
+      return nullptr;
+    }
+
+    /// @brief Process callback that will be called upon server-side RPC request arrival
+    /// and is responsible for handling the payload and calling the appropriate previously subscribed callbacks
+    /// @param topic Previously subscribed topic, we got the response over
+    /// @param data Payload sent by the server over our given topic, that contains our key value pairs
+    inline void process_rpc_message(char *topic, const JsonObjectConst& data) {
+      const char *methodName = data[RPC_METHOD_KEY].as<const char *>();
+
+      if (methodName == nullptr) {
+        Logger::log(RPC_METHOD_NULL);
+        return;
+      }
+ 
+      RPC_Response response;
+      const RPC_Callback *rpc = find_rpc_callback(methodName);
 
+      if (rpc != nullptr) {
         // Do not inform client, if parameter field is missing for some reason
         if (!data.containsKey(RPC_PARAMS_KEY)) {
 #if THINGSBOARD_ENABLE_DEBUG
@@ -1634,8 +1689,7 @@ class ThingsBoardSized {
 #endif // THINGSBOARD_ENABLE_DEBUG
 
         const JsonVariantConst param = data[RPC_PARAMS_KEY].as<JsonVariantConst>();
-        response = rpc.Call_Callback<Logger>(param);
-        break;
+        response = rpc->Call_Callback<Logger>(param);
       }
 
       if (response.isNull()) {
@@ -1708,6 +1762,63 @@ class ThingsBoardSized {
 
 #endif // THINGSBOARD_ENABLE_OTA
 
+    /// @brief Adds the subscribed keys of the shared attribute callbacks starting at the given index into the hashed index,
+    /// has to be called after every subscribe, callbacks without any keys are not indexed, because they are called for every update anyway.
+    /// Additionally grows the buffer of matched keys used while dispatching, so it always has one entry per callback
+    /// @param first Index of the first callback in m_shared_attribute_update_callbacks that has not been indexed yet
+    inline void index_shared_attribute_callbacks(const size_t& first) {
+      for (size_t i = first; i < m_shared_attribute_update_callbacks.size(); i++) {
+        m_shared_attribute_matches.push_back(nullptr);
+#if THINGSBOARD_ENABLE_STL
+        for (const char *att : m_shared_attribute_update_callbacks[i].Get_Attributes()) {
+          if (att == nullptr) {
+#if THINGSBOARD_ENABLE_DEBUG
+            Logger::log(ATT_IS_NULL);
+#endif // THINGSBOARD_ENABLE_DEBUG
+            continue;
+          }
+          m_shared_attribute_index.insert(att, strlen(att), i);
+        }
+#else
+        const char *att = m_shared_attribute_update_callbacks[i].Get_Attributes();
+        // Keys are inserted as pointer and length into the comma seperated string, which therefore does not need to be copied or split into temporary strings
+        while (att != nullptr) {
+          const char *next = strchr(att, COMMA);
+          const size_t length = (next == nullptr) ? strlen(att) : static_cast<size_t>(next - att);
+          m_shared_attribute_index.insert(att, length, i);
+          att = (next == nullptr) ? nullptr : next + 1U;
+        }
+#endif // THINGSBOARD_ENABLE_STL
+      }
+    }
+
+    /// @brief Checks whether the given shared attribute callback subscribed the given key,
+    /// used to dispatch the update if the hashed index could not be built completly
+    /// @param shared_attribute Callback whose subscribed keys should be compared
+    /// @param key Key received from the server, does not have to be null-terminated
+    /// @param length Length of the given key
+    /// @return Whether the given key was subscribed by the callback
+    inline bool contains_shared_attribute(const Shared_Attribute_Callback& shared_attribute, const char *key, const size_t& length) const {
+#if THINGSBOARD_ENABLE_STL
+      for (const char *att : shared_attribute.Get_Attributes()) {
+        if (att != nullptr && strlen(att) == length && strncmp(att, key, length) == 0) {
+          return true;
+        }
+      }
+#else
+      const char *att = shared_attribute.Get_Attributes();
+      while (att != nullptr) {
+        const char *next = strchr(att, COMMA);
+        const size_t att_length = (next == nullptr) ? strlen(att) : static_cast<size_t>(next - att);
+        if (att_length == length && strncmp(att, key, length) == 0) {
+          return true;
+        }
+        att = (next == nullptr) ? nullptr : next + 1U;
+      }
+#endif // THINGSBOARD_ENABLE_STL
+      return false;
+    }
+
     /// @brief Process callback that will be called upon shared attribute update arrival
     /// and is responsible for handling the payload and calling the appropriate previously subscribed callbacks
     /// @param topic Previously subscribed topic, we got the response over
@@ -1724,7 +1835,39 @@ class ThingsBoardSized {
         data = data[SHARED_RESPONSE_KEY];
       }
 
-      for (const Shared_Attribute_Callback& shared_attribute : m_shared_attribute_update_callbacks) {
+      const size_t callbacks = m_shared_attribute_update_callbacks.size();
+      if (callbacks == 0U) {
+        return;
+      }
+
+      // Each received key is looked up once instead of comparing every subscribed key of every callback with the update,
+      // the first matched key is remembered per callback, so that the callbacks are still called only once and in the order they were subscribed
+      Vector<const char *>& requested_att = m_shared_attribute_matches;
+      for (size_t i = 0; i < callbacks; i++) {
+        requested_att[i] = nullptr;
+      }
+
+      for (const JsonPairConst kv : data) {
+        const char *key = kv.key().c_str();
+        const size_t length = kv.key().size();
+        if (m_shared_attribute_index.complete()) {
+          size_t cursor = 0U;
+          for (size_t i = m_shared_attribute_index.find(key, length, cursor); i != Callback_Index::NOT_FOUND; i = m_shared_attribute_index.find(key, length, cursor)) {
+            if (requested_att[i] == nullptr) {
+              requested_att[i] = key;
+            }
+          }
+          continue;
+        }
+        for (size_t i = 0; i < callbacks; i++) {
+          if (requested_att[i] == nullptr && contains_shared_attribute(m_shared_attribute_update_callbacks[i], key, length)) {
+            requested_att[i] = key;
+          }
+        }
+      }
+
+      for (size_t i = 0; i < callbacks; i++) {
+        const Shared_Attribute_Callback& shared_attribute = m_shared_attribute_update_callbacks[i];
 #if THINGSBOARD_ENABLE_STL
         if (shared_attribute.Get_Attributes().empty()) {
 #else
@@ -1738,51 +1881,9 @@ class ThingsBoardSized {
           continue;
         }
 
-        bool containsKey = false;
-        const char *requested_att = nullptr;
-
-#if THINGSBOARD_ENABLE_STL
-        for (const char *att : shared_attribute.Get_Attributes()) {
-#else
-        String stringToSplit = shared_attribute.Get_Attributes();
-        int32_t previousIndex = 0;
-        int32_t currentIndex = 0;
-
-        do {
-          // Find the index of the next comma in the string
-          currentIndex = stringToSplit.indexOf(COMMA, previousIndex);
-        
-          // If no more commas are found, set the currentIndex to the end of the string
-          if (currentIndex == -1) {
-            currentIndex = stringToSplit.length();
-          }
-
-          // Extract the attribute from the original string
-          const char *att = stringToSplit.substring(previousIndex, currentIndex).c_str();
-#endif // THINGSBOARD_ENABLE_STL
-          if (att == nullptr) {
-#if THINGSBOARD_ENABLE_DEBUG
-            Logger::log(ATT_IS_NULL);
-#endif // THINGSBOARD_ENABLE_DEBUG
-            continue;
-          }
-          // Check if the request contained any of our requested keys.
-          containsKey = containsKey || data.containsKey(att);
-          // Break early if the key was requested from this callback.
-          if (containsKey) {
-            requested_att = att;
-            break;
-          }
-#if THINGSBOARD_ENABLE_STL
-        }
-#else
-          previousIndex = currentIndex + 1;
-        } while (currentIndex != stringToSplit.length());
-#endif // THINGSBOARD_ENABLE_STL
-
         // This callback did not request any keys that were in this response,
         // therefore we continue with the next element in the loop.
-        if (!containsKey || requested_att == nullptr) {
+        if (requested_att[i] == nullptr) {
 #if THINGSBOARD_ENABLE_DEBUG
           Logger::log(ATT_NO_CHANGE);
 #endif // THINGSBOARD_ENABLE_DEBUG
@@ -1790,8 +1891,8 @@ class ThingsBoardSized {
         }
 
 #if THINGSBOARD_ENABLE_DEBUG
-        char calling_message[JSON_STRING_SIZE(strlen(CALLING_ATT_CB)) + JSON_STRING_SIZE(strlen(requested_att))];
-        snprintf_P(calling_message, sizeof(calling_message), CALLING_ATT_CB, requested_att);
+        char calling_message[JSON_STRING_SIZE(strlen(CALLING_ATT_CB)) + JSON_STRING_SIZE(strlen(requested_att[i]))];
+        snprintf_P(calling_message, sizeof(calling_message), CALLING_ATT_CB, requested_att[i]);
         Logger::log(calling_message);
 #endif // THINGSBOARD_ENABLE_DEBUG
 
@@ -1932,6 +2033,9 @@ class ThingsBoardSized {
     Vector<RPC_Request_Callback> m_rpc_request_callbacks; // Client side RPC callbacks vector, replacement for non C++ STL boards
     Vector<Shared_Attribute_Callback> m_shared_attribute_update_callbacks; // Shared attribute update callbacks vector, replacement for non C++ STL boards
     Vector<Attribute_Request_Callback> m_attribute_request_callbacks; // Client-side or shared attribute request callback vector, replacement for non C++ STL boards
+    Callback_Index m_rpc_index; // Method name to index in m_rpc_callbacks, allows to dispatch server side RPC requests without comparing every subscribed method name
+    Callback_Index m_shared_attribute_index; // Attribute key to index in m_shared_attribute_update_callbacks, allows to dispatch shared attribute updates without comparing every subscribed key
+    Vector<const char *> m_shared_attribute_matches; // First received key that matched each shared attribute callback, kept the same size as m_shared_attribute_update_callbacks so dispatching does not need to allocate
 
     Provision_Callback m_provision_callback; // Provision response callback
     size_t m_request_id; // Allows nearly 4.3 million requests before wrapping back to 0
@@ -0,0 +1,387 @@
+// Hiện thực Arduino/FreeRTOS/WiFi tối thiểu trên POSIX cho fleet simulator
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <LittleFS.h>
+#include "sim_device.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+bool sim_verbose = false;
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+TwoWire Wire;
+FS LittleFS;
+
+// ==================== ARDUINO CORE ====================
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+    sched_yield();
+}
+
+uint32_t esp_random() {
+    static thread_local std::mt19937 rng(std::random_device{}() ^ (uint32_t)getpid());
+    return rng();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t size) {
+    if (sim_verbose) {
+        fwrite(buf, 1, size, stderr);
+    }
+    return size;
+}
+
+// ==================== FREERTOS ====================
+struct SimTask {
+    std::mutex m;
+    std::condition_variable cv;
+    uint32_t notify = 0;
+};
+
+struct SimSemaphore {
+    std::mutex m;
+    std::condition_variable cv;
+    int count;
+    bool isStatic = false;     // dựng trong StaticSemaphore_t của caller, không free
+};
+static_assert(sizeof(SimSemaphore) <= sizeof(StaticSemaphore_t), "StaticSemaphore_t too small");
+
+// Ring buffer cấp 1 lần lúc tạo, send/receive không cấp phát
+struct SimQueue {
+    std::mutex m;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<uint8_t> items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+};
+
+static thread_local SimTask *currentTask = nullptr;
+
+static SimTask *taskSelf() {
+    if (currentTask == nullptr) {
+        currentTask = new SimTask();   // thread không tạo qua xTaskCreate (vd main)
+    }
+    return currentTask;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth,
+                       void *param, UBaseType_t priority, TaskHandle_t *handle) {
+    SimTask *task = new SimTask();
+    if (handle) *handle = task;
+    std::thread([task, fn, param]() {
+        currentTask = task;
+        fn(param);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth,
+                                   void *param, UBaseType_t priority, TaskHandle_t *handle, int core) {
+    return xTaskCreate(fn, name, stackDepth, param, priority, handle);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return taskSelf();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks * portTICK_PERIOD_MS);
+}
+
+TickType_t xTaskGetTickCount() {
+    return millis() / portTICK_PERIOD_MS;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->m);
+        task->notify++;
+    }
+    task->cv.notify_one();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    SimTask *task = taskSelf();
+    std::unique_lock<std::mutex> lock(task->m);
+    auto ready = [task]() { return task->notify > 0; };
+    if (ticks == portMAX_DELAY) {
+        task->cv.wait(lock, ready);
+    } else {
+        task->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+    }
+    uint32_t value = task->notify;
+    if (value > 0) {
+        task->notify = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    SimSemaphore *sem = new SimSemaphore();
+    sem->count = 0;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SimSemaphore *sem = new SimSemaphore();
+    sem->count = 1;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+    SimSemaphore *sem = new (buffer->storage) SimSemaphore();
+    sem->count = 0;
+    sem->isStatic = true;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    SimSemaphore *sem = new (buffer->storage) SimSemaphore();
+    sem->count = 1;
+    sem->isStatic = true;
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if (sem->isStatic) {
+        sem->~SimSemaphore();
+    } else {
+        delete sem;
+    }
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(sem->m);
+    auto ready = [sem]() { return sem->count > 0; };
+    if (ticks == portMAX_DELAY) {
+        sem->cv.wait(lock, ready);
+    } else if (!sem->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready)) {
+        return pdFALSE;
+    }
+    sem->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    {
+        std::lock_guard<std::mutex> lock(sem->m);
+        if (sem->count > 0) return pdFALSE;
+        sem->count++;
+    }
+    sem->cv.notify_one();
+    return pdTRUE;
+}
+
+// Chờ cv tới khi ready() hoặc hết ticks (portMAX_DELAY = chờ mãi)
+template <class Ready>
+static bool waitTicks(std::condition_variable &cv, std::unique_lock<std::mutex> &lock,
+                      TickType_t ticks, Ready ready) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    SimQueue *queue = new SimQueue();
+    queue->items.resize(length * itemSize);
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->m);
+    if (!waitTicks(queue->notFull, lock, ticks, [queue]() { return queue->count < queue->length; })) {
+        return pdFALSE;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    lock.unlock();
+    queue->notEmpty.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->m);
+    if (!waitTicks(queue->notEmpty, lock, ticks, [queue]() { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    memcpy(item, &queue->items[queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    lock.unlock();
+    queue->notFull.notify_one();
+    return pdTRUE;
+}
+
+// ==================== WIFI / TCP ====================
+int WiFiClass::hostByName(const char *host, IPAddress &result) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *res = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &res) != 0 || res == nullptr) {
+        return 0;
+    }
+    result = IPAddress((uint32_t)((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(res);
+    return 1;
+}
+
+void configTime(long gmtOffset, int daylightOffset, const char *server1,
+                const char *server2, const char *server3) {}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+    IPAddress ip;
+    if (!ip.fromString(host) && WiFi.hostByName(host, ip) != 1) {
+        return 0;
+    }
+    return connect(ip, port);
+}
+
+// Connect không chặn + poll để giới hạn thời gian, sau đó để socket ở chế độ chặn
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+    stop();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = ::connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, timeoutMs) == 1 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+            rc = 0;
+        }
+    }
+    if (rc < 0) {
+        close(fd);
+        return 0;
+    }
+    fcntl(fd, F_SETFL, flags);
+    _fd = fd;
+    setNoDelay(true);
+    return 1;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size) {
+    size_t sent = 0;
+    while (_fd >= 0 && sent < size) {
+        ssize_t n = send(_fd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            stop();
+            break;
+        }
+        sent += n;
+    }
+    return sent;
+}
+
+int WiFiClient::available() {
+    if (_fd < 0) return 0;
+    int n = 0;
+    if (ioctl(_fd, FIONREAD, &n) < 0) return 0;
+    return n;
+}
+
+int WiFiClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size) {
+    if (_fd < 0) return -1;
+    ssize_t n = recv(_fd, buf, size, MSG_DONTWAIT);
+    if (n == 0) {
+        stop();   // peer đóng kết nối
+        return -1;
+    }
+    return n < 0 ? -1 : (int)n;
+}
+
+int WiFiClient::peek() {
+    uint8_t b;
+    if (_fd < 0 || recv(_fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) != 1) return -1;
+    return b;
+}
+
+void WiFiClient::stop() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+uint8_t WiFiClient::connected() {
+    if (_fd < 0) return 0;
+    uint8_t b;
+    ssize_t n = recv(_fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+int WiFiClient::setNoDelay(bool on) {
+    int flag = on ? 1 : 0;
+    return _fd >= 0 ? setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) : -1;
+}
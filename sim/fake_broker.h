@@ -0,0 +1,344 @@
+#ifndef __SIM_FAKE_BROKER_H__
+#define __SIM_FAKE_BROKER_H__
+
+#include <Arduino.h>
+#include <Client.h>
+#include <PubSubClient.h>   // hằng số packet MQTT
+
+// Broker MQTT giả trong bộ nhớ, cắm thẳng vào PubSubClient qua interface Client
+// (không socket, không thread). Hiểu CONNECT/PUBLISH/SUBSCRIBE/PINGREQ/DISCONNECT
+// của 3.1.1 và 5, trả CONNACK/SUBACK/PUBACK/PINGRESP. Dùng toàn buffer cố định
+// để test đếm cấp phát heap không đếm nhầm phần của broker.
+//
+// Điều khiển PUBACK cho test cửa sổ in-flight/gửi lại:
+//   pubackDelayMs : PUBACK chỉ đọc được sau chừng này ms
+//   holdPubacks   : giữ PUBACK tới khi gọi releasePubacks()
+//   dropPubacks   : bỏ hẳn n PUBACK tiếp theo (client phải gửi lại với DUP)
+
+#define FAKE_BROKER_RX_SIZE      8192
+#define FAKE_BROKER_TX_SIZE      4096
+#define FAKE_BROKER_LOG_SIZE     64
+#define FAKE_BROKER_PENDING      32
+#define FAKE_BROKER_TOPIC_SIZE   64
+#define FAKE_BROKER_PAYLOAD_SIZE 1024
+#define FAKE_BROKER_ALIASES      8
+
+struct FakePublish {
+    char     topic[FAKE_BROKER_TOPIC_SIZE];   // đã tra alias nếu topic rỗng
+    uint16_t alias;                           // Topic Alias trong packet (MQTT 5), 0 = không có
+    uint16_t msgId;
+    uint8_t  qos;
+    bool     dup;
+    uint32_t expiry;                          // Message Expiry Interval (MQTT 5), 0 = không có
+    uint16_t payloadLength;
+    uint16_t wireLength;                      // cả packet: fixed header + variable header + payload
+};
+
+class FakeBroker : public Client {
+public:
+    // ---- Cấu hình ----
+    uint8_t  connackCode = 0;
+    bool     sessionPresent = false;
+    uint16_t topicAliasMaximum = 0;    // MQTT 5: gửi trong CONNACK nếu > 0
+    uint16_t receiveMaximum = 0;       // MQTT 5: gửi trong CONNACK nếu > 0
+    bool     ackConnect = true;        // false: không trả CONNACK (test timeout)
+    uint32_t pubackDelayMs = 0;
+    bool     holdPubacks = false;
+    uint32_t dropPubacks = 0;
+
+    // ---- Quan sát ----
+    uint8_t  protocolVersion = 0;      // level trong CONNECT cuối cùng
+    bool     cleanSession = false;
+    uint32_t connects = 0;
+    uint32_t subscribes = 0;
+    uint32_t pings = 0;
+    uint32_t writeCalls = 0;           // số lần client gọi write (đo coalescing)
+    uint32_t bytesIn = 0;              // byte client gửi lên
+    uint32_t publishBytes = 0;         // byte của riêng các packet PUBLISH
+    uint32_t publishCount = 0;         // tổng số PUBLISH, kể cả bản gửi lại
+    uint32_t dupCount = 0;             // PUBLISH có cờ DUP
+    uint32_t pubacksSent = 0;
+    uint8_t  firstPacket = 0;          // byte đầu tiên client gửi sau mỗi connect()
+    uint8_t  lastPayload[FAKE_BROKER_PAYLOAD_SIZE];
+
+    FakeBroker() { reset(); }
+
+    // Xóa mọi trạng thái quan sát và kết nối, giữ cấu hình
+    void reset() {
+        _open = false;
+        _rxLen = _txLen = _txPos = 0;
+        _pendingCount = 0;
+        _logCount = 0;
+        protocolVersion = 0;
+        cleanSession = false;
+        connects = subscribes = pings = writeCalls = 0;
+        bytesIn = publishBytes = publishCount = dupCount = pubacksSent = 0;
+        firstPacket = 0;
+        memset(_aliases, 0, sizeof(_aliases));
+    }
+
+    // PUBLISH đã nhận (kể cả gửi lại), cũ nhất trước
+    uint32_t published() const { return _logCount; }
+    const FakePublish &publish(uint32_t i) const { return _log[i % FAKE_BROKER_LOG_SIZE]; }
+    const FakePublish &lastPublish() const { return publish(_logCount - 1); }
+
+    // PUBACK đang bị giữ/chờ tới hạn
+    uint8_t pendingPubacks() const { return _pendingCount; }
+    void releasePubacks() {
+        for (uint8_t i = 0; i < _pendingCount; i++) _pending[i].dueMs = 0;
+        holdPubacks = false;
+    }
+
+    // Broker chủ động gửi 1 packet xuống client (vd PUBLISH lệnh)
+    void inject(const uint8_t *packet, size_t length) { txAppend(packet, length); }
+
+    // Mất kết nối phía mạng (RST): dữ liệu chưa tới client và PUBACK đang chờ
+    // đều mất, client chỉ biết qua connected()
+    void drop() {
+        _open = false;
+        _txLen = _txPos = 0;
+        _pendingCount = 0;
+    }
+
+    // ---- Client ----
+    int connect(IPAddress ip, uint16_t port) override { return open(); }
+    int connect(const char *host, uint16_t port) override { return open(); }
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t *buf, size_t size) override {
+        if (!_open) return 0;
+        writeCalls++;
+        if (_rxLen == 0 && bytesIn == 0 && size > 0) firstPacket = buf[0];
+        size_t n = size < FAKE_BROKER_RX_SIZE - _rxLen ? size : FAKE_BROKER_RX_SIZE - _rxLen;
+        memcpy(_rx + _rxLen, buf, n);
+        _rxLen += n;
+        bytesIn += n;
+        parse();
+        return n;
+    }
+    using Print::write;
+    int available() override {
+        releaseDue();
+        return _txLen - _txPos;
+    }
+    int read() override {
+        if (available() <= 0) return -1;
+        return _tx[_txPos++];
+    }
+    int read(uint8_t *buf, size_t size) override {
+        int n = available();
+        if (n <= 0) return -1;
+        if ((size_t)n > size) n = size;
+        memcpy(buf, _tx + _txPos, n);
+        _txPos += n;
+        return n;
+    }
+    int peek() override { return available() > 0 ? _tx[_txPos] : -1; }
+    void flush() override {}
+    void stop() override { _open = false; }
+    uint8_t connected() override { return _open || available() > 0; }
+    operator bool() override { return _open; }
+
+private:
+    struct PendingAck {
+        uint16_t msgId;
+        uint32_t dueMs;
+    };
+
+    bool     _open;
+    uint8_t  _rx[FAKE_BROKER_RX_SIZE];
+    uint32_t _rxLen;
+    uint8_t  _tx[FAKE_BROKER_TX_SIZE];
+    uint32_t _txLen, _txPos;
+    PendingAck _pending[FAKE_BROKER_PENDING];
+    uint8_t  _pendingCount;
+    FakePublish _log[FAKE_BROKER_LOG_SIZE];
+    uint32_t _logCount;
+    char     _aliases[FAKE_BROKER_ALIASES + 1][FAKE_BROKER_TOPIC_SIZE];
+
+    int open() {
+        _open = true;
+        _rxLen = _txLen = _txPos = 0;
+        _pendingCount = 0;
+        bytesIn = 0;
+        memset(_aliases, 0, sizeof(_aliases));   // alias chỉ sống trong 1 kết nối
+        return 1;
+    }
+
+    void txAppend(const uint8_t *data, size_t length) {
+        if (_txPos == _txLen) _txPos = _txLen = 0;
+        if (_txLen + length > FAKE_BROKER_TX_SIZE) return;
+        memcpy(_tx + _txLen, data, length);
+        _txLen += length;
+    }
+
+    void sendPuback(uint16_t msgId) {
+        uint8_t ack[4] = { MQTTPUBACK, 2, (uint8_t)(msgId >> 8), (uint8_t)msgId };
+        txAppend(ack, sizeof(ack));
+        pubacksSent++;
+    }
+
+    void releaseDue() {
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < _pendingCount; i++) {
+            PendingAck p = _pending[i];
+            bool due = !holdPubacks && (long)(millis() - p.dueMs) >= 0;
+            if (due) sendPuback(p.msgId);
+            else _pending[kept++] = p;
+        }
+        _pendingCount = kept;
+    }
+
+    static uint32_t readVarint(const uint8_t *p, uint32_t avail, uint8_t *used) {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < 4 && i < avail; i++) {
+            value |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+            if ((p[i] & 0x80) == 0) {
+                *used = i + 1;
+                return value;
+            }
+        }
+        *used = 0;
+        return 0;
+    }
+
+    // Xử lý mọi packet đã nhận đủ trong _rx
+    void parse() {
+        uint32_t pos = 0;
+        while (pos + 2 <= _rxLen) {
+            uint8_t used;
+            uint32_t remaining = readVarint(_rx + pos + 1, _rxLen - pos - 1, &used);
+            if (used == 0) break;
+            uint32_t total = 1 + used + remaining;
+            if (pos + total > _rxLen) break;
+            handle(_rx + pos, 1 + used, total);
+            pos += total;
+        }
+        memmove(_rx, _rx + pos, _rxLen - pos);
+        _rxLen -= pos;
+    }
+
+    void handle(const uint8_t *pkt, uint32_t headerLen, uint32_t total) {
+        const uint8_t *v = pkt + headerLen;
+        uint32_t len = total - headerLen;
+        switch (pkt[0] & 0xF0) {
+        case MQTTCONNECT:
+            handleConnect(v, len);
+            break;
+        case MQTTPUBLISH:
+            handlePublish(pkt[0], v, len, total);
+            break;
+        case MQTTSUBSCRIBE: {
+            subscribes++;
+            uint8_t ack[5] = { MQTTSUBACK, 3, v[0], v[1], 1 };
+            if (protocolVersion == MQTT_VERSION_5) {
+                uint8_t ack5[6] = { MQTTSUBACK, 4, v[0], v[1], 0, 1 };
+                txAppend(ack5, sizeof(ack5));
+            } else {
+                txAppend(ack, sizeof(ack));
+            }
+            break;
+        }
+        case MQTTPINGREQ: {
+            pings++;
+            uint8_t resp[2] = { MQTTPINGRESP, 0 };
+            txAppend(resp, sizeof(resp));
+            break;
+        }
+        case MQTTDISCONNECT:
+            _open = false;
+            break;
+        }
+    }
+
+    void handleConnect(const uint8_t *v, uint32_t len) {
+        connects++;
+        protocolVersion = len > 6 ? v[6] : 0;
+        cleanSession = len > 7 && (v[7] & 0x02);
+        if (!ackConnect) return;
+
+        uint8_t ack[16];
+        uint8_t n = 0;
+        ack[n++] = MQTTCONNACK;
+        ack[n++] = 2;
+        ack[n++] = sessionPresent && !cleanSession ? 1 : 0;
+        ack[n++] = connackCode;
+        if (protocolVersion == MQTT_VERSION_5) {
+            uint8_t props = 0;
+            uint8_t *p = ack + n + 1;
+            if (receiveMaximum > 0) {
+                p[props++] = 0x21;
+                p[props++] = receiveMaximum >> 8;
+                p[props++] = receiveMaximum;
+            }
+            if (topicAliasMaximum > 0) {
+                p[props++] = 0x22;
+                p[props++] = topicAliasMaximum >> 8;
+                p[props++] = topicAliasMaximum;
+            }
+            ack[n++] = props;
+            n += props;
+            ack[1] = n - 2;
+        }
+        txAppend(ack, n);
+    }
+
+    void handlePublish(uint8_t header, const uint8_t *v, uint32_t len, uint32_t total) {
+        FakePublish &p = _log[_logCount % FAKE_BROKER_LOG_SIZE];
+        memset(&p, 0, sizeof(p));
+        p.qos = (header >> 1) & 0x03;
+        p.dup = (header & MQTTDUP) != 0;
+        p.wireLength = total;
+
+        uint32_t pos = 0;
+        uint16_t topicLen = (v[0] << 8) | v[1];
+        pos = 2;
+        uint16_t copy = topicLen < FAKE_BROKER_TOPIC_SIZE - 1 ? topicLen : FAKE_BROKER_TOPIC_SIZE - 1;
+        memcpy(p.topic, v + pos, copy);
+        pos += topicLen;
+        if (p.qos > 0) {
+            p.msgId = (v[pos] << 8) | v[pos + 1];
+            pos += 2;
+        }
+        if (protocolVersion == MQTT_VERSION_5) {
+            uint8_t used;
+            uint32_t propLen = readVarint(v + pos, len - pos, &used);
+            pos += used;
+            uint32_t end = pos + propLen;
+            while (pos < end) {
+                uint8_t id = v[pos++];
+                if (id == 0x02) {
+                    p.expiry = ((uint32_t)v[pos] << 24) | ((uint32_t)v[pos + 1] << 16) | (v[pos + 2] << 8) | v[pos + 3];
+                    pos += 4;
+                } else if (id == 0x23) {
+                    p.alias = (v[pos] << 8) | v[pos + 1];
+                    pos += 2;
+                } else {
+                    pos = end;   // thuộc tính khác: client này không gửi
+                }
+            }
+            if (p.alias > 0 && p.alias <= FAKE_BROKER_ALIASES) {
+                if (topicLen > 0) strcpy(_aliases[p.alias], p.topic);
+                else strcpy(p.topic, _aliases[p.alias]);
+            }
+        }
+        p.payloadLength = len - pos;
+        memcpy(lastPayload, v + pos, p.payloadLength < sizeof(lastPayload) ? p.payloadLength : sizeof(lastPayload));
+
+        _logCount++;
+        publishCount++;
+        publishBytes += total;
+        if (p.dup) dupCount++;
+
+        if (p.qos == 0) return;
+        if (dropPubacks > 0) {
+            dropPubacks--;
+            return;
+        }
+        if (_pendingCount < FAKE_BROKER_PENDING) {
+            _pending[_pendingCount++] = { p.msgId, (uint32_t)(millis() + pubackDelayMs) };
+        }
+        releaseDue();
+    }
+};
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef __SIM_FAKE_RS485_H__
+#define __SIM_FAKE_RS485_H__
+
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Bus RS485 giả có 1 slave Modbus RTU phía sau, thay HardwareSerial cho modbus_rtu.
+// Mô phỏng thời gian trên dây theo baud: flush() chờ hết thời gian phát request,
+// từng byte response "tới" đúng thời điểm (1 ký tự = 11 bit) và có thể chèn khoảng
+// lặng giữa các byte. Callback onReceive(..., true) được gọi từ 1 thread riêng khi
+// line im lặng đủ RX timeout, như UART event task của ESP32.
+//
+// Slave trả lời FC03/FC04 bằng registerValue(), echo FC05/06/15/16. Ghi đè
+// registerValue()/respond() trong test để đổi hành vi.
+
+#define FAKE_RS485_MAX_FRAME 256
+
+class FakeRs485 : public HardwareSerial {
+public:
+    uint32_t baud = 9600;
+    uint8_t  slaveId = 0;            // 0 = trả lời mọi slave
+    uint32_t turnaroundUs = 2000;    // slave xử lý request trước khi trả lời
+    uint32_t interByteUs = 0;        // khoảng lặng thêm giữa mọi byte response
+    uint16_t gapAfterByte = 0;       // chèn gapUs sau byte thứ n của response (0 = không)
+    uint32_t gapUs = 0;
+    uint8_t  exceptionCode = 0;      // != 0: trả exception thay vì dữ liệu
+    uint32_t silentResponses = 0;    // bỏ qua n request tiếp theo (slave không trả lời)
+
+    // Quan sát
+    uint32_t requests = 0;
+    uint32_t txBytes = 0;            // master → slave
+    uint32_t rxBytes = 0;            // slave → master
+    uint32_t idleEvents = 0;
+    uint32_t lastByteUs = 0;         // micros() lúc byte cuối của response cuối tới nơi
+
+    FakeRs485() : _thread(&FakeRs485::eventLoop, this) {}
+    ~FakeRs485() {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _quit = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    uint32_t charUs() const { return 11000000UL / baud; }
+
+    // Byte rác tới ngay lúc này (vd nhiễu/response trễ của transaction trước)
+    void injectNoise(const uint8_t *data, size_t length) {
+        std::lock_guard<std::mutex> lock(_m);
+        uint32_t at = micros();
+        for (size_t i = 0; i < length; i++) {
+            at += charUs();
+            queueByte(data[i], at);
+        }
+        scheduleIdle(at);
+        _cv.notify_all();
+    }
+
+    // ---- HardwareSerial ----
+    void begin(unsigned long b, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) override {
+        baud = b;
+    }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override {
+        std::lock_guard<std::mutex> lock(_m);
+        size_t n = size < sizeof(_request) - _requestLen ? size : sizeof(_request) - _requestLen;
+        memcpy(_request + _requestLen, buf, n);
+        _requestLen += n;
+        txBytes += n;
+        return n;
+    }
+    using Print::write;
+
+    // Như ESP32: chờ tới khi byte cuối rời khỏi chân TX, rồi slave bắt đầu xử lý
+    void flush() override {
+        size_t length;
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            length = _requestLen;
+        }
+        if (length == 0) return;
+        delayMicroseconds(length * charUs());
+
+        std::lock_guard<std::mutex> lock(_m);
+        requests++;
+        uint8_t response[FAKE_RS485_MAX_FRAME];
+        size_t n = silentResponses > 0 ? 0 : respond(_request, _requestLen, response);
+        if (silentResponses > 0) silentResponses--;
+        _requestLen = 0;
+        if (n == 0) return;
+
+        uint32_t at = micros() + turnaroundUs;
+        for (size_t i = 0; i < n; i++) {
+            if (i > 0) at += interByteUs;
+            if (gapAfterByte > 0 && i == gapAfterByte) {
+                scheduleIdle(at);      // khoảng lặng đủ dài cũng làm UART báo idle
+                at += gapUs;
+            }
+            at += charUs();
+            queueByte(response[i], at);
+        }
+        lastByteUs = at;
+        scheduleIdle(at);
+        _cv.notify_all();
+    }
+
+    int available() override {
+        std::lock_guard<std::mutex> lock(_m);
+        return arrived();
+    }
+    int read() override {
+        std::lock_guard<std::mutex> lock(_m);
+        if (arrived() == 0) return -1;
+        rxBytes++;
+        return _rx[_rxHead++];
+    }
+    bool setRxTimeout(uint8_t symbols) override {
+        std::lock_guard<std::mutex> lock(_m);
+        _rxTimeout = symbols;
+        return true;
+    }
+    void onReceive(OnReceiveCb function, bool onlyOnTimeout = false) override {
+        std::lock_guard<std::mutex> lock(_m);
+        _onReceive = function;
+        _onlyOnTimeout = onlyOnTimeout;
+    }
+
+    // ---- Slave ----
+    virtual uint16_t registerValue(uint8_t slave, uint8_t function, uint16_t address) {
+        return address;
+    }
+
+    // Trả về độ dài response, 0 = không trả lời
+    virtual size_t respond(const uint8_t *req, size_t length, uint8_t *resp) {
+        if (length < 8 || crc16(req, length - 2) != (req[length - 2] | (req[length - 1] << 8))) return 0;
+        if (slaveId != 0 && req[0] != slaveId) return 0;
+
+        uint8_t function = req[1];
+        uint16_t address = (req[2] << 8) | req[3];
+        uint16_t count = (req[4] << 8) | req[5];
+        size_t n = 0;
+        resp[n++] = req[0];
+        if (exceptionCode != 0) {
+            resp[n++] = function | 0x80;
+            resp[n++] = exceptionCode;
+        } else if (function == 0x03 || function == 0x04) {
+            resp[n++] = function;
+            resp[n++] = count * 2;
+            for (uint16_t i = 0; i < count; i++) {
+                uint16_t v = registerValue(req[0], function, address + i);
+                resp[n++] = v >> 8;
+                resp[n++] = v & 0xFF;
+            }
+        } else {
+            memcpy(resp + 1, req + 1, 5);
+            n = 6;
+        }
+        uint16_t crc = crc16(resp, n);
+        resp[n++] = crc & 0xFF;
+        resp[n++] = crc >> 8;
+        return n;
+    }
+
+    static uint16_t crc16(const uint8_t *data, size_t length) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+            }
+        }
+        return crc;
+    }
+
+private:
+    std::mutex _m;
+    std::condition_variable _cv;
+    bool _quit = false;
+
+    uint8_t  _request[FAKE_RS485_MAX_FRAME];
+    size_t   _requestLen = 0;
+
+    // Byte response theo thời điểm tới (micros)
+    uint8_t  _rx[4 * FAKE_RS485_MAX_FRAME];
+    uint32_t _rxAt[4 * FAKE_RS485_MAX_FRAME];
+    size_t   _rxHead = 0, _rxTail = 0;
+
+    // Thời điểm UART báo RX timeout
+    uint32_t _idleAt[16];
+    uint8_t  _idleCount = 0;
+
+    std::thread _thread;
+
+    size_t arrived() {
+        uint32_t now = micros();
+        size_t n = _rxHead;
+        while (n < _rxTail && (int32_t)(now - _rxAt[n]) >= 0) n++;
+        return n - _rxHead;
+    }
+
+    void queueByte(uint8_t b, uint32_t at) {
+        if (_rxHead == _rxTail) _rxHead = _rxTail = 0;
+        if (_rxTail >= sizeof(_rx)) return;
+        _rx[_rxTail] = b;
+        _rxAt[_rxTail++] = at;
+    }
+
+    // RX timeout: line im lặng _rxTimeout ký tự sau byte cuối
+    void scheduleIdle(uint32_t lastByteAt) {
+        if (_idleCount < sizeof(_idleAt) / sizeof(_idleAt[0])) {
+            _idleAt[_idleCount++] = lastByteAt + _rxTimeout * charUs();
+        }
+    }
+
+    void eventLoop() {
+        std::unique_lock<std::mutex> lock(_m);
+        while (!_quit) {
+            if (_idleCount == 0) {
+                _cv.wait(lock);
+                continue;
+            }
+            int32_t until = (int32_t)(_idleAt[0] - micros());
+            if (until > 0) {
+                _cv.wait_for(lock, std::chrono::microseconds(until));
+                continue;
+            }
+            memmove(_idleAt, _idleAt + 1, (_idleCount - 1) * sizeof(_idleAt[0]));
+            _idleCount--;
+            idleEvents++;
+            OnReceiveCb cb = _onReceive;
+            lock.unlock();
+            if (cb) cb();
+            lock.lock();
+        }
+    }
+};
+
+#endif
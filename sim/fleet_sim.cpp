@@ -0,0 +1,315 @@
+// Fleet simulator: chạy N thiết bị ảo (mỗi thiết bị 1 process với task_mqtt +
+// temp_humi_report của firmware) publish tới broker, đồng thời 1 client monitor
+// subscribe telemetry để đo thông lượng và độ trễ end-to-end.
+//
+//   pio run -e fleet_sim && .pio/build/fleet_sim/program -n 200 -h 127.0.0.1 -t 60
+//
+// Độ trễ = lúc monitor nhận - "ts" của mẫu, tức gồm cả thời gian mẫu nằm chờ
+// trong batch; đặt {"batch":{"samples":1}} trong -c để chỉ đo đường truyền.
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+#include "payload_codec.h"
+#include "sim_device.h"
+
+#include <vector>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define SIM_MONITOR_BUFFER   2048
+#define SIM_REPORT_LINE      256
+// Sau khi thiết bị cuối cùng thoát: chờ nốt message còn trên đường tới monitor
+#define SIM_MONITOR_GRACE    1000
+
+// Biên vùng .data/.bss của binary (glibc/ld): RAM tĩnh của firmware + shim
+extern char __data_start, _end;
+
+struct MonitorStats {
+    uint32_t messages;
+    uint32_t samples;
+    uint64_t bytes;
+    uint32_t firstMs;
+    uint32_t lastMs;
+    std::vector<uint32_t> latencyMs;
+};
+
+static MonitorStats monitor = {0, 0, 0, 0, 0, {}};
+static String topicPrefix;
+
+static uint64_t epochMs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Batch có timestamp: [{"ts":..,"values":{..}},..]; chưa có giờ thì là 1 object
+static void monitorCallback(char *topic, byte *payload, unsigned int length) {
+    if (strncmp(topic, topicPrefix.c_str(), topicPrefix.length()) != 0) return;
+
+    uint32_t now = millis();
+    if (monitor.messages == 0) monitor.firstMs = now;
+    monitor.lastMs = now;
+    monitor.messages++;
+    monitor.bytes += length;
+
+    StaticJsonDocument<SIM_MONITOR_BUFFER> doc;
+    if (payload_codec_deserialize(doc, payload, length)) return;
+    if (!doc.is<JsonArray>()) {
+        monitor.samples++;
+        return;
+    }
+    uint64_t received = epochMs();
+    for (JsonObjectConst entry : doc.as<JsonArrayConst>()) {
+        monitor.samples++;
+        uint64_t ts = entry["ts"] | (uint64_t)0;
+        if (ts > 0 && ts <= received) {
+            monitor.latencyMs.push_back((uint32_t)(received - ts));
+        }
+    }
+}
+
+template <class T> static T percentile(std::vector<T> &v, double p) {
+    if (v.empty()) return 0;
+    size_t i = (size_t)(p / 100.0 * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+static bool parseReport(const char *line, SimDeviceReport &r) {
+    return sscanf(line, "%d %u %u %u %u %u %u %u %zu %zu %zu",
+                  &r.id, &r.connectMs, &r.samples, &r.enqueued, &r.delivered, &r.dropped,
+                  &r.spooled, &r.queueLatencyMaxMs, &r.heapBytes, &r.heapPeakBytes, &r.rssBytes) == 11;
+}
+
+static void writeReport(int fd, const SimDeviceReport &r) {
+    char line[SIM_REPORT_LINE];
+    int n = snprintf(line, sizeof(line), "%d %u %u %u %u %u %u %u %zu %zu %zu\n",
+                     r.id, r.connectMs, r.samples, r.enqueued, r.delivered, r.dropped,
+                     r.spooled, r.queueLatencyMaxMs, r.heapBytes, r.heapPeakBytes, r.rssBytes);
+    // Dòng < PIPE_BUF nên các process con ghi chung 1 pipe không bị xen kẽ
+    if (write(fd, line, n) != n) {
+        perror("sim: write report");
+    }
+}
+
+static char *readFile(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return NULL;
+    std::string s;
+    char buf[512];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+    fclose(f);
+    return strdup(s.c_str());
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n, --devices N      số thiết bị ảo (10)\n"
+            "  -h, --host HOST      broker MQTT (127.0.0.1)\n"
+            "  -p, --port PORT      cổng broker (1883)\n"
+            "  -t, --duration S     thời gian đo sau khi kết nối, giây (30)\n"
+            "  -i, --interval MS    chu kỳ đọc sensor mỗi thiết bị (1000)\n"
+            "  -r, --ramp MS        giãn cách khởi động giữa 2 thiết bị (20)\n"
+            "  -c, --config FILE    JSON {\"batch\":..,\"filter\":..,\"queue\":..,\"codec\":..}\n"
+            "  -m, --mqtt-version V 4 = 3.1.1, 5 = MQTT 5 (4)\n"
+            "  -P, --prefix STR     tiền tố client id / username (sim-)\n"
+            "  -v, --verbose        in Serial của các thiết bị ra stderr\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    SimDeviceOptions opt;
+    opt.host = "127.0.0.1";
+    opt.port = 1883;
+    opt.prefix = "sim-";
+    opt.periodMs = 1000;
+    opt.durationMs = 30000;
+    opt.configJson = NULL;
+    opt.mqttVersion = 4;
+    int devices = 10;
+    uint32_t rampMs = 20;
+
+    static const struct option longOptions[] = {
+        { "devices", required_argument, NULL, 'n' },
+        { "host", required_argument, NULL, 'h' },
+        { "port", required_argument, NULL, 'p' },
+        { "duration", required_argument, NULL, 't' },
+        { "interval", required_argument, NULL, 'i' },
+        { "ramp", required_argument, NULL, 'r' },
+        { "config", required_argument, NULL, 'c' },
+        { "mqtt-version", required_argument, NULL, 'm' },
+        { "prefix", required_argument, NULL, 'P' },
+        { "verbose", no_argument, NULL, 'v' },
+        { NULL, 0, NULL, 0 },
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "n:h:p:t:i:r:c:m:P:v", longOptions, NULL)) != -1) {
+        switch (c) {
+        case 'n': devices = atoi(optarg); break;
+        case 'h': opt.host = optarg; break;
+        case 'p': opt.port = atoi(optarg); break;
+        case 't': opt.durationMs = atoi(optarg) * 1000; break;
+        case 'i': opt.periodMs = atoi(optarg); break;
+        case 'r': rampMs = atoi(optarg); break;
+        case 'c':
+            opt.configJson = readFile(optarg);
+            if (opt.configJson == NULL) {
+                fprintf(stderr, "❌ Không đọc được %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm': opt.mqttVersion = atoi(optarg) == 5 ? 5 : 4; break;
+        case 'P': opt.prefix = optarg; break;
+        case 'v': sim_verbose = true; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (devices <= 0 || opt.periodMs == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Monitor dùng cùng codec với thiết bị để decode payload
+    if (opt.configJson != NULL) {
+        DynamicJsonDocument doc(2048);
+        if (!deserializeJson(doc, opt.configJson)) {
+            payload_codec_load(doc["codec"]);
+        }
+    }
+    payload_codec_activate();
+
+    topicPrefix = opt.prefix;
+    String monitorId = String(opt.prefix) + "monitor";
+    String monitorTopic = "+/telemetry/#";
+    WiFiClient monitorNet;
+    PubSubClient monitorClient(monitorNet);
+    monitorClient.setServer(opt.host, opt.port);
+    monitorClient.setBufferSize(SIM_MONITOR_BUFFER);
+    monitorClient.setCallback(monitorCallback);
+    if (!monitorClient.connect(monitorId.c_str()) || !monitorClient.subscribe(monitorTopic.c_str())) {
+        fprintf(stderr, "❌ Monitor không kết nối/subscribe được %s:%u (rc=%d)\n",
+                opt.host, opt.port, monitorClient.state());
+        return 1;
+    }
+    printf("🚀 %d devices -> %s:%u, sensor every %u ms, %u s\n",
+           devices, opt.host, opt.port, opt.periodMs, opt.durationMs / 1000);
+
+    int pipeFd[2];
+    if (pipe(pipeFd) < 0) {
+        perror("sim: pipe");
+        return 1;
+    }
+    fcntl(pipeFd[0], F_SETFL, fcntl(pipeFd[0], F_GETFL, 0) | O_NONBLOCK);
+    fflush(stdout);
+
+    std::vector<SimDeviceReport> reports;
+    std::string pending;
+    int started = 0;
+    int running = 0;
+    uint32_t begin = millis();
+    uint32_t lastExit = 0;
+
+    while (started < devices || running > 0 || millis() - lastExit < SIM_MONITOR_GRACE) {
+        // Khởi động dần để không dồn cả fleet vào CONNECT cùng lúc
+        if (started < devices && millis() - begin >= started * rampMs) {
+            opt.id = started;
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(pipeFd[0]);
+                SimDeviceReport report;
+                sim_device_run(opt, report);
+                writeReport(pipeFd[1], report);
+                _exit(0);
+            }
+            if (pid < 0) {
+                perror("sim: fork");
+                break;
+            }
+            started++;
+            running++;
+        }
+
+        // loop() chỉ đọc 1 packet mỗi lần: đọc cạn socket để monitor không thành nút cổ chai
+        monitorClient.loop();
+        while (monitorNet.available() > 0 && monitorClient.loop()) {
+        }
+
+        char buf[1024];
+        ssize_t n;
+        while ((n = read(pipeFd[0], buf, sizeof(buf))) > 0) {
+            pending.append(buf, n);
+        }
+        size_t eol;
+        while ((eol = pending.find('\n')) != std::string::npos) {
+            SimDeviceReport r;
+            if (parseReport(pending.substr(0, eol).c_str(), r)) reports.push_back(r);
+            pending.erase(0, eol + 1);
+        }
+
+        while (running > 0 && waitpid(-1, NULL, WNOHANG) > 0) {
+            running--;
+            lastExit = millis();
+        }
+        if (!monitorClient.connected()) {
+            fprintf(stderr, "⚠️ Monitor mất kết nối, số liệu độ trễ không đầy đủ\n");
+            monitorClient.connect(monitorId.c_str());
+            monitorClient.subscribe(monitorTopic.c_str());
+        }
+        delay(1);
+    }
+
+    // ==================== REPORT ====================
+    std::vector<uint32_t> connectMs;
+    std::vector<size_t> heap, heapPeak, rss;
+    uint64_t samples = 0, delivered = 0, dropped = 0, spooled = 0;
+    uint32_t queueLatencyMax = 0;
+    for (const SimDeviceReport &r : reports) {
+        if (r.connectMs == 0) continue;
+        connectMs.push_back(r.connectMs);
+        heap.push_back(r.heapBytes);
+        heapPeak.push_back(r.heapPeakBytes);
+        rss.push_back(r.rssBytes);
+        samples += r.samples;
+        delivered += r.delivered;
+        dropped += r.dropped;
+        spooled += r.spooled;
+        if (r.queueLatencyMaxMs > queueLatencyMax) queueLatencyMax = r.queueLatencyMaxMs;
+    }
+    std::sort(connectMs.begin(), connectMs.end());
+    std::sort(heap.begin(), heap.end());
+    std::sort(heapPeak.begin(), heapPeak.end());
+    std::sort(rss.begin(), rss.end());
+    std::sort(monitor.latencyMs.begin(), monitor.latencyMs.end());
+
+    double windowS = monitor.messages > 1 ? (monitor.lastMs - monitor.firstMs) / 1000.0 : 0;
+    printf("\n========================================\n");
+    printf("📋 Devices: %zu connected / %d started\n", connectMs.size(), started);
+    printf("   connect ms   p50 %u  p99 %u  max %u\n",
+           percentile(connectMs, 50), percentile(connectMs, 99), connectMs.empty() ? 0 : connectMs.back());
+    printf("📤 Sensor samples %llu, published %llu, queue dropped %llu, spooled (lost) %llu\n",
+           (unsigned long long)samples, (unsigned long long)delivered,
+           (unsigned long long)dropped, (unsigned long long)spooled);
+    printf("   queue latency max %u ms\n", queueLatencyMax);
+    printf("📥 Monitor: %u messages, %u samples, %llu bytes in %.1f s\n",
+           monitor.messages, monitor.samples, (unsigned long long)monitor.bytes, windowS);
+    if (windowS > 0) {
+        printf("   %.1f msg/s  %.1f samples/s  %.1f kB/s\n",
+               monitor.messages / windowS, monitor.samples / windowS, monitor.bytes / windowS / 1024);
+    }
+    printf("⏱️  Latency ms (sample ts -> monitor, %zu samples)\n", monitor.latencyMs.size());
+    printf("   p50 %u  p90 %u  p99 %u  max %u\n",
+           percentile(monitor.latencyMs, 50), percentile(monitor.latencyMs, 90),
+           percentile(monitor.latencyMs, 99), monitor.latencyMs.empty() ? 0 : monitor.latencyMs.back());
+    printf("💾 Memory per device: static %zu B (.data+.bss)\n", (size_t)(&_end - &__data_start));
+    printf("   heap end  p50 %zu  max %zu B\n", percentile(heap, 50), heap.empty() ? 0 : heap.back());
+    printf("   heap peak p50 %zu  max %zu B\n", percentile(heapPeak, 50), heapPeak.empty() ? 0 : heapPeak.back());
+    printf("   RSS peak  p50 %zu  max %zu kB\n", percentile(rss, 50) / 1024, rss.empty() ? 0 : rss.back() / 1024);
+    printf("========================================\n");
+
+    return connectMs.size() == (size_t)devices ? 0 : 2;
+}
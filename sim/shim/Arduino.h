@@ -0,0 +1,257 @@
+#ifndef __SIM_ARDUINO_H__
+#define __SIM_ARDUINO_H__
+
+// Arduino core tối thiểu cho fleet simulator trên host (Linux/POSIX):
+// đủ cho đường publish của coreiot + PubSubClient + ArduinoJson, không hơn.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include <functional>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH   1
+#define LOW    0
+#define INPUT  0
+#define OUTPUT 1
+#define DEC    10
+#define HEX    16
+#define PROGMEM
+#define F(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_byte_near(p) pgm_read_byte(p)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+uint32_t esp_random();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+template <class T> T constrain(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+class String {
+public:
+    String() {}
+    String(const char *s) : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    String(int v, int base = DEC) { fromLong(v, base); }
+    String(unsigned int v, int base = DEC) { fromULong(v, base); }
+    String(long v, int base = DEC) { fromLong(v, base); }
+    String(unsigned long v, int base = DEC) { fromULong(v, base); }
+    String(float v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+    String(double v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+
+    const char *c_str() const { return _s.c_str(); }
+    size_t length() const { return _s.size(); }
+    bool isEmpty() const { return _s.empty(); }
+    bool reserve(unsigned int n) { _s.reserve(n); return true; }
+
+    bool concat(const String &s) { _s += s._s; return true; }
+    bool concat(const char *s) { if (!s) return false; _s += s; return true; }
+    bool concat(const char *s, unsigned int n) { if (!s) return false; _s.append(s, n); return true; }
+    bool concat(char c) { _s += c; return true; }
+    String &operator+=(const String &s) { concat(s); return *this; }
+    String &operator+=(const char *s) { concat(s); return *this; }
+    String &operator+=(char c) { concat(c); return *this; }
+    String &operator+=(int v) { return *this += String(v); }
+    String &operator+=(unsigned int v) { return *this += String(v); }
+    String &operator+=(long v) { return *this += String(v); }
+    String &operator+=(unsigned long v) { return *this += String(v); }
+
+    friend String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+    friend String operator+(const String &a, const char *b) { String r(a); r += b; return r; }
+    friend String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+
+    bool operator==(const String &o) const { return _s == o._s; }
+    bool operator==(const char *o) const { return _s == (o ? o : ""); }
+    bool operator!=(const String &o) const { return !(*this == o); }
+    bool operator!=(const char *o) const { return !(*this == o); }
+    bool operator<(const String &o) const { return _s < o._s; }
+    bool equals(const String &o) const { return *this == o; }
+    bool equalsIgnoreCase(const String &o) const { return strcasecmp(c_str(), o.c_str()) == 0; }
+    bool startsWith(const String &p) const { return _s.compare(0, p._s.size(), p._s) == 0; }
+    bool endsWith(const String &p) const {
+        return _s.size() >= p._s.size() && _s.compare(_s.size() - p._s.size(), p._s.size(), p._s) == 0;
+    }
+
+    char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+    char &operator[](unsigned int i) { return _s[i]; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+    int indexOf(char c, unsigned int from = 0) const { return pos(_s.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return pos(_s.find(s._s, from)); }
+    int lastIndexOf(char c) const { return pos(_s.rfind(c)); }
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        return from < _s.size() ? String(_s.substr(from, to - from)) : String();
+    }
+    void remove(unsigned int index) { if (index < _s.size()) _s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < _s.size()) _s.erase(index, count); }
+    void replace(const String &from, const String &to) {
+        if (from._s.empty()) return;
+        for (size_t p = 0; (p = _s.find(from._s, p)) != std::string::npos; p += to._s.size()) {
+            _s.replace(p, from._s.size(), to._s);
+        }
+    }
+    void trim() {
+        size_t b = _s.find_first_not_of(" \t\r\n");
+        size_t e = _s.find_last_not_of(" \t\r\n");
+        _s = b == std::string::npos ? std::string() : _s.substr(b, e - b + 1);
+    }
+    void toLowerCase() { for (auto &c : _s) c = tolower((unsigned char)c); }
+    void toUpperCase() { for (auto &c : _s) c = toupper((unsigned char)c); }
+    long toInt() const { return atol(c_str()); }
+    float toFloat() const { return atof(c_str()); }
+    void toCharArray(char *buf, unsigned int size) const {
+        if (size == 0) return;
+        strncpy(buf, c_str(), size - 1);
+        buf[size - 1] = 0;
+    }
+
+    // ArduinoJson ghi vào String qua write()
+    size_t write(uint8_t c) { _s += (char)c; return 1; }
+    size_t write(const uint8_t *buf, size_t n) { _s.append((const char *)buf, n); return n; }
+
+private:
+    std::string _s;
+
+    static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+    void fromLong(long v, int base) {
+        if (base == DEC) { _s = std::to_string(v); } else { fromULong((unsigned long)v, base); }
+    }
+    void fromULong(unsigned long v, int base) {
+        char buf[40];
+        snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", v);
+        _s = buf;
+    }
+    void fromDouble(double v, unsigned int decimals) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        _s = buf;
+    }
+};
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buf++);
+        return n;
+    }
+    size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+    size_t write(const char *buf, size_t size) { return write((const uint8_t *)buf, size); }
+    virtual void flush() {}
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base = DEC) { return print(String(v, base)); }
+    size_t print(unsigned int v, int base = DEC) { return print(String(v, base)); }
+    size_t print(long v, int base = DEC) { return print(String(v, base)); }
+    size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+    size_t print(double v, int decimals = 2) { return print(String(v, (unsigned int)decimals)); }
+
+    size_t println() { return write("\r\n"); }
+    template <class T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+    template <class T> size_t println(const T &v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[256];
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        if (n < 0) return 0;
+        return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    void setTimeout(unsigned long ms) { _timeout = ms; }
+    size_t readBytes(char *buf, size_t n) { return readBytes((uint8_t *)buf, n); }
+    size_t readBytes(uint8_t *buf, size_t n) {
+        size_t got = 0;
+        unsigned long start = millis();
+        while (got < n && millis() - start < _timeout) {
+            int c = read();
+            if (c < 0) { delay(1); continue; }
+            buf[got++] = (uint8_t)c;
+        }
+        return got;
+    }
+    String readString() {
+        String s;
+        int c;
+        while ((c = read()) >= 0) s += (char)c;
+        return s;
+    }
+
+protected:
+    unsigned long _timeout = 1000;
+};
+
+#define SERIAL_8N1 0x800001c
+
+// Serial của mỗi thiết bị ảo: mặc định im lặng, bật bằng --verbose.
+// Các hàm UART là virtual để test giả lập thiết bị trên bus (xem sim/fake_rs485.h)
+typedef std::function<void(void)> OnReceiveCb;
+
+class HardwareSerial : public Stream {
+public:
+    HardwareSerial(int uart = 0) {}
+    virtual void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    // RX timeout tính bằng số ký tự; onlyOnTimeout: chỉ gọi callback khi line im lặng
+    virtual bool setRxTimeout(uint8_t symbols) { _rxTimeout = symbols; return true; }
+    virtual void onReceive(OnReceiveCb function, bool onlyOnTimeout = false) {
+        _onReceive = function;
+        _onlyOnTimeout = onlyOnTimeout;
+    }
+    operator bool() const { return true; }
+
+protected:
+    uint8_t     _rxTimeout = 2;
+    OnReceiveCb _onReceive;
+    bool        _onlyOnTimeout = false;
+};
+
+extern HardwareSerial Serial;
+
+#endif
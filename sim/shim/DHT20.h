@@ -0,0 +1,22 @@
+#ifndef __SIM_DHT20_H__
+#define __SIM_DHT20_H__
+
+#include "Wire.h"
+
+#define DHT20_OK                 0
+#define DHT20_ERROR_CONNECT      -11
+#define DHT20_CONVERSION_TIME    80
+
+// Không có sensor thật: simulator tự sinh giá trị rồi gọi thẳng temp_humi_report()
+class DHT20 {
+public:
+    bool begin() { return false; }
+    int startRead() { return DHT20_ERROR_CONNECT; }
+    bool readReady() { return true; }
+    int fetchRead() { return DHT20_ERROR_CONNECT; }
+    uint16_t pollCount() { return 0; }
+    float getTemperature() { return NAN; }
+    float getHumidity() { return NAN; }
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef __SIM_ESPRESSIF_MQTT_CLIENT_H__
+#define __SIM_ESPRESSIF_MQTT_CLIENT_H__
+
+#include <Arduino.h>
+#include "../../lib/ThingsBoard/IMQTT_Client.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Espressif_MQTT_Client giả cho host (thay lib/ThingsBoard khi build coreiot với
+// COREIOT_USE_ESP_MQTT=1), cài đúng interface IMQTT_Client thật. Broker phía sau
+// chạy trong 1 thread riêng đóng vai task event của esp-mqtt: CONNECTED/DISCONNECTED
+// đổi connected(), DATA gọi callback ngay từ thread đó như MQTT_EVENT_DATA, không
+// chờ ai gọi loop().
+//
+// Điều khiển broker:
+//   acceptConnect  : false = không bao giờ có MQTT_EVENT_CONNECTED (test timeout)
+//   connackDelayMs : CONNECTED tới sau chừng này ms kể từ connect()
+//   deliver()      : broker gửi 1 PUBLISH xuống (QoS 0)
+//   drop()         : mất kết nối (MQTT_EVENT_DISCONNECTED)
+
+#define FAKE_ESP_MQTT_TOPIC_SIZE   128   // như MAX_RECEIVED_TOPIC_LENGTH
+#define FAKE_ESP_MQTT_PAYLOAD_SIZE 1024
+
+class Espressif_MQTT_Client : public IMQTT_Client {
+public:
+    // ---- Broker ----
+    bool     acceptConnect = true;
+    uint32_t connackDelayMs = 0;
+
+    // ---- Quan sát (cấu hình client đặt) ----
+    const char *serverCertificate = NULL;
+    uint16_t keepAliveSeconds = 0;
+    bool     autoReconnectDisabled = false;
+    bool     enqueueMessages = false;
+    uint16_t bufferSize = 0;
+    std::string host, clientId, userName, password;
+    uint16_t port = 0;
+
+    // ---- Quan sát (lưu lượng) ----
+    uint32_t connects = 0;
+    uint32_t subscribes = 0;
+    uint32_t publishes = 0;
+    uint32_t delivered = 0;            // số DATA event đã gọi callback
+    std::string lastSubscribe, lastTopic, lastPayload;
+
+    Espressif_MQTT_Client() : _thread(&Espressif_MQTT_Client::eventLoop, this) {}
+    ~Espressif_MQTT_Client() {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _quit = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    // ---- Cấu hình riêng của Espressif_MQTT_Client ----
+    bool set_server_certificate(const char *pem) {
+        serverCertificate = pem;
+        return true;
+    }
+    bool set_keep_alive_timeout(const uint16_t &seconds) {
+        keepAliveSeconds = seconds;
+        return true;
+    }
+    bool set_disable_auto_reconnect(const bool &disable) {
+        autoReconnectDisabled = disable;
+        return true;
+    }
+    void set_enqueue_messages(const bool &enqueue) { enqueueMessages = enqueue; }
+
+    // ---- IMQTT_Client ----
+    void set_callback(function callback) override {
+        std::lock_guard<std::mutex> lock(_m);
+        _callback = callback;
+    }
+    bool set_buffer_size(const uint16_t &size) override {
+        bufferSize = size;
+        return true;
+    }
+    uint16_t get_buffer_size() override { return bufferSize; }
+    void set_server(const char *domain, const uint16_t &p) override {
+        host = domain;
+        port = p;
+    }
+
+    // Như esp_mqtt_client_start/reconnect: chỉ khởi động, CONNECTED tới sau qua event
+    bool connect(const char *id, const char *user, const char *pass) override {
+        std::lock_guard<std::mutex> lock(_m);
+        clientId = id;
+        userName = user;
+        password = pass;
+        connects++;
+        if (acceptConnect) post(EV_CONNECTED, millis() + connackDelayMs);
+        return true;
+    }
+    void disconnect() override { _connected = false; }
+    bool loop() override { return _connected; }
+
+    bool publish(const char *topic, const uint8_t *payload, const size_t &length) override {
+        std::lock_guard<std::mutex> lock(_m);
+        // Outbox (enqueue) nhận cả lúc chưa kết nối, publish trực tiếp thì không
+        if (!enqueueMessages && !_connected) return false;
+        publishes++;
+        lastTopic = topic;
+        lastPayload.assign((const char *)payload, length);
+        return true;
+    }
+    bool subscribe(const char *topic) override {
+        std::lock_guard<std::mutex> lock(_m);
+        if (!_connected) return false;
+        subscribes++;
+        lastSubscribe = topic;
+        return true;
+    }
+    bool unsubscribe(const char *topic) override { return _connected; }
+    bool connected() override { return _connected; }
+
+    // ---- Broker ----
+    void deliver(const char *topic, const char *payload) {
+        std::lock_guard<std::mutex> lock(_m);
+        Event &e = post(EV_DATA, millis());
+        e.topic = topic;
+        e.payload = payload;
+    }
+    void drop() {
+        std::lock_guard<std::mutex> lock(_m);
+        post(EV_DISCONNECTED, millis());
+    }
+
+    // Chờ task event xử lý hết event đã tới hạn
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(_m);
+        _idle.wait(lock, [this]() { return !_busy && (_events.empty() || (long)(_events.front().at - millis()) > 0); });
+    }
+
+private:
+    enum EventType { EV_CONNECTED, EV_DISCONNECTED, EV_DATA };
+    struct Event {
+        EventType type;
+        unsigned long at;
+        std::string topic, payload;
+    };
+
+    std::mutex _m;
+    std::condition_variable _cv, _idle;
+    bool _quit = false;
+    bool _busy = false;
+    std::atomic<bool> _connected{false};
+    function _callback;
+    std::deque<Event> _events;
+    std::thread _thread;
+
+    // Event giữ thứ tự theo thời điểm tới
+    Event &post(EventType type, unsigned long at) {
+        Event e;
+        e.type = type;
+        e.at = at;
+        auto it = _events.begin();
+        while (it != _events.end() && (long)(it->at - at) <= 0) ++it;
+        it = _events.insert(it, e);
+        _cv.notify_all();
+        return *it;
+    }
+
+    void eventLoop() {
+        std::unique_lock<std::mutex> lock(_m);
+        while (!_quit) {
+            if (_events.empty()) {
+                _idle.notify_all();
+                _cv.wait(lock);
+                continue;
+            }
+            long until = (long)(_events.front().at - millis());
+            if (until > 0) {
+                _idle.notify_all();
+                _cv.wait_for(lock, std::chrono::milliseconds(until));
+                continue;
+            }
+            Event e = _events.front();
+            _events.pop_front();
+            if (e.type == EV_CONNECTED) {
+                _connected = true;
+            } else if (e.type == EV_DISCONNECTED) {
+                _connected = false;
+            } else if (_connected && _callback) {
+                // Như mqtt_event_handler: topic chép ra buffer có '\0', payload
+                // nằm trong buffer nhận (router được sửa tại chỗ)
+                char topic[FAKE_ESP_MQTT_TOPIC_SIZE] = {};
+                uint8_t payload[FAKE_ESP_MQTT_PAYLOAD_SIZE];
+                size_t length = e.payload.size() < sizeof(payload) ? e.payload.size() : sizeof(payload);
+                strncpy(topic, e.topic.c_str(), sizeof(topic) - 1);
+                memcpy(payload, e.payload.data(), length);
+                function cb = _callback;
+                _busy = true;
+                lock.unlock();
+                cb(topic, payload, length);
+                lock.lock();
+                _busy = false;
+                delivered++;
+            }
+        }
+    }
+};
+
+#endif
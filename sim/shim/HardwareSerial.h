@@ -0,0 +1,4 @@
+#ifndef __SIM_HARDWARESERIAL_H__
+#define __SIM_HARDWARESERIAL_H__
+#include "Arduino.h"
+#endif
@@ -0,0 +1,29 @@
+#ifndef __SIM_IPADDRESS_H__
+#define __SIM_IPADDRESS_H__
+
+#include "Arduino.h"
+#include <arpa/inet.h>
+
+class IPAddress {
+public:
+    IPAddress() { memset(_b, 0, 4); }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { _b[0] = a; _b[1] = b; _b[2] = c; _b[3] = d; }
+    IPAddress(uint32_t addr) { memcpy(_b, &addr, 4); }   // thứ tự byte mạng
+
+    operator uint32_t() const { uint32_t v; memcpy(&v, _b, 4); return v; }
+    uint8_t operator[](int i) const { return _b[i]; }
+    bool operator==(const IPAddress &o) const { return memcmp(_b, o._b, 4) == 0; }
+
+    bool fromString(const char *s) { return s && inet_pton(AF_INET, s, _b) == 1; }
+    bool fromString(const String &s) { return fromString(s.c_str()); }
+    String toString() const {
+        char buf[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, _b, buf, sizeof(buf));
+        return String(buf);
+    }
+
+private:
+    uint8_t _b[4];
+};
+
+#endif
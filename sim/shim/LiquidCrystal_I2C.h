@@ -0,0 +1,15 @@
+#ifndef __SIM_LIQUIDCRYSTAL_I2C_H__
+#define __SIM_LIQUIDCRYSTAL_I2C_H__
+
+#include "Wire.h"
+
+class LiquidCrystal_I2C {
+public:
+    LiquidCrystal_I2C(uint8_t addr, uint8_t cols, uint8_t rows) {}
+    void begin() {}
+    void clear() {}
+    void setCursor(uint8_t col, uint8_t row) {}
+    size_t print(const char *s) { return 0; }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef __SIM_LITTLEFS_H__
+#define __SIM_LITTLEFS_H__
+
+#include "Arduino.h"
+#include <memory>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// LittleFS giả dựng trên 1 thư mục của host (FS::mount). Chưa mount thì flash
+// trống: mọi lần mở đều thất bại, như fleet simulator vẫn dùng (cấu hình lấy từ
+// dòng lệnh). Test mount 1 thư mục tạm để chạy đúng code LittleFS của firmware.
+class File : public Stream {
+public:
+    File() {}
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t *buf, size_t size) override {
+        return (_h && _h->fp) ? fwrite(buf, 1, size, _h->fp) : 0;
+    }
+    using Print::write;
+    int available() override { return (_h && _h->fp) ? (int)(size() - position()) : 0; }
+    int read() override { return (_h && _h->fp) ? fgetc(_h->fp) : -1; }
+    size_t read(uint8_t *buf, size_t size) { return (_h && _h->fp) ? fread(buf, 1, size, _h->fp) : 0; }
+    int peek() override {
+        if (!_h || !_h->fp) return -1;
+        int c = fgetc(_h->fp);
+        if (c >= 0) ungetc(c, _h->fp);
+        return c;
+    }
+    void flush() override { if (_h && _h->fp) fflush(_h->fp); }
+    // Như LittleFS: seek quá cuối file vẫn thành công, read sau đó trả về 0
+    bool seek(uint32_t pos) { return _h && _h->fp && fseek(_h->fp, pos, SEEK_SET) == 0; }
+    size_t position() const { return (_h && _h->fp) ? (size_t)ftell(_h->fp) : 0; }
+    size_t size() const {
+        if (!_h || !_h->fp) return 0;
+        fflush(_h->fp);
+        struct stat st;
+        return fstat(fileno(_h->fp), &st) == 0 ? (size_t)st.st_size : 0;
+    }
+    const char *name() const { return _h ? _h->name.c_str() : ""; }
+    const char *path() const { return _h ? _h->path.c_str() : ""; }
+    bool isDirectory() const { return _h && _h->dir; }
+    File openNextFile();
+    void close() { _h.reset(); }
+    operator bool() const { return _h != nullptr; }
+
+private:
+    // Handle dùng chung giữa các bản copy của File, giống FileImplPtr của ESP32
+    struct Handle {
+        FILE *fp = nullptr;
+        DIR *dir = nullptr;
+        std::string hostPath;
+        std::string path;    // đường dẫn trong FS, vd "/spool/1.seg"
+        std::string name;    // phần cuối của path
+        ~Handle() {
+            if (fp) fclose(fp);
+            if (dir) closedir(dir);
+        }
+    };
+    std::shared_ptr<Handle> _h;
+
+    friend class FS;
+};
+
+class FS {
+public:
+    // Gắn FS vào 1 thư mục trên host; root rỗng = tháo ra (flash trống)
+    void mount(const char *hostRoot) { _root = hostRoot ? hostRoot : ""; }
+    bool mounted() const { return !_root.empty(); }
+
+    bool begin(bool formatOnFail = false) { return true; }
+    bool exists(const char *path) {
+        struct stat st;
+        return mounted() && stat(host(path).c_str(), &st) == 0;
+    }
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool mkdir(const char *path) { return mounted() && ::mkdir(host(path).c_str(), 0755) == 0; }
+    bool mkdir(const String &path) { return mkdir(path.c_str()); }
+    bool remove(const char *path) { return mounted() && unlink(host(path).c_str()) == 0; }
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *from, const char *to) {
+        return mounted() && ::rename(host(from).c_str(), host(to).c_str()) == 0;
+    }
+
+    File open(const char *path, const char *mode = "r", bool create = false) {
+        File file;
+        if (!mounted() || path == nullptr || path[0] != '/') return file;
+
+        auto h = std::make_shared<File::Handle>();
+        h->path = path;
+        h->hostPath = host(path);
+        const char *slash = strrchr(path, '/');
+        h->name = slash[1] ? slash + 1 : path;
+
+        struct stat st;
+        if (mode[0] == 'r' && stat(h->hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            h->dir = opendir(h->hostPath.c_str());
+            if (h->dir == nullptr) return file;
+        } else {
+            std::string m = std::string(mode) + "b";
+            h->fp = fopen(h->hostPath.c_str(), m.c_str());
+            if (h->fp == nullptr) return file;
+        }
+        file._h = h;
+        return file;
+    }
+    File open(const String &path, const char *mode = "r", bool create = false) {
+        return open(path.c_str(), mode, create);
+    }
+
+private:
+    std::string _root;
+
+    std::string host(const char *path) const { return _root + (path ? path : ""); }
+};
+
+extern FS LittleFS;
+
+inline File File::openNextFile() {
+    if (!_h || !_h->dir) return File();
+    struct dirent *e;
+    while ((e = readdir(_h->dir)) != nullptr) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        std::string child = _h->path;
+        if (child.empty() || child.back() != '/') child += '/';
+        return LittleFS.open((child + e->d_name).c_str(), "r");
+    }
+    return File();
+}
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef __SIM_PRINT_H__
+#define __SIM_PRINT_H__
+#include "Arduino.h"
+#endif
@@ -0,0 +1,4 @@
+#ifndef __SIM_STREAM_H__
+#define __SIM_STREAM_H__
+#include "Arduino.h"
+#endif
@@ -0,0 +1,57 @@
+#ifndef __SIM_WIFI_H__
+#define __SIM_WIFI_H__
+
+#include "Client.h"
+
+#define WIFI_OFF    0
+#define WIFI_STA    1
+#define WIFI_AP     2
+#define WIFI_AP_STA 3
+#define WL_CONNECTED 3
+
+// Client TCP trên socket POSIX (thay cho lwIP của ESP32)
+class WiFiClient : public Client {
+public:
+    WiFiClient() : _fd(-1) {}
+    ~WiFiClient() { stop(); }
+
+    int connect(IPAddress ip, uint16_t port) override { return connect(ip, port, 3000); }
+    int connect(const char *host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return _fd >= 0; }
+    int setNoDelay(bool on);
+    int fd() const { return _fd; }
+
+private:
+    int _fd;
+
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient &operator=(const WiFiClient &) = delete;
+};
+
+// Trên host "WiFi" luôn kết nối ở chế độ STA
+class WiFiClass {
+public:
+    bool isConnected() { return true; }
+    int status() { return WL_CONNECTED; }
+    int getMode() { return WIFI_STA; }
+    int hostByName(const char *host, IPAddress &result);
+};
+
+extern WiFiClass WiFi;
+
+// Host đã có giờ hệ thống, không cần NTP
+void configTime(long gmtOffset, int daylightOffset, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+
+#endif
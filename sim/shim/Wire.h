@@ -0,0 +1,23 @@
+#ifndef __SIM_WIRE_H__
+#define __SIM_WIRE_H__
+
+#include "Arduino.h"
+
+// Không có bus I2C trên host: mặc định không thiết bị nào trả lời (NACK).
+// Các hàm là virtual để test kế thừa và giả lập thiết bị (xem test/test_dht20).
+class TwoWire {
+public:
+    virtual ~TwoWire() {}
+    virtual bool begin() { return true; }
+    virtual bool begin(int sda, int scl) { return true; }
+    virtual void beginTransmission(uint8_t address) {}
+    virtual size_t write(uint8_t data) { return 1; }
+    virtual uint8_t endTransmission(bool sendStop = true) { return 2; }
+    virtual uint8_t requestFrom(uint8_t address, uint8_t quantity) { return 0; }
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+};
+
+extern TwoWire Wire;
+
+#endif
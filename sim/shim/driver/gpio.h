@@ -0,0 +1,7 @@
+#ifndef __SIM_DRIVER_GPIO_H__
+#define __SIM_DRIVER_GPIO_H__
+
+// ESP32-S3: GPIO 0..48
+#define GPIO_IS_VALID_OUTPUT_GPIO(n) ((n) >= 0 && (n) <= 48)
+
+#endif
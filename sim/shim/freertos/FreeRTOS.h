@@ -0,0 +1,28 @@
+#ifndef __SIM_FREERTOS_H__
+#define __SIM_FREERTOS_H__
+
+// FreeRTOS tối thiểu dựng trên pthread: 1 tick = 1 ms
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+
+struct SimTask;
+struct SimSemaphore;
+struct SimQueue;
+typedef SimTask *TaskHandle_t;
+typedef SimSemaphore *SemaphoreHandle_t;
+typedef SimQueue *QueueHandle_t;
+// Đủ chỗ cho SimSemaphore (mutex + condition_variable) dựng tại chỗ, như bản thật
+typedef struct { alignas(16) uint8_t storage[160]; } StaticSemaphore_t;
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __SIM_FREERTOS_QUEUE_H__
+#define __SIM_FREERTOS_QUEUE_H__
+
+#include "FreeRTOS.h"
+
+// Queue copy theo giá trị như FreeRTOS (mỗi phần tử itemSize byte)
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+#endif
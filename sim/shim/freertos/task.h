@@ -0,0 +1,19 @@
+#ifndef __SIM_FREERTOS_TASK_H__
+#define __SIM_FREERTOS_TASK_H__
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+// Mỗi task là 1 thread; stack/priority/core bị bỏ qua
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth,
+                       void *param, UBaseType_t priority, TaskHandle_t *handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth,
+                                   void *param, UBaseType_t priority, TaskHandle_t *handle, int core);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+
+#endif
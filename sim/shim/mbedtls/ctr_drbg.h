@@ -0,0 +1,3 @@
+#ifndef __SIM_MBEDTLS_CTR_DRBG_H__
+#define __SIM_MBEDTLS_CTR_DRBG_H__
+#endif
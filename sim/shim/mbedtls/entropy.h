@@ -0,0 +1,3 @@
+#ifndef __SIM_MBEDTLS_ENTROPY_H__
+#define __SIM_MBEDTLS_ENTROPY_H__
+#endif
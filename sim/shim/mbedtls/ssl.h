@@ -0,0 +1,11 @@
+#ifndef __SIM_MBEDTLS_SSL_H__
+#define __SIM_MBEDTLS_SSL_H__
+
+// Simulator không mô phỏng TLS: chỉ cần kiểu để include/secure_client.h biên dịch.
+// SecureClient trong sim_board.cpp từ chối kết nối, trừ khi test đặt broker TLS giả
+typedef struct { int unused; } mbedtls_ssl_context;
+typedef struct { int unused; } mbedtls_ssl_config;
+
+#define MBEDTLS_ERR_SSL_CA_CHAIN_REQUIRED   -0x7680
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef __SIM_MBEDTLS_X509_CRT_H__
+#define __SIM_MBEDTLS_X509_CRT_H__
+
+typedef struct { int unused; } mbedtls_x509_crt;
+
+#define MBEDTLS_ERR_X509_CERT_VERIFY_FAILED -0x2700
+
+#endif
@@ -0,0 +1,103 @@
+// Phần firmware không có trên host: LED/relay, spool flash, cache TLS.
+// Chỉ giữ đủ hành vi để đường publish của coreiot chạy nguyên vẹn.
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "mainserver.h"
+#include "relay_output.h"
+#include "telemetry_spool.h"
+#include "secure_client.h"
+
+// ==================== TLS ====================
+// Không có mbedtls trên host: fleet chạy với broker TCP thường (coreiot_tls = false).
+// Test đặt sim_tls_broker để có broker kết thúc TLS giả: "bắt tay" chỉ thành công
+// khi client cấu hình đúng CA đã ký chứng chỉ broker (so PEM), như
+// MBEDTLS_SSL_VERIFY_REQUIRED, rồi chuyển tiếp byte MQTT sang broker.
+Client *sim_tls_broker = NULL;
+const char *sim_tls_broker_ca = NULL;
+uint32_t sim_tls_handshakes = 0;
+
+bool tls_session_persist = false;
+
+void tls_session_cache_load() {}
+void tls_session_remove_file() {}
+
+TlsSessionStats tls_session_stats() {
+    TlsSessionStats s;
+    memset(&s, 0, sizeof(s));
+    return s;
+}
+
+void tls_session_save_stats(JsonObject obj) {}
+
+SecureClient::SecureClient()
+    : _caPem(NULL), _port(0), _ready(false), _open(false), _resumed(false), _lastError(-1), _peeked(-1) {}
+SecureClient::~SecureClient() {}
+void SecureClient::setCACert(const char *pem) { _caPem = pem; }
+void SecureClient::setHostname(const char *host) { _host = host; }
+
+int SecureClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+    stop();
+    _port = port;
+    _lastError = -1;
+    if (sim_tls_broker == NULL) return 0;
+    sim_tls_handshakes++;
+    if (_caPem == NULL) {
+        _lastError = MBEDTLS_ERR_SSL_CA_CHAIN_REQUIRED;
+        return 0;
+    }
+    if (sim_tls_broker_ca == NULL || strcmp(_caPem, sim_tls_broker_ca) != 0) {
+        _lastError = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+        return 0;
+    }
+    if (!sim_tls_broker->connect(ip, port)) return 0;
+    _lastError = 0;
+    _open = true;
+    return 1;
+}
+
+int SecureClient::connect(IPAddress ip, uint16_t port) { return connect(ip, port, TLS_HANDSHAKE_TIMEOUT); }
+int SecureClient::connect(const char *host, uint16_t port) {
+    setHostname(host);
+    return connect(IPAddress(127, 0, 0, 1), port, TLS_HANDSHAKE_TIMEOUT);
+}
+size_t SecureClient::write(uint8_t b) { return write(&b, 1); }
+size_t SecureClient::write(const uint8_t *buf, size_t size) { return _open ? sim_tls_broker->write(buf, size) : 0; }
+int SecureClient::available() { return _open ? sim_tls_broker->available() : 0; }
+int SecureClient::read() { return _open ? sim_tls_broker->read() : -1; }
+int SecureClient::read(uint8_t *buf, size_t size) { return _open ? sim_tls_broker->read(buf, size) : -1; }
+int SecureClient::peek() { return _open ? sim_tls_broker->peek() : -1; }
+void SecureClient::flush() {}
+void SecureClient::stop() {
+    if (_open) sim_tls_broker->stop();
+    _open = false;
+}
+uint8_t SecureClient::connected() { return _open && sim_tls_broker->connected(); }
+
+// ==================== BOARD ====================
+void setLED(int num, bool state, int brightness) {}
+
+bool relay_output_handle_json(JsonVariantConst cmd) {
+    return false;
+}
+
+// ==================== SPOOL ====================
+// Không có flash: bản ghi "spool" chỉ được đếm rồi bỏ, simulator báo lại số này
+static TelemetrySpoolStats spoolStats = {0, 0, 0, 0, 0};
+
+void telemetry_spool_init() {}
+
+bool telemetry_spool_append(const uint8_t *payload, size_t length, uint8_t tag) {
+    spoolStats.spooled++;
+    spoolStats.dropped++;
+    return true;
+}
+
+void telemetry_spool_replay(SpoolPublishFn publish) {}
+
+bool telemetry_spool_empty() {
+    return true;
+}
+
+TelemetrySpoolStats telemetry_spool_stats() {
+    return spoolStats;
+}
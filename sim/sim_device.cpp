@@ -0,0 +1,126 @@
+#include "sim_device.h"
+#include "config_coreiot.h"
+#include "coreiot.h"
+#include "mqtt_queue.h"
+#include "payload_codec.h"
+#include "sensor_history.h"
+#include "telemetry_batch.h"
+#include "telemetry_filter.h"
+#include "telemetry_spool.h"
+#include "temp_humi_monitor.h"
+#include "task_mqtt.h"
+
+#include <malloc.h>
+
+// Chờ MQTT kết nối tối đa chừng này trước khi bắt đầu đo
+#define SIM_CONNECT_TIMEOUT  30000
+// Sau khi dừng sensor: chờ task MQTT gửi nốt batch cuối
+#define SIM_DRAIN_TIME       2000
+
+static size_t heapInUse(size_t base = 0) {
+    struct mallinfo2 mi = mallinfo2();
+    size_t used = mi.uordblks + mi.hblkhd;
+    return used > base ? used - base : 0;
+}
+
+// VmHWM: đỉnh RSS của process (kB trong /proc)
+static size_t peakRss() {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) return 0;
+    char line[128];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmHWM: %zu kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb * 1024;
+}
+
+// Cấu hình telemetry giống mục tương ứng trong coreiot.json
+static void applyConfig(const char *json) {
+    if (json == NULL) return;
+    DynamicJsonDocument doc(2048);
+    if (deserializeJson(doc, json)) {
+        fprintf(stderr, "⚠️ sim: config JSON không hợp lệ, dùng mặc định\n");
+        return;
+    }
+    telemetry_batch_load(doc["batch"]);
+    telemetry_filter_load(doc["filter"]);
+    mqtt_queue_load(doc["queue"]);
+    payload_codec_load(doc["codec"]);
+}
+
+// Nhiệt độ/độ ẩm đi ngẫu nhiên quanh giá trị phòng, đủ biến động để qua deadband
+static float walk(float value, float step, float lo, float hi) {
+    value += ((int32_t)(esp_random() % 2001) - 1000) * step / 1000.0f;
+    return constrain(value, lo, hi);
+}
+
+int sim_device_run(const SimDeviceOptions &opt, SimDeviceReport &report) {
+    memset(&report, 0, sizeof(report));
+    report.id = opt.id;
+    // Heap kế thừa từ process cha lúc fork không tính cho thiết bị
+    size_t heapBase = heapInUse();
+
+    String name = String(opt.prefix) + String(opt.id);
+    coreiot_server       = opt.host;
+    coreiot_port         = opt.port;
+    coreiot_client_id    = name;
+    coreiot_username     = name;
+    coreiot_password     = "";
+    coreiot_mqtt_version = opt.mqttVersion;
+    coreiot_tls          = false;
+    applyConfig(opt.configJson);
+
+    // Cùng thứ tự khởi tạo với setup() trong main.cpp
+    sensor_history_init();
+    telemetry_batch_init();
+    telemetry_spool_init();
+    mqtt_queue_init();
+    xTaskCreate(task_mqtt, "MQTT", 4096, NULL, 1, NULL);
+
+    uint32_t start = millis();
+    while (!isMQTTConnected() && millis() - start < SIM_CONNECT_TIMEOUT) {
+        delay(10);
+    }
+    if (!isMQTTConnected()) {
+        report.rssBytes = peakRss();
+        return -1;
+    }
+    report.connectMs = millis() - start;
+
+    float temperature = 25.0f + (esp_random() % 500) / 100.0f;
+    float humidity = 55.0f + (esp_random() % 1000) / 100.0f;
+    uint32_t lastSeq = 0;
+    uint32_t begin = millis();
+    uint32_t next = begin;
+
+    while (millis() - begin < opt.durationMs) {
+        temperature = walk(temperature, 0.5f, -10.0f, 60.0f);
+        humidity = walk(humidity, 2.0f, 0.0f, 100.0f);
+        temp_humi_report(DHT20_OK, temperature, humidity, lastSeq);
+        report.samples++;
+
+        size_t heap = heapInUse(heapBase);
+        if (heap > report.heapPeakBytes) report.heapPeakBytes = heap;
+
+        // Giữ nhịp cố định, không trôi theo thời gian xử lý
+        next += opt.periodMs;
+        int32_t wait = (int32_t)(next - millis());
+        if (wait > 0) vTaskDelay(wait);
+    }
+
+    telemetry_batch_flush();
+    delay(SIM_DRAIN_TIME);
+
+    MqttQueueStats q = mqtt_queue_stats();
+    TelemetrySpoolStats spool = telemetry_spool_stats();
+    report.enqueued          = q.enqueued;
+    report.delivered         = q.delivered;
+    report.dropped           = q.droppedOldest + q.droppedNewest;
+    report.spooled           = spool.spooled;
+    report.queueLatencyMaxMs = q.latencyMaxMs;
+    report.heapBytes         = heapInUse(heapBase);
+    report.rssBytes          = peakRss();
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef __SIM_DEVICE_H__
+#define __SIM_DEVICE_H__
+
+#include <Arduino.h>
+
+// Mỗi thiết bị ảo là 1 process riêng (coreiot/mqtt_queue/telemetry dùng biến
+// static toàn cục như trên ESP32), chạy đúng task_mqtt + temp_humi_report của firmware.
+
+struct SimDeviceOptions {
+    int         id;
+    const char *host;
+    uint16_t    port;
+    const char *prefix;        // client id / username = <prefix><id>
+    uint32_t    periodMs;      // chu kỳ đọc sensor
+    uint32_t    durationMs;    // thời gian chạy sau khi kết nối
+    const char *configJson;    // {"batch":..,"filter":..,"queue":..,"codec":..}, NULL = mặc định
+    int         mqttVersion;
+};
+
+// Kết quả gửi về process cha qua pipe (1 dòng, ghi nguyên khối)
+struct SimDeviceReport {
+    int      id;
+    uint32_t connectMs;        // từ lúc khởi động tới khi MQTT connected (0 = không kết nối được)
+    uint32_t samples;          // lần đọc sensor
+    uint32_t enqueued;         // message vào mqtt_queue
+    uint32_t delivered;        // message task MQTT đã lấy ra để gửi
+    uint32_t dropped;          // bị bỏ trong mqtt_queue (đầy)
+    uint32_t spooled;          // rơi xuống spool (không có flash trên host nên coi như mất)
+    uint32_t queueLatencyMaxMs;
+    size_t   heapBytes;        // heap thiết bị đang dùng khi kết thúc (mallinfo2)
+    size_t   heapPeakBytes;    // đỉnh heap đo theo chu kỳ sensor
+    size_t   rssBytes;         // VmHWM của process (gồm cả code/thư viện dùng chung)
+};
+
+extern bool sim_verbose;
+
+// Chạy 1 thiết bị tới hết durationMs, trả về 0 nếu kết nối được
+int sim_device_run(const SimDeviceOptions &opt, SimDeviceReport &report);
+
+#endif
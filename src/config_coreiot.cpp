@@ -1,6 +1,11 @@
 #include "config_coreiot.h"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include "telemetry_batch.h"
+#include "telemetry_filter.h"
+#include "mqtt_queue.h"
+#include "payload_codec.h"
+#include "secure_client.h"
 
 // ✅ Biến toàn cục
 String coreiot_server    = "";
@@ -8,6 +13,10 @@ int    coreiot_port      = 0;
 String coreiot_client_id = "";
 String coreiot_username  = "";
 String coreiot_password  = "";
+int    coreiot_mqtt_version   = 4;
+uint32_t coreiot_message_expiry = 0;
+bool     coreiot_persistent_session = true;
+bool     coreiot_tls = false;
 
 bool loadCoreIOTConfig() {
     if (!LittleFS.exists("/coreiot.json")) {
@@ -21,7 +30,7 @@ bool loadCoreIOTConfig() {
         return false;
     }
 
-    StaticJsonDocument<512> doc;
+    StaticJsonDocument<1536> doc;
     DeserializationError err = deserializeJson(doc, f);
     f.close();
     
@@ -36,6 +45,15 @@ bool loadCoreIOTConfig() {
     coreiot_client_id = doc["client_id"] | "";
     coreiot_username  = doc["username"] | "";
     coreiot_password  = doc["password"] | "";
+    coreiot_mqtt_version   = doc["mqtt_version"] | 4;
+    coreiot_message_expiry = doc["message_expiry"] | 0;
+    coreiot_persistent_session = doc["persistent_session"] | true;
+    coreiot_tls = doc["tls"] | (coreiot_port == 8883);
+    tls_session_persist = doc["tls_persist_sessions"] | false;
+    telemetry_batch_load(doc["batch"]);
+    telemetry_filter_load(doc["filter"]);
+    mqtt_queue_load(doc["queue"]);
+    payload_codec_load(doc["codec"]);
 
     Serial.println("📄 Loaded CoreIOT config:");
     Serial.println("   Server: " + coreiot_server);
@@ -43,17 +61,28 @@ bool loadCoreIOTConfig() {
     Serial.println("   Client ID: " + coreiot_client_id);
     Serial.println("   Username: " + coreiot_username);
     Serial.println("   Password: " + String(coreiot_password.length() > 0 ? "***" : "(empty)"));
+    Serial.println("   MQTT version: " + String(coreiot_mqtt_version));
+    Serial.println("   TLS: " + String(coreiot_tls ? "on" : "off"));
 
     return true;
 }
 
 bool saveCoreIOTConfig() {
-    StaticJsonDocument<512> doc;
+    StaticJsonDocument<1536> doc;
     doc["server"]    = coreiot_server;
     doc["port"]      = coreiot_port;
     doc["client_id"] = coreiot_client_id;
     doc["username"]  = coreiot_username;
     doc["password"]  = coreiot_password;
+    doc["mqtt_version"]   = coreiot_mqtt_version;
+    doc["message_expiry"] = coreiot_message_expiry;
+    doc["persistent_session"] = coreiot_persistent_session;
+    doc["tls"] = coreiot_tls;
+    doc["tls_persist_sessions"] = tls_session_persist;
+    telemetry_batch_save(doc.createNestedObject("batch"));
+    telemetry_filter_save(doc.createNestedObject("filter"));
+    mqtt_queue_save(doc.createNestedObject("queue"));
+    payload_codec_save(doc.createNestedObject("codec"));
 
     File f = LittleFS.open("/coreiot.json", "w");
     if (!f) {
@@ -2,27 +2,214 @@
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include "config_coreiot.h"
+#include "coreiot.h"
+#include "telemetry_batch.h"
+#include "telemetry_spool.h"
+#include "relay_output.h"
+#include "mqtt_queue.h"
+#include "mqtt_router.h"
+#include "payload_codec.h"
+#include "mainserver.h"
+#include "telemetry_filter.h"
+#include "secure_client.h"
+#include "driver/gpio.h"
+#include <LittleFS.h>
 
-WiFiClient mqttClient;
-PubSubClient client(mqttClient);
+// Backend MQTT chọn lúc build:
+//   0 (mặc định): PubSubClient do task MQTT poll (QoS 1, MQTT 5, persistent session, cache TLS)
+//   1: esp-mqtt (Espressif_MQTT_Client qua IMQTT_Client) chạy task riêng, lệnh nhận
+//      về được dispatch ngay trong event của nó. Chỉ có QoS 0 + clean session, bật bằng
+//      -D COREIOT_USE_ESP_MQTT=1 -D TELEMETRY_QOS=0 -D COMMAND_QOS=0
+#ifndef COREIOT_USE_ESP_MQTT
+#define COREIOT_USE_ESP_MQTT 0
+#endif
+#if COREIOT_USE_ESP_MQTT
+#include "Espressif_MQTT_Client.h"
+#endif
+
+// Buffer PubSubClient đủ lớn cho một batch telemetry
+#define MQTT_BUFFER_SIZE 1024
+// Telemetry gửi QoS 1: giữ tới khi có PUBACK, tự gửi lại nếu mất
+#ifndef TELEMETRY_QOS
+#define TELEMETRY_QOS 1
+#endif
+// Gom các PUBLISH nhỏ (replay spool, batch) trong 20 ms thành 1 lần ghi TCP
+#define MQTT_COALESCE_WINDOW 20
+
+// GPIO lệnh MQTT được phép điều khiển: chỉ các chân header dành cho người dùng.
+// Không bao giờ gồm LED (48, 41), I2C (11, 12), RS485 (9, 10), USB (19, 20) hay
+// flash/PSRAM (26-37). Đổi bằng -D MQTT_GPIO_ALLOW_LIST=... nếu đấu dây khác.
+#ifndef MQTT_GPIO_ALLOW_LIST
+#define MQTT_GPIO_ALLOW_LIST 5, 6, 7, 8, 17, 18, 21, 38, 47
+#endif
+
+// Kết nối lại: backoff mũ 1 s → 60 s, có jitter
+#define MQTT_BACKOFF_MIN     1000
+#define MQTT_BACKOFF_MAX     60000
+// Giới hạn thời gian từng bước kết nối
+#define MQTT_TCP_TIMEOUT     3000      // ms
+#define MQTT_CONNACK_TIMEOUT 5         // s (socket timeout của PubSubClient)
+// Giữ kết quả DNS 10 phút
+#define MQTT_DNS_TTL         600000
+// Lệnh nhận QoS 1: broker giữ lại khi mất kết nối ngắn và gửi lại khi nối lại
+#ifndef COMMAND_QOS
+#define COMMAND_QOS          1
+#endif
+// Espressif_MQTT_Client chỉ publish/subscribe QoS 0: phải chọn rõ lúc build,
+// không để telemetry/lệnh âm thầm mất đảm bảo giao nhận
+#if COREIOT_USE_ESP_MQTT && (TELEMETRY_QOS > 0 || COMMAND_QOS > 0)
+#error "esp-mqtt backend only supports QoS 0: build with -D TELEMETRY_QOS=0 -D COMMAND_QOS=0"
+#endif
+// MQTT 5: broker giữ session 1 giờ sau khi mất kết nối (3.1.1 giữ vô thời hạn)
+#define MQTT_SESSION_EXPIRY  3600
+
+// CA cho MQTT qua TLS (PEM), không có thì không kiểm tra chứng chỉ server
+#define MQTT_TLS_CA_FILE     "/coreiot_ca.pem"
+
+static String tlsCaPem;
 
-unsigned long lastReconnectAttempt = 0;
 String topicCommand;
-String topicTelemetry;
+// Topic telemetry theo định dạng payload: <user>/telemetry[/msgpack|/cbor]
+static String topicTelemetry[PAYLOAD_FORMAT_COUNT];
+
+// ==================== CONNECTION STATE MACHINE ====================
+// Chỉ task MQTT (coreiot_loop) chạm vào mạng; nơi khác chỉ đặt cờ yêu cầu.
+enum MqttConnState {
+    MQTT_ST_BACKOFF,     // chờ tới lượt thử kế tiếp
+    MQTT_ST_RESOLVE,     // validate config + DNS (có cache)
+    MQTT_ST_TCP,         // mở TCP có timeout
+    MQTT_ST_CONNACK,     // đã gửi CONNECT, poll CONNACK không block
+    MQTT_ST_SUBSCRIBE,
+    MQTT_ST_CONNECTED,
+};
+
+static MqttConnState connState = MQTT_ST_RESOLVE;
+static unsigned long nextAttemptAt = 0;
+static uint32_t backoffMs = MQTT_BACKOFF_MIN;
+static uint32_t connectAttempts = 0;
+static bool waitingForWifi = false;
+static volatile bool reconnectRequested = false;
+
+static String dnsHost;
+static IPAddress serverAddress;
+static unsigned long dnsResolvedAt = 0;
+static bool dnsValid = false;
+
+// Topic đã subscribe trong session đang được broker giữ (rỗng = chưa có)
+static String sessionTopic;
+
+// ==================== COMMAND HANDLERS ====================
+static bool commandOn(JsonVariantConst v) {
+    if (v.is<bool>()) return v.as<bool>();
+    const char *s = v | "OFF";
+    return strcasecmp(s, "ON") == 0;
+}
+
+// {"led":1,"state":"ON","brightness":80}
+static void handleLedCommand(const char *topic, JsonVariantConst cmd) {
+    int led = cmd["led"] | 0;
+    if (led < 1 || led > 2) {
+        Serial.println("⚠️ LED command thiếu/sai \"led\" (1 hoặc 2)");
+        return;
+    }
+    setLED(led, commandOn(cmd["state"]), cmd["brightness"] | 100);
+}
+
+static bool gpioAllowed(int gpio) {
+    static const int8_t allowed[] = {MQTT_GPIO_ALLOW_LIST};
+    for (size_t i = 0; i < sizeof(allowed) / sizeof(allowed[0]); i++) {
+        if (allowed[i] == gpio) return GPIO_IS_VALID_OUTPUT_GPIO(gpio);
+    }
+    return false;
+}
+
+// {"gpio":n,"status":"ON"}
+static void handleGpioCommand(const char *topic, JsonVariantConst cmd) {
+    int gpio = cmd["gpio"] | -1;
+    if (cmd["status"].isNull()) {
+        Serial.println("⚠️ GPIO command thiếu gpio/status");
+        return;
+    }
+    if (!gpioAllowed(gpio)) {
+        Serial.printf("⚠️ GPIO %d không nằm trong danh sách cho phép\n", gpio);
+        return;
+    }
+    bool on = commandOn(cmd["status"]);
+    pinMode(gpio, OUTPUT);
+    digitalWrite(gpio, on ? HIGH : LOW);
+    Serial.printf("%s GPIO %d %s\n", on ? "🔆" : "💤", gpio, on ? "ON" : "OFF");
+}
+
+// {"relay":n,"status":"ON"} hoặc {"relays":[...]}
+static void handleRelayCommand(const char *topic, JsonVariantConst cmd) {
+    if (!relay_output_handle_json(cmd)) {
+        Serial.println("⚠️ Relay command không hợp lệ");
+    }
+}
+
+// {"batch":{..},"filter":{..},"queue":{..}}: chỉ các tham số telemetry,
+// server/credentials không đổi được qua MQTT
+static void handleConfigCommand(const char *topic, JsonVariantConst cmd) {
+    telemetry_batch_load(cmd["batch"]);
+    telemetry_filter_load(cmd["filter"]);
+    mqtt_queue_load(cmd["queue"]);
+    saveCoreIOTConfig();
+    Serial.println("⚙️ Telemetry config updated via MQTT");
+}
+
+// Topic cũ <user>/commands: đoán lệnh theo field
+static void handleLegacyCommand(const char *topic, JsonVariantConst cmd) {
+    if (relay_output_handle_json(cmd)) return;
+    if (cmd.containsKey("led")) handleLedCommand(topic, cmd);
+    else if (cmd.containsKey("gpio")) handleGpioCommand(topic, cmd);
+    else Serial.println("⚠️ Lệnh MQTT không nhận dạng được");
+}
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
     Serial.printf("📩 MQTT [%s] => ", topic);
-    
-    String message = "";
-    for (int i = 0; i < length; i++) {
-        message += (char)payload[i];
+    Serial.write(payload, length);
+    Serial.println();
+
+    // Parse tại chỗ trong buffer nhận của backend rồi gọi handler theo topic.
+    // PubSubClient: chạy trong task MQTT; esp-mqtt: chạy ngay trong task event của nó
+    mqtt_router_dispatch(topic, payload, length);
+}
+
+void coreiot_init() {
+    // Level đầu là username, chấp nhận mọi giá trị để đổi cấu hình không cần compile lại
+    mqtt_router_add("+/commands", handleLegacyCommand);
+    mqtt_router_add("+/commands/led", handleLedCommand);
+    mqtt_router_add("+/commands/gpio", handleGpioCommand);
+    mqtt_router_add("+/commands/relay", handleRelayCommand);
+    mqtt_router_add("+/commands/config", handleConfigCommand);
+    mqtt_router_compile();
+
+    if (LittleFS.exists(MQTT_TLS_CA_FILE)) {
+        File f = LittleFS.open(MQTT_TLS_CA_FILE, "r");
+        tlsCaPem = f.readString();
+        f.close();
     }
-    Serial.println(message);
-    
-    // TODO: Xử lý commands từ CoreIOT
+#if !COREIOT_USE_ESP_MQTT
+    tls_session_cache_load();
+#endif
+}
+
+static void scheduleRetry() {
+    // Jitter trong nửa trên cửa sổ backoff để cả fleet không reconnect cùng lúc
+    uint32_t wait = backoffMs / 2 + esp_random() % (backoffMs / 2 + 1);
+    nextAttemptAt = millis() + wait;
+    backoffMs = backoffMs * 2 > MQTT_BACKOFF_MAX ? MQTT_BACKOFF_MAX : backoffMs * 2;
+    connState = MQTT_ST_BACKOFF;
+    Serial.printf("⏳ MQTT retry in %lu ms\n", (unsigned long)wait);
+}
+
+// Chưa có WiFi / config: thử lại sau 1 s, không tính là 1 lần thất bại
+static void waitForPrerequisites() {
+    nextAttemptAt = millis() + MQTT_BACKOFF_MIN;
+    connState = MQTT_ST_BACKOFF;
 }
 
-bool mqttReconnect() {
+static bool configReady() {
     // ✅ Validate config đầy đủ
     if (coreiot_server == "" || coreiot_port == 0) {
         static bool logged = false;
@@ -42,64 +229,184 @@ bool mqttReconnect() {
         }
         return false;
     }
+    return true;
+}
 
-    // ✅ Check WiFi
-    if (!WiFi.isConnected() || WiFi.getMode() != WIFI_STA) {
-        return false;
+static bool resolveServer(IPAddress &ip) {
+    if (ip.fromString(coreiot_server)) {
+        return true;
     }
 
-    Serial.println("\n========================================");
-    Serial.printf("🔌 MQTT connecting to %s:%d\n", coreiot_server.c_str(), coreiot_port);
+    unsigned long now = millis();
+    if (dnsValid && dnsHost == coreiot_server && now - dnsResolvedAt < MQTT_DNS_TTL) {
+        ip = serverAddress;
+        return true;
+    }
 
-    // ✅ Setup MQTT
-    client.setServer(coreiot_server.c_str(), coreiot_port);
-    client.setCallback(mqttCallback);
+    IPAddress resolved;
+    if (WiFi.hostByName(coreiot_server.c_str(), resolved) == 1) {
+        dnsHost = coreiot_server;
+        dnsResolvedAt = now;
+        dnsValid = true;
+        ip = resolved;
+        return true;
+    }
 
-    // ✅ Topics based on username
-    topicCommand = coreiot_username + "/commands";
-    topicTelemetry = coreiot_username + "/telemetry";
+    // DNS lỗi: dùng tạm địa chỉ cũ nếu có
+    if (dnsValid && dnsHost == coreiot_server) {
+        Serial.println("⚠️ DNS failed, using cached address");
+        ip = serverAddress;
+        return true;
+    }
+    return false;
+}
 
-    Serial.println("📋 MQTT Credentials:");
-    Serial.println("   Client ID: " + coreiot_client_id);
-    Serial.println("   Username: " + coreiot_username);
-    Serial.println("   Password: " + String(coreiot_password.length() > 0 ? "***" : "(empty)"));
-    Serial.println("   Command: " + topicCommand);
-    Serial.println("   Telemetry: " + topicTelemetry);
-
-    // ✅ MQTT BASIC AUTHENTICATION
-    bool connected = false;
-    
-    if (coreiot_password.length() > 0) {
-        // Có password
-        connected = client.connect(coreiot_client_id.c_str(), 
-                                   coreiot_username.c_str(), 
-                                   coreiot_password.c_str(), 
-                                   NULL, 0, false, NULL);
-    } else {
-        // Không có password (anonymous with username)
-        Serial.println("⚠️ Connecting without password...");
-        connected = client.connect(coreiot_client_id.c_str(), 
-                                   coreiot_username.c_str(), 
-                                   "", 
-                                   NULL, 0, false, NULL);
+// ==================== MQTT BACKEND ====================
+// Máy trạng thái chỉ gọi các hàm backend* dưới đây, không chạm trực tiếp vào client
+#if COREIOT_USE_ESP_MQTT
+
+static Espressif_MQTT_Client espMqtt;
+static IMQTT_Client &mqtt = espMqtt;
+static unsigned long connectStartedAt = 0;
+static bool connectTimedOut = false;
+// IMQTT_Client giữ con trỏ chuỗi: bản sao chỉ đổi khi bắt đầu kết nối mới
+static String espHost, espClientId, espUsername, espPassword;
+
+// esp-mqtt tự mở TCP/TLS trong task của nó
+static bool backendOpen() {
+    if (coreiot_tls) {
+        if (tlsCaPem.length() == 0) {
+            Serial.println("❌ esp-mqtt: TLS cần CA trong " MQTT_TLS_CA_FILE);
+            return false;
+        }
+        espMqtt.set_server_certificate(tlsCaPem.c_str());
     }
+    return true;
+}
 
-    if (connected) {
-        Serial.println("✅ MQTT connected!");
-        
-        // ✅ Subscribe
-        if (client.subscribe(topicCommand.c_str())) {
-            Serial.println("✅ Subscribed: " + topicCommand);
-        } else {
-            Serial.println("⚠️ Subscribe failed");
+static bool backendBeginConnect() {
+    if (coreiot_persistent_session) {
+        // Cấu hình từ web/flash: không chặn được lúc build, báo mỗi lần kết nối
+        Serial.println("⚠️ esp-mqtt: không hỗ trợ persistent session, dùng clean session "
+                       "(lệnh gửi lúc offline bị mất, không lọc bản gửi lại)");
+    }
+    // publish chỉ ghi vào outbox của esp-mqtt, không block task MQTT
+    espMqtt.set_enqueue_messages(true);
+    // Backoff/jitter vẫn do máy trạng thái quyết định
+    espMqtt.set_disable_auto_reconnect(true);
+    espMqtt.set_keep_alive_timeout(MQTT_KEEPALIVE);
+    mqtt.set_callback(mqttCallback);
+    mqtt.set_buffer_size(MQTT_BUFFER_SIZE);
+
+    espHost = coreiot_server;
+    espClientId = coreiot_client_id;
+    espUsername = coreiot_username;
+    espPassword = coreiot_password;
+    mqtt.set_server(espHost.c_str(), coreiot_port);
+    connectStartedAt = millis();
+    connectTimedOut = false;
+    return mqtt.connect(espClientId.c_str(), espUsername.c_str(), espPassword.c_str());
+}
+
+static int backendPollConnect() {
+    if (mqtt.connected()) return 1;
+    if (millis() - connectStartedAt > MQTT_TCP_TIMEOUT + MQTT_CONNACK_TIMEOUT * 1000UL) {
+        connectTimedOut = true;
+        mqtt.disconnect();
+        return -1;
+    }
+    return 0;
+}
+
+static int backendState() {
+    return connectTimedOut ? MQTT_CONNECTION_TIMEOUT : (mqtt.connected() ? MQTT_CONNECTED : MQTT_CONNECTION_LOST);
+}
+
+// Wrapper IMQTT_Client chỉ có clean session + QoS 0
+static bool backendSessionPresent()  { return false; }
+static uint32_t backendDuplicates()  { return 0; }
+static bool backendConnected()       { return mqtt.connected(); }
+static void backendLoop()            { mqtt.loop(); }
+
+static bool backendSubscribe(const char *topic) {
+    return mqtt.subscribe(topic);
+}
+
+// qos luôn là 0 ở đây (TELEMETRY_QOS đã bị chặn lúc build)
+static bool backendPublish(const char *topic, const uint8_t *payload, size_t length, uint8_t qos) {
+    return mqtt.publish(topic, payload, length);
+}
+
+#else
+
+WiFiClient mqttClient;
+SecureClient mqttSecureClient;
+PubSubClient client(mqttClient);
+
+// Mở TCP (hoặc TCP + bắt tay TLS, nối lại bằng session cũ nếu server cho phép)
+static bool backendOpen() {
+    if (coreiot_tls) {
+        // Như backend esp-mqtt: không có CA thì không kết nối, không bao giờ
+        // gửi password qua TLS chưa xác thực server
+        if (tlsCaPem.length() == 0) {
+            Serial.println("❌ MQTT: TLS cần CA trong " MQTT_TLS_CA_FILE);
+            return false;
         }
-        
-        Serial.println("========================================\n");
+        mqttSecureClient.setCACert(tlsCaPem.c_str());
+        mqttSecureClient.setHostname(coreiot_server.c_str());
+        if (!mqttSecureClient.connect(serverAddress, coreiot_port, MQTT_TCP_TIMEOUT)) {
+            Serial.printf("❌ MQTT: TLS connect to %s failed (-0x%04x)\n",
+                          serverAddress.toString().c_str(), -mqttSecureClient.lastError());
+            return false;
+        }
+        client.setClient(mqttSecureClient);
         return true;
     }
+    if (!mqttClient.connect(serverAddress, coreiot_port, MQTT_TCP_TIMEOUT)) {
+        Serial.printf("❌ MQTT: TCP connect to %s failed\n", serverAddress.toString().c_str());
+        return false;
+    }
+    client.setClient(mqttClient);
+    return true;
+}
+
+// TCP đã mở: cấu hình client và gửi CONNECT (không chờ CONNACK)
+static bool backendBeginConnect() {
+    client.setServer(serverAddress, coreiot_port);
+    client.setCallback(mqttCallback);
+    client.setBufferSize(MQTT_BUFFER_SIZE);
+    client.setSocketTimeout(MQTT_CONNACK_TIMEOUT);
+    client.setCoalesceWindow(MQTT_COALESCE_WINDOW);
+    // MQTT 5: topic telemetry tự dùng alias sau lần publish đầu tiên
+    client.setProtocolVersion(coreiot_mqtt_version == 5 ? MQTT_VERSION_5 : MQTT_VERSION_3_1_1);
+    client.setMessageExpiry(coreiot_message_expiry);
+    client.setSessionExpiry(coreiot_persistent_session ? MQTT_SESSION_EXPIRY : 0);
+    return client.beginConnect(coreiot_client_id.c_str(),
+                               coreiot_username.c_str(),
+                               coreiot_password.c_str(),
+                               NULL, 0, false, NULL, !coreiot_persistent_session);
+}
+
+static int backendPollConnect()      { return client.pollConnect(); }
+static int backendState()            { return client.state(); }
+static bool backendSessionPresent()  { return client.sessionPresent(); }
+static uint32_t backendDuplicates()  { return client.getDuplicateCount(); }
+static bool backendConnected()       { return client.connected(); }
+static void backendLoop()            { client.loop(); }
+
+static bool backendSubscribe(const char *topic) {
+    return client.subscribe(topic, COMMAND_QOS);
+}
+
+static bool backendPublish(const char *topic, const uint8_t *payload, size_t length, uint8_t qos) {
+    return client.publish(topic, payload, length, false, qos);
+}
 
+#endif
+
+static void printConnectError() {
     // ✅ Connection failed
-    int rc = client.state();
+    int rc = backendState();
     Serial.printf("❌ MQTT failed rc=%d\n", rc);
     Serial.println("\n📋 Error codes:");
     Serial.println("   rc=-4: Timeout");
@@ -110,53 +417,282 @@ bool mqttReconnect() {
     Serial.println("   rc=3: Server unavailable");
     Serial.println("   rc=4: Bad username/password");
     Serial.println("   rc=5: Not authorized");
+    Serial.println("   rc>=128: MQTT 5 reason code (0x84 = protocol không hỗ trợ → đặt mqtt_version = 4)");
     Serial.println("\n💡 Check:");
     Serial.println("   1. Client ID, Username, Password correct?");
     Serial.println("   2. Device activated on CoreIOT?");
     Serial.println("   3. Server & Port correct?");
     Serial.println("========================================\n");
-    
-    return false;
 }
 
-void coreiot_loop() {
-    if (!client.connected()) {
-        unsigned long now = millis();
-        if (now - lastReconnectAttempt > 5000) {
-            lastReconnectAttempt = now;
-            if (mqttReconnect()) {
-                lastReconnectAttempt = 0;
+// Kết nối mạng đã mở: chốt topic/codec và gửi CONNECT (không chờ CONNACK)
+static void startConnect() {
+    // ✅ Topics based on username
+    topicCommand = coreiot_username + "/commands/#";
+    for (uint8_t f = 0; f < PAYLOAD_FORMAT_COUNT; f++) {
+        topicTelemetry[f] = coreiot_username + "/telemetry" + payload_codec_suffix(f);
+    }
+    // Định dạng payload cố định trong suốt kết nối này
+    payload_codec_activate();
+
+    Serial.println("📋 MQTT Credentials:");
+    Serial.println("   Client ID: " + coreiot_client_id);
+    Serial.println("   Username: " + coreiot_username);
+    Serial.println("   Password: " + String(coreiot_password.length() > 0 ? "***" : "(empty)"));
+    Serial.println("   Command: " + topicCommand);
+    Serial.println("   Telemetry: " + topicTelemetry[payload_codec_format()]);
+    Serial.println("   Session: " + String(coreiot_persistent_session ? "persistent" : "clean"));
+
+    // ✅ MQTT BASIC AUTHENTICATION (không có password = anonymous with username)
+    if (coreiot_password.length() == 0) {
+        Serial.println("⚠️ Connecting without password...");
+    }
+    if (backendBeginConnect()) {
+        connState = MQTT_ST_CONNACK;
+        return;
+    }
+    printConnectError();
+    scheduleRetry();
+}
+
+// Chạy 1 bước; mỗi bước bị giới hạn thời gian nên task MQTT không bị treo lâu
+static void connectionStep() {
+    switch (connState) {
+    case MQTT_ST_BACKOFF:
+        if (reconnectRequested || (long)(millis() - nextAttemptAt) >= 0) {
+            reconnectRequested = false;
+            connState = MQTT_ST_RESOLVE;
+        }
+        break;
+
+    case MQTT_ST_RESOLVE: {
+        // ✅ Check WiFi
+        if (!configReady() || !WiFi.isConnected() || WiFi.getMode() != WIFI_STA) {
+            waitingForWifi = true;
+            waitForPrerequisites();
+            break;
+        }
+        waitingForWifi = false;
+        connectAttempts++;
+
+        Serial.println("\n========================================");
+        Serial.printf("🔌 MQTT connecting to %s:%d\n", coreiot_server.c_str(), coreiot_port);
+
+        IPAddress ip;
+        if (!resolveServer(ip)) {
+            Serial.println("❌ MQTT: DNS lookup failed for " + coreiot_server);
+            scheduleRetry();
+            break;
+        }
+        serverAddress = ip;
+        connState = MQTT_ST_TCP;
+        break;
+    }
+
+    case MQTT_ST_TCP:
+        if (!backendOpen()) {
+            // Có thể server đã đổi IP: lần sau resolve lại
+            dnsValid = false;
+            scheduleRetry();
+            break;
+        }
+        startConnect();
+        break;
+
+    case MQTT_ST_CONNACK: {
+        int rc = backendPollConnect();
+        if (rc == 0) {
+            break;
+        }
+        if (rc < 0) {
+            printConnectError();
+            scheduleRetry();
+            break;
+        }
+        Serial.println("✅ MQTT connected!");
+        // Broker còn giữ session cũ (kèm subscription): bỏ qua SUBSCRIBE,
+        // lệnh gửi tới lúc offline sẽ được broker gửi lại ngay sau CONNACK
+        if (coreiot_persistent_session && backendSessionPresent() && sessionTopic == topicCommand) {
+            Serial.println("✅ Session resumed: " + topicCommand);
+            Serial.println("========================================\n");
+            backoffMs = MQTT_BACKOFF_MIN;
+            connState = MQTT_ST_CONNECTED;
+            break;
+        }
+        sessionTopic = "";
+        connState = MQTT_ST_SUBSCRIBE;
+        break;
+    }
+
+    case MQTT_ST_SUBSCRIBE:
+        // ✅ Subscribe
+        if (backendSubscribe(topicCommand.c_str())) {
+            Serial.println("✅ Subscribed: " + topicCommand);
+            if (coreiot_persistent_session) {
+                sessionTopic = topicCommand;
             }
+        } else {
+            Serial.println("⚠️ Subscribe failed");
         }
-        return;
+        Serial.println("========================================\n");
+        backoffMs = MQTT_BACKOFF_MIN;
+        connState = MQTT_ST_CONNECTED;
+        break;
+
+    case MQTT_ST_CONNECTED:
+        if (!backendConnected()) {
+            Serial.printf("⚠️ MQTT connection lost (rc=%d)\n", backendState());
+            scheduleRetry();
+        }
+        break;
     }
+}
 
-    client.loop();
+// Payload không vừa slot in-flight thì gửi QoS 0 thay vì kẹt lại mãi trong spool
+static uint8_t publishQos(size_t length) {
+    return length <= publishMaxPayload() ? TELEMETRY_QOS : 0;
 }
 
-void publishData(String json) {
-    if (!client.connected()) {
-        Serial.println("⚠️ MQTT not connected");
-        return;
-    }
-    
-    if (topicTelemetry.length() == 0) {
-        topicTelemetry = coreiot_username + "/telemetry";
+static const char *telemetryTopic(uint8_t format) {
+    return topicTelemetry[format < PAYLOAD_FORMAT_COUNT ? format : PAYLOAD_JSON].c_str();
+}
+
+// Bản ghi spool mang theo định dạng lúc ghi (tag) nên gửi lại đúng topic
+static bool publishSpooled(const uint8_t *payload, size_t length, uint8_t format) {
+    if (connState != MQTT_ST_CONNECTED) {
+        return false;
     }
-    
-    if (client.publish(topicTelemetry.c_str(), json.c_str(), false)) {
-        Serial.println("✅ Published: " + json);
+    return backendPublish(telemetryTopic(format), payload, length, publishQos(length));
+}
+
+static void spoolPayload(const uint8_t *payload, size_t length, uint8_t format) {
+    if (telemetry_spool_append(payload, length, format)) {
+        Serial.printf("📦 MQTT not connected, spooled %u bytes\n", (unsigned)length);
     } else {
-        Serial.println("❌ Publish failed");
+        Serial.println("⚠️ MQTT not connected, spool failed");
+    }
+}
+
+// Gửi hết message producer đã xếp hàng; offline thì chuyển xuống flash
+static void drainQueue() {
+    MqttQueueCell *cell;
+    while ((cell = mqtt_queue_claim()) != NULL) {
+        if (connState != MQTT_ST_CONNECTED) {
+            // ✅ Lưu xuống flash, gửi lại khi MQTT kết nối lại
+            spoolPayload(cell->payload, cell->length, cell->format);
+        } else if (backendPublish(telemetryTopic(cell->format), cell->payload, cell->length, publishQos(cell->length))) {
+            Serial.printf("✅ Published %u bytes (%s)\n", (unsigned)cell->length, payload_codec_name(cell->format));
+        } else {
+            Serial.println("❌ Publish failed (in-flight window full), spooled");
+            spoolPayload(cell->payload, cell->length, cell->format);
+        }
+        mqtt_queue_release(cell);
+    }
+}
+
+// Chỉ chạy trong task MQTT: đây là nơi duy nhất chạm vào client
+void coreiot_loop() {
+    connectionStep();
+
+    if (connState == MQTT_ST_CONNECTED) {
+        backendLoop();
+        telemetry_batch_poll();
+    }
+    drainQueue();
+
+    if (connState == MQTT_ST_CONNECTED) {
+        // Gửi dần backlog đã spool, không lấn át dữ liệu live
+        telemetry_spool_replay(publishSpooled);
+    }
+}
+
+// ==================== PRODUCER API (mọi task) ====================
+// Chỉ xếp hàng, không bao giờ block trên socket
+bool publishPayload(const uint8_t *payload, size_t length) {
+    if (length >= MQTT_QUEUE_MSG_SIZE) {
+        Serial.println("❌ Payload too large, dropped");
+        return false;
     }
+    if (!mqtt_queue_push(payload, length, 0)) {
+        Serial.println("⚠️ MQTT queue full, message dropped");
+        return false;
+    }
+    return true;
+}
+
+bool publishJson(const JsonDocument &doc, uint8_t key) {
+    // JSON / MessagePack / CBOR theo codec của kết nối hiện tại
+    size_t length = payload_codec_measure(doc);
+
+    // serializeJson cần thêm 1 byte cho '\0'
+    if (length >= MQTT_QUEUE_MSG_SIZE) {
+        Serial.println("❌ Payload too large, dropped");
+        return false;
+    }
+
+    // ✅ Serialize thẳng vào ô của hàng đợi, không cấp phát heap
+    MqttQueueCell *cell = mqtt_queue_reserve(key);
+    if (cell == NULL) {
+        Serial.println("⚠️ MQTT queue full, message dropped");
+        return false;
+    }
+    cell->format = payload_codec_format();
+    size_t written = payload_codec_serialize(doc, cell->payload, MQTT_QUEUE_MSG_SIZE);
+    mqtt_queue_commit(cell, written == length ? length : 0);
+    return written == length;
+}
+
+void publishData(const String &json) {
+    publishPayload((const uint8_t *)json.c_str(), json.length());
+}
+
+// Không đọc client/topic đang được task MQTT sửa: tính từ cấu hình
+size_t publishMaxPayload() {
+    size_t topicLength = coreiot_username.length() + strlen("/telemetry/msgpack");
+    size_t overhead = MQTT_MAX_HEADER_SIZE + 2 + topicLength;
+    if (coreiot_mqtt_version == 5) overhead += MQTT_MAX_PUBLISH_PROPERTIES;   // 3.1.1 không có properties
+    size_t bufferSize = MQTT_BUFFER_SIZE;
+#if TELEMETRY_QOS > 0
+    // Packet QoS 1 phải vừa 1 slot in-flight (thêm 2 byte packet id)
+    overhead += 2;
+    if (bufferSize > MQTT_INFLIGHT_PACKET_SIZE) bufferSize = MQTT_INFLIGHT_PACKET_SIZE;
+#endif
+    size_t maxPayload = bufferSize > overhead ? bufferSize - overhead : 0;
+    return maxPayload < MQTT_QUEUE_MSG_SIZE ? maxPayload : MQTT_QUEUE_MSG_SIZE - 1;
 }
 
 bool isMQTTConnected() {
-    return client.connected();
+    return connState == MQTT_ST_CONNECTED;
 }
 
+// Gọi từ Arduino loop: chỉ đặt cờ, không bao giờ block trên mạng.
+// Bỏ qua thời gian chờ khi lần thử trước bị chặn vì mất WiFi và WiFi vừa có lại.
 void CORE_IOT_reconnect() {
-    if (!isMQTTConnected()) {
-        mqttReconnect();
+    if (connState == MQTT_ST_BACKOFF && waitingForWifi && WiFi.isConnected()) {
+        reconnectRequested = true;
+    }
+}
+
+const char *coreiot_state_str() {
+    switch (connState) {
+    case MQTT_ST_BACKOFF:   return "backoff";
+    case MQTT_ST_RESOLVE:   return "resolve";
+    case MQTT_ST_TCP:       return "tcp";
+    case MQTT_ST_CONNACK:   return "connack";
+    case MQTT_ST_SUBSCRIBE: return "subscribe";
+    case MQTT_ST_CONNECTED: return "connected";
     }
-}
\ No newline at end of file
+    return "unknown";
+}
+
+uint32_t coreiot_connect_attempts() {
+    return connectAttempts;
+}
+
+bool coreiot_session_present() {
+    return connState == MQTT_ST_CONNECTED && backendSessionPresent();
+}
+
+uint32_t coreiot_duplicate_commands() {
+    return backendDuplicates();
+}
@@ -1,7 +1,5 @@
 #include "global.h"
 
-float glob_temperature = 0;
-float glob_humidity = 0;
 bool ap_started = false;
 
 String WIFI_SSID;
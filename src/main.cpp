@@ -7,6 +7,10 @@
 #include "temp_humi_monitor.h"
 #include "mainserver.h"
 #include "tinyml.h"
+#include "sensor_history.h"
+#include "telemetry_batch.h"
+#include "telemetry_spool.h"
+#include "mqtt_queue.h"
 
 #include "task_check_info.h"
 #include "task_toogle_boot.h"
@@ -36,6 +40,10 @@ void setup()
       return;
   }
   Serial.println("✅ Semaphore created");
+  sensor_history_init();
+  telemetry_batch_init();
+  telemetry_spool_init();
+  mqtt_queue_init();
   
   // ✅ 3. Initialize WiFi FIRST (CRITICAL!)
   WiFi.mode(WIFI_OFF);
@@ -5,6 +5,7 @@
 #include <Adafruit_NeoPixel.h>
 
 #include "global.h"
+#include "sensor_history.h"
 #include "task_check_info.h"
 #include "mainserver.h"
 
@@ -37,8 +38,6 @@ extern SemaphoreHandle_t xBinarySemaphoreInternet;
 extern String WIFI_SSID;
 extern String WIFI_PASS;
 extern void Save_info_File(String, String, String, String, String);
-extern float glob_temperature;
-extern float glob_humidity;
 
 // ==================== GLOBAL VARIABLES ====================
 WebServer server(80);
@@ -223,15 +222,47 @@ void handleAPConfig() {
 
 void handleSensor() {
   String json;
-  if (isnan(glob_temperature) || glob_temperature == -1) {
+  SensorSnapshot snap = sensor_snapshot_read();
+  if (!snap.valid()) {
     json = "{\"error\":true,\"temperature\":0,\"humidity\":0}";
   } else {
-    json = "{\"error\":false,\"temperature\":" + String(glob_temperature, 1) + 
-           ",\"humidity\":" + String(glob_humidity, 1) + "}";
+    json = "{\"error\":false,\"temperature\":" + String(snap.temperature, 1) + 
+           ",\"humidity\":" + String(snap.humidity, 1) +
+           ",\"age_ms\":" + String(millis() - snap.timestamp) + "}";
   }
   server.send(200, "application/json", json);
 }
 
+// Gửi response theo từng chunk 256 byte thay vì build cả String lớn
+class ChunkedPrint : public Print {
+public:
+  size_t write(uint8_t c) override {
+    buf[len++] = c;
+    if (len == sizeof(buf)) flush();
+    return 1;
+  }
+  void flush() override {
+    if (len > 0) { server.sendContent(buf, len); len = 0; }
+  }
+private:
+  char buf[256];
+  size_t len = 0;
+};
+
+void handleHistory() {
+  uint32_t now = millis() / 1000;
+  uint32_t from = server.hasArg("from") ? server.arg("from").toInt() : 0;
+  uint32_t to = server.hasArg("to") ? server.arg("to").toInt() : now;
+  uint32_t res = server.hasArg("res") ? sensor_history_parse_res(server.arg("res")) : 0;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  ChunkedPrint out;
+  sensor_history_query(out, from, to, res);
+  out.flush();
+  server.sendContent("");
+}
+
 void handleStatic(String path, String type) {
   if (LittleFS.exists(path)) {
     File f = LittleFS.open(path, "r");
@@ -293,6 +324,7 @@ void main_server_task(void *pvParameters) {
   server.on("/connect", HTTP_GET, handleConnect);
   server.on("/apconfig", HTTP_GET, handleAPConfig);
   server.on("/sensor", HTTP_GET, handleSensor);
+  server.on("/api/history", HTTP_GET, handleHistory);
   
   server.on("/script.js", HTTP_GET, []() { handleStatic("/script.js", "application/javascript"); });
   server.on("/styles.css", HTTP_GET, []() { handleStatic("/styles.css", "text/css"); });
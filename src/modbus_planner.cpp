@@ -0,0 +1,86 @@
+#include "modbus_planner.h"
+
+// Thứ tự sắp xếp: slave → function → address
+static bool pointLess(const ModbusPoint &a, const ModbusPoint &b)
+{
+    if (a.slave != b.slave) return a.slave < b.slave;
+    if (a.function != b.function) return a.function < b.function;
+    return a.address < b.address;
+}
+
+bool modbus_plan_build(ModbusReadPlan &plan, ModbusPoint *points, uint8_t count,
+                       uint16_t maxGap, uint16_t maxRegisters)
+{
+    plan.points = points;
+    plan.pointCount = 0;
+    plan.blockCount = 0;
+
+    if (count > MODBUS_PLAN_MAX_POINTS) return false;
+    if (maxRegisters == 0 || maxRegisters > MODBUS_MAX_REGISTERS) maxRegisters = MODBUS_MAX_REGISTERS;
+
+    // Insertion sort trên mảng index (số point nhỏ, không cần gì hơn)
+    uint8_t order[MODBUS_PLAN_MAX_POINTS];
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t j = i;
+        while (j > 0 && pointLess(points[i], points[order[j - 1]])) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    ModbusReadBlock *current = nullptr;
+    for (uint8_t i = 0; i < count; i++) {
+        const ModbusPoint &p = points[order[i]];
+
+        bool merge = false;
+        if (current && current->slave == p.slave && current->function == p.function) {
+            uint16_t end = current->address + current->count;       // register đầu tiên sau block
+            uint16_t span = p.address - current->address + 1;
+            merge = (p.address < end) ||
+                    (p.address - end <= maxGap && span <= maxRegisters);
+        }
+
+        if (merge) {
+            uint16_t span = p.address - current->address + 1;
+            if (span > current->count) current->count = span;
+        } else {
+            if (plan.blockCount >= MODBUS_PLAN_MAX_BLOCKS) return false;
+            current = &plan.blocks[plan.blockCount++];
+            current->slave = p.slave;
+            current->function = p.function;
+            current->address = p.address;
+            current->count = 1;
+        }
+        plan.blockOf[order[i]] = plan.blockCount - 1;
+    }
+
+    plan.pointCount = count;
+    return true;
+}
+
+uint8_t modbus_plan_execute(ModbusReadPlan &plan)
+{
+    uint16_t values[MODBUS_MAX_REGISTERS];
+    uint8_t okCount = 0;
+
+    for (uint8_t b = 0; b < plan.blockCount; b++) {
+        const ModbusReadBlock &block = plan.blocks[b];
+        uint8_t result = modbus_read_registers(block.slave, block.function, block.address, block.count, values);
+        if (result != MODBUS_OK) {
+            Serial.printf("❌ Modbus read slave %u 0x%04X x%u failed: %s\n",
+                          block.slave, block.address, block.count, modbus_result_str(result));
+        }
+
+        for (uint8_t i = 0; i < plan.pointCount; i++) {
+            if (plan.blockOf[i] != b) continue;
+            ModbusPoint &p = plan.points[i];
+            p.ok = (result == MODBUS_OK);
+            if (p.ok) {
+                p.raw = values[p.address - block.address];
+                okCount++;
+            }
+        }
+    }
+    return okCount;
+}
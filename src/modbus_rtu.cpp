@@ -0,0 +1,319 @@
+#include "modbus_rtu.h"
+#include "modbus_scheduler.h"
+
+// ==================== STATE ====================
+static HardwareSerial *bus = nullptr;
+static QueueHandle_t requestQueue = nullptr;
+static TaskHandle_t busTask = nullptr;
+static uint32_t t35Us = 4010;
+static uint32_t lastBusActivityUs = 0;
+static uint16_t crcTable[256];
+
+// ==================== CRC16 ====================
+static void buildCrcTable()
+{
+    for (uint16_t i = 0; i < 256; i++) {
+        uint16_t crc = i;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+        }
+        crcTable[i] = crc;
+    }
+}
+
+uint16_t modbus_crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc = (crc >> 8) ^ crcTable[(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+// ==================== TIMING ====================
+// Spec Modbus RTU: 1 ký tự = 11 bit; trên 19200 baud dùng giá trị cố định 1750us
+static uint32_t computeT35(uint32_t baud)
+{
+    if (baud > 19200) return 1750;
+    return (uint32_t)((35UL * 11UL * 1000000UL) / (10UL * baud));
+}
+
+uint32_t modbus_t35_us()
+{
+    return t35Us;
+}
+
+// ==================== FRAME ====================
+static size_t buildFrame(const ModbusRequest &req, uint8_t *frame)
+{
+    size_t n = 0;
+    frame[n++] = req.slave;
+    frame[n++] = req.function;
+    frame[n++] = req.address >> 8;
+    frame[n++] = req.address & 0xFF;
+    frame[n++] = req.count >> 8;
+    frame[n++] = req.count & 0xFF;
+
+    if (req.function == MODBUS_FC_WRITE_COILS || req.function == MODBUS_FC_WRITE_REGISTERS) {
+        frame[n++] = req.dataLength;
+        memcpy(frame + n, req.data, req.dataLength);
+        n += req.dataLength;
+    }
+
+    uint16_t crc = modbus_crc16(frame, n);
+    frame[n++] = crc & 0xFF;   // CRC gửi byte thấp trước
+    frame[n++] = crc >> 8;
+    return n;
+}
+
+// Độ dài response bình thường (không phải exception) tính theo function code
+static size_t expectedLength(const ModbusRequest &req)
+{
+    switch (req.function) {
+        case MODBUS_FC_READ_COILS:
+        case MODBUS_FC_READ_DISCRETE_INPUTS:
+            return 5 + (req.count + 7) / 8;
+        case MODBUS_FC_READ_HOLDING:
+        case MODBUS_FC_READ_INPUT:
+            return 5 + 2 * req.count;
+        default:
+            return 8;   // FC05/06/15/16 echo lại address + count/value
+    }
+}
+
+// Chờ đủ t3.5 kể từ lần cuối có hoạt động trên bus trước khi phát frame mới
+static void waitInterFrameGap()
+{
+    uint32_t elapsed = micros() - lastBusActivityUs;
+    if (elapsed < t35Us) {
+        delayMicroseconds(t35Us - elapsed);
+    }
+}
+
+// Đọc response theo sự kiện từ UART driver: onReceive(..., true) chỉ gọi
+// callback khi line im lặng đủ RX timeout (~t3.5), tức là khi 1 frame vừa
+// kết thúc. Bus task ngủ trên task notification thay vì poll available().
+static size_t receiveFrame(uint8_t *buf, size_t expected, uint16_t timeoutMs)
+{
+    size_t len = 0;
+    uint32_t start = millis();
+    // Khi đã có byte, chỉ chờ thêm khoảng t3.5 cho phần còn lại của frame
+    uint32_t gapMs = t35Us / 1000 + 2;
+
+    while (true) {
+        uint32_t elapsed = millis() - start;
+        if (len == 0 && elapsed >= timeoutMs) break;
+
+        uint32_t waitMs = (len == 0) ? timeoutMs - elapsed : gapMs;
+        bool idle = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs)) > 0;
+
+        size_t before = len;
+        while (bus->available() && len < MODBUS_MAX_ADU) {
+            buf[len++] = bus->read();
+        }
+
+        if (len >= expected) break;
+        // Exception response có độ dài cố định 5 byte
+        if (len >= 5 && (buf[1] & 0x80)) break;
+        // Line đã idle (hoặc không còn byte mới) → frame kết thúc
+        if (len > 0 && (idle || len == before)) break;
+    }
+
+    lastBusActivityUs = micros();
+    return len;
+}
+
+static uint8_t executeOnce(ModbusRequest &req, const uint8_t *frame, size_t frameLength)
+{
+    // Bỏ các byte rác và sự kiện idle còn sót từ transaction trước
+    while (bus->available()) bus->read();
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    waitInterFrameGap();
+    bus->write(frame, frameLength);
+    bus->flush();
+    lastBusActivityUs = micros();
+
+    size_t len = receiveFrame(req.response, expectedLength(req), req.timeoutMs);
+    req.responseLength = len;
+
+    if (len == 0) return MODBUS_ERR_TIMEOUT;
+    if (len < 5) return MODBUS_ERR_FRAME;
+
+    uint16_t crc = modbus_crc16(req.response, len - 2);
+    if ((req.response[len - 2] | (req.response[len - 1] << 8)) != crc) return MODBUS_ERR_CRC;
+
+    if (req.response[0] != req.slave) return MODBUS_ERR_FRAME;
+    if (req.response[1] == (req.function | 0x80)) {
+        req.exception = req.response[2];
+        return MODBUS_ERR_EXCEPTION;
+    }
+    if (req.response[1] != req.function) return MODBUS_ERR_FRAME;
+    if (len != expectedLength(req)) return MODBUS_ERR_FRAME;
+
+    return MODBUS_OK;
+}
+
+static void execute(ModbusRequest &req)
+{
+    uint8_t frame[MODBUS_MAX_ADU];
+    size_t frameLength = buildFrame(req, frame);
+
+    req.exception = 0;
+    req.attempts = 0;
+    uint32_t startUs = micros();
+    do {
+        req.attempts++;
+        req.result = executeOnce(req, frame, frameLength);
+        // Exception là câu trả lời hợp lệ của slave, retry không có ích
+        if (req.result == MODBUS_OK || req.result == MODBUS_ERR_EXCEPTION) break;
+    } while (req.attempts <= req.retries);
+
+    modbus_stats_record(req.slave, req.result, micros() - startUs);
+}
+
+// ==================== BUS TASK ====================
+// Task duy nhất được phép chạm vào UART. Lệnh từ các task khác (ghi relay...)
+// được xử lý trước; khi queue rỗng mới chạy các job đọc định kỳ tới hạn.
+static void modbus_task(void *pvParameters)
+{
+    ModbusRequest *req;
+    while (true) {
+        uint32_t idleMs = modbus_scheduler_idle_ms();
+        if (xQueueReceive(requestQueue, &req, pdMS_TO_TICKS(idleMs)) == pdTRUE) {
+            execute(*req);
+            // Sau lệnh này caller có thể đã trả về: không chạm vào req nữa
+            xSemaphoreGive(req->done);
+            continue;
+        }
+        modbus_scheduler_run_due();
+    }
+}
+
+// Chạy trong UART event task khi RX timeout xảy ra
+static void onRxIdle()
+{
+    if (busTask) xTaskNotifyGive(busTask);
+}
+
+// ==================== API ====================
+void modbus_init(HardwareSerial &serial, uint32_t baud)
+{
+    if (requestQueue) return;
+
+    buildCrcTable();
+    bus = &serial;
+    t35Us = computeT35(baud);
+    lastBusActivityUs = micros();
+
+    // RX timeout của UART tính bằng số ký tự (11 bit); làm tròn lên để >= t3.5
+    uint32_t charUs = (11UL * 1000000UL) / baud;
+    uint32_t symbols = (t35Us + charUs - 1) / charUs;
+    serial.setRxTimeout(symbols < 1 ? 1 : symbols);
+    serial.onReceive(onRxIdle, true);
+
+    requestQueue = xQueueCreate(MODBUS_QUEUE_LENGTH, sizeof(ModbusRequest *));
+    xTaskCreate(modbus_task, "Task_Modbus", 4096, NULL, 2, &busTask);
+
+    Serial.printf("🔌 Modbus RTU master: %lu baud, t3.5 = %lu us\n",
+                  (unsigned long)baud, (unsigned long)t35Us);
+}
+
+uint8_t modbus_transact(ModbusRequest &req)
+{
+    if (!requestQueue) {
+        req.result = MODBUS_ERR_QUEUE;
+        return req.result;
+    }
+
+    // Job định kỳ chạy ngay trong bus task: thực thi trực tiếp, không qua queue
+    if (xTaskGetCurrentTaskHandle() == busTask) {
+        execute(req);
+        return req.result;
+    }
+
+    // Semaphore tĩnh nằm trong req: không cấp phát, và chỉ bus task give được,
+    // nên notify từ nơi khác (vd mqtt_queue_commit) không đánh thức caller sớm
+    req.done = xSemaphoreCreateBinaryStatic(&req.doneBuffer);
+    ModbusRequest *ptr = &req;
+    if (xQueueSend(requestQueue, &ptr, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        vSemaphoreDelete(req.done);
+        req.result = MODBUS_ERR_QUEUE;
+        return req.result;
+    }
+
+    // Bus task luôn trả lời sau tối đa (retries + 1) * timeout, nên chờ vô hạn
+    // là an toàn và tránh việc bus task ghi vào req sau khi caller đã thoát.
+    xSemaphoreTake(req.done, portMAX_DELAY);
+    vSemaphoreDelete(req.done);
+    return req.result;
+}
+
+void modbus_prepare(ModbusRequest &req, uint8_t slave, uint8_t function, uint16_t address, uint16_t count)
+{
+    req.slave = slave;
+    req.function = function;
+    req.address = address;
+    req.count = count;
+    req.data = nullptr;
+    req.dataLength = 0;
+    req.timeoutMs = MODBUS_DEFAULT_TIMEOUT;
+    req.retries = MODBUS_DEFAULT_RETRIES;
+    req.result = MODBUS_OK;
+    req.exception = 0;
+    req.attempts = 0;
+    req.responseLength = 0;
+}
+
+uint8_t modbus_read_registers(uint8_t slave, uint8_t function, uint16_t address, uint16_t count, uint16_t *out)
+{
+    if (count == 0 || count > MODBUS_MAX_REGISTERS) return MODBUS_ERR_FRAME;
+
+    ModbusRequest req;
+    modbus_prepare(req, slave, function, address, count);
+    if (modbus_transact(req) != MODBUS_OK) return req.result;
+
+    for (uint16_t i = 0; i < count; i++) {
+        out[i] = (req.response[3 + 2 * i] << 8) | req.response[4 + 2 * i];
+    }
+    return MODBUS_OK;
+}
+
+uint8_t modbus_write_coil(uint8_t slave, uint16_t address, bool on)
+{
+    ModbusRequest req;
+    modbus_prepare(req, slave, MODBUS_FC_WRITE_COIL, address, on ? 0xFF00 : 0x0000);
+    return modbus_transact(req);
+}
+
+// bits: LSB của byte đầu tiên là coil tại address (đóng gói theo spec FC15)
+uint8_t modbus_write_coils(uint8_t slave, uint16_t address, uint16_t count, const uint8_t *bits)
+{
+    if (count == 0 || count > MODBUS_MAX_COILS) return MODBUS_ERR_FRAME;
+
+    ModbusRequest req;
+    modbus_prepare(req, slave, MODBUS_FC_WRITE_COILS, address, count);
+    req.data = bits;
+    req.dataLength = (count + 7) / 8;
+    return modbus_transact(req);
+}
+
+uint8_t modbus_write_register(uint8_t slave, uint16_t address, uint16_t value)
+{
+    ModbusRequest req;
+    modbus_prepare(req, slave, MODBUS_FC_WRITE_REGISTER, address, value);
+    return modbus_transact(req);
+}
+
+const char *modbus_result_str(uint8_t result)
+{
+    switch (result) {
+        case MODBUS_OK:            return "ok";
+        case MODBUS_ERR_TIMEOUT:   return "timeout";
+        case MODBUS_ERR_CRC:       return "crc";
+        case MODBUS_ERR_FRAME:     return "frame";
+        case MODBUS_ERR_EXCEPTION: return "exception";
+        case MODBUS_ERR_QUEUE:     return "queue";
+        default:                   return "unknown";
+    }
+}
@@ -0,0 +1,142 @@
+#include "modbus_scheduler.h"
+
+static ModbusPollJob *jobs[MODBUS_MAX_JOBS];
+static volatile uint8_t jobCount = 0;
+
+static ModbusDeviceStats devices[MODBUS_MAX_DEVICES];
+static uint8_t deviceCount = 0;
+static uint32_t busBusyUs = 0;          // tổng thời gian bus bận
+static uint32_t busBusyOverflowMs = 0;  // phần đã chuyển sang ms để tránh tràn
+static uint32_t statsStartMs = 0;
+
+// ==================== JOBS ====================
+bool modbus_scheduler_add(ModbusPollJob &job)
+{
+    if (jobCount >= MODBUS_MAX_JOBS || !job.plan || job.periodMs == 0) return false;
+
+    job.nextDue = millis();
+    job.runs = 0;
+    job.misses = 0;
+    job.maxLateMs = 0;
+
+    // Ghi slot trước, tăng jobCount sau để bus task không thấy job dở dang
+    jobs[jobCount] = &job;
+    jobCount = jobCount + 1;
+    return true;
+}
+
+// Job tới hạn có priority cao nhất; cùng priority thì job trễ hơn chạy trước
+static ModbusPollJob *pickDue(uint32_t now)
+{
+    ModbusPollJob *best = nullptr;
+    for (uint8_t i = 0; i < jobCount; i++) {
+        ModbusPollJob *job = jobs[i];
+        if ((int32_t)(now - job->nextDue) < 0) continue;
+        if (!best || job->priority > best->priority ||
+            (job->priority == best->priority && (int32_t)(job->nextDue - best->nextDue) < 0)) {
+            best = job;
+        }
+    }
+    return best;
+}
+
+uint32_t modbus_scheduler_idle_ms()
+{
+    uint32_t now = millis();
+    uint32_t wait = 1000;
+    for (uint8_t i = 0; i < jobCount; i++) {
+        int32_t until = (int32_t)(jobs[i]->nextDue - now);
+        if (until <= 0) return 0;
+        if ((uint32_t)until < wait) wait = until;
+    }
+    return wait;
+}
+
+void modbus_scheduler_run_due()
+{
+    uint32_t now = millis();
+    ModbusPollJob *job = pickDue(now);
+    if (!job) return;
+
+    uint32_t late = now - job->nextDue;
+    if (late > job->maxLateMs) job->maxLateMs = late;
+    if (job->deadlineMs && late > job->deadlineMs) job->misses++;
+
+    modbus_plan_execute(*job->plan);
+    job->runs++;
+
+    // Giữ nhịp theo lịch; nếu đã trễ hơn 1 chu kỳ thì bỏ qua các lần lỡ
+    job->nextDue += job->periodMs;
+    if ((int32_t)(millis() - job->nextDue) >= 0) {
+        job->nextDue = millis() + job->periodMs;
+    }
+
+    if (job->consumer) xTaskNotifyGive(job->consumer);
+}
+
+// ==================== STATS ====================
+static ModbusDeviceStats *deviceStats(uint8_t slave)
+{
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        if (devices[i].slave == slave) return &devices[i];
+    }
+    if (deviceCount >= MODBUS_MAX_DEVICES) return nullptr;
+    ModbusDeviceStats *d = &devices[deviceCount];
+    memset(d, 0, sizeof(*d));
+    d->slave = slave;
+    deviceCount++;
+    return d;
+}
+
+void modbus_stats_record(uint8_t slave, uint8_t result, uint32_t durationUs)
+{
+    if (statsStartMs == 0) statsStartMs = millis();
+
+    busBusyUs += durationUs;
+    if (busBusyUs >= 1000000) {
+        busBusyOverflowMs += busBusyUs / 1000;
+        busBusyUs %= 1000;
+    }
+
+    ModbusDeviceStats *d = deviceStats(slave);
+    if (!d) return;
+    d->transactions++;
+    d->latencySumUs += durationUs;
+    if (durationUs > d->latencyMaxUs) d->latencyMaxUs = durationUs;
+    if (result != MODBUS_OK) d->errors++;
+    if (result == MODBUS_ERR_TIMEOUT) d->timeouts++;
+    if (result == MODBUS_ERR_EXCEPTION) d->exceptions++;
+}
+
+void modbus_scheduler_save_stats(JsonObject obj)
+{
+    uint32_t busyMs = busBusyOverflowMs + busBusyUs / 1000;
+    uint32_t elapsed = statsStartMs ? millis() - statsStartMs : 0;
+    obj["busy_ms"] = busyMs;
+    obj["utilization"] = elapsed ? (float)busyMs * 100.0f / elapsed : 0.0f;
+
+    JsonArray jobArr = obj.createNestedArray("jobs");
+    for (uint8_t i = 0; i < jobCount; i++) {
+        const ModbusPollJob *job = jobs[i];
+        JsonObject j = jobArr.createNestedObject();
+        j["name"] = job->name;
+        j["period_ms"] = job->periodMs;
+        j["priority"] = job->priority;
+        j["runs"] = job->runs;
+        j["deadline_misses"] = job->misses;
+        j["max_late_ms"] = job->maxLateMs;
+    }
+
+    JsonArray devArr = obj.createNestedArray("devices");
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        const ModbusDeviceStats &d = devices[i];
+        JsonObject o = devArr.createNestedObject();
+        o["slave"] = d.slave;
+        o["transactions"] = d.transactions;
+        o["errors"] = d.errors;
+        o["timeouts"] = d.timeouts;
+        o["exceptions"] = d.exceptions;
+        o["latency_avg_us"] = d.transactions ? (uint32_t)(d.latencySumUs / d.transactions) : 0;
+        o["latency_max_us"] = d.latencyMaxUs;
+    }
+}
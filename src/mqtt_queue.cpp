@@ -0,0 +1,230 @@
+#include "mqtt_queue.h"
+
+// Ring buffer có số thứ tự trên từng ô (kiểu Vyukov): producer giành vị trí
+// bằng compare-exchange, không cần mutex, an toàn giữa 2 core.
+//   sequence == pos      : ô trống, producer ở vị trí pos được ghi
+//   sequence == pos + 1  : đã commit, consumer được lấy
+#define QUEUE_MASK (MQTT_QUEUE_DEPTH - 1)
+
+static_assert((MQTT_QUEUE_DEPTH & QUEUE_MASK) == 0, "MQTT_QUEUE_DEPTH must be a power of two");
+
+MqttQueuePolicy mqtt_queue_policy = MQTT_QUEUE_DROP_OLDEST;
+
+static MqttQueueCell cells[MQTT_QUEUE_DEPTH];
+static std::atomic<uint32_t> enqueuePos(0);
+static std::atomic<uint32_t> dequeuePos(0);
+static std::atomic<uint32_t> latestTicket[MQTT_QUEUE_KEYS];
+static TaskHandle_t consumerTask = NULL;
+
+// Producer cập nhật từ nhiều task
+static std::atomic<uint32_t> statEnqueued(0);
+static std::atomic<uint32_t> statDroppedOldest(0);
+static std::atomic<uint32_t> statDroppedNewest(0);
+static std::atomic<uint32_t> statHighWater(0);
+
+// Chỉ task MQTT cập nhật
+static uint32_t statDelivered = 0;
+static uint32_t statCoalesced = 0;
+static uint32_t latencyMaxMs = 0;
+static uint64_t latencySumMs = 0;
+
+static const char *const policyNames[] = { "drop_oldest", "drop_newest", "coalesce" };
+
+// ==================== HELPERS ====================
+static MqttQueueCell *tryReserve() {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        MqttQueueCell *cell = &cells[pos & QUEUE_MASK];
+        uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell->ticket = pos;
+                return cell;
+            }
+        } else if (diff < 0) {
+            return NULL;   // đầy
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+static MqttQueueCell *tryDequeue() {
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        MqttQueueCell *cell = &cells[pos & QUEUE_MASK];
+        uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return cell;
+            }
+        } else if (diff < 0) {
+            return NULL;   // rỗng, hoặc ô đầu còn đang được producer ghi
+        } else {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+static void freeCell(MqttQueueCell *cell) {
+    cell->sequence.store(cell->ticket + MQTT_QUEUE_DEPTH, std::memory_order_release);
+}
+
+// Ghi nhận ticket mới nhất của key (nhiều producer có thể ghi cùng lúc)
+static void markLatest(uint8_t key, uint32_t ticket) {
+    uint32_t current = latestTicket[key].load(std::memory_order_relaxed);
+    while ((int32_t)(ticket - current) > 0 &&
+           !latestTicket[key].compare_exchange_weak(current, ticket, std::memory_order_release)) {
+    }
+}
+
+static void updateHighWater() {
+    uint32_t depth = enqueuePos.load(std::memory_order_relaxed) - dequeuePos.load(std::memory_order_relaxed);
+    uint32_t high = statHighWater.load(std::memory_order_relaxed);
+    while (depth > high &&
+           !statHighWater.compare_exchange_weak(high, depth, std::memory_order_relaxed)) {
+    }
+}
+
+// ==================== API ====================
+void mqtt_queue_init() {
+    for (uint32_t i = 0; i < MQTT_QUEUE_DEPTH; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueuePos.store(0, std::memory_order_relaxed);
+    dequeuePos.store(0, std::memory_order_release);
+}
+
+void mqtt_queue_set_consumer(TaskHandle_t task) {
+    consumerTask = task;
+}
+
+MqttQueueCell *mqtt_queue_reserve(uint8_t key) {
+    if (key >= MQTT_QUEUE_KEYS) key = 0;
+
+    MqttQueueCell *cell = tryReserve();
+    if (cell == NULL && mqtt_queue_policy != MQTT_QUEUE_DROP_NEWEST) {
+        // Nhường chỗ: bỏ đúng 1 message cũ nhất rồi thử lại. Ô tại enqueuePos
+        // có thể là ô task MQTT đã claim mà chưa release (đang publish/spool):
+        // bỏ message khác cũng không giải phóng được ô đó, nên chuyển thẳng
+        // sang từ chối message mới thay vì xả cả hàng đợi
+        uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+        bool consumerHeld = (int32_t)(dequeuePos.load(std::memory_order_acquire) - (pos - MQTT_QUEUE_DEPTH)) > 0;
+        if (!consumerHeld) {
+            MqttQueueCell *oldest = tryDequeue();
+            if (oldest != NULL) {   // NULL: ô cũ nhất đang được ghi dở
+                freeCell(oldest);
+                statDroppedOldest.fetch_add(1, std::memory_order_relaxed);
+                cell = tryReserve();
+            }
+        }
+    }
+    if (cell == NULL) {
+        statDroppedNewest.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    cell->key = key;
+    cell->format = 0;
+    cell->length = 0;
+    cell->enqueuedMs = millis();
+    return cell;
+}
+
+void mqtt_queue_commit(MqttQueueCell *cell, size_t length) {
+    cell->length = length <= MQTT_QUEUE_MSG_SIZE ? length : 0;
+    if (cell->length > 0) {
+        if (cell->key != 0) {
+            markLatest(cell->key, cell->ticket);
+        }
+        statEnqueued.fetch_add(1, std::memory_order_relaxed);
+    }
+    cell->sequence.store(cell->ticket + 1, std::memory_order_release);
+    updateHighWater();
+
+    if (consumerTask != NULL && cell->length > 0) {
+        xTaskNotifyGive(consumerTask);
+    }
+}
+
+bool mqtt_queue_push(const uint8_t *payload, size_t length, uint8_t key) {
+    if (length == 0 || length > MQTT_QUEUE_MSG_SIZE) return false;
+
+    MqttQueueCell *cell = mqtt_queue_reserve(key);
+    if (cell == NULL) return false;
+    memcpy(cell->payload, payload, length);
+    mqtt_queue_commit(cell, length);
+    return true;
+}
+
+MqttQueueCell *mqtt_queue_claim() {
+    MqttQueueCell *cell;
+    while ((cell = tryDequeue()) != NULL) {
+        if (cell->length == 0) {
+            freeCell(cell);
+            continue;
+        }
+        // Đã có bản mới hơn cùng key phía sau: bỏ bản này
+        if (mqtt_queue_policy == MQTT_QUEUE_COALESCE && cell->key != 0 &&
+            latestTicket[cell->key].load(std::memory_order_acquire) != cell->ticket) {
+            statCoalesced++;
+            freeCell(cell);
+            continue;
+        }
+
+        uint32_t latency = millis() - cell->enqueuedMs;
+        if (latency > latencyMaxMs) latencyMaxMs = latency;
+        latencySumMs += latency;
+        statDelivered++;
+        return cell;
+    }
+    return NULL;
+}
+
+void mqtt_queue_release(MqttQueueCell *cell) {
+    freeCell(cell);
+}
+
+MqttQueueStats mqtt_queue_stats() {
+    MqttQueueStats s;
+    s.enqueued      = statEnqueued.load(std::memory_order_relaxed);
+    s.delivered     = statDelivered;
+    s.droppedOldest = statDroppedOldest.load(std::memory_order_relaxed);
+    s.droppedNewest = statDroppedNewest.load(std::memory_order_relaxed);
+    s.coalesced     = statCoalesced;
+    s.depth         = enqueuePos.load(std::memory_order_relaxed) - dequeuePos.load(std::memory_order_relaxed);
+    s.highWater     = statHighWater.load(std::memory_order_relaxed);
+    s.latencyMaxMs  = latencyMaxMs;
+    s.latencyAvgMs  = statDelivered > 0 ? (uint32_t)(latencySumMs / statDelivered) : 0;
+    return s;
+}
+
+void mqtt_queue_save_stats(JsonObject obj) {
+    MqttQueueStats s = mqtt_queue_stats();
+    obj["policy"]         = policyNames[mqtt_queue_policy];
+    obj["depth"]          = s.depth;
+    obj["high_water"]     = s.highWater;
+    obj["enqueued"]       = s.enqueued;
+    obj["delivered"]      = s.delivered;
+    obj["dropped_oldest"] = s.droppedOldest;
+    obj["dropped_newest"] = s.droppedNewest;
+    obj["coalesced"]      = s.coalesced;
+    obj["latency_max_ms"] = s.latencyMaxMs;
+    obj["latency_avg_ms"] = s.latencyAvgMs;
+}
+
+void mqtt_queue_load(JsonObjectConst obj) {
+    if (obj.isNull()) return;
+    const char *name = obj["policy"] | policyNames[mqtt_queue_policy];
+    for (uint8_t i = 0; i < sizeof(policyNames) / sizeof(policyNames[0]); i++) {
+        if (strcmp(name, policyNames[i]) == 0) {
+            mqtt_queue_policy = (MqttQueuePolicy)i;
+        }
+    }
+}
+
+void mqtt_queue_save(JsonObject obj) {
+    obj["policy"] = policyNames[mqtt_queue_policy];
+}
@@ -0,0 +1,249 @@
+#include "mqtt_router.h"
+#include "payload_codec.h"
+
+// Nút trie lúc đăng ký: danh sách con liên kết, chưa sắp xếp
+struct BuildNode {
+    const char *level;
+    uint8_t     length;
+    int16_t     firstChild;
+    int16_t     next;
+    int8_t      route;
+};
+
+// Nút trie sau compile: con exact nằm liền nhau và đã sắp xếp,
+// con '+' / '#' tách riêng để không phải so chuỗi
+struct RouteNode {
+    const char *level;
+    uint8_t     length;
+    uint8_t     childCount;
+    int16_t     firstChild;
+    int16_t     plus;
+    int16_t     hash;
+    int8_t      route;
+};
+
+static BuildNode buildNodes[MQTT_ROUTER_MAX_NODES];
+static uint16_t  buildCount = 0;
+static RouteNode nodes[MQTT_ROUTER_MAX_NODES];
+static uint16_t  nodeCount = 0;
+static MqttRouteHandler handlers[MQTT_ROUTER_MAX_ROUTES];
+static uint8_t   routeCount = 0;
+static bool      compiled = false;
+
+// Chỉ task MQTT dispatch nên dùng chung 1 document tĩnh (stack task MQTT nhỏ)
+static StaticJsonDocument<MQTT_ROUTER_DOC_SIZE> routeDoc;
+
+// ==================== HELPERS ====================
+static int compareLevel(const char *a, uint8_t aLen, const char *b, uint8_t bLen) {
+    int c = memcmp(a, b, aLen < bLen ? aLen : bLen);
+    return c != 0 ? c : (int)aLen - (int)bLen;
+}
+
+static int16_t newBuildNode(const char *level, uint8_t length) {
+    if (buildCount >= MQTT_ROUTER_MAX_NODES) return -1;
+    BuildNode &n = buildNodes[buildCount];
+    n.level = level;
+    n.length = length;
+    n.firstChild = -1;
+    n.next = -1;
+    n.route = -1;
+    return buildCount++;
+}
+
+static int16_t findOrAddChild(int16_t parent, const char *level, uint8_t length) {
+    for (int16_t c = buildNodes[parent].firstChild; c >= 0; c = buildNodes[c].next) {
+        if (compareLevel(buildNodes[c].level, buildNodes[c].length, level, length) == 0) {
+            return c;
+        }
+    }
+    int16_t c = newBuildNode(level, length);
+    if (c < 0) return -1;
+    buildNodes[c].next = buildNodes[parent].firstChild;
+    buildNodes[parent].firstChild = c;
+    return c;
+}
+
+static bool isWildcard(const BuildNode &n, char w) {
+    return n.length == 1 && n.level[0] == w;
+}
+
+// Chép nút build -> nút phẳng theo BFS: con của một nút nằm liền nhau
+static bool flatten() {
+    static int16_t map[MQTT_ROUTER_MAX_NODES];
+    static int16_t order[MQTT_ROUTER_MAX_NODES];
+    static int16_t exact[MQTT_ROUTER_MAX_NODES];
+    uint16_t head = 0, tail = 0;
+
+    order[tail++] = 0;
+    nodeCount = 1;
+    map[0] = 0;
+
+    while (head < tail) {
+        int16_t b = order[head++];
+        RouteNode &out = nodes[map[b]];
+        out.level = buildNodes[b].level;
+        out.length = buildNodes[b].length;
+        out.route = buildNodes[b].route;
+        out.plus = -1;
+        out.hash = -1;
+        out.childCount = 0;
+        out.firstChild = nodeCount;
+
+        // Gom con exact rồi sắp xếp (insertion sort, số con nhỏ)
+        uint8_t exactCount = 0;
+        for (int16_t c = buildNodes[b].firstChild; c >= 0; c = buildNodes[c].next) {
+            if (isWildcard(buildNodes[c], '+') || isWildcard(buildNodes[c], '#')) continue;
+            uint8_t i = exactCount++;
+            while (i > 0 && compareLevel(buildNodes[exact[i - 1]].level, buildNodes[exact[i - 1]].length,
+                                         buildNodes[c].level, buildNodes[c].length) > 0) {
+                exact[i] = exact[i - 1];
+                i--;
+            }
+            exact[i] = c;
+        }
+        for (uint8_t i = 0; i < exactCount; i++) {
+            map[exact[i]] = nodeCount++;
+            order[tail++] = exact[i];
+        }
+        out.childCount = exactCount;
+
+        for (int16_t c = buildNodes[b].firstChild; c >= 0; c = buildNodes[c].next) {
+            if (isWildcard(buildNodes[c], '+')) {
+                map[c] = nodeCount++;
+                out.plus = map[c];
+                order[tail++] = c;
+            } else if (isWildcard(buildNodes[c], '#')) {
+                map[c] = nodeCount++;
+                out.hash = map[c];
+                order[tail++] = c;
+            }
+        }
+    }
+    return nodeCount <= MQTT_ROUTER_MAX_NODES;
+}
+
+static int16_t findChild(const RouteNode &n, const char *level, uint8_t length) {
+    int16_t lo = n.firstChild, hi = n.firstChild + n.childCount - 1;
+    while (lo <= hi) {
+        int16_t mid = (lo + hi) / 2;
+        int c = compareLevel(nodes[mid].level, nodes[mid].length, level, length);
+        if (c == 0) return mid;
+        if (c < 0) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+static void addMatch(int8_t route, int8_t routes[], uint8_t maxRoutes, uint8_t &count) {
+    if (route >= 0 && count < maxRoutes) {
+        routes[count++] = route;
+    }
+}
+
+// level = đầu level hiện tại, NULL nếu topic đã hết
+static void matchNode(int16_t index, const char *level, int8_t routes[], uint8_t maxRoutes, uint8_t &count) {
+    const RouteNode &n = nodes[index];
+
+    // '#' khớp cả 0 level còn lại ("a/#" khớp "a")
+    if (n.hash >= 0) {
+        addMatch(nodes[n.hash].route, routes, maxRoutes, count);
+    }
+    if (level == NULL) {
+        addMatch(n.route, routes, maxRoutes, count);
+        return;
+    }
+
+    const char *end = strchr(level, '/');
+    uint8_t length = end ? end - level : strlen(level);
+    const char *next = end ? end + 1 : NULL;
+
+    int16_t child = findChild(n, level, length);
+    if (child >= 0) {
+        matchNode(child, next, routes, maxRoutes, count);
+    }
+    if (n.plus >= 0) {
+        matchNode(n.plus, next, routes, maxRoutes, count);
+    }
+}
+
+// ==================== API ====================
+bool mqtt_router_add(const char *pattern, MqttRouteHandler handler) {
+    if (compiled || routeCount >= MQTT_ROUTER_MAX_ROUTES || handler == NULL) return false;
+    if (buildCount == 0 && newBuildNode("", 0) < 0) return false;
+
+    int16_t node = 0;
+    const char *level = pattern;
+    for (;;) {
+        const char *end = strchr(level, '/');
+        uint8_t length = end ? end - level : strlen(level);
+
+        // '#' chỉ được đứng cuối, wildcard phải chiếm trọn level
+        bool hash = length == 1 && level[0] == '#';
+        if ((hash && end != NULL) ||
+            (length > 1 && (memchr(level, '+', length) || memchr(level, '#', length)))) {
+            Serial.printf("❌ Router: invalid pattern %s\n", pattern);
+            return false;
+        }
+
+        node = findOrAddChild(node, level, length);
+        if (node < 0) {
+            Serial.println("❌ Router: trie full");
+            return false;
+        }
+        if (end == NULL) break;
+        level = end + 1;
+    }
+
+    if (buildNodes[node].route >= 0) {
+        Serial.printf("⚠️ Router: duplicate pattern %s\n", pattern);
+        return false;
+    }
+    buildNodes[node].route = routeCount;
+    handlers[routeCount++] = handler;
+    return true;
+}
+
+bool mqtt_router_compile() {
+    if (buildCount == 0 && newBuildNode("", 0) < 0) return false;
+    compiled = flatten();
+    Serial.printf("🧭 Router: %u routes, %u nodes\n", routeCount, nodeCount);
+    return compiled;
+}
+
+uint8_t mqtt_router_match(const char *topic, int8_t routes[], uint8_t maxRoutes) {
+    uint8_t count = 0;
+    if (!compiled || topic == NULL) return 0;
+    // Topic hệ thống ($SYS/...) không khớp wildcard ở level đầu
+    if (topic[0] == '$') {
+        int16_t child = findChild(nodes[0], topic, strcspn(topic, "/"));
+        if (child >= 0) {
+            const char *end = strchr(topic, '/');
+            matchNode(child, end ? end + 1 : NULL, routes, maxRoutes, count);
+        }
+        return count;
+    }
+    matchNode(0, topic, routes, maxRoutes, count);
+    return count;
+}
+
+uint8_t mqtt_router_dispatch(const char *topic, uint8_t *payload, size_t length) {
+    int8_t routes[MQTT_ROUTER_MAX_MATCHES];
+    uint8_t count = mqtt_router_match(topic, routes, MQTT_ROUTER_MAX_MATCHES);
+    if (count == 0) {
+        Serial.printf("⚠️ MQTT: no route for %s\n", topic);
+        return 0;
+    }
+
+    // JSON/MessagePack parse tại chỗ trong buffer (không chép chuỗi), CBOR theo codec
+    DeserializationError err = payload_codec_deserialize(routeDoc, payload, length);
+    if (err) {
+        Serial.printf("❌ MQTT [%s]: %s %s\n", topic, payload_codec_name(payload_codec_format()), err.c_str());
+        return 0;
+    }
+
+    JsonVariantConst root = routeDoc.as<JsonVariantConst>();
+    for (uint8_t i = 0; i < count; i++) {
+        handlers[routes[i]](topic, root);
+    }
+    return count;
+}
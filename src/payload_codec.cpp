@@ -0,0 +1,422 @@
+#include "payload_codec.h"
+#include <atomic>
+#include <math.h>
+
+struct DictEntry {
+    char longKey[PAYLOAD_CODEC_LONG_KEY];
+    char shortKey[PAYLOAD_CODEC_SHORT_KEY];
+};
+
+struct DictTable {
+    DictEntry entries[PAYLOAD_CODEC_DICT_SIZE];
+    uint8_t   count;
+};
+
+// Mặc định: giữ JSON đầy đủ như trước
+PayloadCodecConfig payload_codec_config = { PAYLOAD_JSON, -1, false };
+
+static PayloadCodecConfig active = { PAYLOAD_JSON, -1, false };
+
+// Từ điển key ngắn có 2 bảng: payload_codec_load() (task web/lúc boot, 1 writer)
+// dựng bảng mới ở bảng không dùng rồi đổi con trỏ 1 lần, nên payload_codec_key()
+// ở task cảm biến luôn thấy 1 bảng trọn vẹn, không bao giờ thấy bảng ghi dở.
+// Bảng không dùng có thể vẫn đang bị đọc qua key trả về trước lần đổi trước đó,
+// nên load chờ mọi đoạn payload_codec_keys_begin()/end() kết thúc rồi mới ghi.
+// Chỉ đổi key đo đạc; "ts"/"values" là khung batch của ThingsBoard, giữ nguyên.
+static DictTable dictTables[2] = {
+    {
+        {
+            { "temperature", "t" },
+            { "humidity",    "h" },
+            { "sound",       "s" },
+            { "pressure",    "p" },
+        },
+        4
+    },
+};
+static std::atomic<DictTable *> dict(&dictTables[0]);
+static std::atomic<uint32_t> dictReaders(0);
+
+static const char *const reservedKeys[] = { "ts", "values" };
+
+static const char *const formatNames[PAYLOAD_FORMAT_COUNT] = { "json", "msgpack", "cbor" };
+static const char *const formatSuffixes[PAYLOAD_FORMAT_COUNT] = { "", "/msgpack", "/cbor" };
+
+static const double pow10Table[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+#define MAX_PRECISION 6
+
+// ==================== CBOR (RFC 8949) ====================
+// Chỉ phần cần cho JSON: map, array, text, số nguyên, float, bool, null.
+struct CborWriter {
+    uint8_t *out;     // NULL = chỉ đếm byte
+    size_t   size;
+    size_t   length;
+
+    void put(uint8_t b) {
+        if (out != NULL && length < size) out[length] = b;
+        length++;
+    }
+    void putBytes(const void *data, size_t n) {
+        const uint8_t *p = (const uint8_t *)data;
+        for (size_t i = 0; i < n; i++) put(p[i]);
+    }
+    void putBigEndian(uint64_t value, uint8_t bytes) {
+        for (int8_t i = bytes - 1; i >= 0; i--) put((uint8_t)(value >> (8 * i)));
+    }
+};
+
+static void cborHead(CborWriter &w, uint8_t major, uint64_t value) {
+    major <<= 5;
+    if (value < 24) {
+        w.put(major | value);
+    } else if (value <= 0xFF) {
+        w.put(major | 24);
+        w.putBigEndian(value, 1);
+    } else if (value <= 0xFFFF) {
+        w.put(major | 25);
+        w.putBigEndian(value, 2);
+    } else if (value <= 0xFFFFFFFFUL) {
+        w.put(major | 26);
+        w.putBigEndian(value, 4);
+    } else {
+        w.put(major | 27);
+        w.putBigEndian(value, 8);
+    }
+}
+
+// Half float (3 byte) nếu biểu diễn chính xác, không xử lý số subnormal
+static bool floatToHalf(float f, uint16_t &half) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if ((bits & 0x7FFFFFFF) == 0) {
+        half = sign;
+        return true;
+    }
+    if (exponent < -14 || exponent > 15 || (mantissa & 0x1FFF) != 0) {
+        return false;
+    }
+    half = sign | (uint16_t)((exponent + 15) << 10) | (uint16_t)(mantissa >> 13);
+    return true;
+}
+
+static void cborDouble(CborWriter &w, double value) {
+    // Số nguyên lưu dạng double: ghi như số nguyên, giống JSON in "45" cho 45.0
+    if (value == floor(value) && fabs(value) < 9007199254740992.0) {
+        if (value >= 0) cborHead(w, 0, (uint64_t)value);
+        else cborHead(w, 1, (uint64_t)(-1 - (int64_t)value));
+        return;
+    }
+
+    float f = (float)value;
+    if ((double)f == value) {
+        uint16_t half;
+        if (floatToHalf(f, half)) {
+            w.put(0xF9);
+            w.putBigEndian(half, 2);
+        } else {
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            w.put(0xFA);
+            w.putBigEndian(bits, 4);
+        }
+        return;
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    w.put(0xFB);
+    w.putBigEndian(bits, 8);
+}
+
+static void cborEncode(CborWriter &w, JsonVariantConst v) {
+    if (v.isNull()) {
+        w.put(0xF6);
+    } else if (v.is<bool>()) {
+        w.put(v.as<bool>() ? 0xF5 : 0xF4);
+    } else if (v.is<JsonObjectConst>()) {
+        JsonObjectConst obj = v.as<JsonObjectConst>();
+        cborHead(w, 5, obj.size());
+        for (JsonPairConst kv : obj) {
+            JsonString key = kv.key();
+            cborHead(w, 3, key.size());
+            w.putBytes(key.c_str(), key.size());
+            cborEncode(w, kv.value());
+        }
+    } else if (v.is<JsonArrayConst>()) {
+        JsonArrayConst arr = v.as<JsonArrayConst>();
+        cborHead(w, 4, arr.size());
+        for (JsonVariantConst item : arr) {
+            cborEncode(w, item);
+        }
+    } else if (v.is<const char *>()) {
+        JsonString s = v.as<JsonString>();
+        cborHead(w, 3, s.size());
+        w.putBytes(s.c_str(), s.size());
+    } else if (v.is<long long>()) {
+        long long x = v.as<long long>();
+        if (x >= 0) cborHead(w, 0, (uint64_t)x);
+        else cborHead(w, 1, (uint64_t)(-1 - x));
+    } else if (v.is<unsigned long long>()) {
+        cborHead(w, 0, v.as<unsigned long long>());
+    } else {
+        cborDouble(w, v.as<double>());
+    }
+}
+
+struct CborReader {
+    const uint8_t *p;
+    const uint8_t *end;
+
+    bool readBigEndian(uint8_t bytes, uint64_t &value) {
+        if ((size_t)(end - p) < bytes) return false;
+        value = 0;
+        for (uint8_t i = 0; i < bytes; i++) value = (value << 8) | *p++;
+        return true;
+    }
+};
+
+static bool cborReadHead(CborReader &r, uint8_t &major, uint8_t &info, uint64_t &value) {
+    if (r.p >= r.end) return false;
+    uint8_t ib = *r.p++;
+    major = ib >> 5;
+    info = ib & 0x1F;
+    if (info < 24) {
+        value = info;
+        return true;
+    }
+    if (info > 27) return false;   // không hỗ trợ độ dài không xác định
+    return r.readBigEndian(1 << (info - 24), value);
+}
+
+static float halfToFloat(uint16_t half) {
+    int32_t exponent = (half >> 10) & 0x1F;
+    float mantissa = half & 0x3FF;
+    float value;
+    if (exponent == 0) value = ldexpf(mantissa, -24);
+    else if (exponent == 31) value = mantissa == 0 ? INFINITY : NAN;
+    else value = ldexpf(mantissa + 1024, exponent - 25);
+    return (half & 0x8000) ? -value : value;
+}
+
+static DeserializationError::Code cborDecode(CborReader &r, JsonVariant out, uint8_t depth) {
+    uint8_t major, info;
+    uint64_t value;
+    if (!cborReadHead(r, major, info, value)) return DeserializationError::InvalidInput;
+
+    switch (major) {
+    case 0:
+        out.set((unsigned long long)value);
+        break;
+    case 1:
+        out.set(-1 - (long long)value);
+        break;
+    case 3:
+        if ((uint64_t)(r.end - r.p) < value) return DeserializationError::IncompleteInput;
+        out.set(JsonString((const char *)r.p, value, JsonString::Copied));
+        r.p += value;
+        break;
+    case 4: {
+        if (depth == 0) return DeserializationError::TooDeep;
+        JsonArray arr = out.to<JsonArray>();
+        for (uint64_t i = 0; i < value; i++) {
+            JsonVariant item = arr.add();
+            if (item.isUnbound()) return DeserializationError::NoMemory;
+            DeserializationError::Code err = cborDecode(r, item, depth - 1);
+            if (err != DeserializationError::Ok) return err;
+        }
+        break;
+    }
+    case 5: {
+        if (depth == 0) return DeserializationError::TooDeep;
+        JsonObject obj = out.to<JsonObject>();
+        for (uint64_t i = 0; i < value; i++) {
+            uint8_t keyMajor, keyInfo;
+            uint64_t keyLength;
+            if (!cborReadHead(r, keyMajor, keyInfo, keyLength) || keyMajor != 3) {
+                return DeserializationError::InvalidInput;
+            }
+            if ((uint64_t)(r.end - r.p) < keyLength) return DeserializationError::IncompleteInput;
+            JsonVariant member = obj[JsonString((const char *)r.p, keyLength, JsonString::Copied)].to<JsonVariant>();
+            r.p += keyLength;
+            if (member.isUnbound()) return DeserializationError::NoMemory;
+            DeserializationError::Code err = cborDecode(r, member, depth - 1);
+            if (err != DeserializationError::Ok) return err;
+        }
+        break;
+    }
+    case 7:
+        if (info == 20 || info == 21) out.set(info == 21);
+        else if (info == 22 || info == 23) out.clear();
+        else if (info == 25) out.set(halfToFloat((uint16_t)value));
+        else if (info == 26) {
+            uint32_t bits = (uint32_t)value;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            out.set(f);
+        } else if (info == 27) {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            out.set(d);
+        } else {
+            return DeserializationError::InvalidInput;
+        }
+        break;
+    default:
+        // byte string (2) và tag (6) không dùng trong lệnh
+        return DeserializationError::InvalidInput;
+    }
+    return DeserializationError::Ok;
+}
+
+// ==================== API ====================
+void payload_codec_activate() {
+    active = payload_codec_config;
+    if (active.precision > MAX_PRECISION) active.precision = MAX_PRECISION;
+    Serial.printf("📐 Payload codec: %s, precision %d, short keys %s\n",
+                  formatNames[active.format], active.precision, active.shortKeys ? "on" : "off");
+}
+
+PayloadFormat payload_codec_format() {
+    return active.format;
+}
+
+const char *payload_codec_suffix(uint8_t format) {
+    return format < PAYLOAD_FORMAT_COUNT ? formatSuffixes[format] : "";
+}
+
+const char *payload_codec_name(uint8_t format) {
+    return format < PAYLOAD_FORMAT_COUNT ? formatNames[format] : "unknown";
+}
+
+void payload_codec_keys_begin() {
+    dictReaders.fetch_add(1, std::memory_order_seq_cst);
+}
+
+void payload_codec_keys_end() {
+    dictReaders.fetch_sub(1, std::memory_order_release);
+}
+
+static bool reservedKey(const char *key) {
+    for (uint8_t i = 0; i < sizeof(reservedKeys) / sizeof(reservedKeys[0]); i++) {
+        if (strcmp(reservedKeys[i], key) == 0) return true;
+    }
+    return false;
+}
+
+const char *payload_codec_key(const char *key) {
+    if (!active.shortKeys) return key;
+    const DictTable *table = dict.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < table->count; i++) {
+        if (strcmp(table->entries[i].longKey, key) == 0) return table->entries[i].shortKey;
+    }
+    return key;
+}
+
+double payload_codec_value(float value) {
+    if (active.precision < 0 || isnan(value) || isinf(value)) return value;
+
+    double scale = pow10Table[active.precision];
+    double rounded = round((double)value * scale) / scale;
+    // Nhị phân: ép về float để MessagePack/CBOR ghi 4 byte thay vì 8
+    return active.format == PAYLOAD_JSON ? rounded : (double)(float)rounded;
+}
+
+size_t payload_codec_measure(JsonVariantConst source) {
+    switch (active.format) {
+    case PAYLOAD_MSGPACK:
+        return measureMsgPack(source);
+    case PAYLOAD_CBOR: {
+        CborWriter w = { NULL, 0, 0 };
+        cborEncode(w, source);
+        return w.length;
+    }
+    default:
+        return measureJson(source);
+    }
+}
+
+size_t payload_codec_serialize(JsonVariantConst source, uint8_t *output, size_t size) {
+    switch (active.format) {
+    case PAYLOAD_MSGPACK:
+        return serializeMsgPack(source, output, size);
+    case PAYLOAD_CBOR: {
+        CborWriter w = { output, size, 0 };
+        cborEncode(w, source);
+        return w.length <= size ? w.length : 0;
+    }
+    default:
+        return serializeJson(source, (char *)output, size);
+    }
+}
+
+DeserializationError payload_codec_deserialize(JsonDocument &doc, uint8_t *input, size_t length) {
+    // Dashboard/người dùng gửi tay thường là JSON: luôn nhận
+    bool json = length > 0 && (input[0] == '{' || input[0] == '[' || isspace(input[0]));
+    if (json || active.format == PAYLOAD_JSON) {
+        return deserializeJson(doc, (char *)input, length);
+    }
+    if (active.format == PAYLOAD_MSGPACK) {
+        return deserializeMsgPack(doc, (char *)input, length);
+    }
+
+    doc.clear();
+    CborReader r = { input, input + length };
+    DeserializationError::Code err = cborDecode(r, doc.to<JsonVariant>(), PAYLOAD_CODEC_MAX_DEPTH);
+    if (err == DeserializationError::Ok && r.p != r.end) {
+        err = DeserializationError::InvalidInput;
+    }
+    if (err == DeserializationError::Ok && doc.overflowed()) {
+        err = DeserializationError::NoMemory;
+    }
+    return err;
+}
+
+void payload_codec_load(JsonObjectConst obj) {
+    if (obj.isNull()) return;
+
+    const char *name = obj["format"] | formatNames[payload_codec_config.format];
+    for (uint8_t i = 0; i < PAYLOAD_FORMAT_COUNT; i++) {
+        if (strcmp(name, formatNames[i]) == 0) {
+            payload_codec_config.format = (PayloadFormat)i;
+        }
+    }
+    payload_codec_config.precision = obj["precision"] | payload_codec_config.precision;
+    payload_codec_config.shortKeys = obj["short_keys"] | payload_codec_config.shortKeys;
+
+    JsonObjectConst entries = obj["dict"];
+    if (entries.isNull()) return;
+    // Task cảm biến có thể còn giữ key của bảng sắp ghi (lấy trước lần đổi trước)
+    while (dictReaders.load(std::memory_order_seq_cst) > 0) {
+        delay(1);
+    }
+    DictTable *next = dict.load(std::memory_order_relaxed) == &dictTables[0] ? &dictTables[1] : &dictTables[0];
+    next->count = 0;
+    for (JsonPairConst kv : entries) {
+        const char *shortKey = kv.value() | "";
+        if (next->count >= PAYLOAD_CODEC_DICT_SIZE || reservedKey(kv.key().c_str()) ||
+            strlen(kv.key().c_str()) >= PAYLOAD_CODEC_LONG_KEY ||
+            shortKey[0] == '\0' || strlen(shortKey) >= PAYLOAD_CODEC_SHORT_KEY) {
+            Serial.printf("⚠️ Codec: bỏ qua key %s\n", kv.key().c_str());
+            continue;
+        }
+        DictEntry &e = next->entries[next->count++];
+        strcpy(e.longKey, kv.key().c_str());
+        strcpy(e.shortKey, shortKey);
+    }
+    dict.store(next, std::memory_order_seq_cst);
+}
+
+void payload_codec_save(JsonObject obj) {
+    obj["format"]     = formatNames[payload_codec_config.format];
+    obj["precision"]  = payload_codec_config.precision;
+    obj["short_keys"] = payload_codec_config.shortKeys;
+    JsonObject entries = obj.createNestedObject("dict");
+    const DictTable *table = dict.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < table->count; i++) {
+        entries[table->entries[i].longKey] = table->entries[i].shortKey;
+    }
+}
@@ -0,0 +1,107 @@
+#include "relay_output.h"
+
+static SemaphoreHandle_t relayMutex = nullptr;
+static StaticSemaphore_t relayMutexBuffer;
+
+static uint8_t coilImage = 0;    // trạng thái đã xác nhận
+static uint8_t knownMask = 0;    // bit = 0: chưa biết trạng thái thật (sau boot hoặc lỗi bus)
+
+void relay_output_init()
+{
+    if (!relayMutex) {
+        relayMutex = xSemaphoreCreateMutexStatic(&relayMutexBuffer);
+    }
+}
+
+uint8_t relay_output_apply(uint8_t mask, uint8_t states)
+{
+    const uint8_t allRelays = (1 << RELAY_COUNT) - 1;
+    mask &= allRelays;
+    if (!relayMutex || mask == 0) return MODBUS_OK;
+
+    xSemaphoreTake(relayMutex, portMAX_DELAY);
+
+    uint8_t desired = (coilImage & ~mask) | (states & mask);
+    uint8_t changed = ((desired ^ coilImage) | ~knownMask) & mask;
+    uint8_t result = MODBUS_OK;
+
+    if (changed) {
+        uint8_t first = 0;
+        while (!(changed & (1 << first))) first++;
+        uint8_t last = RELAY_COUNT - 1;
+        while (!(changed & (1 << last))) last--;
+
+        if (first == last) {
+            result = modbus_write_coil(RELAY_SLAVE, first, desired & (1 << first));
+        } else {
+            // Ghi cả dải first..last; relay ở giữa không đổi được ghi lại giá trị cũ.
+            // Bit trên last phải là 0 (FC15: bit thừa của byte cuối = 0)
+            uint8_t bits = (desired >> first) & ((1 << (last - first + 1)) - 1);
+            result = modbus_write_coils(RELAY_SLAVE, first, last - first + 1, &bits);
+        }
+
+        uint8_t written = (first == last) ? (1 << first)
+                                          : (uint8_t)(((1 << (last - first + 1)) - 1) << first);
+        if (result == MODBUS_OK) {
+            coilImage = (coilImage & ~written) | (desired & written);
+            knownMask |= written;
+        } else {
+            // Không chắc slave đã nhận hay chưa → lần sau gửi lại
+            knownMask &= ~written;
+            Serial.printf("❌ Relay write failed: %s\n", modbus_result_str(result));
+        }
+    }
+
+    xSemaphoreGive(relayMutex);
+    return result;
+}
+
+uint8_t relay_output_set(uint8_t index, bool on)
+{
+    if (index >= RELAY_COUNT) return MODBUS_ERR_FRAME;
+    return relay_output_apply(1 << index, on ? (1 << index) : 0);
+}
+
+uint8_t relay_output_state()
+{
+    return coilImage & knownMask;
+}
+
+static bool parseStatus(JsonVariantConst v)
+{
+    if (v.is<bool>()) return v.as<bool>();
+    if (v.is<int>()) return v.as<int>() != 0;
+    const char *s = v.as<const char *>();
+    return s && strcasecmp(s, "ON") == 0;
+}
+
+bool relay_output_handle_json(JsonVariantConst cmd)
+{
+    if (cmd.containsKey("relays")) {
+        JsonArrayConst relays = cmd["relays"];
+        uint8_t mask = 0, states = 0;
+        uint8_t i = 0;
+        for (JsonVariantConst v : relays) {
+            if (i >= RELAY_COUNT) break;
+            mask |= 1 << i;
+            if (parseStatus(v)) states |= 1 << i;
+            i++;
+        }
+        relay_output_apply(mask, states);
+        return true;
+    }
+
+    if (cmd.containsKey("relay")) {
+        int index = cmd["relay"] | -1;
+        if (index < 0 || index >= RELAY_COUNT) {
+            Serial.printf("⚠️ Relay %d không tồn tại\n", index);
+            return true;
+        }
+        bool on = parseStatus(cmd["status"]);
+        Serial.printf("⚙️ Relay %d → %s\n", index, on ? "ON" : "OFF");
+        relay_output_set(index, on);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,422 @@
+#include "secure_client.h"
+#include <LittleFS.h>
+
+// mbedtls 3.x ẩn các trường của struct sau macro này
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+// Session đã serialize (mbedtls_ssl_session_save): chứa master secret và
+// ticket, nên chỉ ghi xuống flash khi bật tls_session_persist
+struct CachedSession {
+    char     host[TLS_SESSION_HOST_LEN];
+    uint16_t port;
+    uint16_t length;           // 0 = ô trống
+    uint32_t usedAt;
+    uint8_t  data[TLS_SESSION_MAX_SIZE];
+};
+
+bool tls_session_persist = false;
+
+static CachedSession sessions[TLS_SESSION_CACHE_SIZE];
+static TlsSessionStats stats = {};
+static uint64_t fullSumMs = 0;
+static uint64_t resumedSumMs = 0;
+
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context drbg;
+static bool rngReady = false;
+
+// ==================== SESSION CACHE ====================
+static bool initRng() {
+    if (rngReady) return true;
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    const char *pers = "secure_client";
+    if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                              (const unsigned char *)pers, strlen(pers)) != 0) {
+        Serial.println("❌ TLS: không khởi tạo được RNG");
+        return false;
+    }
+    rngReady = true;
+    return true;
+}
+
+static int8_t findSession(const char *host, uint16_t port) {
+    for (uint8_t i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        if (sessions[i].length > 0 && sessions[i].port == port && strcmp(sessions[i].host, host) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void saveCacheFile() {
+    File f = LittleFS.open(TLS_SESSION_FILE, "w");
+    if (!f) {
+        Serial.println("❌ TLS: cannot write " TLS_SESSION_FILE);
+        return;
+    }
+    for (uint8_t i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        const CachedSession &s = sessions[i];
+        if (s.length == 0) continue;
+        f.write((const uint8_t *)s.host, TLS_SESSION_HOST_LEN);
+        f.write((const uint8_t *)&s.port, sizeof(s.port));
+        f.write((const uint8_t *)&s.length, sizeof(s.length));
+        f.write(s.data, s.length);
+    }
+    f.close();
+}
+
+// Ghi đè session cùng host:port, nếu không thì ô trống / dùng lâu nhất
+static void storeSession(const char *host, uint16_t port, const mbedtls_ssl_session *session, bool persist) {
+    int8_t slot = findSession(host, port);
+    if (slot < 0) {
+        slot = 0;
+        for (uint8_t i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+            if (sessions[i].length == 0) { slot = i; break; }
+            if (sessions[i].usedAt < sessions[slot].usedAt) slot = i;
+        }
+    }
+
+    CachedSession &s = sessions[slot];
+    size_t length = 0;
+    if (mbedtls_ssl_session_save(session, s.data, sizeof(s.data), &length) != 0) {
+        // Thường do chứng chỉ server quá lớn: bỏ, lần sau bắt tay đầy đủ
+        s.length = 0;
+        return;
+    }
+    strncpy(s.host, host, sizeof(s.host) - 1);
+    s.host[sizeof(s.host) - 1] = 0;
+    s.port = port;
+    s.length = length;
+    s.usedAt = millis();
+
+    if (persist) {
+        saveCacheFile();
+    }
+}
+
+void tls_session_cache_load() {
+    if (!tls_session_persist || !LittleFS.exists(TLS_SESSION_FILE)) return;
+
+    File f = LittleFS.open(TLS_SESSION_FILE, "r");
+    if (!f) return;
+    uint8_t loaded = 0;
+    for (uint8_t i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        CachedSession &s = sessions[i];
+        uint16_t length = 0;
+        if (f.read((uint8_t *)s.host, TLS_SESSION_HOST_LEN) != TLS_SESSION_HOST_LEN ||
+            f.read((uint8_t *)&s.port, sizeof(s.port)) != sizeof(s.port) ||
+            f.read((uint8_t *)&length, sizeof(length)) != sizeof(length) ||
+            length > TLS_SESSION_MAX_SIZE ||
+            f.read(s.data, length) != length) {
+            s.length = 0;
+            break;
+        }
+        s.host[TLS_SESSION_HOST_LEN - 1] = 0;
+        s.length = length;
+        s.usedAt = 0;
+        loaded++;
+    }
+    f.close();
+    Serial.printf("🔐 TLS: loaded %u cached session(s)\n", loaded);
+}
+
+void tls_session_remove_file() {
+    if (LittleFS.exists(TLS_SESSION_FILE)) {
+        LittleFS.remove(TLS_SESSION_FILE);
+    }
+}
+
+TlsSessionStats tls_session_stats() {
+    return stats;
+}
+
+void tls_session_save_stats(JsonObject obj) {
+    obj["handshakes"]     = stats.handshakes;
+    obj["offered"]        = stats.offered;
+    obj["resumed"]        = stats.resumed;
+    obj["failed"]         = stats.failed;
+    obj["hit_rate"]       = stats.offered > 0 ? (stats.resumed * 100) / stats.offered : 0;
+    obj["last_ms"]        = stats.lastMs;
+    obj["full_avg_ms"]    = stats.fullAvgMs;
+    obj["resumed_avg_ms"] = stats.resumedAvgMs;
+    obj["persist"]        = tls_session_persist;
+}
+
+// ==================== SECURE CLIENT ====================
+SecureClient::SecureClient()
+    : _caPem(NULL), _port(0), _ready(false), _open(false),
+      _resumed(false), _lastError(0), _peeked(-1) {
+}
+
+SecureClient::~SecureClient() {
+    stop();
+}
+
+void SecureClient::setCACert(const char *pem) {
+    _caPem = pem;
+}
+
+void SecureClient::setHostname(const char *host) {
+    _host = host;
+}
+
+int SecureClient::bioSend(void *ctx, const unsigned char *buf, size_t len) {
+    SecureClient *self = (SecureClient *)ctx;
+    if (!self->_tcp.connected()) return MBEDTLS_ERR_SSL_CONN_EOF;
+    size_t n = self->_tcp.write(buf, len);
+    return n > 0 ? (int)n : MBEDTLS_ERR_SSL_CONN_EOF;
+}
+
+int SecureClient::bioRecv(void *ctx, unsigned char *buf, size_t len) {
+    SecureClient *self = (SecureClient *)ctx;
+    if (self->_tcp.available() <= 0) {
+        return self->_tcp.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_SSL_CONN_EOF;
+    }
+    int n = self->_tcp.read(buf, len);
+    return n > 0 ? n : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+void SecureClient::release() {
+    if (!_ready) return;
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_x509_crt_free(&_ca);
+    _ready = false;
+}
+
+bool SecureClient::handshake(uint32_t timeoutMs) {
+    if (!initRng()) return false;
+
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_config_init(&_conf);
+    mbedtls_x509_crt_init(&_ca);
+    _ready = true;
+
+    // Luôn kiểm tra chứng chỉ server: không có CA thì không bắt tay
+    if (_caPem == NULL) {
+        _lastError = MBEDTLS_ERR_SSL_CA_CHAIN_REQUIRED;
+        return false;
+    }
+    int ret = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT,
+                                          MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret == 0) {
+        ret = mbedtls_x509_crt_parse(&_ca, (const unsigned char *)_caPem, strlen(_caPem) + 1);
+    }
+    if (ret == 0) {
+        mbedtls_ssl_conf_ca_chain(&_conf, &_ca, NULL);
+        mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    }
+    if (ret != 0) {
+        _lastError = ret;
+        return false;
+    }
+    mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    if ((ret = mbedtls_ssl_setup(&_ssl, &_conf)) != 0 ||
+        (ret = mbedtls_ssl_set_hostname(&_ssl, _host.c_str())) != 0) {
+        _lastError = ret;
+        return false;
+    }
+    mbedtls_ssl_set_bio(&_ssl, this, bioSend, bioRecv, NULL);
+
+    // Gửi kèm session cũ (ticket hoặc session ID) nếu có
+    int8_t slot = findSession(_host.c_str(), _port);
+    bool offered = false;
+    if (slot >= 0) {
+        mbedtls_ssl_session session;
+        mbedtls_ssl_session_init(&session);
+        if (mbedtls_ssl_session_load(&session, sessions[slot].data, sessions[slot].length) == 0 &&
+            mbedtls_ssl_set_session(&_ssl, &session) == 0) {
+            offered = true;
+            sessions[slot].usedAt = millis();
+        } else {
+            sessions[slot].length = 0;   // hỏng hoặc khác phiên bản mbedtls
+        }
+        mbedtls_ssl_session_free(&session);
+    }
+
+    // Tự chạy từng bước để biết server có nhận session cũ không:
+    // bắt tay rút gọn không có bước gửi ClientKeyExchange
+    uint32_t start = millis();
+    bool keyExchange = false;
+    while (_ssl.MBEDTLS_PRIVATE(state) != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        if (_ssl.MBEDTLS_PRIVATE(state) == MBEDTLS_SSL_CLIENT_KEY_EXCHANGE) {
+            keyExchange = true;
+        }
+        ret = mbedtls_ssl_handshake_step(&_ssl);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            if (millis() - start > timeoutMs) {
+                ret = MBEDTLS_ERR_SSL_TIMEOUT;
+                break;
+            }
+            delay(1);
+            continue;
+        }
+        if (ret != 0) break;
+    }
+    uint32_t elapsed = millis() - start;
+
+    if (ret != 0) {
+        _lastError = ret;
+        stats.failed++;
+        if (offered) {
+            // Có server từ chối hẳn session cũ thay vì bắt tay lại đầy đủ
+            sessions[slot].length = 0;
+        }
+        return false;
+    }
+
+    _resumed = offered && !keyExchange;
+    stats.handshakes++;
+    stats.lastMs = elapsed;
+    if (offered) stats.offered++;
+    if (_resumed) {
+        stats.resumed++;
+        resumedSumMs += elapsed;
+        stats.resumedAvgMs = resumedSumMs / stats.resumed;
+    } else {
+        fullSumMs += elapsed;
+        stats.fullAvgMs = fullSumMs / (stats.handshakes - stats.resumed);
+    }
+    Serial.printf("🔐 TLS %s handshake: %lu ms\n", _resumed ? "resumed" : "full", (unsigned long)elapsed);
+
+    // Server có thể cấp ticket mới ở mọi lần bắt tay; chỉ ghi flash sau
+    // bắt tay đầy đủ để không ghi lại mỗi lần nối lại
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_get_session(&_ssl, &session) == 0) {
+        storeSession(_host.c_str(), _port, &session, tls_session_persist && !_resumed);
+    }
+    mbedtls_ssl_session_free(&session);
+    return true;
+}
+
+int SecureClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+    stop();
+    if (_host.length() == 0) {
+        _host = ip.toString();
+    }
+    _port = port;
+    _resumed = false;
+    _lastError = 0;
+
+    if (!_tcp.connect(ip, port, timeoutMs)) {
+        return 0;
+    }
+    if (!handshake(TLS_HANDSHAKE_TIMEOUT)) {
+        stop();
+        return 0;
+    }
+    _open = true;
+    return 1;
+}
+
+int SecureClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip, port, TLS_HANDSHAKE_TIMEOUT);
+}
+
+int SecureClient::connect(const char *host, uint16_t port) {
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip)) {
+        return 0;
+    }
+    setHostname(host);
+    return connect(ip, port, TLS_HANDSHAKE_TIMEOUT);
+}
+
+size_t SecureClient::write(uint8_t b) {
+    return write(&b, 1);
+}
+
+size_t SecureClient::write(const uint8_t *buf, size_t size) {
+    if (!_open) return 0;
+    size_t sent = 0;
+    uint32_t start = millis();
+    while (sent < size) {
+        int ret = mbedtls_ssl_write(&_ssl, buf + sent, size - sent);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        if ((ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) &&
+            millis() - start < TLS_HANDSHAKE_TIMEOUT) {
+            delay(1);
+            continue;
+        }
+        _lastError = ret;
+        stop();
+        break;
+    }
+    return sent;
+}
+
+int SecureClient::available() {
+    if (!_open) return _peeked >= 0 ? 1 : 0;
+    // Giải mã record đang chờ trên TCP (nếu có) mà không lấy dữ liệu ra
+    if (mbedtls_ssl_get_bytes_avail(&_ssl) == 0 && _tcp.available() > 0) {
+        int ret = mbedtls_ssl_read(&_ssl, NULL, 0);
+        if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            _lastError = ret;
+            stop();
+            return 0;
+        }
+    }
+    return mbedtls_ssl_get_bytes_avail(&_ssl) + (_peeked >= 0 ? 1 : 0);
+}
+
+int SecureClient::read(uint8_t *buf, size_t size) {
+    if (size == 0) return 0;
+    int n = 0;
+    if (_peeked >= 0) {
+        buf[n++] = (uint8_t)_peeked;
+        _peeked = -1;
+        if (--size == 0) return n;
+    }
+    if (!_open) return n > 0 ? n : -1;
+
+    int ret = mbedtls_ssl_read(&_ssl, buf + n, size);
+    if (ret > 0) return n + ret;
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        // 0 = server đóng kết nối, hoặc nhận close_notify / lỗi
+        _lastError = ret;
+        stop();
+    }
+    return n > 0 ? n : -1;
+}
+
+int SecureClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int SecureClient::peek() {
+    if (_peeked < 0) {
+        uint8_t b;
+        if (read(&b, 1) == 1) _peeked = b;
+    }
+    return _peeked;
+}
+
+void SecureClient::flush() {
+    // mbedtls_ssl_write đã gửi hết; WiFiClient::flush lại xóa dữ liệu đến nên không gọi
+}
+
+void SecureClient::stop() {
+    if (_open) {
+        mbedtls_ssl_close_notify(&_ssl);
+    }
+    _open = false;
+    _tcp.stop();
+    release();
+    _peeked = -1;
+}
+
+uint8_t SecureClient::connected() {
+    return _open && (_tcp.connected() || mbedtls_ssl_get_bytes_avail(&_ssl) > 0);
+}
@@ -0,0 +1,338 @@
+#include "sensor_history.h"
+#include "global.h"
+
+// ==================== CẤU TRÚC LƯU TRỮ ====================
+struct HistoryRaw {
+    uint32_t t;
+    int16_t  temp;
+    int16_t  humi;
+};
+
+struct HistoryAgg {
+    uint32_t t;        // thời điểm bắt đầu bucket
+    int16_t  tMin, tAvg, tMax;
+    int16_t  hMin, hAvg, hMax;
+};
+
+// Bộ cộng dồn cho bucket đang mở của một tầng
+struct HistoryAcc {
+    uint32_t start;
+    int32_t  tSum, hSum;
+    int16_t  tMin, tMax, hMin, hMax;
+    uint16_t count;
+};
+
+template <typename T, uint16_t N>
+struct HistoryRing {
+    T        items[N];
+    uint16_t head;     // vị trí ghi kế tiếp
+    uint16_t count;
+    uint32_t pushed;   // tổng số phần tử đã push = số thứ tự của phần tử kế tiếp
+
+    void push(const T &item) {
+        items[head] = item;
+        head = (head + 1) % N;
+        if (count < N) count++;
+        pushed++;
+    }
+    uint32_t firstSeq() const { return pushed - count; }
+    // i = 0 là phần tử cũ nhất
+    const T &at(uint16_t i) const { return items[(head + N - count + i) % N]; }
+    T &newest() { return items[(head + N - 1) % N]; }
+};
+
+static HistoryRing<HistoryRaw, HISTORY_RAW_SIZE>    rawRing;
+static HistoryRing<HistoryAgg, HISTORY_MINUTE_SIZE> minuteRing;
+static HistoryRing<HistoryAgg, HISTORY_HOUR_SIZE>   hourRing;
+static HistoryAcc minuteAcc;
+static HistoryAcc hourAcc;
+
+static StaticSemaphore_t historyMutexBuffer;
+static SemaphoreHandle_t historyMutex = NULL;
+
+// Số điểm copy ra mỗi lần giữ khóa khi query
+#define HISTORY_QUERY_CHUNK 32
+// Cursor chưa có vị trí trong ring
+#define HISTORY_SEQ_UNSET   0xFFFFFFFFUL
+
+// ==================== ROLL-UP ====================
+static int16_t toFixed(float v) {
+    return (int16_t)lroundf(constrain(v, -300.0f, 300.0f) * HISTORY_SCALE);
+}
+
+static void accAdd(HistoryAcc &acc, uint32_t start,
+                   int16_t tMin, int16_t tMax, int32_t tSum,
+                   int16_t hMin, int16_t hMax, int32_t hSum, uint16_t n) {
+    if (acc.count == 0) {
+        acc.start = start;
+        acc.tMin = tMin; acc.tMax = tMax;
+        acc.hMin = hMin; acc.hMax = hMax;
+        acc.tSum = acc.hSum = 0;
+    } else {
+        if (tMin < acc.tMin) acc.tMin = tMin;
+        if (tMax > acc.tMax) acc.tMax = tMax;
+        if (hMin < acc.hMin) acc.hMin = hMin;
+        if (hMax > acc.hMax) acc.hMax = hMax;
+    }
+    acc.tSum += tSum;
+    acc.hSum += hSum;
+    acc.count += n;
+}
+
+static HistoryAgg accToAgg(const HistoryAcc &acc) {
+    HistoryAgg agg;
+    agg.t = acc.start;
+    agg.tMin = acc.tMin; agg.tMax = acc.tMax;
+    agg.hMin = acc.hMin; agg.hMax = acc.hMax;
+    agg.tAvg = (int16_t)(acc.tSum / acc.count);
+    agg.hAvg = (int16_t)(acc.hSum / acc.count);
+    return agg;
+}
+
+// Đóng bucket phút: đẩy vào tầng phút và cộng dồn sang tầng giờ
+static void closeMinute() {
+    minuteRing.push(accToAgg(minuteAcc));
+
+    uint32_t hourStart = minuteAcc.start - (minuteAcc.start % HISTORY_RES_HOUR);
+    if (hourAcc.count > 0 && hourAcc.start != hourStart) {
+        hourRing.push(accToAgg(hourAcc));
+        hourAcc.count = 0;
+    }
+    accAdd(hourAcc, hourStart,
+           minuteAcc.tMin, minuteAcc.tMax, minuteAcc.tSum,
+           minuteAcc.hMin, minuteAcc.hMax, minuteAcc.hSum, minuteAcc.count);
+    minuteAcc.count = 0;
+}
+
+void sensor_history_init() {
+    if (historyMutex == NULL) {
+        historyMutex = xSemaphoreCreateMutexStatic(&historyMutexBuffer);
+    }
+}
+
+void sensor_history_add(uint32_t t, float temperature, float humidity) {
+    if (historyMutex == NULL) return;
+
+    HistoryRaw raw = { t, toFixed(temperature), toFixed(humidity) };
+    uint32_t minuteStart = t - (t % HISTORY_RES_MINUTE);
+
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+
+    // Hai mẫu trong cùng 1 giây: giữ mẫu sau
+    if (rawRing.count > 0 && rawRing.newest().t == t) {
+        rawRing.newest() = raw;
+    } else {
+        rawRing.push(raw);
+    }
+
+    if (minuteAcc.count > 0 && minuteAcc.start != minuteStart) {
+        closeMinute();
+    }
+    accAdd(minuteAcc, minuteStart, raw.temp, raw.temp, raw.temp,
+           raw.humi, raw.humi, raw.humi, 1);
+
+    xSemaphoreGive(historyMutex);
+}
+
+// ==================== QUERY ====================
+uint32_t sensor_history_parse_res(const String &res) {
+    if (res == "raw" || res == "1s") return HISTORY_RES_RAW;
+    if (res == "1m") return HISTORY_RES_MINUTE;
+    if (res == "1h") return HISTORY_RES_HOUR;
+    return (uint32_t)res.toInt();
+}
+
+static uint32_t pickResolution(uint32_t from) {
+    if (rawRing.count > 0 && rawRing.at(0).t <= from) return HISTORY_RES_RAW;
+    if (minuteRing.count > 0 && minuteRing.at(0).t <= from) return HISTORY_RES_MINUTE;
+    if (hourRing.count > 0) return HISTORY_RES_HOUR;
+    return minuteRing.count > 0 ? HISTORY_RES_MINUTE : HISTORY_RES_RAW;
+}
+
+// Copy tối đa 'max' phần tử có t trong [from, to] bắt đầu từ số thứ tự seq và
+// dời seq qua phần đã đọc. Ring sắp theo t tăng dần nên lần đầu (seq chưa có)
+// tìm nhị phân, các lần sau đọc tiếp ngay tại seq thay vì quét lại cả ring.
+template <typename T, uint16_t N>
+static uint16_t copyRange(const HistoryRing<T, N> &ring, uint32_t &seq, uint32_t from, uint32_t to,
+                          T *dst, uint16_t max) {
+    uint32_t first = ring.firstSeq();
+    if (seq == HISTORY_SEQ_UNSET) {
+        uint16_t lo = 0, hi = ring.count;
+        while (lo < hi) {
+            uint16_t mid = (lo + hi) / 2;
+            if (ring.at(mid).t < from) lo = mid + 1;
+            else hi = mid;
+        }
+        seq = first + lo;
+    } else if ((int32_t)(seq - first) < 0) {
+        seq = first;   // phần chưa đọc tới đã bị ghi đè
+    }
+
+    uint16_t n = 0;
+    while (n < max && seq - first < ring.count) {
+        const T &item = ring.at(seq - first);
+        if (item.t > to) break;
+        if (item.t >= from) dst[n++] = item;
+        seq++;
+    }
+    return n;
+}
+
+// ==================== CURSOR ====================
+enum HistoryCursorStage : uint8_t {
+    CURSOR_HEADER,
+    CURSOR_DATA,
+    CURSOR_FOOTER,
+    CURSOR_DONE
+};
+
+struct SensorHistoryCursor {
+    uint32_t from, to, res;
+    uint32_t seq;                   // số thứ tự trong ring của điểm kế tiếp cần copy
+    bool     inUse;
+    HistoryCursorStage stage;
+    bool     first;
+    bool     more;                  // lô trước đầy → có thể còn điểm
+    uint16_t count, pos;            // lô đang xuất
+    union {
+        HistoryRaw raw[HISTORY_QUERY_CHUNK];
+        HistoryAgg agg[HISTORY_QUERY_CHUNK];
+    } chunk;
+    char     text[144];             // đoạn JSON đang xuất dở (header / 1 điểm / footer)
+    uint8_t  textLen, textPos;
+};
+
+// Cursor cấp phát tĩnh; cấp/trả dưới historyMutex
+static SensorHistoryCursor cursorPool[HISTORY_CURSOR_POOL];
+
+// Copy lô điểm kế tiếp trong lúc giữ khóa; format/gửi thì không giữ khóa
+static void cursorFill(SensorHistoryCursor *c) {
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    if (c->res == HISTORY_RES_RAW) {
+        c->count = copyRange(rawRing, c->seq, c->from, c->to, c->chunk.raw, HISTORY_QUERY_CHUNK);
+    } else if (c->res == HISTORY_RES_MINUTE) {
+        c->count = copyRange(minuteRing, c->seq, c->from, c->to, c->chunk.agg, HISTORY_QUERY_CHUNK);
+    } else {
+        c->count = copyRange(hourRing, c->seq, c->from, c->to, c->chunk.agg, HISTORY_QUERY_CHUNK);
+    }
+    xSemaphoreGive(historyMutex);
+
+    c->pos = 0;
+    c->more = (c->count == HISTORY_QUERY_CHUNK);
+}
+
+// Format đoạn JSON kế tiếp vào c->text; false khi đã xuất hết
+static bool cursorNextText(SensorHistoryCursor *c) {
+    int n = 0;
+
+    if (c->stage == CURSOR_HEADER) {
+        n = snprintf(c->text, sizeof(c->text), "{\"res\":%lu,\"now\":%lu,\"scale\":%d,\"fields\":[%s],\"data\":[",
+                     (unsigned long)c->res, (unsigned long)(millis() / 1000), HISTORY_SCALE,
+                     c->res == HISTORY_RES_RAW
+                         ? "\"t\",\"temp\",\"humi\""
+                         : "\"t\",\"temp_min\",\"temp_avg\",\"temp_max\",\"humi_min\",\"humi_avg\",\"humi_max\"");
+        c->stage = CURSOR_DATA;
+    } else if (c->stage == CURSOR_DATA) {
+        if (c->pos >= c->count && c->more) {
+            cursorFill(c);
+        }
+        if (c->pos >= c->count) {
+            c->stage = CURSOR_FOOTER;
+            return cursorNextText(c);
+        }
+        const char *sep = c->first ? "" : ",";
+        c->first = false;
+        if (c->res == HISTORY_RES_RAW) {
+            const HistoryRaw &r = c->chunk.raw[c->pos++];
+            n = snprintf(c->text, sizeof(c->text), "%s[%lu,%d,%d]", sep,
+                         (unsigned long)r.t, (int)r.temp, (int)r.humi);
+        } else {
+            const HistoryAgg &a = c->chunk.agg[c->pos++];
+            n = snprintf(c->text, sizeof(c->text), "%s[%lu,%d,%d,%d,%d,%d,%d]", sep,
+                         (unsigned long)a.t, (int)a.tMin, (int)a.tAvg, (int)a.tMax,
+                         (int)a.hMin, (int)a.hAvg, (int)a.hMax);
+        }
+    } else if (c->stage == CURSOR_FOOTER) {
+        n = snprintf(c->text, sizeof(c->text), "]}");
+        c->stage = CURSOR_DONE;
+    } else {
+        return false;
+    }
+
+    c->textLen = (uint8_t)n;
+    c->textPos = 0;
+    return true;
+}
+
+SensorHistoryCursor *sensor_history_cursor_open(uint32_t from, uint32_t to, uint32_t res) {
+    if (historyMutex == NULL) return NULL;
+
+    SensorHistoryCursor *c = NULL;
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < HISTORY_CURSOR_POOL; i++) {
+        if (!cursorPool[i].inUse) {
+            c = &cursorPool[i];
+            c->inUse = true;
+            break;
+        }
+    }
+    if (c != NULL && res == 0) {
+        res = pickResolution(from);
+    }
+    xSemaphoreGive(historyMutex);
+    if (c == NULL) return NULL;
+
+    if (res < HISTORY_RES_MINUTE) {
+        res = HISTORY_RES_RAW;
+    } else if (res < HISTORY_RES_HOUR) {
+        res = HISTORY_RES_MINUTE;
+    } else {
+        res = HISTORY_RES_HOUR;
+    }
+
+    c->from = from;
+    c->to = to;
+    c->res = res;
+    c->seq = HISTORY_SEQ_UNSET;
+    c->stage = CURSOR_HEADER;
+    c->first = true;
+    c->more = true;
+    c->count = c->pos = 0;
+    c->textLen = c->textPos = 0;
+    return c;
+}
+
+// Ghi tối đa len byte; đoạn JSON không vừa sẽ được xuất tiếp ở lần gọi sau
+size_t sensor_history_cursor_read(SensorHistoryCursor *c, uint8_t *buf, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        if (c->textPos >= c->textLen && !cursorNextText(c)) break;
+        size_t n = min((size_t)(c->textLen - c->textPos), len - written);
+        memcpy(buf + written, c->text + c->textPos, n);
+        c->textPos += n;
+        written += n;
+    }
+    return written;
+}
+
+void sensor_history_cursor_close(SensorHistoryCursor *c) {
+    if (c == NULL) return;
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    c->inUse = false;
+    xSemaphoreGive(historyMutex);
+}
+
+void sensor_history_query(Print &out, uint32_t from, uint32_t to, uint32_t res) {
+    SensorHistoryCursor *c = sensor_history_cursor_open(from, to, res);
+    if (c == NULL) {
+        out.print("{\"error\":\"history not initialized\"}");
+        return;
+    }
+
+    uint8_t buf[128];
+    size_t n;
+    while ((n = sensor_history_cursor_read(c, buf, sizeof(buf))) > 0) {
+        out.write(buf, n);
+    }
+    sensor_history_cursor_close(c);
+}
@@ -0,0 +1,67 @@
+#include "sensor_snapshot.h"
+#include <atomic>
+
+// seq lẻ = writer đang ghi. Dữ liệu lưu dạng word atomic để reader
+// không bao giờ đọc nửa chừng một giá trị float.
+static std::atomic<uint32_t> snapSeq(0);
+static std::atomic<uint32_t> snapTemperature(0);
+static std::atomic<uint32_t> snapHumidity(0);
+static std::atomic<uint32_t> snapTimestamp(0);
+static std::atomic<uint32_t> snapFlags(0);
+
+static inline uint32_t floatBits(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static inline float bitsFloat(uint32_t bits) {
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+void sensor_snapshot_publish(float temperature, float humidity, uint8_t flags) {
+    uint32_t seq = snapSeq.load(std::memory_order_relaxed);
+
+    snapSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    snapTemperature.store(floatBits(temperature), std::memory_order_relaxed);
+    snapHumidity.store(floatBits(humidity), std::memory_order_relaxed);
+    snapTimestamp.store(millis(), std::memory_order_relaxed);
+    snapFlags.store(flags, std::memory_order_relaxed);
+
+    snapSeq.store(seq + 2, std::memory_order_release);
+}
+
+SensorSnapshot sensor_snapshot_read() {
+    SensorSnapshot snap;
+    uint32_t before, after;
+
+    do {
+        before = snapSeq.load(std::memory_order_acquire);
+        if (before & 1) {
+            yield();  // writer đang ghi, thử lại
+            continue;
+        }
+        snap.temperature = bitsFloat(snapTemperature.load(std::memory_order_relaxed));
+        snap.humidity    = bitsFloat(snapHumidity.load(std::memory_order_relaxed));
+        snap.timestamp   = snapTimestamp.load(std::memory_order_relaxed);
+        snap.flags       = (uint8_t)snapFlags.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = snapSeq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    snap.seq = before / 2;
+    return snap;
+}
+
+bool sensor_snapshot_read_new(SensorSnapshot &out, uint32_t &lastSeq) {
+    out = sensor_snapshot_read();
+    if (out.seq == 0 || out.seq == lastSeq) {
+        return false;
+    }
+    lastSeq = out.seq;
+    return true;
+}
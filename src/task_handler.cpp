@@ -1,5 +1,6 @@
 #include <task_handler.h>
 #include <task_webserver.h>  // ✅ Thêm để dùng Webserver_sendata()
+#include "relay_output.h"
 
 void handleWebSocketMessage(String message)
 {
@@ -15,6 +16,12 @@ void handleWebSocketMessage(String message)
     JsonObject value = doc["value"];
     if (doc["page"] == "device")
     {
+        // Relay RS485: {"relay":n,"status":"ON"} hoặc {"relays":[...]}
+        if (relay_output_handle_json(value))
+        {
+            return;
+        }
+
         if (!value.containsKey("gpio") || !value.containsKey("status"))
         {
             Serial.println("⚠️ JSON thiếu thông tin gpio hoặc status");
@@ -2,11 +2,19 @@
 #include <WiFi.h>
 #include "coreiot.h"
 #include "config_coreiot.h"
+#include "mqtt_queue.h"
 #include "global.h"
 
+// Nhịp tối đa giữa 2 lượt loop khi không có message mới (keepalive, retry, replay)
+#define MQTT_IO_POLL_MS 50
+
+// Task I/O MQTT: task duy nhất sở hữu PubSubClient.
+// Producer chỉ đẩy message vào mqtt_queue và đánh thức task này.
 void task_mqtt(void *pv) {
 
     Serial.println("=== MQTT task start ===");
+    mqtt_queue_set_consumer(xTaskGetCurrentTaskHandle());
+    coreiot_init();
 
     // ✅ Đợi semaphore Internet trước khi chạy MQTT
     Serial.println("⏳ Đợi WiFi kết nối...");
@@ -15,46 +23,15 @@ void task_mqtt(void *pv) {
         Serial.println("✅ WiFi đã sẵn sàng, bắt đầu MQTT task");
     }
 
-    for (;;) {
-        // ---------------------------------------------------------
-        // ✅ Điều kiện hợp lệ để chạy MQTT loop:
-        // - WiFi đã kết nối
-        // - Server hợp lệ
-        // - Port hợp lệ
-        // - Client ID & Username hợp lệ
-        // ---------------------------------------------------------
-        if (WiFi.isConnected() &&
-            coreiot_server != "" &&
-            coreiot_port > 0 &&
-            coreiot_client_id != "" &&
-            coreiot_username != "") 
-        { 
-            coreiot_loop(); 
-        } 
-        else 
-        {
-            // 🔁 Log 1 lần duy nhất
-            static bool logged = false;
-            if (!logged) {
+    // ✅ Đồng bộ giờ NTP để gắn timestamp cho batch telemetry
+    configTime(0, 0, "pool.ntp.org", "time.google.com");
 
-                // Trường hợp thiếu cấu hình MQTT
-                if (coreiot_server == "" || 
-                    coreiot_port == 0 || 
-                    coreiot_client_id == "" || 
-                    coreiot_username == "") 
-                {
-                    Serial.println("⚠️ CoreIOT config chưa đầy đủ, vui lòng vào Settings để cấu hình");
-                } 
-                else 
-                {
-                    // Trường hợp WiFi lỗi
-                    Serial.println("⚠️ WiFi mất kết nối, đợi reconnect...");
-                }
+    for (;;) {
+        // Máy trạng thái trong coreiot_loop tự kiểm tra WiFi + cấu hình
+        // và đẩy message xuống flash khi chưa kết nối được
+        coreiot_loop();
 
-                logged = true;
-            }
-        }
-        
-        vTaskDelay(5000 / portTICK_PERIOD_MS); // Check mỗi 5s
+        // Thức dậy ngay khi producer xếp message mới
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_IO_POLL_MS));
     }
 }
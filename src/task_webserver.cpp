@@ -4,6 +4,13 @@
 #include "config_coreiot.h"
 #include "coreiot.h"
 #include "mainserver.h"
+#include "sensor_history.h"
+#include "telemetry_batch.h"
+#include "mqtt_queue.h"
+#include "payload_codec.h"
+#include "telemetry_spool.h"
+#include "telemetry_filter.h"
+#include "modbus_scheduler.h"
 
 static AsyncWebServer dashboardServer(8080);
 static AsyncWebSocket ws("/ws");
@@ -40,12 +47,21 @@ void setupCoreIOTAPI() {
 
     // GET config
     dashboardServer.on("/api/coreiot/config", HTTP_GET, [](AsyncWebServerRequest *req){
-        StaticJsonDocument<512> doc;
+        StaticJsonDocument<1536> doc;
         doc["server"] = coreiot_server;
         doc["port"] = coreiot_port;
         doc["client_id"] = coreiot_client_id;
         doc["username"] = coreiot_username;
         doc["password_set"] = (coreiot_password.length() > 0);
+        doc["mqtt_version"] = coreiot_mqtt_version;
+        doc["message_expiry"] = coreiot_message_expiry;
+        doc["persistent_session"] = coreiot_persistent_session;
+        doc["tls"] = coreiot_tls;
+        doc["tls_persist_sessions"] = tls_session_persist;
+        telemetry_batch_save(doc.createNestedObject("batch"));
+        telemetry_filter_save(doc.createNestedObject("filter"));
+        mqtt_queue_save(doc.createNestedObject("queue"));
+        payload_codec_save(doc.createNestedObject("codec"));
         
         String res;
         serializeJson(doc, res);
@@ -57,7 +73,7 @@ void setupCoreIOTAPI() {
         [](AsyncWebServerRequest *req){},
         NULL,
         [](AsyncWebServerRequest *req, uint8_t *data, size_t len, size_t, size_t){
-            StaticJsonDocument<512> doc;
+            StaticJsonDocument<1536> doc;
             if (deserializeJson(doc, data, len)) {
                 req->send(400, "application/json", "{\"success\":false}");
                 return;
@@ -69,6 +85,19 @@ void setupCoreIOTAPI() {
             coreiot_username = doc["username"] | "";
             String pwd = doc["password"] | "";
             if (pwd != "***" && pwd != "") coreiot_password = pwd;
+            coreiot_mqtt_version = doc["mqtt_version"] | coreiot_mqtt_version;
+            coreiot_message_expiry = doc["message_expiry"] | coreiot_message_expiry;
+            coreiot_persistent_session = doc["persistent_session"] | coreiot_persistent_session;
+            coreiot_tls = doc["tls"] | coreiot_tls;   // form không gửi "tls" thì giữ nguyên
+            bool persist = doc["tls_persist_sessions"] | tls_session_persist;
+            if (!persist && tls_session_persist) {
+                tls_session_remove_file();   // không để lại master secret trên flash
+            }
+            tls_session_persist = persist;
+            telemetry_batch_load(doc["batch"]);
+            telemetry_filter_load(doc["filter"]);
+            mqtt_queue_load(doc["queue"]);
+            payload_codec_load(doc["codec"]);
             
             saveCoreIOTConfig();
             req->send(200, "application/json", "{\"success\":true}");
@@ -76,15 +105,47 @@ void setupCoreIOTAPI() {
 
     // GET status
     dashboardServer.on("/api/coreiot/status", HTTP_GET, [](AsyncWebServerRequest *req){
-        StaticJsonDocument<256> doc;
+        StaticJsonDocument<1024> doc;
         doc["mqtt_connected"] = isMQTTConnected();
+        doc["mqtt_state"] = coreiot_state_str();
+        doc["mqtt_attempts"] = coreiot_connect_attempts();
+        doc["mqtt_session_present"] = coreiot_session_present();
+        doc["mqtt_duplicate_commands"] = coreiot_duplicate_commands();
         doc["wifi_connected"] = WiFi.isConnected();
         doc["wifi_ip"] = WiFi.localIP().toString();
+
+        TelemetryBatchStats batch = telemetry_batch_stats();
+        JsonObject b = doc.createNestedObject("batch");
+        b["samples"] = batch.samples;
+        b["flushes"] = batch.flushes;
+        b["dropped"] = batch.dropped;
+
+        TelemetrySpoolStats spool = telemetry_spool_stats();
+        JsonObject sp = doc.createNestedObject("spool");
+        sp["spooled"] = spool.spooled;
+        sp["replayed"] = spool.replayed;
+        sp["dropped"] = spool.dropped;
+        sp["pending_bytes"] = spool.pendingBytes;
+        sp["segments"] = spool.segments;
+
+        telemetry_filter_save_stats(doc.createNestedObject("filter"));
+        mqtt_queue_save_stats(doc.createNestedObject("queue"));
+        tls_session_save_stats(doc.createNestedObject("tls"));
         
         String res;
         serializeJson(doc, res);
         req->send(200, "application/json", res);
     });
+
+    // Thống kê bus RS485: utilization, deadline miss, latency/lỗi từng slave
+    dashboardServer.on("/api/rs485/stats", HTTP_GET, [](AsyncWebServerRequest *req){
+        StaticJsonDocument<1536> doc;
+        modbus_scheduler_save_stats(doc.to<JsonObject>());
+
+        String res;
+        serializeJson(doc, res);
+        req->send(200, "application/json", res);
+    });
 }
 
 void connnectWSV() {
@@ -119,6 +180,29 @@ void connnectWSV() {
         String body = processLedControl(device, state, brightness, httpCode);
         req->send(httpCode, httpCode == 200 ? "application/json" : "text/plain", body);
     });
+    // Lịch sử cảm biến: /api/history?from=&to=&res=raw|1m|1h
+    dashboardServer.on("/api/history", HTTP_GET, [](AsyncWebServerRequest *req){
+        uint32_t now = millis() / 1000;
+        uint32_t from = req->hasParam("from") ? req->getParam("from")->value().toInt() : 0;
+        uint32_t to = req->hasParam("to") ? req->getParam("to")->value().toInt() : now;
+        uint32_t res = req->hasParam("res") ? sensor_history_parse_res(req->getParam("res")->value()) : 0;
+
+        // Trả theo chunk từ cursor: chỉ giữ 1 lô điểm thay vì cả response trong heap
+        SensorHistoryCursor *cursor = sensor_history_cursor_open(from, to, res);
+        if (cursor == NULL) {
+            req->send(503, "application/json", "{\"error\":\"history unavailable\"}");
+            return;
+        }
+        AsyncWebServerResponse *response = req->beginChunkedResponse("application/json",
+            [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return sensor_history_cursor_read(cursor, buffer, maxLen);
+            });
+        // Request luôn kết thúc bằng disconnect (kể cả khi gửi xong) → giải phóng cursor ở đây
+        req->onDisconnect([cursor]() {
+            sensor_history_cursor_close(cursor);
+        });
+        req->send(response);
+    });
     dashboardServer.on("/favicon.ico", HTTP_GET, [](AsyncWebServerRequest *req){
         req->send(204);
     });
@@ -0,0 +1,233 @@
+#include "telemetry_batch.h"
+#include "coreiot.h"
+#include "mqtt_queue.h"
+#include "payload_codec.h"
+#include "global.h"
+#include <sys/time.h>
+
+// Mẫu telemetry đang chờ gửi
+struct TelemetrySample {
+    uint32_t    ms;                          // millis() lúc lấy mẫu
+    uint16_t    bytes;                       // kích thước JSON ước tính của mẫu
+    uint8_t     count;
+    const char *keys[TELEMETRY_MAX_KEYS];
+    float       values[TELEMETRY_MAX_KEYS];
+};
+
+// Đủ chỗ cho TELEMETRY_BATCH_CAPACITY mẫu dạng {"ts":..,"values":{4 key}}
+#define TELEMETRY_BATCH_DOC_SIZE \
+    (JSON_ARRAY_SIZE(TELEMETRY_BATCH_CAPACITY) + \
+     TELEMETRY_BATCH_CAPACITY * (JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(TELEMETRY_MAX_KEYS)))
+
+// Epoch (giây) từ đó trở đi coi như đồng hồ đã được NTP đồng bộ
+#define TELEMETRY_EPOCH_VALID 1600000000
+
+TelemetryBatchConfig telemetry_batch_config = {
+    TELEMETRY_BATCH_SAMPLES, TELEMETRY_BATCH_AGE_MS, TELEMETRY_BATCH_BYTES
+};
+
+static TelemetrySample samples[TELEMETRY_BATCH_CAPACITY];
+static uint8_t  sampleHead = 0;     // mẫu cũ nhất
+static uint8_t  sampleCount = 0;
+static uint32_t pendingBytes = 0;
+static TelemetryBatchStats stats = {0, 0, 0};
+
+static StaticJsonDocument<TELEMETRY_BATCH_DOC_SIZE> batchDoc;
+static StaticSemaphore_t batchMutexBuffer;
+static SemaphoreHandle_t batchMutex = NULL;
+
+// ==================== HELPERS ====================
+static bool clockSynced() {
+    return time(nullptr) > TELEMETRY_EPOCH_VALID;
+}
+
+// Đổi millis() của mẫu sang epoch ms
+static uint64_t sampleEpochMs(const TelemetrySample &s) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    uint64_t nowMs = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    return nowMs - (uint32_t)(millis() - s.ms);
+}
+
+// batchDoc giữ con trỏ key ngắn từ lúc dựng tới lúc serialize: giữ từ điển
+// không bị payload_codec_load() ghi đè suốt đoạn giữ mutex
+static void lockBatch() {
+    xSemaphoreTake(batchMutex, portMAX_DELAY);
+    payload_codec_keys_begin();
+}
+
+static void unlockBatch() {
+    payload_codec_keys_end();
+    xSemaphoreGive(batchMutex);
+}
+
+static TelemetrySample &sampleAt(uint8_t i) {
+    return samples[(sampleHead + i) % TELEMETRY_BATCH_CAPACITY];
+}
+
+static void dropOldest(uint8_t n) {
+    for (uint8_t i = 0; i < n && sampleCount > 0; i++) {
+        pendingBytes -= samples[sampleHead].bytes;
+        sampleHead = (sampleHead + 1) % TELEMETRY_BATCH_CAPACITY;
+        sampleCount--;
+    }
+}
+
+static void fillValues(JsonObject values, const TelemetrySample &s) {
+    for (uint8_t k = 0; k < s.count; k++) {
+        values[payload_codec_key(s.keys[k])] = payload_codec_value(s.values[k]);
+    }
+}
+
+// {"ts":..,"values":{..}}: khung ThingsBoard, chỉ key trong "values" được rút gọn
+static void appendSample(JsonArray arr, const TelemetrySample &s) {
+    JsonObject entry = arr.createNestedObject();
+    entry["ts"] = sampleEpochMs(s);
+    fillValues(entry.createNestedObject("values"), s);
+}
+
+// Key coalesce theo tập field của mẫu: mẫu chưa có timestamp chỉ cần bản mới nhất
+static uint8_t sampleKey(const TelemetrySample &s) {
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (uint8_t k = 0; k < s.count; k++) {
+        for (const char *p = s.keys[k]; *p; p++) {
+            h = (h ^ (uint8_t)*p) * 16777619u;
+        }
+    }
+    return 1 + h % (MQTT_QUEUE_KEYS - 1);
+}
+
+static uint16_t payloadBudget() {
+    size_t budget = publishMaxPayload();
+    if (telemetry_batch_config.maxBytes > 0 && telemetry_batch_config.maxBytes < budget) {
+        budget = telemetry_batch_config.maxBytes;
+    }
+    return budget;
+}
+
+static void publishDoc(uint8_t key = 0) {
+    publishJson(batchDoc, key);
+    stats.flushes++;
+}
+
+static void flushLocked() {
+    uint16_t budget = payloadBudget();
+
+    while (sampleCount > 0) {
+        batchDoc.clear();
+
+        // Chưa có giờ NTP: gửi từng mẫu như cũ để server tự gắn timestamp
+        if (!clockSynced()) {
+            fillValues(batchDoc.to<JsonObject>(), sampleAt(0));
+            publishDoc(sampleKey(sampleAt(0)));
+            dropOldest(1);
+            continue;
+        }
+
+        // Nhồi mẫu vào mảng cho tới khi chạm giới hạn byte
+        JsonArray arr = batchDoc.to<JsonArray>();
+        uint8_t n = 0;
+        while (n < sampleCount) {
+            appendSample(arr, sampleAt(n));
+            if (batchDoc.overflowed() || payload_codec_measure(batchDoc) > budget) {
+                arr.remove(n);
+                break;
+            }
+            n++;
+        }
+
+        if (n == 0) {
+            // Một mẫu đơn lẻ đã vượt giới hạn buffer MQTT
+            Serial.println("⚠️ Telemetry sample larger than MQTT buffer, dropped");
+            stats.dropped++;
+            dropOldest(1);
+            continue;
+        }
+
+        publishDoc();
+        dropOldest(n);
+    }
+}
+
+// ==================== API ====================
+void telemetry_batch_init() {
+    if (batchMutex == NULL) {
+        batchMutex = xSemaphoreCreateMutexStatic(&batchMutexBuffer);
+    }
+}
+
+bool telemetry_batch_add(const char *const keys[], const float values[], uint8_t count) {
+    if (batchMutex == NULL || count == 0 || count > TELEMETRY_MAX_KEYS) return false;
+
+    TelemetrySample s;
+    s.ms = millis();
+    s.count = count;
+    for (uint8_t k = 0; k < count; k++) {
+        s.keys[k] = keys[k];
+        s.values[k] = values[k];
+    }
+
+    lockBatch();
+
+    // Ước lượng kích thước của mẫu khi nằm trong mảng: JSON "[..]" + dấu phẩy,
+    // MessagePack/CBOR 1 byte header mảng
+    batchDoc.clear();
+    appendSample(batchDoc.to<JsonArray>(), s);
+    s.bytes = payload_codec_measure(batchDoc) - 1;
+
+    // Mẫu mới sẽ làm batch vượt giới hạn byte: gửi phần đang chờ trước
+    if (sampleCount == TELEMETRY_BATCH_CAPACITY ||
+        (sampleCount > 0 && pendingBytes + s.bytes + 1 > payloadBudget())) {
+        flushLocked();
+    }
+    sampleAt(sampleCount) = s;
+    sampleCount++;
+    pendingBytes += s.bytes;
+    stats.samples++;
+
+    uint8_t maxSamples = telemetry_batch_config.maxSamples;
+    if (maxSamples == 0 || maxSamples > TELEMETRY_BATCH_CAPACITY) {
+        maxSamples = TELEMETRY_BATCH_CAPACITY;
+    }
+    if (sampleCount >= maxSamples) {
+        flushLocked();
+    }
+
+    unlockBatch();
+    return true;
+}
+
+void telemetry_batch_poll() {
+    if (batchMutex == NULL) return;
+
+    lockBatch();
+    if (sampleCount > 0 && millis() - sampleAt(0).ms >= telemetry_batch_config.maxAgeMs) {
+        flushLocked();
+    }
+    unlockBatch();
+}
+
+void telemetry_batch_flush() {
+    if (batchMutex == NULL) return;
+
+    lockBatch();
+    flushLocked();
+    unlockBatch();
+}
+
+TelemetryBatchStats telemetry_batch_stats() {
+    return stats;
+}
+
+void telemetry_batch_load(JsonObjectConst obj) {
+    if (obj.isNull()) return;
+    telemetry_batch_config.maxSamples = obj["samples"] | telemetry_batch_config.maxSamples;
+    telemetry_batch_config.maxAgeMs   = obj["age_ms"]  | telemetry_batch_config.maxAgeMs;
+    telemetry_batch_config.maxBytes   = obj["bytes"]   | telemetry_batch_config.maxBytes;
+}
+
+void telemetry_batch_save(JsonObject obj) {
+    obj["samples"] = telemetry_batch_config.maxSamples;
+    obj["age_ms"]  = telemetry_batch_config.maxAgeMs;
+    obj["bytes"]   = telemetry_batch_config.maxBytes;
+}
@@ -0,0 +1,120 @@
+#include "telemetry_filter.h"
+#include "telemetry_batch.h"
+
+static const char *const channelKeys[TELEMETRY_CH_COUNT] = {
+    "temperature", "humidity", "sound", "pressure"
+};
+
+// Mặc định: heartbeat 5 phút, ngưỡng theo độ phân giải thực tế của cảm biến
+TelemetryFilterConfig telemetry_filter_config[TELEMETRY_CH_COUNT] = {
+    { 0.2f, 0.0f, 0, 300000 },   // temperature (°C)
+    { 1.0f, 0.0f, 0, 300000 },   // humidity (%)
+    { 1.0f, 0.0f, 0, 300000 },   // sound (dB)
+    { 0.0f, 1.0f, 0, 300000 },   // pressure (%)
+};
+
+struct ChannelState {
+    bool     hasLast;
+    float    lastValue;
+    uint32_t lastSentMs;
+};
+
+static ChannelState channelState[TELEMETRY_CH_COUNT];
+static TelemetryFilterStats channelStats[TELEMETRY_CH_COUNT];
+
+const char *telemetry_channel_key(uint8_t channel) {
+    return channel < TELEMETRY_CH_COUNT ? channelKeys[channel] : "unknown";
+}
+
+bool telemetry_filter_accept(uint8_t channel, float value) {
+    if (channel >= TELEMETRY_CH_COUNT) return false;
+
+    const TelemetryFilterConfig &cfg = telemetry_filter_config[channel];
+    ChannelState &st = channelState[channel];
+    uint32_t now = millis();
+    bool send;
+
+    if (!st.hasLast) {
+        send = true;
+    } else {
+        uint32_t elapsed = now - st.lastSentMs;
+        float delta = fabsf(value - st.lastValue);
+
+        if (elapsed < cfg.minIntervalMs) {
+            send = false;
+        } else if (cfg.maxSilenceMs > 0 && elapsed >= cfg.maxSilenceMs) {
+            send = true;   // heartbeat
+        } else if (cfg.absDelta <= 0 && cfg.pctDelta <= 0) {
+            send = true;   // không cấu hình ngưỡng = không lọc
+        } else {
+            send = (cfg.absDelta > 0 && delta >= cfg.absDelta) ||
+                   (cfg.pctDelta > 0 && delta >= fabsf(st.lastValue) * cfg.pctDelta / 100.0f);
+        }
+    }
+
+    if (send) {
+        st.hasLast = true;
+        st.lastValue = value;
+        st.lastSentMs = now;
+        channelStats[channel].sent++;
+    } else {
+        channelStats[channel].suppressed++;
+    }
+    return send;
+}
+
+uint8_t telemetry_report(const uint8_t channels[], const float values[], uint8_t count) {
+    const char *keys[TELEMETRY_MAX_KEYS];
+    float accepted[TELEMETRY_MAX_KEYS];
+    uint8_t n = 0;
+
+    for (uint8_t i = 0; i < count && n < TELEMETRY_MAX_KEYS; i++) {
+        if (telemetry_filter_accept(channels[i], values[i])) {
+            keys[n] = telemetry_channel_key(channels[i]);
+            accepted[n] = values[i];
+            n++;
+        }
+    }
+
+    if (n > 0) {
+        telemetry_batch_add(keys, accepted, n);
+    }
+    return n;
+}
+
+TelemetryFilterStats telemetry_filter_stats(uint8_t channel) {
+    TelemetryFilterStats empty = {0, 0};
+    return channel < TELEMETRY_CH_COUNT ? channelStats[channel] : empty;
+}
+
+void telemetry_filter_load(JsonObjectConst obj) {
+    if (obj.isNull()) return;
+    for (uint8_t ch = 0; ch < TELEMETRY_CH_COUNT; ch++) {
+        JsonObjectConst c = obj[channelKeys[ch]];
+        if (c.isNull()) continue;
+        TelemetryFilterConfig &cfg = telemetry_filter_config[ch];
+        cfg.absDelta      = c["abs"]    | cfg.absDelta;
+        cfg.pctDelta      = c["pct"]    | cfg.pctDelta;
+        cfg.minIntervalMs = c["min_ms"] | cfg.minIntervalMs;
+        cfg.maxSilenceMs  = c["max_ms"] | cfg.maxSilenceMs;
+    }
+}
+
+void telemetry_filter_save(JsonObject obj) {
+    for (uint8_t ch = 0; ch < TELEMETRY_CH_COUNT; ch++) {
+        const TelemetryFilterConfig &cfg = telemetry_filter_config[ch];
+        JsonObject c = obj.createNestedObject(channelKeys[ch]);
+        c["abs"]    = cfg.absDelta;
+        c["pct"]    = cfg.pctDelta;
+        c["min_ms"] = cfg.minIntervalMs;
+        c["max_ms"] = cfg.maxSilenceMs;
+    }
+}
+
+void telemetry_filter_save_stats(JsonObject obj) {
+    for (uint8_t ch = 0; ch < TELEMETRY_CH_COUNT; ch++) {
+        JsonObject c = obj.createNestedObject(channelKeys[ch]);
+        c["sent"]       = channelStats[ch].sent;
+        c["suppressed"] = channelStats[ch].suppressed;
+    }
+}
@@ -0,0 +1,274 @@
+#include "telemetry_spool.h"
+#include "global.h"
+#include <LittleFS.h>
+
+// Mỗi bản ghi: [len thấp][len cao | tag << 6][payload]
+// (len <= SPOOL_MAX_RECORD nên 2 bit cao còn trống; bản ghi cũ có tag = 0)
+#define SPOOL_HEADER_SIZE 2
+#define SPOOL_LEN_MASK    0x3FFF
+#define SPOOL_TAG_SHIFT   14
+#define SPOOL_CURSOR_FILE SPOOL_DIR "/cursor"
+
+static uint32_t firstSeg = 1;       // segment cũ nhất (đang đọc)
+static uint32_t lastSeg = 0;        // segment mới nhất (đang ghi), < firstSeg = rỗng
+static uint32_t lastSegSize = 0;
+static uint32_t readOffset = 0;     // vị trí đọc trong firstSeg
+static uint32_t totalBytes = 0;
+static uint32_t pendingRecords = 0; // bản ghi chưa gửi, để biết segment hỏng đang giữ bao nhiêu
+static unsigned long lastReplay = 0;
+static TelemetrySpoolStats stats = {0, 0, 0, 0, 0};
+
+static uint8_t recordBuffer[SPOOL_MAX_RECORD];
+
+static StaticSemaphore_t spoolMutexBuffer;
+static SemaphoreHandle_t spoolMutex = NULL;
+
+// ==================== HELPERS ====================
+static String segPath(uint32_t seg) {
+    char path[32];
+    snprintf(path, sizeof(path), SPOOL_DIR "/%lu.seg", (unsigned long)seg);
+    return String(path);
+}
+
+static bool isEmpty() {
+    return lastSeg < firstSeg;
+}
+
+static void saveCursor() {
+    File f = LittleFS.open(SPOOL_CURSOR_FILE, "w");
+    if (!f) return;
+    f.write((const uint8_t *)&firstSeg, sizeof(firstSeg));
+    f.write((const uint8_t *)&readOffset, sizeof(readOffset));
+    f.close();
+}
+
+static void loadCursor() {
+    File f = LittleFS.open(SPOOL_CURSOR_FILE, "r");
+    if (!f) return;
+    uint32_t seg = 0, offset = 0;
+    if (f.read((uint8_t *)&seg, sizeof(seg)) == sizeof(seg) &&
+        f.read((uint8_t *)&offset, sizeof(offset)) == sizeof(offset) &&
+        seg == firstSeg) {
+        readOffset = offset;
+    }
+    f.close();
+}
+
+// Đếm số bản ghi trong segment kể từ offset (dùng khi phải xóa bỏ)
+static uint32_t countRecords(uint32_t seg, uint32_t offset) {
+    File f = LittleFS.open(segPath(seg), "r");
+    if (!f) return 0;
+    uint32_t count = 0;
+    uint32_t size = f.size();
+    uint8_t header[SPOOL_HEADER_SIZE];
+    while (offset + SPOOL_HEADER_SIZE <= size && f.seek(offset) &&
+           f.read(header, SPOOL_HEADER_SIZE) == SPOOL_HEADER_SIZE) {
+        uint16_t len = (header[0] | (header[1] << 8)) & SPOOL_LEN_MASK;
+        count++;
+        offset += SPOOL_HEADER_SIZE + len;
+    }
+    f.close();
+    return count;
+}
+
+static uint32_t segSize(uint32_t seg) {
+    File f = LittleFS.open(segPath(seg), "r");
+    if (!f) return 0;
+    uint32_t size = f.size();
+    f.close();
+    return size;
+}
+
+// Bỏ segment cũ nhất (đã gửi hết hoặc bị xóa do đầy)
+static void dropFirstSegment() {
+    uint32_t size = segSize(firstSeg);
+    uint32_t remaining = size > readOffset ? size - readOffset : 0;
+    totalBytes -= min(totalBytes, remaining);
+    LittleFS.remove(segPath(firstSeg));
+    firstSeg++;
+    readOffset = 0;
+    if (isEmpty()) {
+        lastSegSize = 0;
+        totalBytes = 0;
+        pendingRecords = 0;
+    }
+    saveCursor();
+}
+
+// Số bản ghi chưa gửi trong segment đầu. Không đọc segment này (có thể đã hỏng):
+// lấy tổng đang chờ trừ đi các segment sau nó
+static uint32_t firstSegmentRecords() {
+    uint32_t later = 0;
+    for (uint32_t seg = firstSeg + 1; seg <= lastSeg; seg++) {
+        later += countRecords(seg, 0);
+    }
+    return pendingRecords > later ? pendingRecords - later : 0;
+}
+
+// Bỏ segment đầu mà không gửi (hỏng / mất file / bị xóa do đầy), đếm đủ số bản ghi mất
+static void discardFirstSegment() {
+    uint32_t lost = firstSegmentRecords();
+    stats.dropped += lost;
+    pendingRecords -= lost;
+    dropFirstSegment();
+}
+
+// ==================== API ====================
+void telemetry_spool_init() {
+    if (spoolMutex == NULL) {
+        spoolMutex = xSemaphoreCreateMutexStatic(&spoolMutexBuffer);
+    }
+
+    if (!LittleFS.exists(SPOOL_DIR)) {
+        LittleFS.mkdir(SPOOL_DIR);
+    }
+
+    // Quét các segment còn lại từ lần chạy trước
+    uint32_t minSeg = UINT32_MAX, maxSeg = 0;
+    File dir = LittleFS.open(SPOOL_DIR);
+    if (dir && dir.isDirectory()) {
+        File f = dir.openNextFile();
+        while (f) {
+            const char *name = strrchr(f.name(), '/');
+            name = name ? name + 1 : f.name();
+            uint32_t seg = strtoul(name, NULL, 10);
+            if (seg > 0 && strstr(name, ".seg")) {
+                if (seg < minSeg) minSeg = seg;
+                if (seg > maxSeg) maxSeg = seg;
+                totalBytes += f.size();
+            }
+            f = dir.openNextFile();
+        }
+    }
+
+    if (maxSeg > 0) {
+        firstSeg = minSeg;
+        lastSeg = maxSeg;
+        lastSegSize = segSize(lastSeg);
+        loadCursor();
+        totalBytes -= min(totalBytes, readOffset);
+        pendingRecords = countRecords(firstSeg, readOffset);
+        for (uint32_t seg = firstSeg + 1; seg <= lastSeg; seg++) {
+            pendingRecords += countRecords(seg, 0);
+        }
+        Serial.printf("📦 Spool: %lu bytes pending in %lu segments\n",
+                      (unsigned long)totalBytes, (unsigned long)(lastSeg - firstSeg + 1));
+    }
+}
+
+bool telemetry_spool_append(const uint8_t *payload, size_t length, uint8_t tag) {
+    if (spoolMutex == NULL) return false;
+
+    if (length == 0 || length > SPOOL_MAX_RECORD) {
+        stats.dropped++;
+        return false;
+    }
+
+    xSemaphoreTake(spoolMutex, portMAX_DELAY);
+
+    uint32_t recordSize = SPOOL_HEADER_SIZE + length;
+    if (isEmpty() || lastSegSize + recordSize > SPOOL_SEGMENT_SIZE) {
+        lastSeg = isEmpty() ? firstSeg : lastSeg + 1;
+        lastSegSize = 0;
+    }
+
+    // Đầy: xóa segment cũ nhất (nhưng không xóa segment đang ghi)
+    while (totalBytes + recordSize > SPOOL_MAX_BYTES && firstSeg < lastSeg) {
+        discardFirstSegment();
+    }
+
+    bool ok = false;
+    File f = LittleFS.open(segPath(lastSeg), "a");
+    if (f) {
+        uint16_t word = length | ((uint16_t)(tag & 0x03) << SPOOL_TAG_SHIFT);
+        uint8_t header[SPOOL_HEADER_SIZE] = { (uint8_t)(word & 0xFF), (uint8_t)(word >> 8) };
+        ok = f.write(header, SPOOL_HEADER_SIZE) == SPOOL_HEADER_SIZE &&
+             f.write(payload, length) == length;
+        f.close();
+    }
+
+    if (ok) {
+        lastSegSize += recordSize;
+        totalBytes += recordSize;
+        pendingRecords++;
+        stats.spooled++;
+    } else {
+        stats.dropped++;
+        Serial.println("❌ Spool write failed");
+    }
+
+    xSemaphoreGive(spoolMutex);
+    return ok;
+}
+
+void telemetry_spool_replay(SpoolPublishFn publish) {
+    if (spoolMutex == NULL) return;
+
+    unsigned long now = millis();
+    if (now - lastReplay < SPOOL_REPLAY_INTERVAL) return;
+    lastReplay = now;
+
+    xSemaphoreTake(spoolMutex, portMAX_DELAY);
+
+    uint8_t sent = 0;
+    bool progressed = false;
+    while (!isEmpty() && sent < SPOOL_REPLAY_BATCH) {
+        File f = LittleFS.open(segPath(firstSeg), "r");
+        if (!f) {
+            discardFirstSegment();
+            continue;
+        }
+
+        f.seek(readOffset);
+        bool stop = false;
+        bool corrupt = false;
+        uint8_t header[SPOOL_HEADER_SIZE];
+        while (sent < SPOOL_REPLAY_BATCH && f.read(header, SPOOL_HEADER_SIZE) == SPOOL_HEADER_SIZE) {
+            uint16_t word = header[0] | (header[1] << 8);
+            uint16_t len = word & SPOOL_LEN_MASK;
+            if (len > SPOOL_MAX_RECORD || f.read(recordBuffer, len) != len) {
+                // Bản ghi hỏng (vd mất điện khi đang ghi): bỏ phần còn lại của segment,
+                // đếm cả các bản ghi phía sau không đọc được nữa
+                corrupt = true;
+                break;
+            }
+            if (!publish(recordBuffer, len, word >> SPOOL_TAG_SHIFT)) {
+                stop = true;
+                break;
+            }
+            readOffset += SPOOL_HEADER_SIZE + len;
+            totalBytes -= min(totalBytes, (uint32_t)(SPOOL_HEADER_SIZE + len));
+            if (pendingRecords > 0) pendingRecords--;
+            stats.replayed++;
+            sent++;
+            progressed = true;
+        }
+        bool finished = corrupt || readOffset >= f.size();
+        f.close();
+
+        if (stop) break;
+        if (corrupt) {
+            discardFirstSegment();
+            progressed = false;
+        } else if (finished) {
+            dropFirstSegment();
+            progressed = false;
+        }
+    }
+    if (progressed) {
+        saveCursor();
+    }
+
+    xSemaphoreGive(spoolMutex);
+}
+
+bool telemetry_spool_empty() {
+    return isEmpty();
+}
+
+TelemetrySpoolStats telemetry_spool_stats() {
+    TelemetrySpoolStats s = stats;
+    s.pendingBytes = totalBytes;
+    s.segments = isEmpty() ? 0 : lastSeg - firstSeg + 1;
+    return s;
+}
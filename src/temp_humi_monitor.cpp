@@ -1,10 +1,61 @@
 #include "temp_humi_monitor.h"
 #include "coreiot.h"  // ✅ THÊM DÒNG NÀY
+#include "sensor_history.h"
+#include "telemetry_filter.h"
 #include <ArduinoJson.h>
 
 DHT20 dht20;
 LiquidCrystal_I2C lcd(33,16,2);
 
+#define DHT20_POLL_INTERVAL 10  // ms giữa 2 lần hỏi trạng thái busy
+
+// Đọc DHT20 không chặn CPU: kích đo, nhường task trong lúc sensor chuyển đổi
+// (~80ms), sau đó hỏi trạng thái theo chu kỳ rồi mới lấy dữ liệu.
+static int dht20_read_async()
+{
+    int status = dht20.startRead();
+    if (status != DHT20_OK) return status;
+
+    vTaskDelay(DHT20_CONVERSION_TIME / portTICK_PERIOD_MS);
+    while (!dht20.readReady()) {
+        vTaskDelay(DHT20_POLL_INTERVAL / portTICK_PERIOD_MS);
+    }
+    return dht20.fetchRead();
+}
+
+// Xử lý một lần đọc: snapshot + lịch sử + lọc/gom batch để publish.
+// Tách khỏi task để fleet simulator (sim/) dùng chung đúng logic payload.
+void temp_humi_report(int status, float temperature, float humidity, uint32_t &lastSeq)
+{
+    uint8_t flags = 0;
+    if (status == DHT20_OK && !isnan(temperature)) flags |= SENSOR_TEMP_VALID;
+    if (status == DHT20_OK && !isnan(humidity))    flags |= SENSOR_HUMI_VALID;
+    if (flags != SENSOR_ALL_VALID) {
+        Serial.println("Failed to read from DHT sensor!");
+        temperature = humidity = -1;
+    }
+
+    // ✅ Ghi cả cặp giá trị một lần, reader không bao giờ thấy nửa mẫu
+    sensor_snapshot_publish(temperature, humidity, flags);
+    if (flags == SENSOR_ALL_VALID) {
+        sensor_history_add(millis() / 1000, temperature, humidity);
+    }
+
+    Serial.print("Humidity: ");
+    Serial.print(humidity);
+    Serial.print("%  Temperature: ");
+    Serial.print(temperature);
+    Serial.println("°C");
+
+    // ✅ Chỉ gửi khi có mẫu mới và hợp lệ, không đẩy bản trùng/lỗi lên CoreIOT
+    // Giá trị đi qua bộ lọc deadband rồi mới được gom batch để publish
+    SensorSnapshot snap;
+    if (sensor_snapshot_read_new(snap, lastSeq) && snap.valid()) {
+        static const uint8_t channels[] = { TELEMETRY_CH_TEMPERATURE, TELEMETRY_CH_HUMIDITY };
+        const float values[] = { snap.temperature, snap.humidity };
+        telemetry_report(channels, values, 2);
+    }
+}
 
 void temp_humi_monitor(void *pvParameters){
 
@@ -12,33 +63,14 @@ void temp_humi_monitor(void *pvParameters){
     Serial.begin(115200);
     dht20.begin();
 
-    while (1){
-        dht20.read();
-        float temperature = dht20.getTemperature();
-        float humidity = dht20.getHumidity();
+    uint32_t lastSeq = 0;
 
-        if (isnan(temperature) || isnan(humidity)) {
-            Serial.println("Failed to read from DHT sensor!");
-            temperature = humidity = -1;
+    while (1){
+        int status = dht20_read_async();
+        if (status != DHT20_OK) {
+            Serial.printf("DHT20 read error %d (polls: %u)\n", status, dht20.pollCount());
         }
-
-        glob_temperature = temperature;
-        glob_humidity = humidity;
-
-        Serial.print("Humidity: ");
-        Serial.print(humidity);
-        Serial.print("%  Temperature: ");
-        Serial.print(temperature);
-        Serial.println("°C");
-
-        // ✅ THAY THÀNH HÀM publishData (gửi JSON)
-        StaticJsonDocument<128> doc;
-        doc["temperature"] = temperature;
-        doc["humidity"] = humidity;
-        
-        String jsonData;
-        serializeJson(doc, jsonData);
-        publishData(jsonData);
+        temp_humi_report(status, dht20.getTemperature(), dht20.getHumidity(), lastSeq);
         
         vTaskDelay(5000);
     }
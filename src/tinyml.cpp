@@ -48,14 +48,22 @@ void tiny_ml_task(void *pvParameters)
 {
 
     setupTinyML();
+    uint32_t lastSeq = 0;
 
     while (1)
     {
+        // Only run inference on a fresh, valid sample
+        SensorSnapshot snap;
+        if (!sensor_snapshot_read_new(snap, lastSeq) || !snap.valid())
+        {
+            vTaskDelay(1000);
+            continue;
+        }
 
         // Prepare input data (e.g., sensor readings)
         // For a simple example, let's assume a single float input
-        input->data.f[0] = glob_temperature;
-        input->data.f[1] = glob_humidity;
+        input->data.f[0] = snap.temperature;
+        input->data.f[1] = snap.humidity;
 
         // Run inference
         TfLiteStatus invoke_status = interpreter->Invoke();
@@ -0,0 +1,215 @@
+// Test máy trạng thái đọc không chặn của DHT20 (startRead/readReady/fetchRead)
+// với bus I2C giả: kịch bản số lần sensor báo busy, đếm số lần hỏi trạng thái
+// và thời gian thực tới khi có dữ liệu.
+//   pio test -e native -f test_dht20
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + thư viện cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../lib/DHT20/DHT20.cpp"
+
+#define DHT20_POLL_INTERVAL 10  // giống temp_humi_monitor.cpp
+
+// Cảm biến giả ở địa chỉ 0x38: lệnh đo 0xAC 0x33 0x00 bắt đầu 1 lần chuyển
+// đổi, sau đó 'busyPolls' lần đọc trạng thái đầu tiên trả về bit busy (0x80).
+class FakeDht20Bus : public TwoWire {
+public:
+    uint8_t  triggerStatus = 0;    // kết quả endTransmission() của lệnh đo
+    int      busyPolls = 0;        // còn bao nhiêu lần đọc trạng thái báo busy
+    float    temperature = 25.5;
+    float    humidity = 61.25;
+    uint32_t statusReads = 0;      // số lần đọc 1 byte trạng thái
+    uint32_t triggers = 0;
+    unsigned long triggerMs = 0;
+    unsigned long firstPollMs = 0; // lần hỏi trạng thái đầu tiên sau lệnh đo
+
+    void beginTransmission(uint8_t address) override {
+        _address = address;
+        _txLen = 0;
+    }
+    size_t write(uint8_t data) override {
+        if (_txLen < sizeof(_tx)) _tx[_txLen++] = data;
+        return 1;
+    }
+    uint8_t endTransmission(bool sendStop = true) override {
+        if (_address != 0x38) return 2;
+        if (_txLen == 3 && _tx[0] == 0xAC && _tx[1] == 0x33 && _tx[2] == 0x00) {
+            if (triggerStatus != 0) return triggerStatus;
+            triggers++;
+            triggerMs = millis();
+            firstPollMs = 0;
+            _measuring = true;
+        }
+        return 0;
+    }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) override {
+        _rxLen = _rxPos = 0;
+        if (address != 0x38) return 0;
+        if (quantity == 1) {
+            statusReads++;
+            if (_measuring && firstPollMs == 0) firstPollMs = millis();
+            bool busy = _measuring && busyPolls > 0;
+            if (busy) busyPolls--;
+            _rx[_rxLen++] = 0x18 | (busy ? 0x80 : 0x00);
+        } else if (quantity == 7) {
+            frame(_rx);
+            _rxLen = 7;
+            _measuring = false;
+        } else {
+            memset(_rx, 0, quantity);
+            _rxLen = quantity;
+        }
+        return _rxLen;
+    }
+    int available() override { return _rxLen - _rxPos; }
+    int read() override { return _rxPos < _rxLen ? _rx[_rxPos++] : -1; }
+
+private:
+    uint8_t _address = 0;
+    uint8_t _tx[8];
+    uint8_t _txLen = 0;
+    uint8_t _rx[8];
+    uint8_t _rxLen = 0;
+    uint8_t _rxPos = 0;
+    bool    _measuring = false;
+
+    // Khung 7 byte theo datasheet: trạng thái, 20 bit độ ẩm, 20 bit nhiệt độ, CRC8
+    void frame(uint8_t *b) {
+        uint32_t rh = (uint32_t)(humidity / 100.0 * 1048576.0);
+        uint32_t t  = (uint32_t)((temperature + 50.0) / 200.0 * 1048576.0);
+        b[0] = 0x18;
+        b[1] = rh >> 12;
+        b[2] = rh >> 4;
+        b[3] = ((rh & 0x0F) << 4) | ((t >> 16) & 0x0F);
+        b[4] = t >> 8;
+        b[5] = t;
+        uint8_t crc = 0xFF;
+        for (int i = 0; i < 6; i++) {
+            crc ^= b[i];
+            for (int j = 0; j < 8; j++) crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+        b[6] = crc;
+    }
+};
+
+static FakeDht20Bus bus;
+static DHT20 *sensor;
+
+// Giống dht20_read_async() trong temp_humi_monitor.cpp
+static int read_async()
+{
+    int status = sensor->startRead();
+    if (status != DHT20_OK) return status;
+
+    vTaskDelay(DHT20_CONVERSION_TIME / portTICK_PERIOD_MS);
+    while (!sensor->readReady()) {
+        vTaskDelay(DHT20_POLL_INTERVAL / portTICK_PERIOD_MS);
+    }
+    return sensor->fetchRead();
+}
+
+void setUp(void)
+{
+    bus = FakeDht20Bus();
+    sensor = new DHT20(&bus);
+}
+
+void tearDown(void)
+{
+    delete sensor;
+}
+
+void test_ready_sensor_needs_one_poll(void)
+{
+    unsigned long start = millis();
+    TEST_ASSERT_EQUAL_INT(DHT20_OK, read_async());
+    unsigned long elapsed = millis() - start;
+
+    TEST_ASSERT_EQUAL_UINT32(1, bus.triggers);
+    TEST_ASSERT_EQUAL_UINT16(1, sensor->pollCount());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 25.5, sensor->getTemperature());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 61.25, sensor->getHumidity());
+    TEST_ASSERT_GREATER_OR_EQUAL(DHT20_CONVERSION_TIME, elapsed);
+    TEST_ASSERT_LESS_THAN(DHT20_CONVERSION_TIME + 3 * DHT20_POLL_INTERVAL, elapsed);
+}
+
+void test_bus_untouched_during_conversion(void)
+{
+    bus.busyPolls = 3;
+    TEST_ASSERT_EQUAL_INT(DHT20_OK, sensor->startRead());
+    uint32_t readsAfterTrigger = bus.statusReads;
+
+    // Gọi readReady() dồn dập trong cửa sổ chuyển đổi không được chạm bus
+    while (millis() - bus.triggerMs < DHT20_CONVERSION_TIME - 10) {
+        TEST_ASSERT_FALSE(sensor->readReady());
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL_UINT32(readsAfterTrigger, bus.statusReads);
+    TEST_ASSERT_EQUAL_UINT16(0, sensor->pollCount());
+    TEST_ASSERT_EQUAL_INT(DHT20_READ_PENDING, sensor->fetchRead());
+}
+
+void test_busy_sensor_polled_until_ready(void)
+{
+    bus.busyPolls = 4;
+    unsigned long start = millis();
+    TEST_ASSERT_EQUAL_INT(DHT20_OK, read_async());
+    unsigned long elapsed = millis() - start;
+
+    // 4 lần busy + 1 lần sẵn sàng; lần hỏi đầu không sớm hơn thời gian chuyển đổi
+    TEST_ASSERT_EQUAL_UINT16(5, sensor->pollCount());
+    TEST_ASSERT_GREATER_OR_EQUAL(DHT20_CONVERSION_TIME, bus.firstPollMs - bus.triggerMs);
+    TEST_ASSERT_GREATER_OR_EQUAL(DHT20_CONVERSION_TIME + 4 * DHT20_POLL_INTERVAL, elapsed);
+    TEST_ASSERT_LESS_THAN(DHT20_CONVERSION_TIME + 8 * DHT20_POLL_INTERVAL, elapsed);
+
+    char msg[80];
+    snprintf(msg, sizeof(msg), "4 busy polls: %u status reads, %lu ms", sensor->pollCount(), elapsed);
+    TEST_MESSAGE(msg);
+}
+
+void test_stuck_sensor_times_out(void)
+{
+    bus.busyPolls = 1000000;
+    unsigned long start = millis();
+    TEST_ASSERT_EQUAL_INT(DHT20_ERROR_READ_TIMEOUT, read_async());
+    unsigned long elapsed = millis() - start;
+
+    TEST_ASSERT_GREATER_OR_EQUAL(DHT20_CONVERSION_TIMEOUT, elapsed);
+    TEST_ASSERT_LESS_THAN(DHT20_CONVERSION_TIMEOUT + 3 * DHT20_POLL_INTERVAL, elapsed);
+    // Chu kỳ hỏi ~11ms (10ms chờ + 1ms trong readStatus) => khoảng 80 lần, không phải busy-loop
+    TEST_ASSERT_LESS_THAN(120, sensor->pollCount());
+    TEST_ASSERT_FALSE(sensor->readPending());
+}
+
+void test_trigger_i2c_error_keeps_wire_status(void)
+{
+    bus.triggerStatus = 2;   // NACK địa chỉ
+    TEST_ASSERT_EQUAL_INT(DHT20_ERROR_WIRE - 2, sensor->startRead());
+    TEST_ASSERT_FALSE(sensor->readPending());
+
+    bus.triggerStatus = 5;   // timeout bus
+    TEST_ASSERT_EQUAL_INT(-25, sensor->startRead());
+    TEST_ASSERT_EQUAL_UINT32(0, bus.triggers);
+}
+
+void test_rate_limit_between_reads(void)
+{
+    TEST_ASSERT_EQUAL_INT(DHT20_OK, read_async());
+    TEST_ASSERT_EQUAL_INT(DHT20_ERROR_LASTREAD, sensor->startRead());
+    TEST_ASSERT_EQUAL_UINT32(1, bus.triggers);
+}
+
+int main(int argc, char **argv)
+{
+    // startRead() từ chối đọc trong 1s đầu (lastRead = 0), millis() của shim tính từ lúc chạy
+    while (millis() < 1000) delay(10);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_ready_sensor_needs_one_poll);
+    RUN_TEST(test_bus_untouched_during_conversion);
+    RUN_TEST(test_busy_sensor_polled_until_ready);
+    RUN_TEST(test_stuck_sensor_times_out);
+    RUN_TEST(test_trigger_i2c_error_keeps_wire_status);
+    RUN_TEST(test_rate_limit_between_reads);
+    return UNITY_END();
+}
@@ -0,0 +1,189 @@
+// Backend esp-mqtt của coreiot (COREIOT_USE_ESP_MQTT=1) trên Espressif_MQTT_Client
+// giả (sim/shim): máy trạng thái kết nối/backoff vẫn do coreiot giữ, lệnh chiều về
+// được dispatch ngay trong task event của esp-mqtt thay vì chờ task MQTT poll,
+// telemetry đi vào outbox. Đo độ trễ từ lúc broker gửi lệnh tới lúc handler chạy.
+//   pio test -e native -f test_esp_mqtt
+#include <unity.h>
+
+// esp-mqtt chỉ có QoS 0: phải chọn rõ, coreiot.cpp chặn lúc build nếu không
+#define COREIOT_USE_ESP_MQTT 1
+#define TELEMETRY_QOS 0
+#define COMMAND_QOS 0
+
+// Arduino/FreeRTOS giả + phần board của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/sim_board.cpp"
+#include "../../src/config_coreiot.cpp"
+#include "../../src/mqtt_queue.cpp"
+#include "../../src/mqtt_router.cpp"
+#include "../../src/payload_codec.cpp"
+#include "../../src/telemetry_filter.cpp"
+#include "../../src/telemetry_batch.cpp"
+#include "../../src/coreiot.cpp"
+#include <thread>
+
+#define BENCH_COMMANDS 200
+// Chu kỳ poll của task_mqtt.cpp: độ trễ tối đa của lệnh với backend PubSubClient
+#define MQTT_IO_POLL_MS 50
+
+// Handler thử, đăng ký cùng bảng route của coreiot
+static volatile uint32_t probeCalls = 0;
+static volatile uint32_t probeAtUs = 0;
+static std::thread::id probeThread;
+
+static void handleProbe(const char *topic, JsonVariantConst cmd) {
+    probeAtUs = micros();
+    probeThread = std::this_thread::get_id();
+    probeCalls++;
+}
+
+// Chạy task MQTT tới khi coreiot báo đã kết nối (CONNECTED tới từ task event)
+static bool connectNow() {
+    connState = MQTT_ST_BACKOFF;
+    nextAttemptAt = millis();
+    for (int i = 0; i < 200 && connState != MQTT_ST_CONNECTED; i++) {
+        coreiot_loop();
+        delay(1);
+    }
+    return connState == MQTT_ST_CONNECTED;
+}
+
+void setUp(void)
+{
+    espMqtt.acceptConnect = true;
+    espMqtt.connackDelayMs = 0;
+    coreiot_persistent_session = false;
+    TEST_ASSERT_TRUE(connectNow());
+}
+
+void tearDown(void)
+{
+    espMqtt.drop();
+    espMqtt.waitIdle();
+}
+
+void test_connect_configures_event_driven_client(void)
+{
+    TEST_ASSERT_TRUE(espMqtt.enqueueMessages);
+    TEST_ASSERT_TRUE(espMqtt.autoReconnectDisabled);   // backoff/jitter là của coreiot
+    TEST_ASSERT_EQUAL_UINT16(MQTT_KEEPALIVE, espMqtt.keepAliveSeconds);
+    TEST_ASSERT_EQUAL_UINT16(MQTT_BUFFER_SIZE, espMqtt.bufferSize);
+    TEST_ASSERT_EQUAL_STRING("127.0.0.1", espMqtt.host.c_str());
+    TEST_ASSERT_EQUAL_UINT16(1883, espMqtt.port);
+    TEST_ASSERT_EQUAL_STRING("dev1", espMqtt.clientId.c_str());
+    TEST_ASSERT_EQUAL_STRING("dev1/commands/#", espMqtt.lastSubscribe.c_str());
+}
+
+void test_command_dispatched_without_mqtt_task(void)
+{
+    uint32_t before = probeCalls;
+    espMqtt.deliver("dev1/commands/probe", "{\"on\":1}");
+    espMqtt.waitIdle();
+    // Không gọi coreiot_loop(): handler đã chạy trong thread event của esp-mqtt
+    TEST_ASSERT_EQUAL_UINT32(before + 1, probeCalls);
+    TEST_ASSERT_TRUE(probeThread != std::this_thread::get_id());
+}
+
+void test_command_latency_benchmark(void)
+{
+    uint32_t worstUs = 0, totalUs = 0;
+    for (int i = 0; i < BENCH_COMMANDS; i++) {
+        uint32_t before = probeCalls;
+        uint32_t sentUs = micros();
+        espMqtt.deliver("dev1/commands/probe", "{\"on\":1}");
+        espMqtt.waitIdle();
+        TEST_ASSERT_EQUAL_UINT32(before + 1, probeCalls);
+        uint32_t latencyUs = probeAtUs - sentUs;
+        totalUs += latencyUs;
+        if (latencyUs > worstUs) worstUs = latencyUs;
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%d commands: avg %u us, worst %u us (PubSubClient: up to %u ms poll)",
+             BENCH_COMMANDS, (unsigned)(totalUs / BENCH_COMMANDS), (unsigned)worstUs, (unsigned)MQTT_IO_POLL_MS);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(MQTT_IO_POLL_MS * 1000UL, worstUs);
+}
+
+void test_publish_goes_to_outbox_at_qos0(void)
+{
+    uint32_t before = espMqtt.publishes;
+    StaticJsonDocument<64> doc;
+    doc["temperature"] = 25.5;
+    TEST_ASSERT_TRUE(publishJson(doc));
+    coreiot_loop();
+    TEST_ASSERT_EQUAL_UINT32(before + 1, espMqtt.publishes);
+    TEST_ASSERT_EQUAL_STRING("dev1/telemetry", espMqtt.lastTopic.c_str());
+    TEST_ASSERT_EQUAL_UINT8(0, publishQos(espMqtt.lastPayload.size()));
+}
+
+void test_lost_connection_backs_off_then_reconnects(void)
+{
+    uint32_t connects = espMqtt.connects;
+    uint32_t subscribes = espMqtt.subscribes;
+    espMqtt.drop();
+    espMqtt.waitIdle();
+    coreiot_loop();
+    TEST_ASSERT_EQUAL_INT(MQTT_ST_BACKOFF, connState);
+    // esp-mqtt không tự nối lại: chưa hết backoff thì không có CONNECT mới
+    coreiot_loop();
+    TEST_ASSERT_EQUAL_UINT32(connects, espMqtt.connects);
+
+    TEST_ASSERT_TRUE(connectNow());
+    TEST_ASSERT_EQUAL_UINT32(connects + 1, espMqtt.connects);
+    TEST_ASSERT_EQUAL_UINT32(subscribes + 1, espMqtt.subscribes);
+}
+
+void test_connack_timeout_backs_off(void)
+{
+    espMqtt.drop();
+    espMqtt.waitIdle();
+    espMqtt.acceptConnect = false;
+    TEST_ASSERT_FALSE(connectNow());
+    TEST_ASSERT_EQUAL_INT(MQTT_ST_CONNACK, connState);
+
+    // Giả lập đã chờ hết thời gian TCP + CONNACK
+    connectStartedAt = millis() - (MQTT_TCP_TIMEOUT + MQTT_CONNACK_TIMEOUT * 1000UL) - 1;
+    coreiot_loop();
+    TEST_ASSERT_EQUAL_INT(MQTT_ST_BACKOFF, connState);
+    TEST_ASSERT_EQUAL_INT(MQTT_CONNECTION_TIMEOUT, backendState());
+}
+
+void test_persistent_session_falls_back_to_clean(void)
+{
+    // Không có session-present: mỗi lần nối lại đều SUBSCRIBE lại
+    coreiot_persistent_session = true;
+    uint32_t subscribes = espMqtt.subscribes;
+    espMqtt.drop();
+    espMqtt.waitIdle();
+    TEST_ASSERT_TRUE(connectNow());
+    espMqtt.drop();
+    espMqtt.waitIdle();
+    TEST_ASSERT_TRUE(connectNow());
+    TEST_ASSERT_EQUAL_UINT32(subscribes + 2, espMqtt.subscribes);
+}
+
+int main(int argc, char **argv)
+{
+    coreiot_server = "127.0.0.1";
+    coreiot_port = 1883;
+    coreiot_client_id = "dev1";
+    coreiot_username = "dev1";
+    coreiot_password = "secret";
+    coreiot_tls = false;
+    mqtt_router_add("+/commands/probe", handleProbe);
+    mqtt_queue_init();
+    mqtt_queue_set_consumer(xTaskGetCurrentTaskHandle());
+    telemetry_batch_init();
+    coreiot_init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_connect_configures_event_driven_client);
+    RUN_TEST(test_command_dispatched_without_mqtt_task);
+    RUN_TEST(test_command_latency_benchmark);
+    RUN_TEST(test_publish_goes_to_outbox_at_qos0);
+    RUN_TEST(test_lost_connection_backs_off_then_reconnects);
+    RUN_TEST(test_connack_timeout_backs_off);
+    RUN_TEST(test_persistent_session_falls_back_to_clean);
+    return UNITY_END();
+}
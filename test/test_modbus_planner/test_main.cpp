@@ -0,0 +1,210 @@
+// Planner gộp register Modbus (modbus_plan_build là hàm thuần) và benchmark
+// thời gian bus mỗi chu kỳ đọc trước/sau khi gộp, chạy qua modbus_rtu thật
+// trên bus RS485 giả 9600 baud.
+//   pio test -e native -f test_modbus_planner
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/fake_rs485.h"
+#include "../../src/modbus_rtu.cpp"
+#include "../../src/modbus_scheduler.cpp"
+#include "../../src/modbus_planner.cpp"
+
+#define BUS_BAUD 9600
+
+static FakeRs485 rs485;
+
+static ModbusPoint point(uint8_t slave, uint8_t function, uint16_t address)
+{
+    ModbusPoint p = {slave, function, address, 0, false};
+    return p;
+}
+
+// Đo 1 chu kỳ đọc: thời gian từ lúc gửi request đầu tới khi có giá trị cuối
+static uint32_t cycleUs(ModbusReadPlan &plan, uint32_t *requests)
+{
+    uint32_t before = rs485.requests;
+    uint32_t start = micros();
+    TEST_ASSERT_EQUAL_UINT8(plan.pointCount, modbus_plan_execute(plan));
+    uint32_t elapsed = micros() - start;
+    *requests = rs485.requests - before;
+    return elapsed;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// ==================== PLANNER ====================
+void test_adjacent_points_merge_into_one_block(void)
+{
+    // 2 điểm của cảm biến âm thanh/áp suất (task_rs485.cpp)
+    ModbusPoint pts[] = {
+        point(0x06, MODBUS_FC_READ_HOLDING, 0x01F9),
+        point(0x06, MODBUS_FC_READ_HOLDING, 0x01F6),
+    };
+    ModbusReadPlan plan;
+    TEST_ASSERT_TRUE(modbus_plan_build(plan, pts, 2));
+    TEST_ASSERT_EQUAL_UINT8(1, plan.blockCount);
+    TEST_ASSERT_EQUAL_HEX16(0x01F6, plan.blocks[0].address);
+    TEST_ASSERT_EQUAL_UINT16(4, plan.blocks[0].count);
+    TEST_ASSERT_EQUAL_UINT8(0, plan.blockOf[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, plan.blockOf[1]);
+}
+
+void test_gap_tolerance_splits_blocks(void)
+{
+    ModbusPoint pts[] = {
+        point(1, MODBUS_FC_READ_HOLDING, 100),
+        point(1, MODBUS_FC_READ_HOLDING, 105),   // cách 4 register
+        point(1, MODBUS_FC_READ_HOLDING, 120),   // cách 14 register
+    };
+    ModbusReadPlan plan;
+    TEST_ASSERT_TRUE(modbus_plan_build(plan, pts, 3, 4));
+    TEST_ASSERT_EQUAL_UINT8(2, plan.blockCount);
+    TEST_ASSERT_EQUAL_UINT16(6, plan.blocks[0].count);
+    TEST_ASSERT_EQUAL_UINT16(120, plan.blocks[1].address);
+
+    TEST_ASSERT_TRUE(modbus_plan_build(plan, pts, 3, 3));
+    TEST_ASSERT_EQUAL_UINT8(3, plan.blockCount);
+
+    TEST_ASSERT_TRUE(modbus_plan_build(plan, pts, 3, 20));
+    TEST_ASSERT_EQUAL_UINT8(1, plan.blockCount);
+    TEST_ASSERT_EQUAL_UINT16(21, plan.blocks[0].count);
+}
+
+void test_block_respects_register_limit(void)
+{
+    ModbusPoint pts[] = {
+        point(1, MODBUS_FC_READ_INPUT, 0),
+        point(1, MODBUS_FC_READ_INPUT, 9),
+        point(1, MODBUS_FC_READ_INPUT, 10),
+    };
+    ModbusReadPlan plan;
+    TEST_ASSERT_TRUE(modbus_plan_build(plan, pts, 3, 100, 10));
+    TEST_ASSERT_EQUAL_UINT8(2, plan.blockCount);
+    TEST_ASSERT_EQUAL_UINT16(10, plan.blocks[0].count);
+    TEST_ASSERT_EQUAL_UINT16(10, plan.blocks[1].address);
+    TEST_ASSERT_EQUAL_UINT16(1, plan.blocks[1].count);
+}
+
+void test_slave_and_function_never_merge(void)
+{
+    ModbusPoint pts[] = {
+        point(2, MODBUS_FC_READ_HOLDING, 10),
+        point(1, MODBUS_FC_READ_HOLDING, 11),
+        point(1, MODBUS_FC_READ_INPUT, 12),
+        point(1, MODBUS_FC_READ_HOLDING, 10),
+    };
+    ModbusReadPlan plan;
+    TEST_ASSERT_TRUE(modbus_plan_build(plan, pts, 4));
+    TEST_ASSERT_EQUAL_UINT8(3, plan.blockCount);
+    TEST_ASSERT_EQUAL_UINT8(plan.blockOf[1], plan.blockOf[3]);
+    TEST_ASSERT_NOT_EQUAL(plan.blockOf[0], plan.blockOf[1]);
+    TEST_ASSERT_NOT_EQUAL(plan.blockOf[2], plan.blockOf[1]);
+}
+
+void test_too_many_blocks_rejected(void)
+{
+    ModbusPoint pts[MODBUS_PLAN_MAX_BLOCKS + 1];
+    for (uint8_t i = 0; i <= MODBUS_PLAN_MAX_BLOCKS; i++) {
+        pts[i] = point(i + 1, MODBUS_FC_READ_HOLDING, 0);
+    }
+    ModbusReadPlan plan;
+    TEST_ASSERT_FALSE(modbus_plan_build(plan, pts, MODBUS_PLAN_MAX_BLOCKS + 1));
+    TEST_ASSERT_TRUE(modbus_plan_build(plan, pts, MODBUS_PLAN_MAX_BLOCKS));
+}
+
+// ==================== BENCHMARK ====================
+void test_execute_scatters_values_to_points(void)
+{
+    ModbusPoint pts[] = {
+        point(0x06, MODBUS_FC_READ_HOLDING, 0x01F9),
+        point(0x06, MODBUS_FC_READ_HOLDING, 0x01F6),
+    };
+    ModbusReadPlan plan;
+    modbus_plan_build(plan, pts, 2);
+    uint32_t requests;
+    cycleUs(plan, &requests);
+    TEST_ASSERT_EQUAL_UINT32(1, requests);
+    TEST_ASSERT_TRUE(pts[0].ok && pts[1].ok);
+    TEST_ASSERT_EQUAL_HEX16(0x01F9, pts[0].raw);   // slave giả trả về chính địa chỉ
+    TEST_ASSERT_EQUAL_HEX16(0x01F6, pts[1].raw);
+}
+
+// So sánh 1 bộ điểm: mỗi điểm 1 request (maxRegisters = 1, như trước khi có
+// planner) với plan gộp mặc định. Lấy trung bình vài chu kỳ.
+static void benchmark(const char *name, ModbusPoint *pts, uint8_t count, uint8_t expectBlocks)
+{
+    const int cycles = 3;
+    ModbusReadPlan separate, merged;
+    TEST_ASSERT_TRUE(modbus_plan_build(separate, pts, count, 0, 1));
+    TEST_ASSERT_TRUE(modbus_plan_build(merged, pts, count));
+    TEST_ASSERT_EQUAL_UINT8(count, separate.blockCount);
+    TEST_ASSERT_EQUAL_UINT8(expectBlocks, merged.blockCount);
+
+    uint32_t beforeUs = 0, afterUs = 0, beforeReq = 0, afterReq = 0, n;
+    uint32_t txBefore = rs485.txBytes, rxBefore = rs485.rxBytes;
+    for (int i = 0; i < cycles; i++) {
+        beforeUs += cycleUs(separate, &n);
+        beforeReq += n;
+    }
+    uint32_t beforeBytes = (rs485.txBytes - txBefore) + (rs485.rxBytes - rxBefore);
+    txBefore = rs485.txBytes;
+    rxBefore = rs485.rxBytes;
+    for (int i = 0; i < cycles; i++) {
+        afterUs += cycleUs(merged, &n);
+        afterReq += n;
+    }
+    uint32_t afterBytes = (rs485.txBytes - txBefore) + (rs485.rxBytes - rxBefore);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg),
+             "%s @%u baud: before %u req, %u B, %.1f ms/cycle | after %u req, %u B, %.1f ms/cycle",
+             name, BUS_BAUD,
+             (unsigned)(beforeReq / cycles), (unsigned)(beforeBytes / cycles), beforeUs / 1000.0 / cycles,
+             (unsigned)(afterReq / cycles), (unsigned)(afterBytes / cycles), afterUs / 1000.0 / cycles);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL_UINT32(count * cycles, beforeReq);
+    TEST_ASSERT_EQUAL_UINT32(expectBlocks * cycles, afterReq);
+    TEST_ASSERT_LESS_THAN(beforeUs, afterUs);
+}
+
+void test_benchmark_sensor_poll(void)
+{
+    ModbusPoint pts[] = {
+        point(0x06, MODBUS_FC_READ_HOLDING, 0x01F6),
+        point(0x06, MODBUS_FC_READ_HOLDING, 0x01F9),
+    };
+    benchmark("sound+pressure", pts, 2, 1);
+}
+
+void test_benchmark_two_meters(void)
+{
+    // 2 đồng hồ điện, mỗi cái 4 đại lượng rải trong 1 vùng register nhỏ
+    ModbusPoint pts[] = {
+        point(1, MODBUS_FC_READ_INPUT, 0x0000), point(1, MODBUS_FC_READ_INPUT, 0x0006),
+        point(1, MODBUS_FC_READ_INPUT, 0x000C), point(1, MODBUS_FC_READ_INPUT, 0x0046),
+        point(2, MODBUS_FC_READ_INPUT, 0x0000), point(2, MODBUS_FC_READ_INPUT, 0x0006),
+        point(2, MODBUS_FC_READ_INPUT, 0x000C), point(2, MODBUS_FC_READ_INPUT, 0x0046),
+    };
+    benchmark("2 meters x 4 points", pts, 8, 4);
+}
+
+int main(int argc, char **argv)
+{
+    rs485.begin(BUS_BAUD);
+    modbus_init(rs485, BUS_BAUD);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_adjacent_points_merge_into_one_block);
+    RUN_TEST(test_gap_tolerance_splits_blocks);
+    RUN_TEST(test_block_respects_register_limit);
+    RUN_TEST(test_slave_and_function_never_merge);
+    RUN_TEST(test_too_many_blocks_rejected);
+    RUN_TEST(test_execute_scatters_values_to_points);
+    RUN_TEST(test_benchmark_sensor_poll);
+    RUN_TEST(test_benchmark_two_meters);
+    return UNITY_END();
+}
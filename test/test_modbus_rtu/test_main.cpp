@@ -0,0 +1,180 @@
+// Nhận response Modbus RTU theo sự kiện RX timeout của UART (receiveFrame):
+// UART giả phát từng byte đúng thời gian trên dây 9600 baud, chèn khoảng lặng
+// giữa các byte để kiểm tra việc tách frame theo t3.5 và đo độ trễ từ byte cuối
+// tới khi modbus_transact() trả kết quả.
+//   pio test -e native -f test_modbus_rtu
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/fake_rs485.h"
+#include "../../src/modbus_rtu.cpp"
+#include "../../src/modbus_scheduler.cpp"
+#include "../../src/modbus_planner.cpp"
+
+#define BUS_BAUD 9600
+// Độ trễ cho phép từ byte cuối tới lúc caller nhận kết quả: RX timeout (~t3.5)
+// + lịch thread của host. Polling cũ mất cố định 100 ms.
+#define MAX_LATENCY_US 15000
+
+static FakeRs485 rs485;
+
+// Cấu hình mặc định của slave giả trước mỗi test
+static void resetBus()
+{
+    rs485.turnaroundUs = 2000;
+    rs485.interByteUs = 0;
+    rs485.gapAfterByte = 0;
+    rs485.gapUs = 0;
+    rs485.exceptionCode = 0;
+    rs485.silentResponses = 0;
+}
+
+static uint8_t readHolding(ModbusRequest &req, uint16_t count, uint16_t timeoutMs = MODBUS_DEFAULT_TIMEOUT)
+{
+    modbus_prepare(req, 0x06, MODBUS_FC_READ_HOLDING, 0x01F6, count);
+    req.timeoutMs = timeoutMs;
+    return modbus_transact(req);
+}
+
+void setUp(void)
+{
+    resetBus();
+}
+
+void tearDown(void)
+{
+    // Để phần đuôi response (nếu có) của test trước trôi hết khỏi bus
+    delay(30);
+    resetBus();
+}
+
+void test_response_handed_over_when_line_goes_idle(void)
+{
+    ModbusRequest req;
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_OK, readHolding(req, 4));
+    uint32_t latencyUs = micros() - rs485.lastByteUs;
+
+    TEST_ASSERT_EQUAL_UINT8(1, req.attempts);
+    TEST_ASSERT_EQUAL_UINT16(5 + 2 * 4, req.responseLength);
+    TEST_ASSERT_EQUAL_HEX8(0x01, req.response[3]);   // register 0x01F6 = 0x01F6
+    TEST_ASSERT_EQUAL_HEX8(0xF6, req.response[4]);
+    TEST_ASSERT_LESS_THAN(MAX_LATENCY_US, latencyUs);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "last byte -> result: %.2f ms (t3.5 = %.2f ms)",
+             latencyUs / 1000.0, modbus_t35_us() / 1000.0);
+    TEST_MESSAGE(msg);
+}
+
+void test_gap_shorter_than_t35_stays_one_frame(void)
+{
+    // ~1.5 ký tự im lặng giữa mọi byte: chậm nhưng vẫn là 1 frame
+    rs485.interByteUs = rs485.charUs() * 3 / 2;
+    ModbusRequest req;
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_OK, readHolding(req, 8));
+    TEST_ASSERT_EQUAL_UINT8(1, req.attempts);
+    TEST_ASSERT_EQUAL_UINT16(5 + 2 * 8, req.responseLength);
+    TEST_ASSERT_LESS_THAN(MAX_LATENCY_US, micros() - rs485.lastByteUs);
+}
+
+void test_gap_longer_than_t35_ends_the_frame(void)
+{
+    // Im lặng 3 lần t3.5 sau byte thứ 5: master phải coi 5 byte đầu là 1 frame
+    // (sai CRC) thay vì chờ ghép phần còn lại, rồi retry
+    rs485.gapAfterByte = 5;
+    rs485.gapUs = 3 * modbus_t35_us();
+    ModbusRequest req;
+    uint8_t result = readHolding(req, 4);
+    TEST_ASSERT_TRUE(result == MODBUS_ERR_CRC || result == MODBUS_ERR_FRAME);
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_DEFAULT_RETRIES + 1, req.attempts);
+}
+
+void test_exception_response_returns_early(void)
+{
+    rs485.exceptionCode = 0x02;   // illegal data address
+    ModbusRequest req;
+    uint32_t start = millis();
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_ERR_EXCEPTION, readHolding(req, 4));
+    TEST_ASSERT_EQUAL_HEX8(0x02, req.exception);
+    TEST_ASSERT_EQUAL_UINT8(1, req.attempts);
+    TEST_ASSERT_EQUAL_UINT16(5, req.responseLength);
+    TEST_ASSERT_LESS_THAN(MODBUS_DEFAULT_TIMEOUT / 2, millis() - start);
+}
+
+void test_silent_slave_times_out_after_each_attempt(void)
+{
+    rs485.silentResponses = 10;
+    ModbusRequest req;
+    uint32_t start = millis();
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_ERR_TIMEOUT, readHolding(req, 4, 50));
+    uint32_t elapsed = millis() - start;
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_DEFAULT_RETRIES + 1, req.attempts);
+    // 3 lần x (phát request ~9 ms + chờ 50 ms)
+    TEST_ASSERT_GREATER_OR_EQUAL(3 * 50, elapsed);
+    TEST_ASSERT_LESS_THAN(3 * (50 + 9) + 40, elapsed);
+}
+
+void test_slow_slave_within_timeout(void)
+{
+    rs485.turnaroundUs = 120000;
+    ModbusRequest req;
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_OK, readHolding(req, 2));
+    TEST_ASSERT_EQUAL_UINT8(1, req.attempts);
+    TEST_ASSERT_LESS_THAN(MAX_LATENCY_US, micros() - rs485.lastByteUs);
+}
+
+void test_stale_bytes_dropped_before_request(void)
+{
+    const uint8_t noise[] = {0x06, 0x03, 0x55, 0xAA};
+    rs485.injectNoise(noise, sizeof(noise));
+    delay(10);   // rác đã nằm trong RX buffer khi request mới bắt đầu
+
+    ModbusRequest req;
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_OK, readHolding(req, 1));
+    TEST_ASSERT_EQUAL_UINT8(1, req.attempts);
+    TEST_ASSERT_EQUAL_UINT16(7, req.responseLength);
+}
+
+void test_unrelated_notify_does_not_end_wait(void)
+{
+    // Task MQTT vừa chờ relay (modbus_transact) vừa nhận xTaskNotifyGive từ
+    // mqtt_queue_commit: notify đó không được làm caller thoát trước bus task
+    rs485.turnaroundUs = 50000;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    std::thread producer([self]() {
+        for (int i = 0; i < 5; i++) {
+            delay(5);
+            xTaskNotifyGive(self);
+        }
+    });
+
+    ModbusRequest req;
+    uint32_t start = millis();
+    uint8_t result = readHolding(req, 4);
+    uint32_t elapsed = millis() - start;
+    producer.join();
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_OK, result);
+    TEST_ASSERT_EQUAL_UINT8(1, req.attempts);
+    TEST_ASSERT_EQUAL_UINT16(5 + 2 * 4, req.responseLength);
+    TEST_ASSERT_GREATER_OR_EQUAL(50, elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    rs485.begin(BUS_BAUD);
+    modbus_init(rs485, BUS_BAUD);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_response_handed_over_when_line_goes_idle);
+    RUN_TEST(test_gap_shorter_than_t35_stays_one_frame);
+    RUN_TEST(test_gap_longer_than_t35_ends_the_frame);
+    RUN_TEST(test_exception_response_returns_early);
+    RUN_TEST(test_silent_slave_times_out_after_each_attempt);
+    RUN_TEST(test_slow_slave_within_timeout);
+    RUN_TEST(test_stale_bytes_dropped_before_request);
+    RUN_TEST(test_unrelated_notify_does_not_end_wait);
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+// MQTT 3.1.1 và MQTT 5 trên cùng broker giả: giới hạn kích thước PUBLISH chỉ trừ
+// chỗ cho properties khi thực sự nói MQTT 5, và so sánh số byte lên dây mỗi mẫu
+// telemetry giữa 3.1.1 (topic đầy đủ) và MQTT 5 (topic alias).
+//   pio test -e native -f test_mqtt5
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + broker giả (PubSubClient là lib_deps)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/fake_broker.h"
+
+#define TOPIC "v1/devices/me/telemetry"
+#define BUFFER_SIZE 128
+// Header cố định tối đa + độ dài topic + topic
+#define TOPIC_OVERHEAD (MQTT_MAX_HEADER_SIZE + 2 + sizeof(TOPIC) - 1)
+
+static FakeBroker broker;
+static PubSubClient *client;
+static uint8_t payload[MQTT_INFLIGHT_PACKET_SIZE];
+
+static void connectAs(uint8_t version)
+{
+    client->setProtocolVersion(version);
+    TEST_ASSERT_TRUE(client->connect("dev"));
+    TEST_ASSERT_EQUAL_UINT8(version == MQTT_VERSION_5 ? 5 : 4, broker.protocolVersion);
+}
+
+void setUp(void)
+{
+    broker.topicAliasMaximum = 0;
+    broker.holdPubacks = true;
+    broker.reset();
+    memset(payload, 'x', sizeof(payload));
+    client = new PubSubClient(broker);
+    client->setServer(IPAddress(127, 0, 0, 1), 1883);
+    client->setBufferSize(BUFFER_SIZE);
+}
+
+void tearDown(void)
+{
+    delete client;
+}
+
+void test_v311_publish_uses_whole_buffer(void)
+{
+    connectAs(MQTT_VERSION_3_1_1);
+    const unsigned int maxPayload = BUFFER_SIZE - TOPIC_OVERHEAD;
+    TEST_ASSERT_TRUE(client->publish(TOPIC, payload, maxPayload));
+    TEST_ASSERT_FALSE(client->publish(TOPIC, payload, maxPayload + 1));
+    TEST_ASSERT_EQUAL_UINT32(1, broker.published());
+    TEST_ASSERT_EQUAL_UINT16(maxPayload, broker.lastPublish().payloadLength);
+}
+
+void test_v5_publish_reserves_properties(void)
+{
+    connectAs(MQTT_VERSION_5);
+    const unsigned int maxPayload = BUFFER_SIZE - TOPIC_OVERHEAD - MQTT_MAX_PUBLISH_PROPERTIES;
+    TEST_ASSERT_FALSE(client->publish(TOPIC, payload, maxPayload + 1));
+    TEST_ASSERT_TRUE(client->publish(TOPIC, payload, maxPayload));
+    TEST_ASSERT_EQUAL_UINT16(maxPayload, broker.lastPublish().payloadLength);
+}
+
+void test_v311_qos1_uses_whole_inflight_slot(void)
+{
+    connectAs(MQTT_VERSION_3_1_1);
+    const unsigned int maxPayload = MQTT_INFLIGHT_PACKET_SIZE - TOPIC_OVERHEAD - 2;
+    TEST_ASSERT_FALSE(client->publish(TOPIC, payload, maxPayload + 1, false, 1));
+    TEST_ASSERT_TRUE(client->publish(TOPIC, payload, maxPayload, false, 1));
+    TEST_ASSERT_TRUE(client->beginPublish(TOPIC, maxPayload, false, 1));
+    TEST_ASSERT_EQUAL_UINT32(maxPayload, client->write(payload, maxPayload));
+    TEST_ASSERT_TRUE(client->endPublish());
+    TEST_ASSERT_EQUAL_UINT32(2, broker.published());
+    TEST_ASSERT_EQUAL_UINT16(maxPayload, broker.lastPublish().payloadLength);
+}
+
+void test_v5_qos1_reserves_properties(void)
+{
+    connectAs(MQTT_VERSION_5);
+    const unsigned int maxPayload = MQTT_INFLIGHT_PACKET_SIZE - TOPIC_OVERHEAD - 2 - MQTT_MAX_PUBLISH_PROPERTIES;
+    TEST_ASSERT_FALSE(client->publish(TOPIC, payload, maxPayload + 1, false, 1));
+    TEST_ASSERT_FALSE(client->beginPublish(TOPIC, maxPayload + 1, false, 1));
+    TEST_ASSERT_TRUE(client->publish(TOPIC, payload, maxPayload, false, 1));
+}
+
+// Byte PUBLISH trên dây cho n mẫu telemetry cỡ thật, trên 1 kết nối
+static uint32_t wireBytes(uint8_t version, uint32_t samples)
+{
+    const char *sample = "{\"temperature\":25.5,\"humidity\":61.2}";
+    connectAs(version);
+    for (uint32_t i = 0; i < samples; i++) {
+        TEST_ASSERT_TRUE(client->publish(TOPIC, (const uint8_t *)sample, strlen(sample)));
+    }
+    TEST_ASSERT_EQUAL_UINT32(samples, broker.published());
+    uint32_t bytes = broker.publishBytes;
+    client->disconnect();
+    broker.reset();
+    return bytes;
+}
+
+void test_bytes_on_wire_v311_vs_v5(void)
+{
+    const uint32_t samples = 50;
+    broker.holdPubacks = false;
+    broker.topicAliasMaximum = MQTT_MAX_TOPIC_ALIASES;
+    uint32_t v311 = wireBytes(MQTT_VERSION_3_1_1, samples);
+    uint32_t v5 = wireBytes(MQTT_VERSION_5, samples);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u samples on \"" TOPIC "\": 3.1.1 %.1f B/sample, 5 + alias %.1f B/sample",
+             (unsigned)samples, (double)v311 / samples, (double)v5 / samples);
+    TEST_MESSAGE(msg);
+
+    // Từ mẫu thứ 2, alias thay topic 23 byte bằng 3 byte property + 1 byte độ dài
+    // properties; mẫu đầu gửi cả topic lẫn alias (thêm 4 byte)
+    TEST_ASSERT_LESS_THAN(v311, v5);
+    TEST_ASSERT_EQUAL_UINT32(v311 - (samples - 1) * (sizeof(TOPIC) - 1 - 3 - 1) + 4, v5);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_v311_publish_uses_whole_buffer);
+    RUN_TEST(test_v5_publish_reserves_properties);
+    RUN_TEST(test_v311_qos1_uses_whole_inflight_slot);
+    RUN_TEST(test_v5_qos1_reserves_properties);
+    RUN_TEST(test_bytes_on_wire_v311_vs_v5);
+    return UNITY_END();
+}
@@ -0,0 +1,371 @@
+// Độ bền của PubSubClient khi socket/broker cư xử lạ: đọc packet từ Client báo
+// có dữ liệu nhưng read() không trả được byte nào; mất kết nối khi còn PUBLISH
+// nằm trong buffer coalescing; lệnh QoS 1 được gửi lại sau khi resume session.
+// Kèm benchmark đường nhận: số lần gọi Client mỗi packet và byte/s khi đọc từng
+// byte (như trước, giờ chỉ còn khi gắn Stream) so với readBytes. loop() chạy
+// giữa beginPublish() và endPublish() không làm hỏng packet đang ghép.
+//   pio test -e native -f test_mqtt_client
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + broker giả (PubSubClient là lib_deps)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/fake_broker.h"
+
+// available() > 0 nhưng read(buf, n) trả -1, như WiFiClientSecure khi TLS record
+// chưa giải mã xong hoặc socket đã lỗi. Đếm mọi lần client gọi available()/read().
+class StallingBroker : public FakeBroker {
+public:
+    bool stallBulkRead = false;
+    uint32_t bulkReads = 0;
+    uint32_t byteReads = 0;
+    uint32_t availableCalls = 0;
+
+    int available() override {
+        if (!_inside) availableCalls++;
+        return FakeBroker::available();
+    }
+    int read() override {
+        byteReads++;
+        _inside = true;
+        int c = FakeBroker::read();
+        _inside = false;
+        return c;
+    }
+    int read(uint8_t *buf, size_t size) override {
+        bulkReads++;
+        if (stallBulkRead) {
+            return -1;
+        }
+        _inside = true;
+        int n = FakeBroker::read(buf, size);
+        _inside = false;
+        return n;
+    }
+
+    void resetCounters() {
+        bulkReads = byteReads = availableCalls = 0;
+    }
+
+private:
+    bool _inside = false;   // available() gọi từ bên trong read() không tính
+};
+
+// Stream bỏ hết dữ liệu: bật đường nhận PUBLISH từng byte của PubSubClient
+class NullStream : public Stream {
+public:
+    size_t write(uint8_t b) override { return 1; }
+    size_t write(const uint8_t *buf, size_t size) override { return size; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+};
+
+static StallingBroker broker;
+static PubSubClient *client;
+static uint32_t received;
+
+static void onMessage(char *topic, uint8_t *payload, unsigned int length)
+{
+    received++;
+}
+
+// PUBLISH QoS 0 từ broker xuống client
+static void injectPublish(const char *topic, const char *payload)
+{
+    uint8_t packet[128];
+    uint16_t topicLength = strlen(topic), payloadLength = strlen(payload);
+    size_t n = 0;
+    packet[n++] = MQTTPUBLISH;
+    packet[n++] = 2 + topicLength + payloadLength;
+    packet[n++] = topicLength >> 8;
+    packet[n++] = topicLength & 0xFF;
+    memcpy(packet + n, topic, topicLength);
+    n += topicLength;
+    memcpy(packet + n, payload, payloadLength);
+    n += payloadLength;
+    broker.inject(packet, n);
+}
+
+// PUBLISH QoS 1 (dup = gửi lại) từ broker xuống client
+static void injectQos1(uint16_t msgId, bool dup)
+{
+    const char *topic = "dev1/commands/relay";
+    const char *payload = "{\"relay\":1,\"status\":\"ON\"}";
+    uint8_t packet[128];
+    uint16_t topicLength = strlen(topic), payloadLength = strlen(payload);
+    size_t n = 0;
+    packet[n++] = MQTTPUBLISH | MQTTQOS1 | (dup ? MQTTDUP : 0);
+    packet[n++] = 2 + topicLength + 2 + payloadLength;
+    packet[n++] = topicLength >> 8;
+    packet[n++] = topicLength & 0xFF;
+    memcpy(packet + n, topic, topicLength);
+    n += topicLength;
+    packet[n++] = msgId >> 8;
+    packet[n++] = msgId & 0xFF;
+    memcpy(packet + n, payload, payloadLength);
+    n += payloadLength;
+    broker.inject(packet, n);
+    client->loop();
+}
+
+// Mất mạng rồi nối lại persistent session
+static void reconnect(bool sessionPresent)
+{
+    broker.drop();
+    TEST_ASSERT_FALSE(client->connected());
+    broker.sessionPresent = sessionPresent;
+    TEST_ASSERT_TRUE(client->connect("dev", NULL, NULL, 0, 0, 0, 0, false));
+    broker.sessionPresent = false;
+}
+
+void setUp(void)
+{
+    broker.stallBulkRead = false;
+    broker.resetCounters();
+    broker.reset();
+    received = 0;
+    client = new PubSubClient(broker);
+    client->setServer(IPAddress(127, 0, 0, 1), 1883);
+    client->setCallback(onMessage);
+    client->setSocketTimeout(1);
+    TEST_ASSERT_TRUE(client->connect("dev"));
+}
+
+void tearDown(void)
+{
+    delete client;
+}
+
+void test_stalled_read_gives_up_after_socket_timeout(void)
+{
+    injectPublish("v1/devices/me/rpc/request/1", "{\"method\":\"setLED\"}");
+    broker.stallBulkRead = true;
+
+    uint32_t start = millis();
+    client->loop();
+    uint32_t elapsed = millis() - start;
+
+    // Vòng đọc phải tính timeout cả khi available() > 0: không quay mãi
+    TEST_ASSERT_GREATER_THAN(1, broker.bulkReads);
+    TEST_ASSERT_GREATER_OR_EQUAL(1000, elapsed);
+    TEST_ASSERT_LESS_THAN(1500, elapsed);
+    TEST_ASSERT_EQUAL_UINT32(0, received);
+}
+
+void test_bulk_read_still_delivers_message(void)
+{
+    injectPublish("v1/devices/me/rpc/request/1", "{\"method\":\"setLED\"}");
+    client->loop();
+    TEST_ASSERT_EQUAL_UINT32(1, received);
+}
+
+// PUBLISH QoS 0 lớn (remaining length nhiều byte) từ broker xuống client
+static size_t injectLargePublish(const char *topic, size_t payloadLength)
+{
+    static uint8_t packet[FAKE_BROKER_TX_SIZE];
+    uint16_t topicLength = strlen(topic);
+    uint32_t remaining = 2 + topicLength + payloadLength;
+    size_t n = 0;
+    packet[n++] = MQTTPUBLISH;
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        packet[n++] = digit | (remaining > 0 ? 0x80 : 0);
+    } while (remaining > 0);
+    packet[n++] = topicLength >> 8;
+    packet[n++] = topicLength & 0xFF;
+    memcpy(packet + n, topic, topicLength);
+    n += topicLength;
+    memset(packet + n, 'x', payloadLength);
+    n += payloadLength;
+    broker.inject(packet, n);
+    return n;
+}
+
+struct ReceiveBench {
+    double readsPerPacket;
+    double availablePerPacket;
+    double bytesPerSecond;
+};
+
+static ReceiveBench benchmarkReceive(uint32_t packets, size_t payloadLength)
+{
+    uint64_t wireBytes = 0;
+    broker.resetCounters();
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < packets; i++) {
+        wireBytes += injectLargePublish("dev1/commands/config", payloadLength);
+        client->loop();
+    }
+    uint32_t elapsedUs = micros() - start;
+    TEST_ASSERT_EQUAL_UINT32(packets, received);
+
+    ReceiveBench r;
+    r.readsPerPacket = (double)(broker.byteReads + broker.bulkReads) / packets;
+    r.availablePerPacket = (double)broker.availableCalls / packets;
+    r.bytesPerSecond = elapsedUs > 0 ? wireBytes * 1e6 / elapsedUs : 0;
+    return r;
+}
+
+void test_benchmark_receive_path(void)
+{
+    const uint32_t packets = 500;
+    const size_t payloadLength = 1024;
+    client->setBufferSize(1200);
+
+    // Trước: từng byte qua read() (đường Stream vẫn giữ cách này)
+    NullStream sink;
+    client->setStream(sink);
+    ReceiveBench perByte = benchmarkReceive(packets, payloadLength);
+
+    // Sau: header từng byte, phần thân 1 lần readBytes
+    delete client;
+    client = new PubSubClient(broker);
+    client->setCallback(onMessage);
+    client->setBufferSize(1200);
+    broker.reset();
+    TEST_ASSERT_TRUE(client->connect("dev"));
+    received = 0;
+    ReceiveBench bulk = benchmarkReceive(packets, payloadLength);
+
+    char msg[200];
+    snprintf(msg, sizeof(msg),
+             "1 KB PUBLISH x%u: per-byte %.1f read + %.1f available/packet, %.1f MB/s | "
+             "readBytes %.1f read + %.1f available/packet, %.1f MB/s",
+             (unsigned)packets, perByte.readsPerPacket, perByte.availablePerPacket, perByte.bytesPerSecond / 1e6,
+             bulk.readsPerPacket, bulk.availablePerPacket, bulk.bytesPerSecond / 1e6);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_GREATER_THAN(payloadLength, perByte.readsPerPacket);
+    TEST_ASSERT_LESS_THAN(8, bulk.readsPerPacket);   // fixed header + 1 lần đọc thân
+    TEST_ASSERT_LESS_THAN(perByte.readsPerPacket / 100, bulk.readsPerPacket);
+}
+
+void test_loop_between_begin_and_end_publish_keeps_staged_packet(void)
+{
+    const char *payload = "{\"temperature\":25.5}";
+    size_t half = strlen(payload) / 2;
+    TEST_ASSERT_TRUE(client->beginPublish("dev1/telemetry", strlen(payload), false));
+    TEST_ASSERT_EQUAL(half, client->write((const uint8_t *)payload, half));
+
+    // Broker gửi lệnh xuống giữa chừng; loop() không được đọc đè buffer
+    injectPublish("dev1/commands/relay", "{\"relay\":1,\"status\":\"ON\"}");
+    TEST_ASSERT_TRUE(client->loop());
+    TEST_ASSERT_EQUAL_UINT32(0, received);
+
+    size_t rest = strlen(payload) - half;
+    TEST_ASSERT_EQUAL(rest, client->write((const uint8_t *)payload + half, rest));
+    TEST_ASSERT_EQUAL(1, client->endPublish());
+    TEST_ASSERT_EQUAL_UINT32(1, broker.published());
+    TEST_ASSERT_EQUAL_STRING("dev1/telemetry", broker.lastPublish().topic);
+    TEST_ASSERT_EQUAL_UINT16(strlen(payload), broker.lastPublish().payloadLength);
+    TEST_ASSERT_EQUAL_MEMORY(payload, broker.lastPayload, strlen(payload));
+
+    // Lệnh vẫn nằm trên socket và được xử lý ở loop() kế tiếp
+    TEST_ASSERT_TRUE(client->loop());
+    TEST_ASSERT_EQUAL_UINT32(1, received);
+}
+
+void test_coalesced_bytes_not_flushed_into_next_connection(void)
+{
+    client->setCoalesceWindow(1000);
+    const uint8_t payload[] = "{\"temperature\":25.5}";
+    TEST_ASSERT_TRUE(client->publish("dev/telemetry", payload, sizeof(payload) - 1));
+    TEST_ASSERT_EQUAL_UINT32(0, broker.published());   // còn nằm trong buffer
+
+    // Mất mạng trước khi cửa sổ coalescing hết hạn, rồi nối lại
+    broker.drop();
+    TEST_ASSERT_FALSE(client->connected());
+    TEST_ASSERT_TRUE(client->connect("dev"));
+
+    // Byte đầu tiên trên kết nối mới phải là CONNECT, không phải PUBLISH cũ
+    TEST_ASSERT_EQUAL_HEX8(MQTTCONNECT, broker.firstPacket);
+    client->flushWrites();
+    TEST_ASSERT_EQUAL_UINT32(0, broker.published());
+}
+
+void test_coalesced_qos1_resent_from_window_after_reconnect(void)
+{
+    client->setCoalesceWindow(1000);
+    const uint8_t payload[] = "{\"humidity\":60}";
+    TEST_ASSERT_TRUE(client->publish("dev/telemetry", payload, sizeof(payload) - 1, false, 1));
+    TEST_ASSERT_EQUAL_UINT8(1, client->getInflightCount());
+
+    broker.drop();
+    TEST_ASSERT_FALSE(client->connected());
+    broker.sessionPresent = true;
+    TEST_ASSERT_TRUE(client->connect("dev", NULL, NULL, 0, 0, 0, 0, false));
+    broker.sessionPresent = false;
+    client->flushWrites();
+
+    // Gửi lại đúng 1 lần từ cửa sổ in-flight, sau CONNECT
+    TEST_ASSERT_EQUAL_HEX8(MQTTCONNECT, broker.firstPacket);
+    TEST_ASSERT_EQUAL_UINT32(1, broker.published());
+    TEST_ASSERT_TRUE(broker.lastPublish().dup);
+}
+
+void test_redelivery_after_resume_dropped(void)
+{
+    injectQos1(7, false);
+    TEST_ASSERT_EQUAL_UINT32(1, received);
+
+    // PUBACK cho id 7 mất cùng kết nối: broker gửi lại với DUP sau khi resume
+    reconnect(true);
+    injectQos1(7, true);
+    TEST_ASSERT_EQUAL_UINT32(1, received);
+    TEST_ASSERT_EQUAL_UINT32(1, client->getDuplicateCount());
+
+    // Lại mất PUBACK mới: lần gửi lại tiếp theo vẫn bị bỏ qua
+    reconnect(true);
+    injectQos1(7, true);
+    TEST_ASSERT_EQUAL_UINT32(1, received);
+    TEST_ASSERT_EQUAL_UINT32(2, client->getDuplicateCount());
+}
+
+void test_id_reused_after_resume_delivered(void)
+{
+    injectQos1(7, false);
+    reconnect(true);
+
+    // Message mới đầu tiên kết thúc phần gửi lại của resume: id 7 cũ đã được
+    // ack, DUP 7 sau đó là message khác mà client chưa từng thấy
+    injectQos1(8, false);
+    injectQos1(7, true);
+    TEST_ASSERT_EQUAL_UINT32(3, received);
+    TEST_ASSERT_EQUAL_UINT32(0, client->getDuplicateCount());
+}
+
+void test_ids_from_older_connections_forgotten(void)
+{
+    injectQos1(7, false);
+    reconnect(true);
+    reconnect(true);
+
+    // id 7 thuộc kết nối trước nữa: server có thể đã dùng lại nó
+    injectQos1(7, true);
+    TEST_ASSERT_EQUAL_UINT32(2, received);
+}
+
+void test_new_session_redelivers_nothing(void)
+{
+    injectQos1(7, false);
+    reconnect(false);
+    injectQos1(7, true);
+    TEST_ASSERT_EQUAL_UINT32(2, received);
+    TEST_ASSERT_EQUAL_UINT32(0, client->getDuplicateCount());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stalled_read_gives_up_after_socket_timeout);
+    RUN_TEST(test_bulk_read_still_delivers_message);
+    RUN_TEST(test_benchmark_receive_path);
+    RUN_TEST(test_loop_between_begin_and_end_publish_keeps_staged_packet);
+    RUN_TEST(test_coalesced_bytes_not_flushed_into_next_connection);
+    RUN_TEST(test_coalesced_qos1_resent_from_window_after_reconnect);
+    RUN_TEST(test_redelivery_after_resume_dropped);
+    RUN_TEST(test_id_reused_after_resume_delivered);
+    RUN_TEST(test_ids_from_older_connections_forgotten);
+    RUN_TEST(test_new_session_redelivers_nothing);
+    return UNITY_END();
+}
@@ -0,0 +1,293 @@
+// QoS 1 của PubSubClient với broker giả giữ/trễ/bỏ PUBACK: cửa sổ in-flight,
+// pipelining nhiều PUBLISH trong 1 RTT, gửi lại với cờ DUP khi hết hạn chờ,
+// khớp PUBACK theo packet id và gửi lại sau khi kết nối lại (kể cả khi phiên
+// mới thương lượng version khác với version packet được đóng gói).
+//   pio test -e native -f test_mqtt_inflight
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + broker giả (PubSubClient là lib_deps)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/fake_broker.h"
+
+static FakeBroker broker;
+static PubSubClient *client;
+static const uint8_t payload[] = "{\"temperature\":25.5}";
+
+static bool publishQos1()
+{
+    return client->publish("dev/telemetry", payload, sizeof(payload) - 1, false, 1);
+}
+
+// Chạy loop() như task MQTT cho tới khi cond() đúng hoặc hết thời gian
+template <class Cond>
+static uint32_t loopUntil(Cond cond, uint32_t timeoutMs)
+{
+    uint32_t start = millis();
+    while (!cond() && millis() - start < timeoutMs) {
+        client->loop();
+        delay(1);
+    }
+    return millis() - start;
+}
+
+static void connectClient(bool cleanSession = true)
+{
+    TEST_ASSERT_TRUE(client->connect("dev", NULL, NULL, 0, 0, 0, 0, cleanSession));
+}
+
+void setUp(void)
+{
+    broker.pubackDelayMs = 0;
+    broker.holdPubacks = false;
+    broker.dropPubacks = 0;
+    broker.receiveMaximum = 0;
+    broker.topicAliasMaximum = 0;
+    broker.reset();
+    client = new PubSubClient(broker);
+    client->setServer(IPAddress(127, 0, 0, 1), 1883);
+    connectClient();
+}
+
+void tearDown(void)
+{
+    delete client;
+}
+
+void test_window_limits_unacknowledged_publishes(void)
+{
+    broker.holdPubacks = true;
+    for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        TEST_ASSERT_TRUE(publishQos1());
+    }
+    // Cả cửa sổ đã lên dây trước khi có PUBACK nào (không stop-and-wait)
+    TEST_ASSERT_EQUAL_UINT32(MQTT_MAX_INFLIGHT, broker.published());
+    TEST_ASSERT_EQUAL_UINT8(MQTT_MAX_INFLIGHT, client->getInflightCount());
+    TEST_ASSERT_FALSE(publishQos1());
+
+    broker.releasePubacks();
+    loopUntil([]() { return client->getInflightCount() == 0; }, 200);
+    TEST_ASSERT_EQUAL_UINT8(0, client->getInflightCount());
+    TEST_ASSERT_TRUE(publishQos1());
+}
+
+void test_window_is_configurable(void)
+{
+    broker.holdPubacks = true;
+    client->setInflightWindow(2);
+    TEST_ASSERT_TRUE(publishQos1());
+    TEST_ASSERT_TRUE(publishQos1());
+    TEST_ASSERT_FALSE(publishQos1());
+    TEST_ASSERT_EQUAL_UINT32(2, broker.published());
+}
+
+void test_packet_ids_unique_while_in_flight(void)
+{
+    broker.holdPubacks = true;
+    for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        publishQos1();
+    }
+    for (uint32_t i = 0; i < broker.published(); i++) {
+        TEST_ASSERT_NOT_EQUAL(0, broker.publish(i).msgId);
+        TEST_ASSERT_EQUAL_UINT8(1, broker.publish(i).qos);
+        TEST_ASSERT_FALSE(broker.publish(i).dup);
+        for (uint32_t j = 0; j < i; j++) {
+            TEST_ASSERT_NOT_EQUAL(broker.publish(j).msgId, broker.publish(i).msgId);
+        }
+    }
+}
+
+void test_delayed_pubacks_pipeline_in_one_rtt(void)
+{
+    const uint32_t rttMs = 60;
+    broker.pubackDelayMs = rttMs;
+    uint32_t start = millis();
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(publishQos1());
+    }
+    loopUntil([]() { return client->getInflightCount() == 0; }, 1000);
+    uint32_t elapsed = millis() - start;
+
+    char msg[80];
+    snprintf(msg, sizeof(msg), "3 QoS 1 publishes, PUBACK after %u ms: done in %u ms",
+             (unsigned)rttMs, (unsigned)elapsed);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT8(0, client->getInflightCount());
+    TEST_ASSERT_GREATER_OR_EQUAL(rttMs, elapsed);
+    TEST_ASSERT_LESS_THAN(2 * rttMs, elapsed);   // stop-and-wait sẽ mất 3 RTT
+    TEST_ASSERT_EQUAL_UINT32(0, client->getRetransmitCount());
+}
+
+void test_dropped_puback_resent_with_dup_after_timeout(void)
+{
+    client->setRetryTimeout(100);
+    broker.dropPubacks = 1;
+    TEST_ASSERT_TRUE(publishQos1());
+    uint16_t id = broker.lastPublish().msgId;
+
+    // Chưa tới hạn: không gửi lại
+    loopUntil([]() { return false; }, 50);
+    TEST_ASSERT_EQUAL_UINT32(1, broker.published());
+    TEST_ASSERT_EQUAL_UINT8(1, client->getInflightCount());
+
+    loopUntil([]() { return client->getInflightCount() == 0; }, 300);
+    TEST_ASSERT_EQUAL_UINT32(2, broker.published());
+    TEST_ASSERT_TRUE(broker.lastPublish().dup);
+    TEST_ASSERT_EQUAL_UINT16(id, broker.lastPublish().msgId);
+    TEST_ASSERT_EQUAL_UINT16(sizeof(payload) - 1, broker.lastPublish().payloadLength);
+    TEST_ASSERT_EQUAL_UINT32(1, client->getRetransmitCount());
+    TEST_ASSERT_EQUAL_UINT8(0, client->getInflightCount());
+}
+
+void test_puback_matched_by_packet_id(void)
+{
+    broker.holdPubacks = true;
+    publishQos1();
+    publishQos1();
+    uint16_t first = broker.publish(0).msgId;
+    uint16_t second = broker.publish(1).msgId;
+
+    // PUBACK cho id lạ không giải phóng gì
+    uint16_t unknown = first ^ second ^ 0x7777;
+    uint8_t ack[4] = {MQTTPUBACK, 2, (uint8_t)(unknown >> 8), (uint8_t)unknown};
+    broker.inject(ack, sizeof(ack));
+    loopUntil([]() { return false; }, 20);
+    TEST_ASSERT_EQUAL_UINT8(2, client->getInflightCount());
+
+    // PUBACK khác thứ tự: chỉ message tương ứng được giải phóng
+    ack[2] = second >> 8;
+    ack[3] = second;
+    broker.inject(ack, sizeof(ack));
+    loopUntil([]() { return client->getInflightCount() < 2; }, 100);
+    TEST_ASSERT_EQUAL_UINT8(1, client->getInflightCount());
+
+    client->setRetryTimeout(10);
+    broker.holdPubacks = false;
+    broker.releasePubacks();
+    loopUntil([]() { return client->getInflightCount() == 0; }, 200);
+    // Chỉ message đầu (chưa được ack) bị gửi lại
+    for (uint32_t i = 2; i < broker.published(); i++) {
+        TEST_ASSERT_EQUAL_UINT16(first, broker.publish(i).msgId);
+    }
+}
+
+void test_unacknowledged_resent_after_reconnect(void)
+{
+    broker.holdPubacks = true;
+    publishQos1();
+    publishQos1();
+    TEST_ASSERT_EQUAL_UINT32(2, broker.published());
+
+    // Mất mạng trước khi có PUBACK, nối lại với persistent session
+    broker.drop();
+    TEST_ASSERT_FALSE(client->connected());
+    broker.holdPubacks = false;
+    broker.sessionPresent = true;
+    connectClient(false);
+    broker.sessionPresent = false;
+
+    TEST_ASSERT_EQUAL_UINT32(4, broker.published());
+    TEST_ASSERT_TRUE(broker.publish(2).dup);
+    TEST_ASSERT_TRUE(broker.publish(3).dup);
+    TEST_ASSERT_EQUAL_UINT16(broker.publish(0).msgId, broker.publish(2).msgId);
+    TEST_ASSERT_EQUAL_UINT16(broker.publish(1).msgId, broker.publish(3).msgId);
+    loopUntil([]() { return client->getInflightCount() == 0; }, 200);
+    TEST_ASSERT_EQUAL_UINT8(0, client->getInflightCount());
+}
+
+void test_mqtt5_receive_maximum_caps_window(void)
+{
+    client->disconnect();
+    broker.receiveMaximum = 2;
+    broker.holdPubacks = true;
+    client->setProtocolVersion(MQTT_VERSION_5);
+    connectClient();
+    TEST_ASSERT_EQUAL_UINT8(MQTT_VERSION_5, broker.protocolVersion);
+
+    TEST_ASSERT_TRUE(publishQos1());
+    TEST_ASSERT_TRUE(publishQos1());
+    TEST_ASSERT_FALSE(publishQos1());
+}
+
+// Mất mạng khi còn 2 PUBLISH chưa ack, nối lại persistent session với version khác
+static void reconnectWithVersion(uint8_t version)
+{
+    broker.drop();
+    broker.holdPubacks = false;
+    broker.sessionPresent = true;
+    client->setProtocolVersion(version);
+    connectClient(false);
+    broker.sessionPresent = false;
+    TEST_ASSERT_EQUAL_UINT8(version, broker.protocolVersion);
+}
+
+static void assertResent(uint32_t index, uint16_t msgId)
+{
+    const FakePublish &p = broker.publish(index);
+    TEST_ASSERT_TRUE(p.dup);
+    TEST_ASSERT_EQUAL_UINT16(msgId, p.msgId);
+    TEST_ASSERT_EQUAL_STRING("dev/telemetry", p.topic);
+    TEST_ASSERT_EQUAL_UINT16(0, p.alias);
+    TEST_ASSERT_EQUAL_UINT16(sizeof(payload) - 1, p.payloadLength);
+}
+
+void test_v5_packets_rebuilt_for_v311_session(void)
+{
+    client->disconnect();
+    broker.topicAliasMaximum = 4;
+    broker.holdPubacks = true;
+    client->setProtocolVersion(MQTT_VERSION_5);
+    client->setMessageExpiry(60);
+    connectClient();
+    publishQos1();
+    publishQos1();   // lần 2 chỉ gửi alias, topic rỗng
+    TEST_ASSERT_EQUAL_UINT16(1, broker.publish(1).alias);
+    TEST_ASSERT_EQUAL_UINT32(sizeof("dev/telemetry") - 1 + 2 + 2 + 1 + 5 + 3 + sizeof(payload) - 1 + 2,
+                             broker.publish(0).wireLength);
+
+    reconnectWithVersion(MQTT_VERSION);
+
+    // Không còn khối properties, topic đầy đủ, payload nguyên vẹn
+    TEST_ASSERT_EQUAL_UINT32(4, broker.published());
+    assertResent(2, broker.publish(0).msgId);
+    assertResent(3, broker.publish(1).msgId);
+    TEST_ASSERT_EQUAL_MEMORY(payload, broker.lastPayload, sizeof(payload) - 1);
+    TEST_ASSERT_EQUAL_UINT32(sizeof("dev/telemetry") - 1 + 2 + 2 + sizeof(payload) - 1 + 2,
+                             broker.publish(3).wireLength);
+    loopUntil([]() { return client->getInflightCount() == 0; }, 200);
+    TEST_ASSERT_EQUAL_UINT8(0, client->getInflightCount());
+}
+
+void test_v311_packets_rebuilt_for_v5_session(void)
+{
+    broker.holdPubacks = true;
+    publishQos1();
+    publishQos1();
+
+    client->setMessageExpiry(0);
+    reconnectWithVersion(MQTT_VERSION_5);
+
+    // Có khối properties (rỗng) để broker MQTT 5 không đọc nhầm payload
+    TEST_ASSERT_EQUAL_UINT32(4, broker.published());
+    assertResent(2, broker.publish(0).msgId);
+    assertResent(3, broker.publish(1).msgId);
+    TEST_ASSERT_EQUAL_UINT32(0, broker.publish(3).expiry);
+    TEST_ASSERT_EQUAL_MEMORY(payload, broker.lastPayload, sizeof(payload) - 1);
+    loopUntil([]() { return client->getInflightCount() == 0; }, 200);
+    TEST_ASSERT_EQUAL_UINT8(0, client->getInflightCount());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_window_limits_unacknowledged_publishes);
+    RUN_TEST(test_window_is_configurable);
+    RUN_TEST(test_packet_ids_unique_while_in_flight);
+    RUN_TEST(test_delayed_pubacks_pipeline_in_one_rtt);
+    RUN_TEST(test_dropped_puback_resent_with_dup_after_timeout);
+    RUN_TEST(test_puback_matched_by_packet_id);
+    RUN_TEST(test_unacknowledged_resent_after_reconnect);
+    RUN_TEST(test_mqtt5_receive_maximum_caps_window);
+    RUN_TEST(test_v5_packets_rebuilt_for_v311_session);
+    RUN_TEST(test_v311_packets_rebuilt_for_v5_session);
+    return UNITY_END();
+}
@@ -0,0 +1,102 @@
+// Hàng đợi publish (mqtt_queue): chính sách khi đầy, đặc biệt lúc task MQTT
+// đang giữ 1 ô đã claim (publish/spool chưa xong) thì reserve chỉ được bỏ
+// tối đa 1 message, không xả cả backlog.
+//   pio test -e native -f test_mqtt_queue
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../src/mqtt_queue.cpp"
+
+static void pushNumbered(uint8_t n) {
+    uint8_t payload[1] = {n};
+    TEST_ASSERT_TRUE(mqtt_queue_push(payload, 1, 0));
+}
+
+static void fillQueue() {
+    for (uint8_t i = 0; i < MQTT_QUEUE_DEPTH; i++) {
+        pushNumbered(i);
+    }
+    TEST_ASSERT_EQUAL_UINT16(MQTT_QUEUE_DEPTH, mqtt_queue_stats().depth);
+}
+
+void setUp(void)
+{
+    mqtt_queue_init();
+    mqtt_queue_policy = MQTT_QUEUE_DROP_OLDEST;
+}
+
+void tearDown(void) {}
+
+void test_full_queue_drops_exactly_one_oldest(void)
+{
+    fillQueue();
+    MqttQueueStats before = mqtt_queue_stats();
+    pushNumbered(100);
+
+    MqttQueueStats after = mqtt_queue_stats();
+    TEST_ASSERT_EQUAL_UINT32(before.droppedOldest + 1, after.droppedOldest);
+    TEST_ASSERT_EQUAL_UINT32(before.droppedNewest, after.droppedNewest);
+    TEST_ASSERT_EQUAL_UINT16(MQTT_QUEUE_DEPTH, after.depth);
+
+    // Message 0 bị bỏ, còn lại 1..DEPTH-1 rồi tới message mới
+    for (uint8_t i = 1; i < MQTT_QUEUE_DEPTH; i++) {
+        MqttQueueCell *cell = mqtt_queue_claim();
+        TEST_ASSERT_NOT_NULL(cell);
+        TEST_ASSERT_EQUAL_UINT8(i, cell->payload[0]);
+        mqtt_queue_release(cell);
+    }
+    MqttQueueCell *cell = mqtt_queue_claim();
+    TEST_ASSERT_NOT_NULL(cell);
+    TEST_ASSERT_EQUAL_UINT8(100, cell->payload[0]);
+    mqtt_queue_release(cell);
+}
+
+void test_consumer_held_cell_does_not_drain_backlog(void)
+{
+    fillQueue();
+    // Task MQTT đang publish message 0 (socket/flash có thể block)
+    MqttQueueCell *held = mqtt_queue_claim();
+    TEST_ASSERT_NOT_NULL(held);
+    uint16_t depth = mqtt_queue_stats().depth;
+    MqttQueueStats before = mqtt_queue_stats();
+
+    TEST_ASSERT_NULL(mqtt_queue_reserve(0));
+
+    MqttQueueStats after = mqtt_queue_stats();
+    TEST_ASSERT_GREATER_OR_EQUAL(depth - 1, after.depth);   // mất tối đa 1 message
+    TEST_ASSERT_EQUAL_UINT32(1, (after.droppedOldest - before.droppedOldest) +
+                                (after.droppedNewest - before.droppedNewest));
+
+    // Backlog còn nguyên sau khi consumer release
+    mqtt_queue_release(held);
+    uint16_t remaining = 0;
+    MqttQueueCell *cell;
+    while ((cell = mqtt_queue_claim()) != NULL) {
+        remaining++;
+        mqtt_queue_release(cell);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(depth - 1, remaining);
+}
+
+void test_drop_newest_rejects_when_full(void)
+{
+    mqtt_queue_policy = MQTT_QUEUE_DROP_NEWEST;
+    fillQueue();
+    MqttQueueStats before = mqtt_queue_stats();
+    uint8_t payload[1] = {100};
+    TEST_ASSERT_FALSE(mqtt_queue_push(payload, 1, 0));
+    MqttQueueStats after = mqtt_queue_stats();
+    TEST_ASSERT_EQUAL_UINT32(before.droppedNewest + 1, after.droppedNewest);
+    TEST_ASSERT_EQUAL_UINT32(before.droppedOldest, after.droppedOldest);
+    TEST_ASSERT_EQUAL_UINT16(MQTT_QUEUE_DEPTH, after.depth);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_full_queue_drops_exactly_one_oldest);
+    RUN_TEST(test_consumer_held_cell_does_not_drain_backlog);
+    RUN_TEST(test_drop_newest_rejects_when_full);
+    return UNITY_END();
+}
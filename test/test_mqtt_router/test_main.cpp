@@ -0,0 +1,252 @@
+// Router lệnh MQTT: các trường hợp biên của wildcard '+' / '#' theo spec MQTT
+// (level rỗng, '#' khớp 0 level, topic $SYS, pattern sai) và benchmark độ trễ
+// dispatch với 50 route so với duyệt tuần tự từng pattern.
+//   pio test -e native -f test_mqtt_router
+#include <unity.h>
+
+// Arduino giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../src/payload_codec.cpp"
+#include "../../src/mqtt_router.cpp"
+
+#define BENCH_ROUTES 50
+
+// Route biên, id = thứ tự đăng ký
+enum {
+    R_ALL,          // "#"
+    R_A_HASH,       // "a/#"
+    R_A_PLUS,       // "a/+"
+    R_A_PLUS_C,     // "a/+/c"
+    R_PLUS_PLUS,    // "+/+"
+    R_PLUS_X,       // "+/x"
+    R_SYS_HASH,     // "$SYS/#"
+    R_DEV_CMD,      // "dev/cmd"
+    R_EDGE_COUNT
+};
+
+static const char *const edgePatterns[R_EDGE_COUNT] = {
+    "#", "a/#", "a/+", "a/+/c", "+/+", "+/x", "$SYS/#", "dev/cmd",
+};
+
+// Route lấp cho đủ 50, kiểu coreiot: "+/commands/cmd<n>"
+static char fillerPatterns[BENCH_ROUTES - R_EDGE_COUNT][24];
+static const char *benchPatterns[BENCH_ROUTES];
+static uint32_t handled;
+static bool invalidRejected, allAdded, duplicateRejected, routerCompiled;
+
+static void countHandler(const char *topic, JsonVariantConst payload)
+{
+    handled++;
+}
+
+// Tập route khớp dưới dạng bitmask theo id
+static uint64_t matches(const char *topic)
+{
+    int8_t routes[MQTT_ROUTER_MAX_ROUTES];
+    uint8_t n = mqtt_router_match(topic, routes, MQTT_ROUTER_MAX_ROUTES);
+    uint64_t mask = 0;
+    for (uint8_t i = 0; i < n; i++) mask |= 1ULL << routes[i];
+    return mask;
+}
+
+#define BIT(r) (1ULL << (r))
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// ==================== EDGE CASES ====================
+void test_hash_matches_parent_level(void)
+{
+    // "a/#" khớp cả "a" (0 level còn lại)
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL) | BIT(R_A_HASH), matches("a"));
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL) | BIT(R_A_HASH) | BIT(R_A_PLUS_C), matches("a/b/c"));
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL) | BIT(R_A_HASH), matches("a/b/c/d"));
+}
+
+void test_plus_matches_exactly_one_level(void)
+{
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL) | BIT(R_A_HASH) | BIT(R_A_PLUS) | BIT(R_PLUS_PLUS), matches("a/b"));
+    // '+' không nuốt nhiều level
+    TEST_ASSERT_EQUAL_HEX64(0, matches("a/b/c") & (BIT(R_A_PLUS) | BIT(R_PLUS_PLUS)));
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL) | BIT(R_PLUS_PLUS) | BIT(R_PLUS_X), matches("q/x"));
+}
+
+void test_plus_matches_empty_level(void)
+{
+    // Level rỗng vẫn là 1 level: "a//c", "a/", "/x"
+    TEST_ASSERT_TRUE(matches("a//c") & BIT(R_A_PLUS_C));
+    TEST_ASSERT_TRUE(matches("a/") & BIT(R_A_PLUS));
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL) | BIT(R_PLUS_PLUS) | BIT(R_PLUS_X), matches("/x"));
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL) | BIT(R_PLUS_PLUS), matches("/"));
+}
+
+void test_exact_level_compared_by_length(void)
+{
+    TEST_ASSERT_TRUE(matches("dev/cmd") & BIT(R_DEV_CMD));
+    TEST_ASSERT_FALSE(matches("dev/cm") & BIT(R_DEV_CMD));
+    TEST_ASSERT_FALSE(matches("dev/cmdx") & BIT(R_DEV_CMD));
+    TEST_ASSERT_FALSE(matches("dev/cmd/x") & BIT(R_DEV_CMD));
+    TEST_ASSERT_FALSE(matches("de/cmd") & BIT(R_DEV_CMD));
+}
+
+void test_sys_topics_skip_leading_wildcards(void)
+{
+    // '#' và '+' ở level đầu không khớp topic bắt đầu bằng '$'
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_SYS_HASH), matches("$SYS/broker/uptime"));
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_SYS_HASH), matches("$SYS"));
+    TEST_ASSERT_EQUAL_HEX64(0, matches("$other/x"));
+}
+
+void test_invalid_patterns_rejected(void)
+{
+    // Kết quả đăng ký trong main(): '#' không ở cuối, wildcard lẫn ký tự khác,
+    // handler NULL và pattern trùng đều bị từ chối; 50 route hợp lệ đều vào trie
+    TEST_ASSERT_TRUE(invalidRejected);
+    TEST_ASSERT_TRUE(duplicateRejected);
+    TEST_ASSERT_TRUE(allAdded);
+    TEST_ASSERT_TRUE(routerCompiled);
+    // Sau compile mọi add đều bị từ chối, kể cả pattern hợp lệ
+    TEST_ASSERT_FALSE(mqtt_router_add("late/route", countHandler));
+}
+
+void test_match_respects_max_routes(void)
+{
+    int8_t routes[2];
+    TEST_ASSERT_EQUAL_UINT8(2, mqtt_router_match("a/b/c", routes, 2));
+    TEST_ASSERT_EQUAL_UINT8(0, mqtt_router_match(NULL, routes, 2));
+}
+
+void test_filler_routes_match(void)
+{
+    TEST_ASSERT_TRUE(matches("dev1/commands/cmd0") & BIT(R_EDGE_COUNT));
+    TEST_ASSERT_TRUE(matches("dev1/commands/cmd41") & BIT(BENCH_ROUTES - 1));
+    TEST_ASSERT_EQUAL_HEX64(BIT(R_ALL), matches("dev1/commands/cmd42"));
+}
+
+// ==================== BENCHMARK ====================
+// Cách làm trước khi có trie: so topic với từng pattern theo thứ tự đăng ký
+static bool naiveMatch(const char *pattern, const char *topic)
+{
+    if (topic[0] == '$' && (pattern[0] == '+' || pattern[0] == '#')) return false;
+    while (*pattern) {
+        if (pattern[0] == '#') return true;
+        const char *pEnd = strchr(pattern, '/');
+        const char *tEnd = strchr(topic, '/');
+        size_t pLen = pEnd ? pEnd - pattern : strlen(pattern);
+        size_t tLen = tEnd ? tEnd - topic : strlen(topic);
+        if (!(pLen == 1 && pattern[0] == '+') && (pLen != tLen || memcmp(pattern, topic, pLen) != 0)) {
+            return false;
+        }
+        if (pEnd == NULL) return tEnd == NULL;
+        if (tEnd == NULL) return strcmp(pEnd + 1, "#") == 0;
+        pattern = pEnd + 1;
+        topic = tEnd + 1;
+    }
+    return *topic == '\0';
+}
+
+static uint8_t naiveDispatch(const char *topic)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < BENCH_ROUTES && count < MQTT_ROUTER_MAX_MATCHES; i++) {
+        if (naiveMatch(benchPatterns[i], topic)) count++;
+    }
+    return count;
+}
+
+static double nsPerOp(uint32_t startUs, uint32_t iterations)
+{
+    return (micros() - startUs) * 1000.0 / iterations;
+}
+
+void test_naive_matcher_agrees_with_trie(void)
+{
+    const char *topics[] = {"a", "a/b", "a/b/c", "a//c", "/x", "$SYS/x", "dev/cmd", "dev1/commands/cmd7"};
+    for (size_t t = 0; t < sizeof(topics) / sizeof(topics[0]); t++) {
+        uint64_t naive = 0;
+        for (uint8_t i = 0; i < BENCH_ROUTES; i++) {
+            if (naiveMatch(benchPatterns[i], topics[t])) naive |= 1ULL << i;
+        }
+        TEST_ASSERT_EQUAL_HEX64(naive, matches(topics[t]));
+    }
+}
+
+void test_benchmark_dispatch_50_routes(void)
+{
+    // Lệnh thật tới route đầu, giữa, cuối và 1 topic không có route riêng
+    const char *topics[] = {
+        "dev1/commands/cmd0", "dev1/commands/cmd20", "dev1/commands/cmd41", "dev1/telemetry/ack",
+    };
+    const uint8_t topicCount = sizeof(topics) / sizeof(topics[0]);
+    const uint32_t iterations = 200000;
+    volatile uint32_t sink = 0;
+    int8_t routes[MQTT_ROUTER_MAX_MATCHES];
+
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += mqtt_router_match(topics[i % topicCount], routes, MQTT_ROUTER_MAX_MATCHES);
+    }
+    double trieNs = nsPerOp(start, iterations);
+
+    start = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += naiveDispatch(topics[i % topicCount]);
+    }
+    double naiveNs = nsPerOp(start, iterations);
+
+    // Dispatch đầy đủ: match + parse JSON tại chỗ + gọi handler
+    const char *json = "{\"method\":\"setValue\",\"params\":true}";
+    uint8_t payload[64];
+    const uint32_t dispatches = 20000;
+    handled = 0;
+    start = micros();
+    for (uint32_t i = 0; i < dispatches; i++) {
+        size_t length = strlen(json);
+        memcpy(payload, json, length);
+        mqtt_router_dispatch(topics[i % 3], payload, length);
+    }
+    double dispatchNs = nsPerOp(start, dispatches);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%u routes: trie match %.0f ns, linear scan %.0f ns, full dispatch (JSON) %.0f ns",
+             BENCH_ROUTES, trieNs, naiveNs, dispatchNs);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL_UINT32(2 * dispatches, handled);   // route riêng + "#"
+    TEST_ASSERT_LESS_THAN(naiveNs, trieNs);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < R_EDGE_COUNT; i++) {
+        benchPatterns[n++] = edgePatterns[i];
+    }
+    for (uint8_t i = 0; n < BENCH_ROUTES; i++) {
+        snprintf(fillerPatterns[i], sizeof(fillerPatterns[i]), "+/commands/cmd%u", i);
+        benchPatterns[n++] = fillerPatterns[i];
+    }
+
+    // Router chỉ compile 1 lần cho cả chương trình: đăng ký hết ở đây
+    invalidRejected = !mqtt_router_add("a/#/b", countHandler) && !mqtt_router_add("a/b#", countHandler) &&
+                      !mqtt_router_add("a+/b", countHandler) && !mqtt_router_add("x", NULL);
+    allAdded = true;
+    for (uint8_t i = 0; i < BENCH_ROUTES; i++) {
+        allAdded = mqtt_router_add(benchPatterns[i], countHandler) && allAdded;
+    }
+    duplicateRejected = !mqtt_router_add("a/+", countHandler);
+    routerCompiled = mqtt_router_compile();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_hash_matches_parent_level);
+    RUN_TEST(test_plus_matches_exactly_one_level);
+    RUN_TEST(test_plus_matches_empty_level);
+    RUN_TEST(test_exact_level_compared_by_length);
+    RUN_TEST(test_sys_topics_skip_leading_wildcards);
+    RUN_TEST(test_invalid_patterns_rejected);
+    RUN_TEST(test_match_respects_max_routes);
+    RUN_TEST(test_filler_routes_match);
+    RUN_TEST(test_naive_matcher_agrees_with_trie);
+    RUN_TEST(test_benchmark_dispatch_50_routes);
+    return UNITY_END();
+}
@@ -0,0 +1,116 @@
+// Kết nối MQTT qua TLS của coreiot (backend PubSubClient) với broker kết thúc TLS
+// giả của simulator: thiếu CA thì không mở kết nối (fail closed, password không
+// bao giờ rời thiết bị), CA sai thì bắt tay thất bại, CA đúng thì MQTT chạy bình
+// thường qua SecureClient. Host không có mbedtls nên phần kiểm tra chứng chỉ là
+// của broker giả (sim_board.cpp), không phải của secure_client.cpp.
+//   pio test -e native -f test_mqtt_tls
+#include <unity.h>
+
+// Arduino/FreeRTOS giả + phần board của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/sim_board.cpp"
+#include "../../sim/fake_broker.h"
+#include "../../src/config_coreiot.cpp"
+#include "../../src/mqtt_queue.cpp"
+#include "../../src/mqtt_router.cpp"
+#include "../../src/payload_codec.cpp"
+#include "../../src/telemetry_filter.cpp"
+#include "../../src/telemetry_batch.cpp"
+#include "../../src/coreiot.cpp"
+
+// Chỉ cần 2 PEM khác nhau: broker giả so chuỗi thay cho kiểm tra chữ ký
+static const char *const BROKER_CA = "-----BEGIN CERTIFICATE-----\nbroker-ca\n-----END CERTIFICATE-----\n";
+static const char *const OTHER_CA = "-----BEGIN CERTIFICATE-----\nother-ca\n-----END CERTIFICATE-----\n";
+
+static FakeBroker broker;
+
+// Bắt đầu 1 lần kết nối từ bước mở socket, như sau khi đã resolve DNS
+static void openWithCa(const char *pem)
+{
+    tlsCaPem = pem;
+    connState = MQTT_ST_TCP;
+    coreiot_loop();
+}
+
+void setUp(void)
+{
+    client.disconnect();
+    broker.reset();
+    sim_tls_handshakes = 0;
+    coreiot_tls = true;
+}
+
+void tearDown(void) {}
+
+void test_missing_ca_fails_closed(void)
+{
+    openWithCa("");
+    TEST_ASSERT_EQUAL_INT(MQTT_ST_BACKOFF, connState);
+    // Không thử bắt tay, không có byte nào (CONNECT kèm password) tới broker
+    TEST_ASSERT_EQUAL_UINT32(0, sim_tls_handshakes);
+    TEST_ASSERT_EQUAL_UINT32(0, broker.connects);
+    TEST_ASSERT_EQUAL_UINT32(0, broker.bytesIn);
+}
+
+void test_wrong_ca_rejected_before_connect_packet(void)
+{
+    openWithCa(OTHER_CA);
+    TEST_ASSERT_EQUAL_INT(MQTT_ST_BACKOFF, connState);
+    TEST_ASSERT_EQUAL_UINT32(1, sim_tls_handshakes);
+    TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_X509_CERT_VERIFY_FAILED, mqttSecureClient.lastError());
+    TEST_ASSERT_EQUAL_UINT32(0, broker.bytesIn);
+}
+
+void test_matching_ca_connects_and_publishes(void)
+{
+    openWithCa(BROKER_CA);
+    for (int i = 0; i < 10 && connState != MQTT_ST_CONNECTED; i++) {
+        coreiot_loop();
+    }
+    TEST_ASSERT_EQUAL_INT(MQTT_ST_CONNECTED, connState);
+    TEST_ASSERT_EQUAL_UINT32(1, sim_tls_handshakes);
+    TEST_ASSERT_EQUAL_UINT32(1, broker.connects);
+    TEST_ASSERT_EQUAL_UINT32(1, broker.subscribes);
+
+    StaticJsonDocument<64> doc;
+    doc["temperature"] = 25.5;
+    TEST_ASSERT_TRUE(publishJson(doc));
+    coreiot_loop();
+    delay(MQTT_COALESCE_WINDOW + 1);
+    coreiot_loop();
+    TEST_ASSERT_EQUAL_UINT32(1, broker.published());
+    const std::string topic = "dev1/telemetry";
+    TEST_ASSERT_EQUAL_STRING(topic.c_str(), broker.lastPublish().topic);
+}
+
+void test_plain_tcp_unaffected_by_missing_ca(void)
+{
+    // TLS tắt: CA không liên quan, socket TCP thường của simulator được dùng
+    coreiot_tls = false;
+    openWithCa("");
+    TEST_ASSERT_EQUAL_UINT32(0, sim_tls_handshakes);
+    TEST_ASSERT_NOT_EQUAL(MQTT_ST_TCP, connState);
+}
+
+int main(int argc, char **argv)
+{
+    coreiot_server = "broker.local";
+    coreiot_port = 8883;
+    coreiot_client_id = "dev1";
+    coreiot_username = "dev1";
+    coreiot_password = "secret";
+    serverAddress = IPAddress(127, 0, 0, 1);
+    sim_tls_broker = &broker;
+    sim_tls_broker_ca = BROKER_CA;
+    mqtt_queue_init();
+    mqtt_queue_set_consumer(xTaskGetCurrentTaskHandle());
+    telemetry_batch_init();
+    coreiot_init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_missing_ca_fails_closed);
+    RUN_TEST(test_wrong_ca_rejected_before_connect_packet);
+    RUN_TEST(test_matching_ca_connects_and_publishes);
+    RUN_TEST(test_plain_tcp_unaffected_by_missing_ca);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+// payload_codec: đổi từ điển key ngắn trong lúc task khác đang encode (task web
+// POST cấu hình vs task cảm biến), khung batch "ts"/"values" không bị rút gọn
+// và benchmark số byte tiết kiệm mỗi mẫu telemetry theo từng định dạng/tùy chọn.
+//   pio test -e native -f test_payload_codec
+#include <unity.h>
+#include <atomic>
+#include <thread>
+
+// Arduino giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../src/payload_codec.cpp"
+
+static const char *const longKeys[] = {"temperature", "humidity", "sound", "pressure"};
+#define KEY_COUNT (sizeof(longKeys) / sizeof(longKeys[0]))
+
+// Từ điển mà mọi key ngắn cùng kết thúc bằng suffix: key trả về từ 1 bảng
+// trọn vẹn luôn có đúng suffix của bảng đó
+static void loadDict(char suffix)
+{
+    StaticJsonDocument<512> doc;
+    for (uint8_t i = 0; i < KEY_COUNT; i++) {
+        char shortKey[4] = {longKeys[i][0], suffix, '\0'};
+        doc["dict"][longKeys[i]] = shortKey;
+    }
+    payload_codec_load(doc.as<JsonObjectConst>());
+}
+
+static void useConfig(PayloadFormat format, int8_t precision, bool shortKeys)
+{
+    payload_codec_config = {format, precision, shortKeys};
+    payload_codec_activate();
+}
+
+void setUp(void)
+{
+    loadDict('0');
+    useConfig(PAYLOAD_JSON, -1, true);
+}
+
+void tearDown(void) {}
+
+void test_load_replaces_dictionary(void)
+{
+    loadDict('x');
+    TEST_ASSERT_EQUAL_STRING("tx", payload_codec_key("temperature"));
+    TEST_ASSERT_EQUAL_STRING("unknown", payload_codec_key("unknown"));
+
+    StaticJsonDocument<256> saved;
+    payload_codec_save(saved.to<JsonObject>());
+    TEST_ASSERT_EQUAL_STRING("hx", saved["dict"]["humidity"] | "");
+}
+
+void test_batch_envelope_keys_never_shortened(void)
+{
+    StaticJsonDocument<256> doc;
+    doc["dict"]["ts"] = "T";
+    doc["dict"]["values"] = "v";
+    doc["dict"]["temperature"] = "t";
+    payload_codec_load(doc.as<JsonObjectConst>());
+    TEST_ASSERT_EQUAL_STRING("ts", payload_codec_key("ts"));
+    TEST_ASSERT_EQUAL_STRING("values", payload_codec_key("values"));
+    TEST_ASSERT_EQUAL_STRING("t", payload_codec_key("temperature"));
+}
+
+void test_reload_waits_for_keys_in_use(void)
+{
+    // Task cảm biến giữ key "t0" (bảng 0) trong lúc dựng document
+    payload_codec_keys_begin();
+    const char *key = payload_codec_key("temperature");
+    TEST_ASSERT_EQUAL_STRING("t0", key);
+
+    // Task web POST 2 lần liền: lần 2 sẽ ghi lại đúng bảng chứa "t0"
+    std::atomic<uint32_t> loads(0);
+    std::thread web([&loads]() {
+        loadDict('a');
+        loads++;
+        loadDict('b');
+        loads++;
+    });
+    delay(50);
+    TEST_ASSERT_EQUAL_STRING("t0", key);
+    TEST_ASSERT_EQUAL_UINT32(0, loads.load());
+
+    payload_codec_keys_end();
+    web.join();
+    TEST_ASSERT_EQUAL_UINT32(2, loads.load());
+    TEST_ASSERT_EQUAL_STRING("tb", payload_codec_key("temperature"));
+}
+
+void test_encoder_never_sees_half_loaded_dictionary(void)
+{
+    // Task web đổi từ điển liên tục trong khi task cảm biến tra key
+    std::atomic<bool> stop(false);
+    std::atomic<uint32_t> reloads(0);
+    std::thread web([&stop, &reloads]() {
+        for (uint32_t i = 0; !stop; i++) {
+            loadDict(i % 2 ? 'b' : 'a');
+            reloads++;
+        }
+    });
+
+    uint32_t lookups = 0, torn = 0;
+    uint32_t start = millis();
+    while (millis() - start < 300) {
+        payload_codec_keys_begin();
+        for (uint8_t i = 0; i < KEY_COUNT; i++) {
+            const char *key = payload_codec_key(longKeys[i]);
+            bool ok = key[0] == longKeys[i][0] && strlen(key) == 2 &&
+                      (key[1] == '0' || key[1] == 'a' || key[1] == 'b');
+            if (!ok) torn++;
+            lookups++;
+        }
+        payload_codec_keys_end();
+    }
+    stop = true;
+    web.join();
+
+    char msg[80];
+    snprintf(msg, sizeof(msg), "%u lookups during %u dictionary reloads, %u torn", (unsigned)lookups,
+             (unsigned)reloads.load(), (unsigned)torn);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_GREATER_THAN_UINT32(1, reloads.load());
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+}
+
+// ==================== BENCHMARK ====================
+// 1 mẫu telemetry như telemetry_batch: {"ts":..,"values":{..}}
+static size_t sampleBytes(PayloadFormat format, int8_t precision, bool shortKeys)
+{
+    useConfig(format, precision, shortKeys);
+    const float values[] = {27.4321f, 61.2345f, 48.9012f, 1013.2468f};
+    StaticJsonDocument<512> doc;
+    JsonObject entry = doc.createNestedArray().createNestedObject();
+    entry["ts"] = 1760000000123ULL;
+    JsonObject v = entry.createNestedObject("values");
+    for (uint8_t i = 0; i < 4; i++) {
+        v[payload_codec_key(longKeys[i])] = payload_codec_value(values[i]);
+    }
+    size_t measured = payload_codec_measure(doc.as<JsonVariantConst>());
+    uint8_t out[256];
+    TEST_ASSERT_EQUAL_UINT32(measured, payload_codec_serialize(doc.as<JsonVariantConst>(), out, sizeof(out)));
+    return measured;
+}
+
+void test_benchmark_bytes_saved_per_sample(void)
+{
+    struct Variant {
+        const char   *name;
+        PayloadFormat format;
+        int8_t        precision;
+        bool          shortKeys;
+    };
+    const Variant variants[] = {
+        {"json, precision 2", PAYLOAD_JSON, 2, false},
+        {"json, short keys", PAYLOAD_JSON, -1, true},
+        {"json, short keys, precision 2", PAYLOAD_JSON, 2, true},
+        {"msgpack, short keys, precision 2", PAYLOAD_MSGPACK, 2, true},
+        {"cbor, short keys, precision 2", PAYLOAD_CBOR, 2, true},
+    };
+    size_t baseline = sampleBytes(PAYLOAD_JSON, -1, false);
+    char msg[128];
+    snprintf(msg, sizeof(msg), "json, full keys, raw floats: %u B/sample", (unsigned)baseline);
+    TEST_MESSAGE(msg);
+
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        const Variant &v = variants[i];
+        size_t bytes = sampleBytes(v.format, v.precision, v.shortKeys);
+        snprintf(msg, sizeof(msg), "%s: %u B/sample, saves %u B (%.0f%%)", v.name, (unsigned)bytes,
+                 (unsigned)(baseline - bytes), 100.0 * (baseline - bytes) / baseline);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_LESS_THAN(baseline, bytes);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_load_replaces_dictionary);
+    RUN_TEST(test_batch_envelope_keys_never_shortened);
+    RUN_TEST(test_reload_waits_for_keys_in_use);
+    RUN_TEST(test_encoder_never_sees_half_loaded_dictionary);
+    RUN_TEST(test_benchmark_bytes_saved_per_sample);
+    return UNITY_END();
+}
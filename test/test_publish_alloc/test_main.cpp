@@ -0,0 +1,203 @@
+// Đường publish telemetry không cấp phát heap: publishJson / batch flush →
+// mqtt_queue → task MQTT → PubSubClient → socket. Đếm mọi lần gọi operator new
+// và malloc/calloc/realloc trong lúc publish ở trạng thái ổn định (sau lần
+// publish đầu, khi PubSubClient đã cấp buffer in-flight/coalesce).
+//   pio test -e native -f test_publish_alloc
+#include <unity.h>
+#include <new>
+
+// Arduino/FreeRTOS giả + phần board của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/sim_board.cpp"
+#include "../../sim/fake_broker.h"
+#include "../../src/config_coreiot.cpp"
+#include "../../src/mqtt_queue.cpp"
+#include "../../src/mqtt_router.cpp"
+#include "../../src/payload_codec.cpp"
+#include "../../src/telemetry_filter.cpp"
+#include "../../src/telemetry_batch.cpp"
+#include "../../src/coreiot.cpp"
+
+// ==================== ĐẾM CẤP PHÁT ====================
+static volatile bool countAllocs = false;
+static volatile uint32_t newCalls = 0;
+static volatile uint32_t mallocCalls = 0;
+
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+extern "C" void __libc_free(void *);
+
+extern "C" void *malloc(size_t n) {
+    if (countAllocs) mallocCalls++;
+    return __libc_malloc(n);
+}
+extern "C" void *calloc(size_t n, size_t size) {
+    if (countAllocs) mallocCalls++;
+    return __libc_calloc(n, size);
+}
+extern "C" void *realloc(void *p, size_t n) {
+    if (countAllocs) mallocCalls++;
+    return __libc_realloc(p, n);
+}
+extern "C" void free(void *p) {
+    __libc_free(p);
+}
+
+void *operator new(size_t n) {
+    if (countAllocs) newCalls++;
+    void *p = malloc(n ? n : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void *operator new(size_t n, const std::nothrow_t &) noexcept {
+    if (countAllocs) newCalls++;
+    return malloc(n ? n : 1);
+}
+void *operator new[](size_t n, const std::nothrow_t &t) noexcept { return operator new(n, t); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static void startCounting() {
+    newCalls = mallocCalls = 0;
+    countAllocs = true;
+}
+
+static void stopCounting() {
+    countAllocs = false;
+}
+
+// ==================== BROKER + TASK MQTT ====================
+static FakeBroker broker;
+
+// 1 lượt của task_mqtt: loop, chờ hết cửa sổ coalesce rồi loop lần nữa
+// để packet được ghi ra và PUBACK được đọc về
+static void mqttTaskTurn() {
+    coreiot_loop();
+    delay(MQTT_COALESCE_WINDOW + 1);
+    coreiot_loop();
+}
+
+static void connectToBroker() {
+    broker.reset();
+    client.setClient(broker);
+    broker.connect(serverAddress, coreiot_port);
+    startConnect();
+    for (int i = 0; i < 10 && connState != MQTT_ST_CONNECTED; i++) {
+        coreiot_loop();
+    }
+}
+
+static StaticJsonDocument<256> sampleDoc;
+
+static void fillSample(int i) {
+    sampleDoc.clear();
+    sampleDoc["temperature"] = 25.0 + i * 0.1;
+    sampleDoc["humidity"] = 60.0 + i * 0.2;
+    sampleDoc["seq"] = i;
+}
+
+void setUp(void)
+{
+    mqtt_queue_init();
+    connectToBroker();
+    TEST_ASSERT_EQUAL_INT(MQTT_ST_CONNECTED, connState);
+
+    // Lần publish đầu cấp buffer in-flight/coalesce của PubSubClient và
+    // đối tượng task của shim FreeRTOS: không tính
+    fillSample(0);
+    TEST_ASSERT_TRUE(publishJson(sampleDoc));
+    mqttTaskTurn();
+    TEST_ASSERT_EQUAL_UINT32(1, broker.published());
+}
+
+void tearDown(void)
+{
+    stopCounting();
+}
+
+void test_counter_sees_allocations(void)
+{
+    // Tự kiểm tra: hook thật sự bắt được cấp phát
+    startCounting();
+    String s = coreiot_username + "/a/topic/long/enough/to/leave/the/small/string/buffer";
+    stopCounting();
+    TEST_ASSERT_GREATER_THAN(0, mallocCalls);
+    TEST_ASSERT_GREATER_THAN(0, newCalls);
+    TEST_ASSERT_TRUE(s.length() > 0);
+}
+
+void test_publish_json_allocates_nothing(void)
+{
+    const int count = 40;
+    startCounting();
+    for (int i = 1; i <= count; i++) {
+        fillSample(i);
+        TEST_ASSERT_TRUE(publishJson(sampleDoc));
+        mqttTaskTurn();
+    }
+    stopCounting();
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%d publishes: %u operator new, %u malloc",
+             count, (unsigned)newCalls, (unsigned)mallocCalls);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(0, newCalls);
+    TEST_ASSERT_EQUAL_UINT32(0, mallocCalls);
+
+    // Đã thật sự đi hết đường tới broker, QoS 1 và được PUBACK
+    TEST_ASSERT_EQUAL_UINT32(1 + count, broker.published());
+    TEST_ASSERT_EQUAL_STRING("dev1/telemetry", broker.lastPublish().topic);
+    TEST_ASSERT_EQUAL_UINT8(TELEMETRY_QOS, broker.lastPublish().qos);
+    TEST_ASSERT_EQUAL(0, client.getInflightCount());
+    const char *expected = "{\"temperature\":29,\"humidity\":68,\"seq\":40}";
+    TEST_ASSERT_EQUAL_UINT16(strlen(expected), broker.lastPublish().payloadLength);
+    TEST_ASSERT_EQUAL_MEMORY(expected, broker.lastPayload, strlen(expected));
+}
+
+void test_batch_flush_allocates_nothing(void)
+{
+    static const char *const keys[] = { "temperature", "humidity" };
+    uint32_t before = broker.published();
+
+    startCounting();
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 4; i++) {
+            float values[] = { 24.5f + i, 55.0f + round };
+            TEST_ASSERT_TRUE(telemetry_batch_add(keys, values, 2));
+        }
+        telemetry_batch_flush();
+        mqttTaskTurn();
+    }
+    stopCounting();
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "10 batch flushes: %u operator new, %u malloc",
+             (unsigned)newCalls, (unsigned)mallocCalls);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(0, newCalls);
+    TEST_ASSERT_EQUAL_UINT32(0, mallocCalls);
+    TEST_ASSERT_GREATER_OR_EQUAL(before + 10, broker.published());
+    TEST_ASSERT_EQUAL_UINT32(0, telemetry_batch_stats().dropped);
+}
+
+int main(int argc, char **argv)
+{
+    coreiot_server = "127.0.0.1";
+    coreiot_port = 1883;
+    coreiot_client_id = "dev1";
+    coreiot_username = "dev1";
+    serverAddress = IPAddress(127, 0, 0, 1);
+    mqtt_queue_set_consumer(xTaskGetCurrentTaskHandle());
+    telemetry_batch_init();
+    coreiot_init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_counter_sees_allocations);
+    RUN_TEST(test_publish_json_allocates_nothing);
+    RUN_TEST(test_batch_flush_allocates_nothing);
+    return UNITY_END();
+}
@@ -0,0 +1,100 @@
+// Ghi relay qua slave RS485 giả: đổi nhiều relay gộp thành đúng 1 frame FC15,
+// bit ngoài dải first..last không lọt vào byte dữ liệu, lệnh không đổi gì thì
+// không gửi frame nào.
+//   pio test -e native -f test_relay_output
+#include <unity.h>
+
+// Arduino/FreeRTOS giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../sim/fake_rs485.h"
+#include "../../src/modbus_rtu.cpp"
+#include "../../src/modbus_scheduler.cpp"
+#include "../../src/modbus_planner.cpp"
+#include "../../src/relay_output.cpp"
+
+#define BUS_BAUD 9600
+
+// Slave giữ lại request cuối cùng nhận được
+class RelaySlave : public FakeRs485 {
+public:
+    uint8_t lastRequest[FAKE_RS485_MAX_FRAME];
+    size_t  lastLength = 0;
+
+    size_t respond(const uint8_t *req, size_t length, uint8_t *resp) override {
+        memcpy(lastRequest, req, length);
+        lastLength = length;
+        return FakeRs485::respond(req, length, resp);
+    }
+};
+
+static RelaySlave rs485;
+
+// Số frame relay_output_apply() gửi ra bus
+static uint32_t applyFrames(uint8_t mask, uint8_t states)
+{
+    uint32_t before = rs485.requests;
+    TEST_ASSERT_EQUAL_UINT8(MODBUS_OK, relay_output_apply(mask, states));
+    return rs485.requests - before;
+}
+
+static void assertWriteCoils(uint16_t address, uint16_t count, uint8_t bits)
+{
+    TEST_ASSERT_EQUAL_HEX8(RELAY_SLAVE, rs485.lastRequest[0]);
+    TEST_ASSERT_EQUAL_HEX8(MODBUS_FC_WRITE_COILS, rs485.lastRequest[1]);
+    TEST_ASSERT_EQUAL_UINT16(address, (rs485.lastRequest[2] << 8) | rs485.lastRequest[3]);
+    TEST_ASSERT_EQUAL_UINT16(count, (rs485.lastRequest[4] << 8) | rs485.lastRequest[5]);
+    TEST_ASSERT_EQUAL_UINT8(1, rs485.lastRequest[6]);
+    TEST_ASSERT_EQUAL_HEX8(bits, rs485.lastRequest[7]);
+}
+
+void setUp(void) {}
+
+void tearDown(void)
+{
+    delay(30);
+}
+
+void test_unknown_state_written_in_one_frame(void)
+{
+    // Sau boot chưa biết trạng thái thật: cả 4 relay trong 1 frame FC15
+    TEST_ASSERT_EQUAL_UINT32(1, applyFrames(0x0F, 0x09));
+    assertWriteCoils(0, RELAY_COUNT, 0x09);
+    TEST_ASSERT_EQUAL_HEX8(0x09, relay_output_state());
+}
+
+void test_multi_relay_change_masks_bits_above_range(void)
+{
+    // Relay 1, 2 bật; relay 3 (đang bật) nằm ngoài dải ghi, không được lọt vào dữ liệu
+    TEST_ASSERT_EQUAL_UINT32(1, applyFrames(0x06, 0x06));
+    assertWriteCoils(1, 2, 0x03);
+    TEST_ASSERT_EQUAL_HEX8(0x0F, relay_output_state());
+}
+
+void test_no_op_change_sends_nothing(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(0, applyFrames(0x06, 0x06));
+    TEST_ASSERT_EQUAL_UINT32(0, applyFrames(0x0F, 0x0F));
+    TEST_ASSERT_EQUAL_HEX8(0x0F, relay_output_state());
+}
+
+void test_single_relay_change_uses_fc05(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(1, applyFrames(0x0F, 0x0B));
+    TEST_ASSERT_EQUAL_HEX8(MODBUS_FC_WRITE_COIL, rs485.lastRequest[1]);
+    TEST_ASSERT_EQUAL_UINT16(2, (rs485.lastRequest[2] << 8) | rs485.lastRequest[3]);
+    TEST_ASSERT_EQUAL_HEX8(0x0B, relay_output_state());
+}
+
+int main(int argc, char **argv)
+{
+    rs485.begin(BUS_BAUD);
+    modbus_init(rs485, BUS_BAUD);
+    relay_output_init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_unknown_state_written_in_one_frame);
+    RUN_TEST(test_multi_relay_change_masks_bits_above_range);
+    RUN_TEST(test_no_op_change_sends_nothing);
+    RUN_TEST(test_single_relay_change_uses_fc05);
+    return UNITY_END();
+}
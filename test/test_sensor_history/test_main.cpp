@@ -0,0 +1,116 @@
+// Cursor của lịch sử cảm biến: lấy từ pool tĩnh (hết pool → NULL), đọc tiếp từ
+// vị trí đã lưu qua nhiều lô, không lặp/mất điểm khi ring bị ghi đè giữa chừng.
+//   pio test -e native -f test_sensor_history
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <string>
+
+// Arduino/FreeRTOS giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../src/sensor_history.cpp"
+
+static uint32_t nextT = 1;
+
+static void addSamples(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++, nextT++) {
+        sensor_history_add(nextT, 20.0f + (nextT % 10), 50.0f);
+    }
+}
+
+// Đọc hết cursor theo buffer nhỏ; sau lần đọc đầu gọi between() một lần
+template <class Between>
+static std::string readAll(SensorHistoryCursor *c, Between between)
+{
+    std::string out;
+    uint8_t buf[48];
+    size_t n;
+    bool first = true;
+    while ((n = sensor_history_cursor_read(c, buf, sizeof(buf))) > 0) {
+        out.append((const char *)buf, n);
+        if (first) between();
+        first = false;
+    }
+    return out;
+}
+
+// Kiểm tra mảng "data" raw: t tăng dần, trả về số điểm, điểm đầu/cuối
+static size_t checkRaw(const std::string &json, uint32_t &firstT, uint32_t &lastT)
+{
+    DynamicJsonDocument doc(256 * 1024);
+    TEST_ASSERT_EQUAL_INT(DeserializationError::Ok, deserializeJson(doc, json).code());
+    TEST_ASSERT_EQUAL_UINT32(HISTORY_RES_RAW, doc["res"].as<uint32_t>());
+    JsonArray data = doc["data"];
+    uint32_t prev = 0;
+    for (JsonArray point : data) {
+        uint32_t t = point[0];
+        TEST_ASSERT_GREATER_THAN_UINT32(prev, t);
+        prev = t;
+    }
+    firstT = data.size() ? data[0][0].as<uint32_t>() : 0;
+    lastT = prev;
+    return data.size();
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_cursor_reads_range_across_chunks(void)
+{
+    addSamples(200);
+    SensorHistoryCursor *c = sensor_history_cursor_open(50, 149, HISTORY_RES_RAW);
+    TEST_ASSERT_NOT_NULL(c);
+    std::string json = readAll(c, []() {});
+    sensor_history_cursor_close(c);
+
+    uint32_t firstT, lastT;
+    TEST_ASSERT_EQUAL_UINT32(100, checkRaw(json, firstT, lastT));
+    TEST_ASSERT_EQUAL_UINT32(50, firstT);
+    TEST_ASSERT_EQUAL_UINT32(149, lastT);
+}
+
+void test_cursor_resumes_after_ring_overwritten(void)
+{
+    // Ring đầy rồi bị ghi đè quá vị trí cursor trong lúc response đang gửi
+    addSamples(HISTORY_RAW_SIZE);
+    SensorHistoryCursor *c = sensor_history_cursor_open(0, 0xFFFFFFFF, HISTORY_RES_RAW);
+    TEST_ASSERT_NOT_NULL(c);
+    uint32_t openedAt = nextT;
+    std::string json = readAll(c, []() { addSamples(HISTORY_RAW_SIZE / 2); });
+    sensor_history_cursor_close(c);
+
+    // Không lặp điểm (t tăng dần) và đọc tới cả mẫu mới thêm
+    uint32_t firstT, lastT;
+    size_t points = checkRaw(json, firstT, lastT);
+    TEST_ASSERT_EQUAL_UINT32(nextT - 1, lastT);
+    TEST_ASSERT_GREATER_THAN_UINT32(openedAt, lastT);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(HISTORY_RAW_SIZE + HISTORY_RAW_SIZE / 2, points);
+}
+
+void test_cursor_pool_exhausted_then_reused(void)
+{
+    SensorHistoryCursor *cursors[HISTORY_CURSOR_POOL];
+    for (uint8_t i = 0; i < HISTORY_CURSOR_POOL; i++) {
+        cursors[i] = sensor_history_cursor_open(0, 10, HISTORY_RES_RAW);
+        TEST_ASSERT_NOT_NULL(cursors[i]);
+    }
+    TEST_ASSERT_NULL(sensor_history_cursor_open(0, 10, HISTORY_RES_RAW));
+
+    sensor_history_cursor_close(cursors[0]);
+    SensorHistoryCursor *again = sensor_history_cursor_open(0, 10, HISTORY_RES_RAW);
+    TEST_ASSERT_TRUE(again == cursors[0]);
+    for (uint8_t i = 0; i < HISTORY_CURSOR_POOL; i++) {
+        sensor_history_cursor_close(cursors[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    sensor_history_init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_cursor_reads_range_across_chunks);
+    RUN_TEST(test_cursor_resumes_after_ring_overwritten);
+    RUN_TEST(test_cursor_pool_exhausted_then_reused);
+    return UNITY_END();
+}
@@ -0,0 +1,246 @@
+// Test spool telemetry trên LittleFS giả dựng bằng thư mục tạm của host:
+// thứ tự/tag khi replay, nhịp replay, con trỏ đọc sau reboot, xóa segment cũ
+// khi đầy và đếm đủ số bản ghi mất khi segment bị hỏng.
+//   pio test -e native -f test_telemetry_spool
+#include <unity.h>
+#include <string>
+#include <vector>
+
+// Arduino/FreeRTOS/LittleFS giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../src/telemetry_spool.cpp"
+
+static char fsRoot[64];
+static std::vector<std::string> published;
+static std::vector<uint8_t> publishedTags;
+static int failAfter = -1;   // publish thất bại sau n lần thành công, -1 = luôn thành công
+
+static bool capturePublish(const uint8_t *payload, size_t length, uint8_t tag)
+{
+    if (failAfter == 0) return false;
+    if (failAfter > 0) failAfter--;
+    published.push_back(std::string((const char *)payload, length));
+    publishedTags.push_back(tag);
+    return true;
+}
+
+// Bản ghi thứ i: "rec<i>" rồi đệm tới đúng size byte
+static std::string record(int i, size_t size)
+{
+    std::string s = "rec" + std::to_string(i) + ":";
+    s.resize(size, 'a' + i % 26);
+    return s;
+}
+
+static void assert_record(int i, size_t size, const std::string &actual)
+{
+    std::string expected = record(i, size);
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), actual.c_str());
+}
+
+static bool append(int i, size_t size, uint8_t tag = 0)
+{
+    std::string r = record(i, size);
+    return telemetry_spool_append((const uint8_t *)r.data(), r.size(), tag);
+}
+
+// Bỏ qua SPOOL_REPLAY_INTERVAL để test không phải ngủ giữa các lượt
+static void replayNow()
+{
+    lastReplay = millis() - SPOOL_REPLAY_INTERVAL;
+    telemetry_spool_replay(capturePublish);
+}
+
+static void drain()
+{
+    for (int i = 0; i < 1000 && !telemetry_spool_empty(); i++) {
+        replayNow();
+    }
+}
+
+// Trạng thái RAM mất khi reboot, flash (thư mục tạm) giữ nguyên
+static void reboot()
+{
+    firstSeg = 1;
+    lastSeg = 0;
+    lastSegSize = 0;
+    readOffset = 0;
+    totalBytes = 0;
+    pendingRecords = 0;
+    lastReplay = 0;
+    stats = TelemetrySpoolStats{0, 0, 0, 0, 0};
+    telemetry_spool_init();
+}
+
+static int segmentFiles()
+{
+    int n = 0;
+    File dir = LittleFS.open(SPOOL_DIR);
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        if (strstr(f.name(), ".seg")) n++;
+    }
+    return n;
+}
+
+void setUp(void)
+{
+    strcpy(fsRoot, "/tmp/spool_test_XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(fsRoot));
+    LittleFS.mount(fsRoot);
+    published.clear();
+    publishedTags.clear();
+    failAfter = -1;
+    reboot();
+}
+
+void tearDown(void)
+{
+    std::string cmd = std::string("rm -rf ") + fsRoot;
+    system(cmd.c_str());
+    LittleFS.mount(NULL);
+}
+
+void test_replay_in_order_with_tags(void)
+{
+    for (int i = 0; i < 12; i++) {
+        TEST_ASSERT_TRUE(append(i, 20 + i * 7, i % 4));
+    }
+    TEST_ASSERT_FALSE(telemetry_spool_empty());
+
+    replayNow();
+    TEST_ASSERT_EQUAL_size_t(SPOOL_REPLAY_BATCH, published.size());
+    drain();
+
+    TEST_ASSERT_EQUAL_size_t(12, published.size());
+    for (int i = 0; i < 12; i++) {
+        assert_record(i, 20 + i * 7, published[i]);
+        TEST_ASSERT_EQUAL_UINT8(i % 4, publishedTags[i]);
+    }
+    TelemetrySpoolStats s = telemetry_spool_stats();
+    TEST_ASSERT_EQUAL_UINT32(12, s.spooled);
+    TEST_ASSERT_EQUAL_UINT32(12, s.replayed);
+    TEST_ASSERT_EQUAL_UINT32(0, s.dropped);
+    TEST_ASSERT_EQUAL_UINT32(0, s.pendingBytes);
+    TEST_ASSERT_EQUAL_UINT16(0, s.segments);
+    TEST_ASSERT_EQUAL_INT(0, segmentFiles());
+}
+
+void test_replay_is_paced(void)
+{
+    for (int i = 0; i < 10; i++) append(i, 50);
+
+    replayNow();
+    TEST_ASSERT_EQUAL_size_t(SPOOL_REPLAY_BATCH, published.size());
+    // Gọi lại ngay trong cùng chu kỳ: không gửi thêm
+    telemetry_spool_replay(capturePublish);
+    TEST_ASSERT_EQUAL_size_t(SPOOL_REPLAY_BATCH, published.size());
+}
+
+void test_publish_failure_resumes_at_same_record(void)
+{
+    for (int i = 0; i < 6; i++) append(i, 40);
+
+    failAfter = 2;
+    replayNow();
+    TEST_ASSERT_EQUAL_size_t(2, published.size());
+    TEST_ASSERT_EQUAL_UINT32(2, telemetry_spool_stats().replayed);
+
+    failAfter = -1;
+    drain();
+    TEST_ASSERT_EQUAL_size_t(6, published.size());
+    assert_record(2, 40, published[2]);
+    TEST_ASSERT_EQUAL_UINT32(0, telemetry_spool_stats().dropped);
+}
+
+void test_cursor_survives_reboot(void)
+{
+    for (int i = 0; i < 8; i++) append(i, 100);
+    replayNow();
+    TEST_ASSERT_EQUAL_size_t(5, published.size());
+
+    reboot();
+    TEST_ASSERT_FALSE(telemetry_spool_empty());
+    TEST_ASSERT_EQUAL_UINT32(3 * (SPOOL_HEADER_SIZE + 100), telemetry_spool_stats().pendingBytes);
+    TEST_ASSERT_EQUAL_UINT32(3, pendingRecords);
+
+    drain();
+    TEST_ASSERT_EQUAL_size_t(8, published.size());
+    for (int i = 0; i < 8; i++) {
+        assert_record(i, 100, published[i]);
+    }
+}
+
+void test_full_spool_evicts_oldest_segments(void)
+{
+    // 1002 byte/bản ghi → 8 bản ghi mỗi segment 8 KB, ~65 bản ghi vừa 64 KB
+    const int total = 100;
+    for (int i = 0; i < total; i++) {
+        TEST_ASSERT_TRUE(append(i, 1000));
+    }
+    TelemetrySpoolStats s = telemetry_spool_stats();
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(SPOOL_MAX_BYTES, s.pendingBytes);
+    TEST_ASSERT_GREATER_THAN(0, s.dropped);
+    TEST_ASSERT_EQUAL_UINT32(0, s.dropped % 8);   // bỏ nguyên segment
+
+    drain();
+    s = telemetry_spool_stats();
+    TEST_ASSERT_EQUAL_UINT32(total, s.replayed + s.dropped);
+    // Còn lại đúng các bản ghi mới nhất, theo thứ tự
+    assert_record(s.dropped, 1000, published.front());
+    assert_record(total - 1, 1000, published.back());
+}
+
+void test_corrupt_segment_counts_every_skipped_record(void)
+{
+    // 502 byte/bản ghi → segment 1 giữ 16 bản ghi, segment 2 giữ 4
+    for (int i = 0; i < 20; i++) append(i, 500);
+    TEST_ASSERT_EQUAL_UINT16(2, telemetry_spool_stats().segments);
+
+    // Hỏng header bản ghi thứ 3 của segment 1 (độ dài vượt SPOOL_MAX_RECORD)
+    File f = LittleFS.open(segPath(1), "r+");
+    TEST_ASSERT_TRUE((bool)f);
+    f.seek(2 * (SPOOL_HEADER_SIZE + 500));
+    const uint8_t garbage[SPOOL_HEADER_SIZE] = { 0xFF, 0x3F };
+    f.write(garbage, sizeof(garbage));
+    f.close();
+
+    drain();
+    TelemetrySpoolStats s = telemetry_spool_stats();
+    TEST_ASSERT_EQUAL_UINT32(2 + 4, s.replayed);
+    TEST_ASSERT_EQUAL_UINT32(14, s.dropped);
+    TEST_ASSERT_EQUAL_UINT32(s.spooled, s.replayed + s.dropped);
+    assert_record(16, 500, published[2]);
+}
+
+void test_missing_segment_counts_its_records(void)
+{
+    for (int i = 0; i < 20; i++) append(i, 500);
+    LittleFS.remove(segPath(1));
+
+    drain();
+    TelemetrySpoolStats s = telemetry_spool_stats();
+    TEST_ASSERT_EQUAL_UINT32(4, s.replayed);
+    TEST_ASSERT_EQUAL_UINT32(16, s.dropped);
+}
+
+void test_oversized_record_rejected(void)
+{
+    std::string big(SPOOL_MAX_RECORD + 1, 'x');
+    TEST_ASSERT_FALSE(telemetry_spool_append((const uint8_t *)big.data(), big.size()));
+    TEST_ASSERT_EQUAL_UINT32(1, telemetry_spool_stats().dropped);
+    TEST_ASSERT_TRUE(telemetry_spool_empty());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_in_order_with_tags);
+    RUN_TEST(test_replay_is_paced);
+    RUN_TEST(test_publish_failure_resumes_at_same_record);
+    RUN_TEST(test_cursor_survives_reboot);
+    RUN_TEST(test_full_spool_evicts_oldest_segments);
+    RUN_TEST(test_corrupt_segment_counts_every_skipped_record);
+    RUN_TEST(test_missing_segment_counts_its_records);
+    RUN_TEST(test_oversized_record_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,218 @@
+// Dispatch RPC server-side và shared attribute của lib/ThingsBoard qua
+// Callback_Index (băm tên method/key thay vì so với mọi callback đã subscribe),
+// kèm benchmark thời gian xử lý 1 message (gồm parse JSON) theo số callback.
+//   pio test -e native -f test_thingsboard_dispatch
+#include <unity.h>
+
+// ThingsBoard nằm trong lib_ignore của env native: include thẳng mã nguồn,
+// tắt OTA (cần mbedtls) và PROGMEM
+#define THINGSBOARD_ENABLE_OTA 0
+#define THINGSBOARD_ENABLE_PROGMEM 0
+
+// Arduino/FreeRTOS giả của simulator + code cần test (test_build_src = no)
+#include "../../sim/arduino_shim.cpp"
+#include "../../lib/ThingsBoard/ThingsBoard.h"
+#include "../../lib/ThingsBoard/Callback_Index.cpp"
+#include "../../lib/ThingsBoard/Callback_Watchdog.cpp"
+#include "../../lib/ThingsBoard/Helper.cpp"
+#include "../../lib/ThingsBoard/ThingsBoardDefaultLogger.cpp"
+#include "../../lib/ThingsBoard/Telemetry.cpp"
+#include "../../lib/ThingsBoard/RPC_Response.cpp"
+#include "../../lib/ThingsBoard/RPC_Callback.cpp"
+#include "../../lib/ThingsBoard/RPC_Request_Callback.cpp"
+#include "../../lib/ThingsBoard/Shared_Attribute_Callback.cpp"
+#include "../../lib/ThingsBoard/Attribute_Request_Callback.cpp"
+#include "../../lib/ThingsBoard/Provision_Callback.cpp"
+#include <string>
+#include <vector>
+
+#define RPC_TOPIC        "v1/devices/me/rpc/request/1"
+#define ATTRIBUTE_UPDATE "v1/devices/me/attributes"
+#define BENCH_CALLBACKS  64
+#define BENCH_MESSAGES   20000
+
+// IMQTT_Client giả: chỉ giữ callback để test đẩy message vào như broker
+class LoopbackClient : public IMQTT_Client {
+public:
+    function callback;
+    uint32_t published = 0;
+
+    void set_callback(function cb) override { callback = cb; }
+    bool set_buffer_size(const uint16_t &size) override { return true; }
+    uint16_t get_buffer_size() override { return 1024; }
+    void set_server(const char *domain, const uint16_t &port) override {}
+    bool connect(const char *id, const char *user, const char *pass) override { return true; }
+    void disconnect() override {}
+    bool loop() override { return true; }
+    bool publish(const char *topic, const uint8_t *payload, const size_t &length) override {
+        published++;
+        return true;
+    }
+    bool subscribe(const char *topic) override { return true; }
+    bool unsubscribe(const char *topic) override { return true; }
+    bool connected() override { return true; }
+
+    void receive(const char *topic, const std::string &payload) {
+        std::string t = topic, p = payload;
+        callback(&t[0], (uint8_t *)&p[0], p.size());
+    }
+};
+
+static LoopbackClient mqtt;
+static ThingsBoardSized<128> tb(mqtt, 1024);
+
+static int rpcWhich = -1;
+static RPC_Response rpcA(const RPC_Data &) { rpcWhich = 0; return RPC_Response("r", 1); }
+static RPC_Response rpcB(const RPC_Data &) { rpcWhich = 1; return RPC_Response("r", 1); }
+static RPC_Response rpcC(const RPC_Data &) { rpcWhich = 2; return RPC_Response("r", 1); }
+
+static int attMask = 0;
+static void attA(const Shared_Attribute_Data &) { attMask |= 1; }
+static void attB(const Shared_Attribute_Data &) { attMask |= 2; }
+static void attC(const Shared_Attribute_Data &) { attMask |= 4; }
+
+static int rpc(const char *method) {
+    rpcWhich = -1;
+    mqtt.receive(RPC_TOPIC, std::string("{\"method\":\"") + method + "\",\"params\":1}");
+    return rpcWhich;
+}
+
+static int att(const char *payload) {
+    attMask = 0;
+    mqtt.receive(ATTRIBUTE_UPDATE, payload);
+    return attMask;
+}
+
+static Shared_Attribute_Callback keys(Shared_Attribute_Callback::function cb, std::vector<const char *> &list) {
+    return Shared_Attribute_Callback(cb, list.cbegin(), list.cend());
+}
+
+void setUp(void) {}
+
+void tearDown(void)
+{
+    tb.RPC_Unsubscribe();
+    tb.Shared_Attributes_Unsubscribe();
+}
+
+void test_rpc_exact_match_then_prefix_fallback(void)
+{
+    tb.RPC_Subscribe(RPC_Callback("set", rpcA));
+    tb.RPC_Subscribe(RPC_Callback("setValue", rpcB));
+    tb.RPC_Subscribe(RPC_Callback("setValue", rpcC));
+    TEST_ASSERT_EQUAL_INT(1, rpc("setValue"));   // khớp đúng thắng, callback subscribe trước
+    TEST_ASSERT_EQUAL_INT(0, rpc("set"));
+    TEST_ASSERT_EQUAL_INT(0, rpc("setOther"));   // không khớp đúng: vẫn khớp tiền tố như cũ
+    TEST_ASSERT_EQUAL_INT(-1, rpc("get"));
+}
+
+void test_rpc_unsubscribe_clears_index(void)
+{
+    tb.RPC_Subscribe(RPC_Callback("set", rpcA));
+    tb.RPC_Unsubscribe();
+    TEST_ASSERT_EQUAL_INT(-1, rpc("set"));
+    tb.RPC_Subscribe(RPC_Callback("get", rpcC));
+    TEST_ASSERT_EQUAL_INT(2, rpc("get"));
+    TEST_ASSERT_EQUAL_INT(-1, rpc("set"));
+}
+
+void test_shared_attributes_called_once_in_order(void)
+{
+    std::vector<const char *> fwLed = {"fw", "led"}, led = {"led"};
+    tb.Shared_Attributes_Subscribe(keys(attA, fwLed));
+    tb.Shared_Attributes_Subscribe(keys(attB, led));
+    tb.Shared_Attributes_Subscribe(Shared_Attribute_Callback(attC));   // không key: nhận mọi update
+    TEST_ASSERT_EQUAL_INT(7, att("{\"led\":1}"));
+    TEST_ASSERT_EQUAL_INT(7, att("{\"fw\":1,\"led\":2}"));
+    TEST_ASSERT_EQUAL_INT(5, att("{\"fw\":1}"));
+    TEST_ASSERT_EQUAL_INT(4, att("{\"f\":1}"));
+    TEST_ASSERT_EQUAL_INT(7, att("{\"shared\":{\"led\":1}}"));
+}
+
+void test_shared_attributes_resubscribe_after_unsubscribe(void)
+{
+    std::vector<const char *> led = {"led"};
+    tb.Shared_Attributes_Subscribe(keys(attA, led));
+    tb.Shared_Attributes_Unsubscribe();
+    TEST_ASSERT_EQUAL_INT(0, att("{\"led\":1}"));
+    tb.Shared_Attributes_Subscribe(keys(attB, led));
+    TEST_ASSERT_EQUAL_INT(2, att("{\"fw\":1,\"led\":2}"));
+}
+
+void test_index_grows_and_finds_every_key(void)
+{
+    Callback_Index index;
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; i++) names.push_back("key" + std::to_string(i));
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(index.insert(names[i].c_str(), names[i].size(), i));
+    }
+    TEST_ASSERT_TRUE(index.complete());
+    TEST_ASSERT_EQUAL_UINT32(100, index.size());
+    for (int i = 0; i < 100; i++) {
+        size_t cursor = 0;
+        TEST_ASSERT_EQUAL_UINT32(i, index.find(names[i].c_str(), names[i].size(), cursor));
+        TEST_ASSERT_EQUAL_UINT32(Callback_Index::NOT_FOUND, index.find(names[i].c_str(), names[i].size(), cursor));
+    }
+    size_t cursor = 0;
+    TEST_ASSERT_EQUAL_UINT32(Callback_Index::NOT_FOUND, index.find("key", 3, cursor));
+}
+
+// ns cho 1 message (parse JSON + dispatch) với count callback đã subscribe
+static double benchRpc(int count, std::vector<std::string> &names) {
+    for (int i = 0; i < count; i++) tb.RPC_Subscribe(RPC_Callback(names[i].c_str(), rpcA));
+    std::string msg[4];
+    for (int k = 0; k < 4; k++) {
+        msg[k] = "{\"method\":\"" + names[(k * 21 + count - 1) % count] + "\",\"params\":1}";
+    }
+    uint32_t start = micros();
+    for (int i = 0; i < BENCH_MESSAGES; i++) mqtt.receive(RPC_TOPIC, msg[i & 3]);
+    uint32_t elapsed = micros() - start;
+    tb.RPC_Unsubscribe();
+    return elapsed * 1000.0 / BENCH_MESSAGES;
+}
+
+static double benchAttributes(int count, std::vector<std::string> &names) {
+    std::vector<std::vector<const char *>> lists(count);
+    for (int i = 0; i < count; i++) {
+        lists[i].push_back(names[i].c_str());
+        tb.Shared_Attributes_Subscribe(keys(attA, lists[i]));
+    }
+    std::string msg[4];
+    for (int k = 0; k < 4; k++) {
+        msg[k] = "{\"" + names[(k * 17 + count - 1) % count] + "\":1,\"" + names[k % count] + "\":2}";
+    }
+    uint32_t start = micros();
+    for (int i = 0; i < BENCH_MESSAGES; i++) mqtt.receive(ATTRIBUTE_UPDATE, msg[i & 3]);
+    uint32_t elapsed = micros() - start;
+    tb.Shared_Attributes_Unsubscribe();
+    return elapsed * 1000.0 / BENCH_MESSAGES;
+}
+
+void test_benchmark_dispatch(void)
+{
+    std::vector<std::string> names;
+    for (int i = 0; i < BENCH_CALLBACKS; i++) names.push_back("setMethod" + std::to_string(i));
+
+    double rpcFew = benchRpc(4, names), rpcMany = benchRpc(BENCH_CALLBACKS, names);
+    double attFew = benchAttributes(4, names), attMany = benchAttributes(BENCH_CALLBACKS, names);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "ns/msg, 4 -> %d callbacks: rpc %.0f -> %.0f, shared attributes %.0f -> %.0f",
+             BENCH_CALLBACKS, rpcFew, rpcMany, attFew, attMany);
+    TEST_MESSAGE(msg);
+    // Tra bảng băm: thêm callback gần như không làm chậm RPC
+    TEST_ASSERT_LESS_THAN(rpcFew * 2, rpcMany);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rpc_exact_match_then_prefix_fallback);
+    RUN_TEST(test_rpc_unsubscribe_clears_index);
+    RUN_TEST(test_shared_attributes_called_once_in_order);
+    RUN_TEST(test_shared_attributes_resubscribe_after_unsubscribe);
+    RUN_TEST(test_index_grows_and_finds_every_key);
+    RUN_TEST(test_benchmark_dispatch);
+    return UNITY_END();
+}